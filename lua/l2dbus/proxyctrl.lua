@@ -752,7 +752,8 @@ end
 -- call that will block the Lua VM. If it is **not** the main Lua
 -- coroutine (or thread) then the coroutine will yield waiting for a
 -- reply. When the reply or a timeout occurs the thread will be resumed
--- and the reply message returned. If this method is called from a secondary
+-- and the reply message returned. Tasks started with @{l2dbus.spawn|spawn}
+-- are suspended and resumed by their Dispatcher. If this method is called from a secondary
 -- coroutine then it **MUST NOT** be called via a Lua *pcall* (or 
 -- protected call) since this *waitForReply* may yield and under Lua 5.1
 -- yielding across a protected call is not allowed.
@@ -786,7 +787,10 @@ function ProxyController:waitForReply(pendingCall)
 	else
 		-- See if we're calling from the main thread
 		local co = coroutine.running()
-		if not co then
+		if l2dbus.inTask() then
+			-- The dispatcher resumes the task once the reply arrives
+			reply = pendingCall:await()
+		elseif not co then
 			-- The main thread cannot yield so we must explicity block
 			pendingCall:block()
 			reply = pendingCall:stealReply()
@@ -137,34 +137,157 @@ local DBUS_PROPERTIES_INTERFACE_METADATA =
 	interface = DBUS_PROPERTIES_INTERFACE_NAME
 }
 
+-- Reply contexts are pooled by the core module
+local newReplyContext = l2dbus.ReplyContext.new
+
+
 --
--- Forward method declarations
+-- Calculates the D-Bus signature of the arguments of a method in
+-- the given direction.
 --
-local newReplyContext
+local function calcMethodSignature(method, dir)
+	local sigs = {}
+	local nArgs = method.args and #method.args or 0
+	for argIdx = 1, nArgs do
+		-- If the direction isn't specified then it's assumed to
+		-- be an input parameter
+		if (method.args[argIdx].dir or "in") == dir then
+			sigs[#sigs + 1] = method.args[argIdx].sig
+		end
+	end
+	return table.concat(sigs)
+end
 
 
 --
--- Calculates the D-Bus signature of a method or signal.
+-- Compiles the dispatch records of the methods of an interface. The
+-- signatures are calculated once here rather than on every request.
 --
-local function calcSignatureFromMetadata(member, dir, metadata)
-	local nMethods = #metadata.methods
-	local signature = ""
-	local argDir = nil
+local function compileMethods(metadata)
+	local records = {}
+	local nMethods = metadata.methods and #metadata.methods or 0
 	for memIdx = 1, nMethods do
-		if metadata.methods[memIdx].name == member then
-			local nArgs = #metadata.methods[memIdx].args
-			for argIdx = 1, nArgs do
-				-- If the direction isn't specified then it's assumed to
-				-- be an input parameter
-				argDir = metadata.methods[memIdx].args[argIdx].dir or "in"
-				if argDir == dir then
-					signature = signature .. metadata.methods[memIdx].args[argIdx].sig
-				end
+		local method = metadata.methods[memIdx]
+		records[method.name] = {
+								inSig = calcMethodSignature(method, "in"),
+								outSig = calcMethodSignature(method, "out")
+								}
+	end
+	return records
+end
+
+
+--
+-- Calculates the D-Bus signatures of the signals of an interface.
+--
+local function compileSignals(metadata)
+	local signatures = {}
+	local nSignals = metadata.signals and #metadata.signals or 0
+	for sigIdx = 1, nSignals do
+		local signal = metadata.signals[sigIdx]
+		local sigs = {}
+		local nArgs = signal.args and #signal.args or 0
+		for argIdx = 1, nArgs do
+			sigs[argIdx] = signal.args[argIdx].sig
+		end
+		signatures[signal.name] = table.concat(sigs)
+	end
+	return signatures
+end
+
+
+--
+-- Descriptions of interfaces keyed by interface name and then by the
+-- metadata (a Lua table or D-Bus XML) they were created from. Services
+-- adding an interface with the same metadata share the description: the
+-- InterfaceDescriptor and the compiled method and signal signatures. A
+-- description is released once no service uses it.
+--
+-- Metadata is matched by identity: an equal but distinct table is parsed
+-- again. Descriptors aren't interned by name (InterfaceDescriptor.intern)
+-- because services are free to describe the same interface differently.
+--
+local sharedDescriptions = {}
+
+
+--
+-- Returns the shared description of an interface.
+--
+local function getSharedDescription(name, metadata)
+	local byMetadata = sharedDescriptions[name]
+	if byMetadata == nil then
+		byMetadata = setmetatable({}, {__mode = "kv"})
+		sharedDescriptions[name] = byMetadata
+	end
+	
+	local shared = byMetadata[metadata]
+	if shared == nil then
+		local key = metadata
+		-- If the metadata is a string then we'll assume it's D-Bus XML formatted
+		-- data that can be converted to an equivalent Lua table.
+		if "string" == type(metadata) then
+			metadata = M.convertXmlToIntfMeta(name, metadata)
+		end
+		verify("table" == type(metadata),
+		       string.format("invalid metadata type (%s)", type(metadata)))
+		shared = {
+				metadata = metadata,
+				-- Created with the first interface
+				descriptor = nil,
+				methods = compileMethods(metadata),
+				signals = compileSignals(metadata)
+				}
+		byMetadata[key] = shared
+	end
+	return shared
+end
+
+
+--
+-- Creates a lower level interface from a shared description.
+--
+local function newSharedInterface(name, shared)
+	if shared.descriptor == nil then
+		shared.descriptor = l2dbus.InterfaceDescriptor.new(name, shared.metadata)
+	end
+	local intfInst = l2dbus.Interface.new(shared.descriptor, nil, nil)
+	-- Handlers given in the metadata are dispatched from C
+	local nMethods = shared.metadata.methods and #shared.metadata.methods or 0
+	for memIdx = 1, nMethods do
+		local method = shared.metadata.methods[memIdx]
+		if "function" == type(method.handler) then
+			intfInst:setMethodHandler(method.name, method.handler)
+		end
+	end
+	return intfInst
+end
+
+
+--
+-- Rebuilds the index used to dispatch requests that don't name an
+-- interface. It maps a member name and input signature to the handler
+-- (and reply signature) of the first interface added with a registered
+-- handler for that method.
+--
+local function rebuildMemberIndex(svcObj)
+	local index = {}
+	for intfName, intfItem in pairs(svcObj.interfaces) do
+		for methName, handler in pairs(intfItem.handlers) do
+			local record = intfItem.methods[methName]
+			local bySig = index[methName]
+			if bySig == nil then
+				bySig = {}
+				index[methName] = bySig
+			end
+			local entry = bySig[record.inSig]
+			if (entry == nil) or (entry.seq > intfItem.seq) then
+				bySig[record.inSig] = { handler = handler,
+										outSig = record.outSig,
+										seq = intfItem.seq }
 			end
-			break 
 		end
 	end
-	return signature
+	svcObj.memberIndex = index
 end
 
 
@@ -180,47 +303,46 @@ local function globalHandler(lowLevelObj, conn, msg, svcObj)
 	local status = nil
 	local result = nil
 	local outSig = nil
+	local record = nil
+	local intfItem = intfName and svcObj.interfaces[intfName]
+	local inSig = nil
 	
-	-- Search for a suitable handler
-	if intfName and svcObj.interfaces[intfName] then
-		if svcObj.interfaces[intfName].methods[member] then
-			handler = svcObj.interfaces[intfName].methods[member].handler
-			outSig = svcObj.interfaces[intfName].methods[member].outSig
-		end
-	-- Else an interface wasn't provided so find the first interface
-	-- with a matching name and method signature
+	-- Look up a suitable handler
+	if intfItem then
+		record = intfItem.methods[member]
+		-- Methods unknown to the interface have no reply signature
+		outSig = record and record.outSig or ""
+		inSig = record and record.inSig
+		handler = intfItem.handlers[member]
+	-- Else an interface wasn't provided (or isn't one of this object's)
+	-- so find the first interface with a matching name and method
+	-- signature
 	else
-		for intfKey, intfItem in pairs(svcObj.interfaces) do
-			for methName, methItem in pairs(intfItem.methods) do
-				if (methName == member) then
-					if intfItem.methods[member].inSig == msg:getSignature() then
-						handler = intfItem.methods[member].handler
-						outSig = intfItem.methods[member].outSig
-						break
-					end
-				end
-			end
-			if handler ~= nil then
-				break
-			end
-		end
+		local bySig = svcObj.memberIndex[member]
+		record = bySig and bySig[msg:getSignature()]
+		outSig = record and record.outSig
+		handler = record and record.handler
 	end
 	
-	if (handler ~= nil) or (svcObj.defHandler ~= nil ) then
-		if (outSig == nil) and intfName and svcObj.interfaces[intfName] then
-			outSig = calcSignatureFromMetadata(member, "out",
-								svcObj.interfaces[intfName].metadata)
-		end
-		context = newReplyContext(outSig, conn, msg)
+	-- Requests with the wrong arguments never reach the method handler
+	if (handler ~= nil) and (inSig ~= nil) and (inSig ~= msg:getSignature()) then
+		context = newReplyContext(conn, msg, outSig, lowLevelObj)
+		context:error(l2dbus.Dbus.ERROR_INVALID_ARGS,
+					"Unexpected signature for method")
+		context:release()
+	elseif (handler ~= nil) or (svcObj.defHandler ~= nil ) then
+		context = newReplyContext(conn, msg, outSig, lowLevelObj)
 		if handler ~= nil then
 			status, result = pcall(handler, context, msg:getArgs())
 		else
 			status, result = pcall(svcObj.defHandler, context, intfName, member,
 									msg:getArgsAsArray())
 		end
-		if not status then
-			context:error(L2DBUS_ERROR_PROCESSING_REQUEST, result) 
+		if not status and not context:isReplied() then
+			context:error(L2DBUS_ERROR_PROCESSING_REQUEST, tostring(result))
 		end
+		-- A context that has been replied to is recycled
+		context:release()
 	-- Else there are no registered handlers to process this request
 	else
 		-- Indicate that it was *not* handled
@@ -254,6 +376,15 @@ function M.new(objPath, introspectable, defaultHandler)
 	local svcObj = {
 				defHandler = defaultHandler,
 				interfaces = {},
+				-- Number of interfaces added (orders the member index)
+				nAdded = 0,
+				memberIndex = {},
+				-- Connection and window of batched PropertiesChanged signals
+				batching = nil,
+				-- Connections the service is attached to
+				connections = {},
+				-- Signal emitters keyed by interface then signal name
+				emitters = {},
 				objInst = nil
 				}
 				
@@ -432,7 +563,16 @@ end
 function Service:attach(conn)
 	verify("userdata" == type(conn),
 	       string.format("invalid connection type (%s)", type(conn)))
-	return conn:registerServiceObject(self.objInst)
+	local isAttached = conn:registerServiceObject(self.objInst)
+	if isAttached then
+		self.connections[#self.connections + 1] = conn
+		for _, byName in pairs(self.emitters) do
+			for _, emitter in pairs(byName) do
+				emitter:addConnection(conn)
+			end
+		end
+	end
+	return isAttached
 end
 
 
@@ -451,7 +591,20 @@ end
 function Service:detach(conn)
 	verify("userdata" == type(conn),
 	       string.format("invalid connection type (%s)", type(conn)))
-	return conn:unregisterServiceObject(self.objInst)
+	local isDetached = conn:unregisterServiceObject(self.objInst)
+	if isDetached then
+		for idx = #self.connections, 1, -1 do
+			if self.connections[idx] == conn then
+				table.remove(self.connections, idx)
+			end
+		end
+		for _, byName in pairs(self.emitters) do
+			for _, emitter in pairs(byName) do
+				emitter:removeConnection(conn)
+			end
+		end
+	end
+	return isDetached
 end
 
 
@@ -465,12 +618,19 @@ end
 -- @{convertXmlToIntfMeta} can be used to convert XML to the Lua equivalent
 -- but is typically unnecessary for this method.
 -- </br>
+-- Services adding an interface with the same metadata (the same Lua table
+-- or XML string) share a single @{l2dbus.InterfaceDescriptor|description}
+-- of it. Only the identical table or string is shared: an equal copy of
+-- the metadata gets a description of its own. The metadata must not be
+-- modified once it has been added.
+-- </br>
 -- If the interface that is being added contains D-Bus properties then
 -- the D-Bus property interface <a href="http://dbus.freedesktop.org/doc/dbus-specification.html#standard-interfaces-properties">
 -- org.freedesktop.DBus.Properties</a> will automatically be added to this
--- service. It is required that handlers for the **Get**, **Set**, and
--- **GetAll** methods will be registered to handle inquires on the object
--- properties.
+-- service. Requests for properties whose values are stored with
+-- @{setProperty} are answered natively. Handlers for the **Get**, **Set**,
+-- and **GetAll** methods must be registered to handle inquires on any other
+-- object properties.
 -- 
 -- @within Service
 -- @tparam userdata svc The Service instance.
@@ -487,34 +647,49 @@ end
 -- @function addInterface
 function Service:addInterface(name, metadata)
 	verify(validate.isValidInterface(name), "invalid D-Bus interface name")
-	-- If the metadata is a string then we'll assume it's D-Bus XML formatted
-	-- data that can be converted to an equivalent Lua table.
-	if "string" == type(metadata) then
-		metadata = M.convertXmlToIntfMeta(name, metadata)
-	end
-	verify("table" == type(metadata),
-	       string.format("invalid metadata type (%s)", type(metadata)))
+	local shared = getSharedDescription(name, metadata)
+	metadata = shared.metadata
 	
 	local isAdded = false
 	local status = true
-	-- Create a lower level interface
-	local intfInst = l2dbus.Interface.new(name, nil, nil)
-	if intfInst then
-		if metadata.methods then 
+	-- Create a lower level interface. The D-Bus Property interface is
+	-- answered natively for properties stored with setProperty().
+	-- Other interfaces share the descriptor of their description.
+	local intfInst
+	if name == DBUS_PROPERTIES_INTERFACE_NAME then
+		intfInst = l2dbus.Properties.new()
+		if intfInst and metadata.methods then 
 			status = pcall(intfInst.registerMethods, intfInst, metadata.methods)
 		end
-		if status and metadata.signals then
+		if intfInst and status and metadata.signals then
 			status = pcall(intfInst.registerSignals, intfInst, metadata.signals)
 		end
-		if status and metadata.properties then
+		if intfInst and status and metadata.properties then
 			status = pcall(intfInst.registerProperties, intfInst, metadata.properties)
 		end
-		
+	else
+		status, intfInst = pcall(newSharedInterface, name, shared)
+		if not status then
+			intfInst = nil
+		end
+	end
+	if intfInst then
 		-- Add it to the lower-level service object
 		if status and self.objInst:addInterface(intfInst) then
+			self.nAdded = self.nAdded + 1
 			self.interfaces[name] = { intfInst = intfInst,
+									shared = shared,
 									metadata = metadata,
-									methods = {}}
+									methods = shared.methods,
+									signals = shared.signals,
+									-- Method handlers of this service
+									handlers = {},
+									seq = self.nAdded }
+			rebuildMemberIndex(self)
+			if self.batching and metadata.properties and #metadata.properties > 0 then
+				intfInst:setPropertyBatching(self.batching.conn,
+							self.objInst:path(), self.batching.windowMsec)
+			end
 			isAdded = true
 		end
 		
@@ -538,9 +713,9 @@ function Service:addInterface(name, metadata)
 		end
 	end
 	
-	-- If the interface wasn't added to the
+	-- If the interface (with its own description) wasn't added to the
 	-- object successfully then ...
-	if intfInst and not isAdded then
+	if intfInst and not isAdded and (intfInst:descriptor() == nil) then
 		intfInst:clearMethods()
 		intfInst:clearSignals()
 		intfInst:clearProperties()
@@ -567,6 +742,12 @@ function Service:removeInterface(name)
 	if self.interfaces[name] then
 		if self.objInst:removeInterface(self.interfaces[name].intfInst) then
 			self.interfaces[name] = nil
+			-- Emitters of the interface no longer send anything
+			for _, emitter in pairs(self.emitters[name] or {}) do
+				emitter:clearConnections()
+			end
+			self.emitters[name] = nil
+			rebuildMemberIndex(self)
 			isRemoved = true
 		end
 	end
@@ -584,11 +765,14 @@ end
 -- 
 -- 		function onRequest(ctx, arg1, arg2, ..., argN)
 -- 
--- Where the first argument of the handler will **always** be a context
--- instance that can used to reply either immediately or at some point
--- int the  future (outside the scope of the handler if a reference to
--- the context is maintained). A Lua error may be thrown if an error is
--- encountered registering a handler. 
+-- Where the first argument of the handler will **always** be a
+-- @{l2dbus.ReplyContext|ReplyContext} that can used to reply either
+-- immediately or at some point int the  future (outside the scope of the
+-- handler if a reference to the context is maintained). A context that was
+-- replied to within the handler is released once the handler returns and
+-- can't be used afterwards (replying to it again raises an error even if
+-- its state has been recycled for another request). A Lua error may be
+-- thrown if an error is encountered registering a handler. 
 -- 
 -- @within Service
 -- @tparam userdata svc The Service instance.
@@ -607,35 +791,15 @@ function Service:registerMethodHandler(intfName, methodName, handler)
 		error("interface unknown to this service object: " .. intfName)
 	end
 	
-	local numMethods = 0
-	if self.interfaces[intfName].metadata.methods then
-		numMethods = #self.interfaces[intfName].metadata.methods
-	end
-	
-	local methodExists = false
-	for idx = 1, numMethods do
-		if self.interfaces[intfName].metadata.methods[idx].name == methodName  then
-			methodExists = true
-			break	
-		end
-	end
-	
-	if not methodExists then
+	local intfItem = self.interfaces[intfName]
+	if intfItem.methods[methodName] == nil then
 		error("interface does not have method: " .. methodName)
 	end
 	
 	-- This will replace any previous handler that might have
 	-- already been assigned
-	self.interfaces[intfName].methods[methodName] =
-				{
-				handler = handler,
-				inSig = calcSignatureFromMetadata(methodName,
-								"in",
-								self.interfaces[intfName].metadata),
-				outSig = calcSignatureFromMetadata(methodName,
-								"out",
-								self.interfaces[intfName].metadata)
-				}
+	intfItem.handlers[methodName] = handler
+	rebuildMemberIndex(self)
 end
 
 
@@ -662,8 +826,10 @@ function Service:unregisterMethodHandler(intfName, methodName)
 		error("interface '" .. intfName .. "' is unknown to this service object")
 	end
 	
-	if self.interfaces[intfName].methods[methodName] then
-		self.interfaces[intfName].methods[methodName] = nil
+	local handlers = self.interfaces[intfName].handlers
+	if handlers[methodName] then
+		handlers[methodName] = nil
+		rebuildMemberIndex(self)
 		return true
 	else
 		return false
@@ -671,6 +837,192 @@ function Service:unregisterMethodHandler(intfName, methodName)
 end
 
 
+--- Stores the value of a property of an interface.
+-- 
+-- The value is marshalled once and kept by the interface. Clients
+-- reading the property (**Get** or **GetAll**) or writing it (**Set**)
+-- are answered from the stored value without calling any Lua handler.
+-- A Lua error is thrown if the interface or property is unknown or the
+-- value doesn't match the signature of the property.
+-- 
+-- @within Service
+-- @tparam userdata svc The Service instance.
+-- @tparam string intfName The D-Bus interface name owning the property.
+-- @tparam string propName The name of the property.
+-- @tparam any value The value of the property.
+-- @function setProperty
+function Service:setProperty(intfName, propName, value)
+	verify(validate.isValidInterface(intfName), "invalid D-Bus interface name")
+	if self.interfaces[intfName] == nil then
+		error("interface '" .. intfName .. "' is unknown to this service object")
+	end
+	self.interfaces[intfName].intfInst:setProperty(propName, value)
+end
+
+
+--- Returns the stored value of a property of an interface.
+-- 
+-- @within Service
+-- @tparam userdata svc The Service instance.
+-- @tparam string intfName The D-Bus interface name owning the property.
+-- @tparam string propName The name of the property.
+-- @treturn any The stored value or **nil** if no value has been stored.
+-- @function getProperty
+function Service:getProperty(intfName, propName)
+	verify(validate.isValidInterface(intfName), "invalid D-Bus interface name")
+	if self.interfaces[intfName] == nil then
+		error("interface '" .. intfName .. "' is unknown to this service object")
+	end
+	return self.interfaces[intfName].intfInst:getProperty(propName)
+end
+
+
+--- Sets a hook called before a value written by a client is stored.
+-- 
+-- See @{l2dbus.Interface.setPropertySetter|Interface:setPropertySetter}.
+-- 
+-- @within Service
+-- @tparam userdata svc The Service instance.
+-- @tparam string intfName The D-Bus interface name owning the properties.
+-- @tparam ?func setter The hook or **nil** to remove it.
+-- @function setPropertySetter
+function Service:setPropertySetter(intfName, setter)
+	verify(validate.isValidInterface(intfName), "invalid D-Bus interface name")
+	if self.interfaces[intfName] == nil then
+		error("interface '" .. intfName .. "' is unknown to this service object")
+	end
+	self.interfaces[intfName].intfInst:setPropertySetter(setter)
+end
+
+
+--- Invalidates the stored value of a property of an interface.
+-- 
+-- See @{l2dbus.Interface.invalidateProperty|Interface:invalidateProperty}.
+-- 
+-- @within Service
+-- @tparam userdata svc The Service instance.
+-- @tparam string intfName The D-Bus interface name owning the property.
+-- @tparam string propName The name of the property.
+-- @function invalidateProperty
+function Service:invalidateProperty(intfName, propName)
+	verify(validate.isValidInterface(intfName), "invalid D-Bus interface name")
+	if self.interfaces[intfName] == nil then
+		error("interface '" .. intfName .. "' is unknown to this service object")
+	end
+	self.interfaces[intfName].intfInst:invalidateProperty(propName)
+end
+
+
+--- Batches the PropertiesChanged signals of the service.
+-- 
+-- Changes to the properties of each interface of the service (made with
+-- @{setProperty}, @{invalidateProperty}, or by clients setting them) are
+-- collected for the duration of the window and announced with one
+-- PropertiesChanged signal per interface carrying the latest values.
+-- Interfaces added later are batched the same way.
+-- 
+-- @within Service
+-- @tparam userdata svc The Service instance.
+-- @tparam ?userdata conn The D-Bus connection on which to emit the signals
+-- or **nil** to stop batching.
+-- @tparam ?number windowMsec How long changes are collected in milliseconds.
+-- The default (0) collects the changes of one main loop iteration.
+-- @function setPropertyBatching
+function Service:setPropertyBatching(conn, windowMsec)
+	if conn then
+		self.batching = { conn = conn, windowMsec = windowMsec or 0 }
+	else
+		self.batching = nil
+	end
+	for _, intf in pairs(self.interfaces) do
+		if intf.metadata.properties and #intf.metadata.properties > 0 then
+			if conn then
+				intf.intfInst:setPropertyBatching(conn, self.objInst:path(),
+												windowMsec)
+			else
+				intf.intfInst:setPropertyBatching(nil)
+			end
+		end
+	end
+end
+
+
+--- Returns the batched property change counters of the service.
+-- 
+-- @within Service
+-- @tparam userdata svc The Service instance.
+-- @treturn table A table with the total number of *changes* recorded
+-- and *signals* emitted by all the interfaces of the service.
+-- @function getPropertyBatchStats
+function Service:getPropertyBatchStats()
+	local stats = { changes = 0, signals = 0 }
+	for _, intf in pairs(self.interfaces) do
+		local s = intf.intfInst:getPropertyBatchStats()
+		stats.changes = stats.changes + s.changes
+		stats.signals = stats.signals + s.signals
+	end
+	return stats
+end
+
+
+--- Sets the maximum number of deferred replies the service may have in-flight.
+-- 
+-- Handlers that reply after returning call
+-- @{l2dbus.ReplyContext.defer|defer} on their context. Once the limit is
+-- reached further deferrals are refused and the caller is sent a
+-- *org.freedesktop.DBus.Error.LimitsExceeded* error.
+-- 
+-- @within Service
+-- @tparam userdata svc The Service instance.
+-- @tparam number limit The maximum number of in-flight deferred replies or
+-- zero (0) for no limit.
+-- @function setDeferredLimit
+function Service:setDeferredLimit(limit)
+	verifyTypesWithMsg("number", "unexpected type for arg #1", limit)
+	self.objInst:setDeferredLimit(limit)
+end
+
+
+--- Returns statistics about the deferred replies of the service.
+-- 
+-- @within Service
+-- @tparam userdata svc The Service instance.
+-- @treturn table The statistics as returned by
+-- @{l2dbus.ServiceObject.getDeferredStats|getDeferredStats}.
+-- @function getDeferredStats
+function Service:getDeferredStats()
+	return self.objInst:getDeferredStats()
+end
+
+
+--- Sets the admission limits of requests to the service.
+-- 
+-- Requests over a limit are answered with an error before they reach
+-- a handler. See @{l2dbus.ServiceObject.setAdmission|setAdmission} for
+-- the supported options.
+-- 
+-- @within Service
+-- @tparam userdata svc The Service instance.
+-- @tparam ?table options The admission limits or **nil** to remove them.
+-- @function setAdmission
+function Service:setAdmission(options)
+	verifyTypesWithMsg("nil|table", "unexpected type for arg #1", options)
+	self.objInst:setAdmission(options)
+end
+
+
+--- Returns statistics about the admission control of the service.
+-- 
+-- @within Service
+-- @tparam userdata svc The Service instance.
+-- @treturn table The statistics as returned by
+-- @{l2dbus.ServiceObject.getAdmissionStats|getAdmissionStats}.
+-- @function getAdmissionStats
+function Service:getAdmissionStats()
+	return self.objInst:getAdmissionStats()
+end
+
+
 --- Provides a method to emit a signal on a specific connection.
 -- 
 -- This method provides a means to send a D-Bus signal with the given
@@ -686,7 +1038,8 @@ end
 -- arbitrary interface name cannot be specified). Also, signals are only
 -- queued to be sent and are not immediately delivered. Call the
 -- @{l2dbus.Connection.flush|flush} method on the connection to block until the
--- message has been sent. 
+-- message has been sent. Signals that are emitted often should be sent
+-- with an emitter returned by @{signalEmitter} instead.
 -- 
 -- @within Service
 -- @tparam userdata svc The Service instance.
@@ -709,21 +1062,8 @@ function Service:emit(conn, intfName, signalName, ...)
 		error("interface '" .. intfName .. "' is unknown to this service object")
 	end
 
-	local nSignals = 0
-	if self.interfaces[intfName].metadata.signals then
-		nSignals = #self.interfaces[intfName].metadata.signals
-	end
-	local signature = ""
-	for sigIdx = 1, nSignals do
-		local sigItem = self.interfaces[intfName].metadata.signals[sigIdx]
-		if sigItem.name == signalName then
-			local nArgs = #sigItem.args
-			for argIdx = 1, nArgs do
-				signature = signature .. sigItem.args[argIdx].sig
-			end
-			break			
-		end
-	end
+	-- Signals unknown to the interface are sent without arguments
+	local signature = self.interfaces[intfName].signals[signalName] or ""
 		
 	local msg = l2dbus.Message.newSignal(self.objInst:path(), intfName,
 										signalName)
@@ -738,156 +1078,54 @@ function Service:emit(conn, intfName, signalName, ...)
 end
 
 
---- ReplyContext
--- @type ReplyContext
-
-
---
--- Set up the metadata information for the ReplyContext class
---
-local ReplyContext = { __type = "l2dbus.lua.reply_context" }
-ReplyContext.__index = ReplyContext
-
--- Constructor for a ReplyContext.
---
--- Creates a new reply context which can be used to reply to a request
--- at a later time. This is a "private" function that should only
--- be called (internally) by the Service's request dispatcher.
---
--- @within ReplyContext
--- @tparam string outSig The output/reply signature.
--- @tparam userdata conn The L2DBUS connection.
--- @tparam userdata msg The request message.
--- @treturn table The reply context.
--- @function newReplyContext
-newReplyContext = function(outSig, conn, msg)
-	local context = {
-					outSignature = outSig,
-					conn = conn,
-					msg = msg
-					}
+--- Returns an emitter for a signal of the service.
+-- 
+-- The emitter is a callable @{l2dbus.SignalEmitter|SignalEmitter} bound to
+-- the object path of the service, the interface, the signal and its
+-- signature. It sends the signal on every connection the service is
+-- attached to, including those attached after the emitter was created.
+-- Calling the emitter, e.g. *emitter(arg1, arg2)*, is much cheaper than
+-- calling @{emit} since the signal header and signature are prepared only
+-- once. Emitters are cached so asking for the same signal again returns the
+-- same emitter. Removing the interface from the service detaches its
+-- emitters from all connections.
+-- 
+-- @within Service
+-- @tparam userdata svc The Service instance.
+-- @tparam string intfName The D-Bus interface name owning the signal.
+-- @tparam string signalName The name of the D-Bus signal.
+-- @treturn userdata The signal emitter.
+-- @function signalEmitter
+function Service:signalEmitter(intfName, signalName)
+	verify(validate.isValidInterface(intfName), "invalid D-Bus interface name")
+	verify(validate.isValidMember(signalName), "invalid D-Bus signal name")
 	
-	return setmetatable(context, ReplyContext)
-end
-
-
---- Returns the D-Bus connection associated with the context.
---
--- Returns the D-Bus connection on which the original request message
--- arrived. This will be the connection on which the response is sent.
---
--- @within ReplyContext
--- @tparam table ctx The reply context.
--- @treturn userdata The D-Bus connection associated with the context.
--- @function getConnection
-function ReplyContext:getConnection()
-	return self.conn
-end
-
-
---- Returns the request message associated with the context.
---
--- Returns the original D-Bus request message for which there should
--- be a reply.
---
--- @within ReplyContext
--- @tparam table ctx The reply context.
--- @treturn userdata The D-Bus request message associated with the context.
--- @function getMessage
-function ReplyContext:getMessage()
-	return self.msg
-end
-
-
---- Returns an indication of whether the request expects a reply message.
---
--- The method returns a boolean value indicating whether or not the
--- original request expects a reply (or not). If no reply is needed/expected
--- then message traffic can be reduced by not sending a reply. Typically
--- most requests expect a reply. Technically, even if a reply is not needed
--- it is not an error to send one anyway. The client will likely ignore the
--- reply.
---
--- @within ReplyContext
--- @tparam table ctx The reply context.
--- @treturn bool Returns **true** if the request expects a reply, **false**
--- if a reply is **not** needed.
--- @function needsReply
-function ReplyContext:needsReply()
-	return not self.msg:getNoReply()
-end
-
-
---- Returns a response to the associated method request.
---
--- The method queues the response to a request associated with the context.
--- The parameters are marshalled into a response message which is then
--- enqueued into the out-going message queue. If it's critical that the
--- response is delivered immediately (rather than during the next iteration
--- of the dispatch loop) call the @{l2dbus.Connection.flush|flush} method on
--- the connection to block until the response message has been sent. It is
--- considered an error to respond to the same request more than once. An
--- @{error} reply is considered a response as well.
---
--- @within ReplyContext
--- @tparam table ctx The reply context.
--- @tparam any ... The list of arguments associated with the response. The
--- signature of these arguments is taken from the D-Bus interface specification
--- for the return (out) parameters. This signature is used to guide the
--- conversion from Lua types to D-Bus types.
--- @treturn bool Returns **true** if the response is enqueued to be sent and
--- **false** otherwise.
--- @treturn number Returns the serial number of the enqueued response message
--- or zero (0) if it cannot be queued.
--- @function reply
-function ReplyContext:reply(...)
-	local replyMsg = l2dbus.Message.newMethodReturn(self.msg)
-	-- If an output signature is available then ...
-	if self.outSignature then
-		replyMsg:addArgsBySignature(self.outSignature, ...)
-	-- Else no signature was provided for the reply message
-	else
-		-- Make our best guess encoding thing correctly
-		replyMsg:addArgs(...)
+	local intfItem = self.interfaces[intfName]
+	if intfItem == nil then
+		error("interface '" .. intfName .. "' is unknown to this service object")
+	end
+	local signature = intfItem.signals[signalName]
+	if signature == nil then
+		error("signal '" .. signalName .. "' is unknown to interface '" ..
+			intfName .. "'")
 	end
-	local result = self.conn:send(replyMsg)
-	-- Dispose of the reply message since D-Bus now owns it
-	replyMsg:dispose()
 	
-	-- Return serial # if sent or zero if it can't be queued
-	return result
-end
-
-
---- Returns an error response to the associated method request.
---
--- The method queues an error response to the request associated with the
--- context. The error is enqueued into the out-going message queue. If it's
--- critical that the D-Bus error is delivered immediately (rather than during
--- the next iteration of the dispatch loop) call the
--- @{l2dbus.Connection.flush|flush} method on the connection to block until the
--- response message has been sent. An
--- @{error} reply is considered a valid
--- response to a request and fullfills the request. An additional response is
--- unnecessary.
---
--- @within ReplyContext
--- @tparam table ctx The reply context.
--- @tparam string errName The D-Bus error name.
--- @tparam string|nil errMsg An optional error message.
--- @treturn bool Returns **true** if the error is enqueued to be sent and
--- **false** otherwise.
--- @treturn number Returns the serial number of the enqueued error message
--- or zero (0) if it cannot be queued.
--- @function error
-function ReplyContext:error(errName, errMsg)
-	verify(validate.isValidInterface(errName), "invalid D-Bus error name")
-	local errorMsg = l2dbus.Message.newError(self.msg, errName, errMsg)
-	-- Return true/serial # or false/nil
-	local result = self.conn:send(errorMsg)
-	-- Dispose of the errorMsg since D-Bus now owns it
-	errorMsg:dispose()
-	return result
+	local byName = self.emitters[intfName]
+	if byName == nil then
+		byName = {}
+		self.emitters[intfName] = byName
+	end
+	local emitter = byName[signalName]
+	if emitter == nil then
+		emitter = l2dbus.SignalEmitter.new(self.objInst:path(), intfName,
+										signalName, signature)
+		for _, conn in ipairs(self.connections) do
+			emitter:addConnection(conn)
+		end
+		byName[signalName] = emitter
+	end
+	
+	return emitter
 end
 
 
@@ -225,11 +225,11 @@ local function newProxy(bus, busName, objPath)
             -- No sense waiting for a reply we don't care about
             if ignoreReply then
                 return true, {errCode = M.ERR_OK, errMsg = ""}
-            elseif co == nil then
-                -- We're in the main thread - the only thing we can do
-                -- is block and wait for a response.
-                pending:block()
-                local msg = pending:stealReply()
+            elseif (co == nil) or l2dbus.inTask() then
+                -- A task is suspended (and later resumed by the dispatcher)
+                -- until the reply arrives. In the main thread the only thing
+                -- we can do is block and wait for a response.
+                local msg = pending:await()
                 if msg:getType() == l2dbus.Dbus.MESSAGE_TYPE_ERROR then
                     return nil, {errCode = M.ERR_DBUS, errMsg = tostring(msg:getArgs()) }
                 else
@@ -0,0 +1,404 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_admission.c
+ * @author         Glenn Schmottlach
+ * @brief          Implementation of the admission control of service
+ *                 requests.
+ *===========================================================================
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "dbus/dbus.h"
+#include "l2dbus_admission.h"
+#include "l2dbus_util.h"
+#include "l2dbus_trace.h"
+#include "l2dbus_alloc.h"
+
+
+/**
+ * @brief Finds the in-flight count of a sender.
+ *
+ * @param [in]  adm     The admission control state.
+ * @param [in]  sender  The unique name of the sender (may be NULL).
+ * @param [in]  hash    The hash of the sender name.
+ * @param [out] prev    The slot linking to the entry (may be NULL).
+ * @return The entry of the sender or NULL if it has nothing in-flight.
+ */
+static l2dbus_AdmissionSender*
+l2dbus_admissionFindSender
+    (
+    l2dbus_Admission*           adm,
+    const char*                 sender,
+    unsigned                    hash,
+    l2dbus_AdmissionSender***   prev
+    )
+{
+    l2dbus_AdmissionSender** link;
+
+    if ( NULL == sender )
+    {
+        sender = "";
+    }
+
+    for ( link = &adm->senders[hash % L2DBUS_ADMISSION_SENDER_BUCKETS];
+        NULL != *link;
+        link = &(*link)->next )
+    {
+        if ( ((*link)->hash == hash) && (0 == strcmp((*link)->sender, sender)) )
+        {
+            if ( NULL != prev )
+            {
+                *prev = link;
+            }
+            return *link;
+        }
+    }
+
+    return NULL;
+}
+
+
+/**
+ * @brief Sends the error reply to a rejected request.
+ *
+ * @param [in] adm      The admission control state.
+ * @param [in] conn     The connection the request arrived on.
+ * @param [in] msg      The rejected request.
+ * @param [in] reason   The reason the request was rejected.
+ */
+static void
+l2dbus_admissionReject
+    (
+    l2dbus_Admission*       adm,
+    DBusConnection*         conn,
+    DBusMessage*            msg,
+    l2dbus_AdmissionResult  reason
+    )
+{
+    DBusMessage* errMsg;
+    const char* text;
+
+    switch ( reason )
+    {
+        case L2DBUS_ADMISSION_REJECT_AGE:
+            ++adm->rejectedAge;
+            text = "Request waited too long to be handled";
+            break;
+
+        case L2DBUS_ADMISSION_REJECT_SENDER:
+            ++adm->rejectedSender;
+            text = "Too many requests in-flight from the sender";
+            break;
+
+        default:
+            ++adm->rejectedConcurrent;
+            text = "Too many requests in-flight";
+            break;
+    }
+
+    L2DBUS_TRACE((L2DBUS_TRC_INFO, "Rejected request (serial #=%u): %s",
+                dbus_message_get_serial(msg), text));
+
+    if ( !dbus_message_get_no_reply(msg) )
+    {
+        errMsg = dbus_message_new_error(msg, (NULL != adm->errorName) ?
+                                adm->errorName : DBUS_ERROR_LIMITS_EXCEEDED,
+                                text);
+        if ( NULL != errMsg )
+        {
+            dbus_connection_send(conn, errMsg, NULL);
+            dbus_message_unref(errMsg);
+        }
+    }
+}
+
+
+/**
+ * @brief Initializes the admission control state (no limits).
+ *
+ * @param [in] adm  The admission control state.
+ */
+void
+l2dbus_admissionInit
+    (
+    l2dbus_Admission*   adm
+    )
+{
+    memset(adm, 0, sizeof(*adm));
+}
+
+
+/**
+ * @brief Releases the resources of the admission control state.
+ *
+ * @param [in] adm  The admission control state.
+ */
+void
+l2dbus_admissionFree
+    (
+    l2dbus_Admission*   adm
+    )
+{
+    l2dbus_AdmissionSender* entry;
+    unsigned idx;
+
+    for ( idx = 0U; idx < L2DBUS_ADMISSION_SENDER_BUCKETS; ++idx )
+    {
+        while ( NULL != adm->senders[idx] )
+        {
+            entry = adm->senders[idx];
+            adm->senders[idx] = entry->next;
+            l2dbus_free(entry->sender);
+            l2dbus_free(entry);
+        }
+    }
+    l2dbus_free(adm->active);
+    l2dbus_free(adm->errorName);
+    l2dbus_admissionInit(adm);
+}
+
+
+/**
+ * @brief Decides whether a request is handed to its handler.
+ *
+ * Only method calls are subject to the limits. A request that is over
+ * a limit is answered with an error right away and is never seen by a
+ * handler. An admitted request is in-flight until the matching call to
+ * l2dbus_admissionExit() once its handler returns or, if a deferred
+ * reply claims it, until l2dbus_admissionRelease().
+ *
+ * @param [in] adm      The admission control state.
+ * @param [in] conn     The connection the request arrived on.
+ * @param [in] msg      The request.
+ * @param [in] queuedAt The time (in msec) the request was queued or
+ * zero (0) if it wasn't.
+ * @return True if the request is admitted or false if it was rejected.
+ */
+l2dbus_Bool
+l2dbus_admissionEnter
+    (
+    l2dbus_Admission*   adm,
+    DBusConnection*     conn,
+    DBusMessage*        msg,
+    double              queuedAt
+    )
+{
+    l2dbus_AdmissionResult result = L2DBUS_ADMISSION_ADMITTED;
+    l2dbus_AdmissionSender* entry;
+    l2dbus_AdmissionActive* active;
+    const char* sender;
+    unsigned hash;
+    unsigned capacity;
+
+    if ( (DBUS_MESSAGE_TYPE_METHOD_CALL != dbus_message_get_type(msg)) ||
+        ((0.0 >= adm->maxQueueAge) && (0U == adm->maxPerSender) &&
+        (0U == adm->maxConcurrent)) )
+    {
+        return L2DBUS_TRUE;
+    }
+
+    sender = dbus_message_get_sender(msg);
+    hash = l2dbus_hashString(sender);
+    entry = l2dbus_admissionFindSender(adm, sender, hash, NULL);
+
+    if ( (0.0 < adm->maxQueueAge) && (0.0 < queuedAt) &&
+        ((l2dbus_getMonotonicTime() - queuedAt) > adm->maxQueueAge) )
+    {
+        result = L2DBUS_ADMISSION_REJECT_AGE;
+    }
+    else if ( (0U < adm->maxConcurrent) &&
+            (adm->nInFlight >= adm->maxConcurrent) )
+    {
+        result = L2DBUS_ADMISSION_REJECT_CONCURRENT;
+    }
+    else if ( (0U < adm->maxPerSender) && (NULL != entry) &&
+            (entry->count >= adm->maxPerSender) )
+    {
+        result = L2DBUS_ADMISSION_REJECT_SENDER;
+    }
+
+    if ( L2DBUS_ADMISSION_ADMITTED != result )
+    {
+        l2dbus_admissionReject(adm, conn, msg, result);
+        return L2DBUS_FALSE;
+    }
+
+    ++adm->admitted;
+
+    /* Without memory the request is admitted but not counted */
+    if ( adm->nActive == adm->activeCapacity )
+    {
+        capacity = (0U == adm->activeCapacity) ? 4U : 2U * adm->activeCapacity;
+        active = (l2dbus_AdmissionActive*)l2dbus_realloc(adm->active,
+                                                capacity * sizeof(*active));
+        if ( NULL == active )
+        {
+            return L2DBUS_TRUE;
+        }
+        adm->active = active;
+        adm->activeCapacity = capacity;
+    }
+
+    if ( NULL == entry )
+    {
+        entry = (l2dbus_AdmissionSender*)l2dbus_calloc(1, sizeof(*entry));
+        if ( NULL == entry )
+        {
+            return L2DBUS_TRUE;
+        }
+        entry->sender = l2dbus_strDup((NULL != sender) ? sender : "");
+        if ( NULL == entry->sender )
+        {
+            l2dbus_free(entry);
+            return L2DBUS_TRUE;
+        }
+        entry->hash = hash;
+        entry->next = adm->senders[hash % L2DBUS_ADMISSION_SENDER_BUCKETS];
+        adm->senders[hash % L2DBUS_ADMISSION_SENDER_BUCKETS] = entry;
+        ++adm->nSenders;
+    }
+
+    ++entry->count;
+    ++adm->nInFlight;
+    active = &adm->active[adm->nActive++];
+    active->msg = msg;
+    active->claimed = L2DBUS_FALSE;
+
+    return L2DBUS_TRUE;
+}
+
+
+/**
+ * @brief Called once the handler of an admitted request returns.
+ *
+ * The request stops being in-flight unless a deferred reply has claimed
+ * it. Requests that weren't counted are ignored.
+ *
+ * @param [in] adm  The admission control state.
+ * @param [in] msg  The request.
+ */
+void
+l2dbus_admissionExit
+    (
+    l2dbus_Admission*   adm,
+    DBusMessage*        msg
+    )
+{
+    unsigned idx;
+    l2dbus_Bool claimed;
+
+    /* Handlers return in the reverse order they were called */
+    for ( idx = adm->nActive; 0U < idx; --idx )
+    {
+        if ( msg == adm->active[idx - 1U].msg )
+        {
+            claimed = adm->active[idx - 1U].claimed;
+            memmove(&adm->active[idx - 1U], &adm->active[idx],
+                    (adm->nActive - idx) * sizeof(*adm->active));
+            --adm->nActive;
+            if ( !claimed )
+            {
+                l2dbus_admissionRelease(adm, msg);
+            }
+            break;
+        }
+    }
+}
+
+
+/**
+ * @brief Transfers an in-flight request to its deferred reply.
+ *
+ * @param [in] adm  The admission control state.
+ * @param [in] msg  The request whose reply is deferred.
+ * @return True if the request was counted and is now owned by the
+ * deferred reply which must call l2dbus_admissionRelease() once answered.
+ */
+l2dbus_Bool
+l2dbus_admissionClaim
+    (
+    l2dbus_Admission*   adm,
+    DBusMessage*        msg
+    )
+{
+    unsigned idx;
+
+    for ( idx = adm->nActive; 0U < idx; --idx )
+    {
+        if ( msg == adm->active[idx - 1U].msg )
+        {
+            if ( adm->active[idx - 1U].claimed )
+            {
+                return L2DBUS_FALSE;
+            }
+            adm->active[idx - 1U].claimed = L2DBUS_TRUE;
+            return L2DBUS_TRUE;
+        }
+    }
+
+    return L2DBUS_FALSE;
+}
+
+
+/**
+ * @brief Stops counting an admitted request as in-flight.
+ *
+ * @param [in] adm  The admission control state.
+ * @param [in] msg  The request.
+ */
+void
+l2dbus_admissionRelease
+    (
+    l2dbus_Admission*   adm,
+    DBusMessage*        msg
+    )
+{
+    l2dbus_AdmissionSender* entry;
+    l2dbus_AdmissionSender** prev = NULL;
+    const char* sender = dbus_message_get_sender(msg);
+
+    entry = l2dbus_admissionFindSender(adm, sender, l2dbus_hashString(sender),
+                                    &prev);
+    if ( NULL != entry )
+    {
+        if ( 0U == --entry->count )
+        {
+            *prev = entry->next;
+            l2dbus_free(entry->sender);
+            l2dbus_free(entry);
+            --adm->nSenders;
+        }
+    }
+
+    assert( 0U < adm->nInFlight );
+    if ( 0U < adm->nInFlight )
+    {
+        --adm->nInFlight;
+    }
+}
@@ -0,0 +1,102 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_admission.h
+ * @author         Glenn Schmottlach
+ * @brief          Definition of the admission control of service requests.
+ *===========================================================================
+ */
+
+#ifndef L2DBUS_ADMISSION_H_
+#define L2DBUS_ADMISSION_H_
+
+#include "dbus/dbus.h"
+#include "l2dbus_types.h"
+
+/* Number of buckets of the table of in-flight requests by sender */
+#define L2DBUS_ADMISSION_SENDER_BUCKETS     (32)
+
+/* Reasons for rejecting a request */
+typedef enum
+{
+    L2DBUS_ADMISSION_ADMITTED = 0,
+    L2DBUS_ADMISSION_REJECT_AGE,
+    L2DBUS_ADMISSION_REJECT_SENDER,
+    L2DBUS_ADMISSION_REJECT_CONCURRENT
+} l2dbus_AdmissionResult;
+
+/* Number of requests in-flight from a single sender */
+typedef struct l2dbus_AdmissionSender
+{
+    char*                               sender;
+    unsigned                            hash;
+    unsigned                            count;
+    struct l2dbus_AdmissionSender*      next;
+} l2dbus_AdmissionSender;
+
+/* A request whose handler is running */
+typedef struct l2dbus_AdmissionActive
+{
+    DBusMessage*                        msg;
+    /* Set once a deferred reply has taken over the request */
+    l2dbus_Bool                         claimed;
+} l2dbus_AdmissionActive;
+
+typedef struct l2dbus_Admission
+{
+    /* Limits (zero means unlimited) */
+    double                              maxQueueAge;
+    unsigned                            maxPerSender;
+    unsigned                            maxConcurrent;
+    /* Name of the error sent to rejected callers (NULL for the default) */
+    char*                               errorName;
+    /* Requests in-flight overall and by sender */
+    unsigned                            nInFlight;
+    unsigned                            nSenders;
+    l2dbus_AdmissionSender*             senders[L2DBUS_ADMISSION_SENDER_BUCKETS];
+    /* Stack of requests whose handler is running (nested calls) */
+    l2dbus_AdmissionActive*             active;
+    unsigned                            nActive;
+    unsigned                            activeCapacity;
+    /* Statistics */
+    unsigned long                       admitted;
+    unsigned long                       rejectedAge;
+    unsigned long                       rejectedSender;
+    unsigned long                       rejectedConcurrent;
+} l2dbus_Admission;
+
+void l2dbus_admissionInit(l2dbus_Admission* adm);
+void l2dbus_admissionFree(l2dbus_Admission* adm);
+l2dbus_Bool l2dbus_admissionEnter(l2dbus_Admission* adm,
+                                DBusConnection* conn,
+                                DBusMessage* msg,
+                                double queuedAt);
+void l2dbus_admissionExit(l2dbus_Admission* adm, DBusMessage* msg);
+l2dbus_Bool l2dbus_admissionClaim(l2dbus_Admission* adm, DBusMessage* msg);
+void l2dbus_admissionRelease(l2dbus_Admission* adm, DBusMessage* msg);
+
+#endif /* Guard for L2DBUS_ADMISSION_H_ */
@@ -35,23 +35,34 @@
 #include "l2dbus_compat.h"
 #include "l2dbus_callback.h"
 #include "l2dbus_debug.h"
+#include "l2dbus_context.h"
+#include "l2dbus_trace.h"
+#include "l2dbus_profile.h"
+#include "l2dbus_util.h"
 #include "lauxlib.h"
 
-/* The Lua thread used to run all callbacks */
-static lua_State*  gCallbackThread = NULL;
-static int gCallbackRef = LUA_NOREF;
+/* Stack slot of the callback thread holding the object registry */
+#define L2DBUS_CALLBACK_OBJREG_IDX  (1)
 
 
 void
 l2dbus_callbackConfigure
     (
-    lua_State*   L
+    lua_State*              L,
+    struct l2dbus_Context*  modCtx
     )
 {
-    if ( NULL == gCallbackThread )
+    assert( NULL != modCtx );
+    if ( NULL == modCtx->cbThread )
     {
-        gCallbackThread = lua_newthread(L);
-        gCallbackRef = luaL_ref(L, LUA_REGISTRYINDEX);
+        modCtx->cbThread = lua_newthread(L);
+        modCtx->cbThreadRef = luaL_ref(L, LUA_REGISTRYINDEX);
+
+        /* The object registry stays at the bottom of the callback thread
+         * so callbacks can reach it without going through the registry.
+         */
+        lua_rawgeti(modCtx->cbThread, LUA_REGISTRYINDEX, modCtx->objRegRef);
+        assert( L2DBUS_CALLBACK_OBJREG_IDX == lua_gettop(modCtx->cbThread) );
     }
 }
 
@@ -59,33 +70,40 @@ l2dbus_callbackConfigure
 void
 l2dbus_callbackShutdown
     (
-    lua_State*   L
+    lua_State*              L,
+    struct l2dbus_Context*  modCtx
     )
 {
-    if ( LUA_NOREF != gCallbackRef )
+    if ( (NULL != modCtx) && (LUA_NOREF != modCtx->cbThreadRef) )
     {
-        luaL_unref(L, LUA_REGISTRYINDEX, gCallbackRef);
-        gCallbackRef = LUA_NOREF;
+        luaL_unref(L, LUA_REGISTRYINDEX, modCtx->cbThreadRef);
+        modCtx->cbThreadRef = LUA_NOREF;
     }
 }
 
 
 lua_State*
-l2dbus_callbackGetThread(void)
+l2dbus_callbackGetThread
+    (
+    const l2dbus_CallbackCtx*   ctx
+    )
 {
-    return gCallbackThread;
+    assert( NULL != ctx );
+    return (NULL != ctx->modCtx) ? ctx->modCtx->cbThread : NULL;
 }
 
 
 void
 l2dbus_callbackInit
     (
+    lua_State*          L,
     l2dbus_CallbackCtx* ctx
     )
 {
     assert( NULL != ctx );
     ctx->funcRef = LUA_NOREF;
     ctx->userRef = LUA_NOREF;
+    ctx->modCtx = l2dbus_contextGet(L);
 }
 
 
@@ -144,3 +162,319 @@ l2dbus_callbackUnref
 }
 
 
+/**
+ * @brief Prepares the callback thread to deliver a callback.
+ *
+ * Every C to Lua callback is delivered using the same sequence:
+ * l2dbus_callbackBegin(), l2dbus_callbackPushObject() to retrieve the
+ * userdata wrapping the native object, l2dbus_callbackInvoke() and finally
+ * l2dbus_callbackEnd(). Only the stack above the returned base is used so a
+ * callback delivered while another is running (e.g. from a nested dispatch)
+ * leaves the stack of the outer one untouched.
+ *
+ * @param [in]  ctx     The callback context of the object.
+ * @param [out] base    The stack top to restore with l2dbus_callbackEnd().
+ * @return The Lua thread used to run the callback.
+ */
+lua_State*
+l2dbus_callbackBegin
+    (
+    const l2dbus_CallbackCtx*   ctx,
+    int*                        base
+    )
+{
+    lua_State* L;
+
+    assert( (NULL != ctx) && (NULL != ctx->modCtx) );
+    assert( NULL != base );
+
+    L = ctx->modCtx->cbThread;
+    *base = lua_gettop(L);
+
+    return L;
+}
+
+
+/**
+ * @brief Pushes the userdata registered for a native object.
+ *
+ * On the callback thread the object registry is kept in a fixed stack slot
+ * so the lookup is a single table access. Elsewhere it's reached through
+ * the module context of the callback so, unlike l2dbus_objectRegistryGet(),
+ * no lookup of the context itself is needed.
+ *
+ * @param [in] L    The callback thread.
+ * @param [in] ctx  The callback context of the object.
+ * @param [in] key  The key the object was registered with.
+ * @return The userdata (also left on the stack) or NULL (with nil left on
+ * the stack) if it's been garbage collected.
+ */
+void*
+l2dbus_callbackPushObject
+    (
+    lua_State*                  L,
+    const l2dbus_CallbackCtx*   ctx,
+    const void*                 key
+    )
+{
+    if ( L == ctx->modCtx->cbThread )
+    {
+        lua_pushlightuserdata(L, (void*)key);
+        lua_rawget(L, L2DBUS_CALLBACK_OBJREG_IDX);
+    }
+    else
+    {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, ctx->modCtx->objRegRef);
+        lua_pushlightuserdata(L, (void*)key);
+        lua_rawget(L, -2);
+        lua_remove(L, -2);
+    }
+
+    return lua_touserdata(L, -1);
+}
+
+
+/**
+ * @brief Calls the handler of a callback context.
+ *
+ * The arguments of the handler must already be pushed on the stack. The
+ * user token of the context is passed as the last argument. Errors raised
+ * by the handler are traced and removed from the stack.
+ *
+ * @param [in] L        The callback thread.
+ * @param [in] ctx      The callback context holding the handler.
+ * @param [in] nArgs    The number of arguments on the stack (not counting
+ * the user token).
+ * @param [in] nResults The number of results to leave on the stack.
+ * @param [in] what     Describes the callback in trace messages.
+ * @return Zero on success or the (non-zero) error code of lua_pcall().
+ */
+int
+l2dbus_callbackInvoke
+    (
+    lua_State*                  L,
+    const l2dbus_CallbackCtx*   ctx,
+    int                         nArgs,
+    int                         nResults,
+    const char*                 what
+    )
+{
+    return l2dbus_callbackInvokeDetail(L, ctx, nArgs, nResults, what, NULL);
+}
+
+
+/**
+ * @brief Calls the handler of a callback context.
+ *
+ * Like l2dbus_callbackInvoke() but with a detail (e.g. the D-Bus member
+ * being handled) that further identifies the call when it's profiled.
+ *
+ * @param [in] L        The callback thread.
+ * @param [in] ctx      The callback context holding the handler.
+ * @param [in] nArgs    The number of arguments on the stack (not counting
+ * the user token).
+ * @param [in] nResults The number of results to leave on the stack.
+ * @param [in] what     Describes the callback in trace messages. This must
+ * be a static string.
+ * @param [in] detail   Optional detail about the call or NULL.
+ * @return Zero on success or the (non-zero) error code of lua_pcall().
+ */
+int
+l2dbus_callbackInvokeDetail
+    (
+    lua_State*                  L,
+    const l2dbus_CallbackCtx*   ctx,
+    int                         nArgs,
+    int                         nResults,
+    const char*                 what,
+    const char*                 detail
+    )
+{
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ctx->funcRef);
+    lua_insert(L, -(nArgs + 1));
+    /* LUA_NOREF isn't in the array part of the registry */
+    if ( LUA_NOREF == ctx->userRef )
+    {
+        lua_pushnil(L);
+    }
+    else
+    {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, ctx->userRef);
+    }
+
+    return l2dbus_callbackCall(L, ctx->modCtx, nArgs + 1, nResults, what,
+                                detail);
+}
+
+
+/*
+ * Calls the function sitting below its arguments on the callback thread.
+ * The function at the (negative) profile index identifies the call when
+ * it's profiled.
+ */
+static int
+l2dbus_callbackCallProfiled
+    (
+    lua_State*              L,
+    struct l2dbus_Context*  modCtx,
+    int                     nArgs,
+    int                     nResults,
+    const char*             what,
+    const char*             detail,
+    int                     profIdx
+    )
+{
+    l2dbus_Profiler* prof = modCtx->profiler;
+    l2dbus_ProfileEntry* entry = NULL;
+    double start = 0.0;
+    int status;
+
+    if ( (NULL != prof) && prof->enabled )
+    {
+        entry = l2dbus_profileLookup(L, prof, profIdx, what, detail);
+        start = l2dbus_getMonotonicTime();
+    }
+    else
+    {
+        prof = NULL;
+    }
+
+    ++modCtx->cbDepth;
+    status = lua_pcall(L, nArgs, nResults, 0);
+    --modCtx->cbDepth;
+    if ( 0 != status )
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_ERROR, "%s callback error: %s", what,
+                    lua_isstring(L, -1) ? lua_tostring(L, -1) : ""));
+        lua_pop(L, 1);
+    }
+
+    if ( NULL != prof )
+    {
+        l2dbus_profileRecord(L, prof, entry, what,
+                            l2dbus_getMonotonicTime() - start);
+    }
+
+    return status;
+}
+
+
+/**
+ * @brief Calls a function already sitting on the callback thread.
+ *
+ * This is the common path of l2dbus_callbackInvokeDetail() for callers
+ * that push the function themselves (e.g. a handler that isn't held by a
+ * callback context). The function must be followed by its arguments.
+ * Errors are traced and removed from the stack.
+ *
+ * @param [in] L        The callback thread.
+ * @param [in] modCtx   The module context of the callback.
+ * @param [in] nArgs    The number of arguments following the function.
+ * @param [in] nResults The number of results to leave on the stack.
+ * @param [in] what     Describes the callback in trace messages. This must
+ * be a static string.
+ * @param [in] detail   Optional detail about the call or NULL.
+ * @return Zero on success or the (non-zero) error code of lua_pcall().
+ */
+int
+l2dbus_callbackCall
+    (
+    lua_State*              L,
+    struct l2dbus_Context*  modCtx,
+    int                     nArgs,
+    int                     nResults,
+    const char*             what,
+    const char*             detail
+    )
+{
+    return l2dbus_callbackCallProfiled(L, modCtx, nArgs, nResults, what,
+                                        detail, -(nArgs + 1));
+}
+
+
+/**
+ * @brief Calls a C thunk that in turn calls a Lua handler.
+ *
+ * Like l2dbus_callbackCall() except the thunk's first argument must be
+ * the Lua handler. The handler rather than the (shared) thunk identifies
+ * the call when it's profiled.
+ *
+ * @param [in] L        The callback thread.
+ * @param [in] modCtx   The module context of the callback.
+ * @param [in] nArgs    The number of arguments following the thunk
+ * (including the handler).
+ * @param [in] nResults The number of results to leave on the stack.
+ * @param [in] what     Describes the callback in trace messages. This must
+ * be a static string.
+ * @param [in] detail   Optional detail about the call or NULL.
+ * @return Zero on success or the (non-zero) error code of lua_pcall().
+ */
+int
+l2dbus_callbackCallThunk
+    (
+    lua_State*              L,
+    struct l2dbus_Context*  modCtx,
+    int                     nArgs,
+    int                     nResults,
+    const char*             what,
+    const char*             detail
+    )
+{
+    assert( 0 < nArgs );
+    return l2dbus_callbackCallProfiled(L, modCtx, nArgs, nResults, what,
+                                        detail, -nArgs);
+}
+
+
+/**
+ * @brief Cleans up the callback thread once a callback has been delivered.
+ *
+ * @param [in] L    The callback thread.
+ * @param [in] base The stack top returned by l2dbus_callbackBegin().
+ */
+void
+l2dbus_callbackEnd
+    (
+    lua_State*  L,
+    int         base
+    )
+{
+    lua_settop(L, base);
+}
+
+
+/**
+ * @brief Marks the start of a handler called from within the message
+ * dispatch of the D-Bus library.
+ *
+ * The D-Bus library holds the dispatch lock of the connection while
+ * these handlers run so the main loop cannot be safely re-entered until
+ * the matching call to l2dbus_callbackLeaveDbusDispatch().
+ *
+ * @param [in] ctx  The callback context of the handler.
+ */
+void
+l2dbus_callbackEnterDbusDispatch
+    (
+    const l2dbus_CallbackCtx*   ctx
+    )
+{
+    ++ctx->modCtx->dbusDispatchDepth;
+}
+
+
+/**
+ * @brief Marks the end of a handler called from within the message
+ * dispatch of the D-Bus library.
+ *
+ * @param [in] ctx  The callback context of the handler.
+ */
+void
+l2dbus_callbackLeaveDbusDispatch
+    (
+    const l2dbus_CallbackCtx*   ctx
+    )
+{
+    assert( 0 < ctx->modCtx->dbusDispatchDepth );
+    --ctx->modCtx->dbusDispatchDepth;
+}
@@ -38,20 +38,42 @@
 
 #define L2DBUS_CALLBACK_NOREF_NEEDED    (0)
 
+/* Forward declarations */
+struct l2dbus_Context;
+
 typedef struct l2dbus_CallbackCtx
 {
     int funcRef;
     int userRef;
+    /* The module context of the Lua state owning the callback */
+    struct l2dbus_Context* modCtx;
 } l2dbus_CallbackCtx;
 
-void l2dbus_callbackConfigure(lua_State* L);
-void l2dbus_callbackShutdown(lua_State* L);
-lua_State* l2dbus_callbackGetThread(void);
+void l2dbus_callbackConfigure(lua_State* L, struct l2dbus_Context* modCtx);
+void l2dbus_callbackShutdown(lua_State* L, struct l2dbus_Context* modCtx);
+lua_State* l2dbus_callbackGetThread(const l2dbus_CallbackCtx* ctx);
 
-void l2dbus_callbackInit(l2dbus_CallbackCtx* ctx);
+void l2dbus_callbackInit(lua_State* L, l2dbus_CallbackCtx* ctx);
 void l2dbus_callbackDestroy(lua_State* L, l2dbus_CallbackCtx* ctx);
 
 void l2dbus_callbackRef(lua_State* L, int funcIdx, int userIdx, l2dbus_CallbackCtx* ctx);
 void l2dbus_callbackUnref(lua_State* L, l2dbus_CallbackCtx* ctx);
 
+lua_State* l2dbus_callbackBegin(const l2dbus_CallbackCtx* ctx, int* base);
+void* l2dbus_callbackPushObject(lua_State* L, const l2dbus_CallbackCtx* ctx, const void* key);
+int l2dbus_callbackInvoke(lua_State* L, const l2dbus_CallbackCtx* ctx, int nArgs,
+                        int nResults, const char* what);
+int l2dbus_callbackInvokeDetail(lua_State* L, const l2dbus_CallbackCtx* ctx,
+                        int nArgs, int nResults, const char* what,
+                        const char* detail);
+int l2dbus_callbackCall(lua_State* L, struct l2dbus_Context* modCtx, int nArgs,
+                        int nResults, const char* what, const char* detail);
+int l2dbus_callbackCallThunk(lua_State* L, struct l2dbus_Context* modCtx,
+                        int nArgs, int nResults, const char* what,
+                        const char* detail);
+void l2dbus_callbackEnd(lua_State* L, int base);
+
+void l2dbus_callbackEnterDbusDispatch(const l2dbus_CallbackCtx* ctx);
+void l2dbus_callbackLeaveDbusDispatch(const l2dbus_CallbackCtx* ctx);
+
 #endif /* Guard for L2DBUS_CALLBACK_H_ */
@@ -61,3 +61,32 @@ void luaL_setfuncs
 #endif
 
 
+/*
+ * Resumes a coroutine. On return the values yielded (or returned) by the
+ * coroutine are the only values on its stack.
+ */
+int
+l2dbus_resume
+    (
+    lua_State*  co,
+    lua_State*  from,
+    int         nArgs,
+    int*        nResults
+    )
+{
+    int status;
+
+#if !defined LUA_VERSION_NUM || LUA_VERSION_NUM==501
+    (void)from;
+    status = lua_resume(co, nArgs);
+    *nResults = lua_gettop(co);
+#elif LUA_VERSION_NUM < 504
+    status = lua_resume(co, from, nArgs);
+    *nResults = lua_gettop(co);
+#else
+    status = lua_resume(co, from, nArgs, nResults);
+#endif
+
+    return status;
+}
+
@@ -60,6 +60,8 @@ void luaL_setfuncs(lua_State* L, const luaL_Reg* l, int nup);
 
 #endif
 
+int l2dbus_resume(lua_State* co, lua_State* from, int nArgs, int* nResults);
+
 #define lua_boxpointer(L,u) \
     (*(void **)(lua_newuserdata(L, sizeof(void *))) = (u))
 
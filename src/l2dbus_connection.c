@@ -29,6 +29,7 @@
 #include "l2dbus_compat.h"
 #include "l2dbus_connection.h"
 #include "l2dbus_dispatcher.h"
+#include "l2dbus_context.h"
 #include "l2dbus_core.h"
 #include "l2dbus_object.h"
 #include "l2dbus_util.h"
@@ -38,7 +39,9 @@
 #include "l2dbus_message.h"
 #include "l2dbus_pendingcall.h"
 #include "l2dbus_match.h"
+#include "l2dbus_fallback.h"
 #include "l2dbus_serviceobject.h"
+#include "l2dbus_dbuscompat.h"
 
 /**
  L2DBUS Connection
@@ -131,7 +134,9 @@ l2dbus_openConnection
     {
         /* Reset the userdata structure */
         LIST_INIT(&connUd->matches);
+        LIST_INIT(&connUd->fallbacks);
         connUd->dispUdRef = LUA_NOREF;
+        l2dbus_objectIndexInit(&connUd->objIndex);
 
         connUd->conn = cdbus_connectionOpen(dispUd->disp, address,
                                             privConn, exitOnDisconnect);
@@ -145,6 +150,7 @@ l2dbus_openConnection
             /* Add a reference to the Dispatcher userdata */
             lua_pushvalue(L, 1 /* dispUd */);
             connUd->dispUdRef = luaL_ref(L, LUA_REGISTRYINDEX);
+            connUd->dispUd = dispUd;
 
             /* Add a (weak) mapping between the CDBUS connection and
              * the associated Lua userdata wrapper
@@ -240,7 +246,9 @@ l2dbus_openStandardConnection
     {
         /* Reset the userdata structure */
         LIST_INIT(&connUd->matches);
+        LIST_INIT(&connUd->fallbacks);
         connUd->dispUdRef = LUA_NOREF;
+        l2dbus_objectIndexInit(&connUd->objIndex);
 
         connUd->conn = cdbus_connectionOpenStandard(dispUd->disp, busType,
                                             privConn, exitOnDisconnect);
@@ -254,6 +262,7 @@ l2dbus_openStandardConnection
             /* Add a reference to the Dispatcher userdata */
             lua_pushvalue(L, 1 /* dispUd */);
             connUd->dispUdRef = luaL_ref(L, LUA_REGISTRYINDEX);
+            connUd->dispUd = dispUd;
 
             /* Add a (weak) mapping between the CDBUS connection and
              * the associated Lua userdata wrapper
@@ -773,6 +782,165 @@ l2dbus_connectionSendWithReplyAndBlock
 }
 
 
+/**
+ @function call
+ @within Connection
+
+ Sends a message and waits for the reply while continuing to run the
+ Dispatcher.
+
+ Unlike @{sendWithReplyAndBlock} timers, watches, signals and other
+ requests continue to be serviced while waiting for the reply. This
+ requires nested calls to be enabled on the Dispatcher with
+ @{l2dbus.Dispatcher.setCallNesting|setCallNesting}. The call behaves
+ exactly like @{sendWithReplyAndBlock} (e.g. nothing else is serviced)
+ when:
+
+ <ul>
+ <li>Nested calls aren't enabled on the Dispatcher</li>
+ <li>The maximum nesting depth has been reached</li>
+ <li>It's made from a handler called directly by the D-Bus library (an
+ @{l2dbus.Interface|Interface} handler or a
+ @{l2dbus.PendingCall|PendingCall} notification) which cannot re-enter
+ the main loop</li>
+ <li>It's made from a task (use @{l2dbus.PendingCall.await|await}
+ instead)</li>
+ </ul>
+
+ @tparam userdata conn The D-Bus connection object
+ @tparam userdata msg The D-Bus message to send
+ @tparam ?number timeout An optional timeout in milliseconds to wait for a
+ reply. Two special values are allowed as well:
+ @{l2dbus.Dbus.TIMEOUT_USE_DEFAULT|TIMEOUT_USE_DEFAULT}
+ and @{l2dbus.Dbus.TIMEOUT_INFINITE|TIMEOUT_INFINITE}. The default
+ value (if none is specified) is @{l2dbus.Dbus.TIMEOUT_USE_DEFAULT|TIMEOUT_USE_DEFAULT}.
+ @treturn userdata|nil The reply message or **nil** if there was an error. If
+ a D-Bus error message is received then **nil** is returned here and the
+ error name and message are returned in the next two parameters.
+ @treturn string|nil The error name (if any).
+ @treturn string|nil The error message (if any).
+ */
+static int
+l2dbus_connectionCall
+    (
+    lua_State*  L
+    )
+{
+    DBusError dbusError;
+    DBusMessage* replyMsg = NULL;
+    DBusPendingCall* pending = NULL;
+    l2dbus_Connection* connUd;
+    l2dbus_Message* msgUd;
+    l2dbus_Dispatcher* dispUd;
+    l2dbus_ServiceObject* heldObj = NULL;
+    l2dbus_Context* ctx;
+    cdbus_HResult rc = CDBUS_RESULT_SUCCESS;
+    int msecTimeout;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    connUd = (l2dbus_Connection*)luaL_checkudata(L, 1,
+                                            L2DBUS_CONNECTION_MTBL_NAME);
+    msgUd = (l2dbus_Message*)luaL_checkudata(L, 2, L2DBUS_MESSAGE_MTBL_NAME);
+    msecTimeout = luaL_optint(L, 3, DBUS_TIMEOUT_USE_DEFAULT);
+    dispUd = connUd->dispUd;
+    ctx = l2dbus_contextGet(L);
+
+    if ( (0U == dispUd->maxCallDepth) || (0 < ctx->dbusDispatchDepth) ||
+        (NULL != ctx->curTask) )
+    {
+        return l2dbus_connectionSendWithReplyAndBlock(L);
+    }
+    else if ( dispUd->callDepth >= dispUd->maxCallDepth )
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_WARN,
+            "Nested call depth (%u) reached, blocking for reply",
+            dispUd->callDepth));
+        return l2dbus_connectionSendWithReplyAndBlock(L);
+    }
+
+    L2DBUS_TRACE_MSG((L2DBUS_TRC_TRACE, msgUd->msg));
+    if ( !dbus_connection_send_with_reply(cdbus_connectionGetDBus(connUd->conn),
+        msgUd->msg, &pending, msecTimeout) )
+    {
+        lua_pushnil(L);
+        lua_pushstring(L, DBUS_ERROR_NO_MEMORY);
+        lua_pushstring(L, "Failed to send message");
+        return 3;
+    }
+    else if ( NULL == pending )
+    {
+        lua_pushnil(L);
+        lua_pushstring(L, DBUS_ERROR_DISCONNECTED);
+        lua_pushstring(L, "Connection is closed");
+        return 3;
+    }
+
+    /* Keep the handler waiting here from being re-entered */
+    if ( dispUd->holdObjects && (NULL != dispUd->activeObject) )
+    {
+        heldObj = dispUd->activeObject;
+        l2dbus_serviceObjectHoldRequests(heldObj);
+    }
+
+    ++dispUd->callDepth;
+    while ( !dbus_pending_call_get_completed(pending) && CDBUS_SUCCEEDED(rc) )
+    {
+        rc = cdbus_dispatcherRun(dispUd->disp, CDBUS_RUN_ONCE);
+    }
+    --dispUd->callDepth;
+
+    if ( NULL != heldObj )
+    {
+        l2dbus_serviceObjectReleaseRequests(L, heldObj, dispUd);
+    }
+
+    if ( !dbus_pending_call_get_completed(pending) )
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_ERROR,
+            "Failed to run dispatcher (0x%X), blocking for reply", rc));
+        dbus_pending_call_block(pending);
+    }
+    replyMsg = dbus_pending_call_steal_reply(pending);
+    dbus_pending_call_unref(pending);
+
+    if ( NULL == replyMsg )
+    {
+        lua_pushnil(L);
+        lua_pushstring(L, DBUS_ERROR_NO_REPLY);
+        lua_pushstring(L, "No reply received");
+    }
+    else if ( DBUS_MESSAGE_TYPE_ERROR == dbus_message_get_type(replyMsg) )
+    {
+        dbus_error_init(&dbusError);
+        dbus_set_error_from_message(&dbusError, replyMsg);
+        dbus_message_unref(replyMsg);
+        lua_pushnil(L);
+        lua_pushstring(L, (NULL != dbusError.name) ? dbusError.name : DBUS_ERROR_FAILED);
+        lua_pushstring(L, (NULL != dbusError.message) ? dbusError.message : "");
+        dbus_error_free(&dbusError);
+    }
+    else if ( NULL == l2dbus_messageWrap(L, replyMsg, L2DBUS_FALSE) )
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_ERROR, "Failed to wrap D-Bus reply message (serial #=%d)",
+                        dbus_message_get_serial(replyMsg)));
+        dbus_message_unref(replyMsg);
+        lua_pushstring(L, DBUS_ERROR_NO_MEMORY);
+        lua_pushstring(L, "Failed to bind to reply message");
+    }
+    else
+    {
+        /* No error name or message */
+        lua_pushnil(L);
+        lua_pushnil(L);
+    }
+
+    /* Message, error name (if any), message (if any) */
+    return 3;
+}
+
+
 /**
  @function flush
  @within Connection
@@ -959,6 +1127,218 @@ l2dbus_connectionUnregisterMatch
 }
 
 
+/**
+ @function registerFallback
+ @within Connection
+
+ Registers a handler for a whole subtree of object paths.
+
+ Instead of registering a @{l2dbus.ServiceObject|service object} for
+ every object of a large (or dynamic) tree, a single handler can serve
+ the root path and every path below it. Objects registered at a more
+ specific path still receive their own messages.
+
+ The message handler should have the following prototype:
+     function onMessage(conn, message, relPath, userToken)
+
+ where *relPath* is the path of the message relative to the root of the
+ subtree without a leading '/' (e.g. "dev3/track7") and is empty for the
+ root itself. The handler returns one of the
+ @{l2dbus.Dbus.HANDLER_RESULT_HANDLED|HANDLER_RESULT_xxx} values.
+
+ If an introspection function is provided, Introspect requests are
+ answered with the XML it returns for the path. It's only called when a
+ client introspects an object and should have the following prototype:
+     function onIntrospect(conn, relPath, userToken)
+
+ If it returns anything but a string the request is passed to the message
+ handler instead.
+
+ Messages for the subtree count against the dispatch
+ @{l2dbus.Dispatcher.setBudget|budget} like those of service objects and
+ are queued by the @{l2dbus.Dispatcher.setTypePriority|priority} of
+ their message type once it's exhausted. A method call the handler
+ doesn't handle after being queued is answered with an UnknownMethod
+ error.
+
+ @tparam userdata conn The D-Bus connection object
+ @tparam string path The root object path of the subtree
+ @tparam func handler The message handler for the subtree
+ @tparam ?func|nil introspect Optional function returning the
+ introspection XML of a path
+ @tparam ?any userToken Optional user defined data that is delivered to
+ the handler and introspection function
+ @treturn lightuserdata Returns a subtree handle that can be used to
+ @{unregisterFallback|unregister} the handler.
+ */
+static int
+l2dbus_connectionRegisterFallback
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Connection* connUd;
+    l2dbus_Fallback* fallback;
+    l2dbus_Context* ctx;
+    int introspectIdx = L2DBUS_CALLBACK_NOREF_NEEDED;
+    int userIdx = L2DBUS_CALLBACK_NOREF_NEEDED;
+    const char* path;
+    const char* errReason = "";
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+    connUd = (l2dbus_Connection*)luaL_checkudata(L, 1,
+                                                L2DBUS_CONNECTION_MTBL_NAME);
+    path = luaL_checkstring(L, 2);
+    if ( !l2dbus_validatePath(path) )
+    {
+        luaL_argerror(L, 2, "invalid D-Bus object path");
+    }
+    luaL_checktype(L, 3, LUA_TFUNCTION);
+
+    if ( !lua_isnoneornil(L, 4) )
+    {
+        luaL_checktype(L, 4, LUA_TFUNCTION);
+        introspectIdx = 4;
+    }
+
+    if ( 4 < lua_gettop(L) )
+    {
+        userIdx = 5;
+    }
+
+    fallback = l2dbus_newFallback(L, 1 /*conn*/, path, 3 /*callback*/,
+                                introspectIdx, userIdx, &errReason);
+    if ( NULL == fallback )
+    {
+        luaL_error(L, "%s", errReason);
+    }
+
+    LIST_INSERT_HEAD(&connUd->fallbacks, fallback, link);
+
+    /* The child nodes of cached introspection data may have changed */
+    ctx = l2dbus_contextGet(L);
+    ctx->introspectTreeStamp = ++ctx->introspectStamp;
+
+    lua_pushlightuserdata(L, fallback);
+
+    return 1;
+}
+
+
+/**
+ @function unregisterFallback
+ @within Connection
+
+ Unregisters the handler of a subtree of object paths.
+
+ @tparam userdata conn The D-Bus connection object
+ @tparam lightuserdata handle The subtree handle returned by
+ @{registerFallback}
+ @treturn bool Returns **true** if the handler is unregistered and
+ **false** if the handle is unknown.
+ */
+static int
+l2dbus_connectionUnregisterFallback
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Connection* connUd;
+    l2dbus_Fallback* fallback;
+    l2dbus_Fallback* hnd;
+    l2dbus_Context* ctx;
+    l2dbus_Bool isUnregistered = L2DBUS_FALSE;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+    connUd = (l2dbus_Connection*)luaL_checkudata(L, 1,
+                                                L2DBUS_CONNECTION_MTBL_NAME);
+
+    luaL_checktype(L, 2, LUA_TLIGHTUSERDATA);
+    hnd = (l2dbus_Fallback*)lua_touserdata(L, 2);
+
+    LIST_FOREACH(fallback, &connUd->fallbacks, link)
+    {
+        if ( hnd == fallback )
+        {
+            LIST_REMOVE(fallback, link);
+            l2dbus_disposeFallback(L, fallback);
+            isUnregistered = L2DBUS_TRUE;
+            break;
+        }
+    }
+
+    if ( isUnregistered )
+    {
+        /* The child nodes of cached introspection data may have changed */
+        ctx = l2dbus_contextGet(L);
+        ctx->introspectTreeStamp = ++ctx->introspectStamp;
+    }
+
+    lua_pushboolean(L, isUnregistered);
+
+    return 1;
+}
+
+
+/**
+ @function setMatchPriority
+ @within Connection
+
+ Sets the dispatch priority class of messages delivered to a match handler.
+
+ The priority class determines the order in which messages are delivered
+ when the Dispatcher has deferred their delivery because its dispatch
+ @{l2dbus.Dispatcher.setBudget|budget} was exhausted. By default the
+ priority class is derived from the
+ @{l2dbus.Dispatcher.setTypePriority|type} of the message.
+
+ @tparam userdata conn The D-Bus connection object
+ @tparam lightuserdata handle The match rule handle
+ @tparam ?number priority The priority class (e.g.
+ @{l2dbus.Dispatcher.PRIORITY_LOW|PRIORITY_LOW}) or **nil** for the
+ @{l2dbus.Dispatcher.PRIORITY_DEFAULT|default}.
+ @treturn bool Returns **true** if the priority is set or **false** if
+ the handle is unknown.
+ */
+static int
+l2dbus_connectionSetMatchPriority
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Connection* connUd;
+    l2dbus_Match* match;
+    l2dbus_Match* hnd;
+    int priority;
+    l2dbus_Bool isSet = L2DBUS_FALSE;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+    connUd = (l2dbus_Connection*)luaL_checkudata(L, 1,
+                                                L2DBUS_CONNECTION_MTBL_NAME);
+
+    luaL_checktype(L, 2, LUA_TLIGHTUSERDATA);
+    hnd = (l2dbus_Match*)lua_touserdata(L, 2);
+    priority = l2dbus_checkDispatchPriority(L, 3);
+
+    LIST_FOREACH(match, &connUd->matches, link)
+    {
+        if ( hnd == match )
+        {
+            match->priority = priority;
+            isSet = L2DBUS_TRUE;
+            break;
+        }
+    }
+
+    lua_pushboolean(L, isSet);
+
+    return 1;
+}
+
+
 /**
  @function registerServiceObject
  @within Connection
@@ -984,6 +1364,8 @@ l2dbus_connectionRegisterObject
 {
     l2dbus_Connection* connUd;
     l2dbus_ServiceObject* svcObjUd;
+    l2dbus_Context* ctx;
+    l2dbus_Bool isRegistered;
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
@@ -992,7 +1374,15 @@ l2dbus_connectionRegisterObject
     svcObjUd = (l2dbus_ServiceObject*)luaL_checkudata(L, 2,
                                                 L2DBUS_SERVICE_OBJECT_MTBL_NAME);
 
-    lua_pushboolean(L, cdbus_connectionRegisterObject(connUd->conn, svcObjUd->obj));
+    isRegistered = cdbus_connectionRegisterObject(connUd->conn, svcObjUd->obj);
+    if ( isRegistered )
+    {
+        /* The child nodes of cached introspection data may have changed */
+        ctx = l2dbus_contextGet(L);
+        ctx->introspectTreeStamp = ++ctx->introspectStamp;
+        l2dbus_objectIndexAdd(L, connUd, svcObjUd);
+    }
+    lua_pushboolean(L, isRegistered);
 
     return 1;
 }
@@ -1020,6 +1410,8 @@ l2dbus_connectionUnregisterObject
 {
     l2dbus_Connection* connUd;
     l2dbus_ServiceObject* svcObjUd;
+    l2dbus_Context* ctx;
+    l2dbus_Bool isUnregistered;
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
@@ -1028,8 +1420,16 @@ l2dbus_connectionUnregisterObject
 
     svcObjUd = (l2dbus_ServiceObject*)luaL_checkudata(L, 2,
                                                 L2DBUS_SERVICE_OBJECT_MTBL_NAME);
-    lua_pushboolean(L, cdbus_connectionUnregisterObject(connUd->conn,
-                       cdbus_objectGetPath(svcObjUd->obj)));
+    isUnregistered = cdbus_connectionUnregisterObject(connUd->conn,
+                                        cdbus_objectGetPath(svcObjUd->obj));
+    if ( isUnregistered )
+    {
+        /* The child nodes of cached introspection data may have changed */
+        ctx = l2dbus_contextGet(L);
+        ctx->introspectTreeStamp = ++ctx->introspectStamp;
+        l2dbus_objectIndexRemove(L, connUd, svcObjUd);
+    }
+    lua_pushboolean(L, isUnregistered);
 
     return 1;
 }
@@ -1232,6 +1632,8 @@ l2dbus_connectionDispose
     cdbus_HResult rc;
     l2dbus_Match* match;
     l2dbus_Match* next;
+    l2dbus_Fallback* fallback;
+    l2dbus_Fallback* nextFallback;
 
     l2dbus_Connection* ud = (l2dbus_Connection*)luaL_checkudata(L, -1,
                                         L2DBUS_CONNECTION_MTBL_NAME);
@@ -1247,6 +1649,18 @@ l2dbus_connectionDispose
         l2dbus_disposeMatch(L, match);
     }
 
+    /* Loop through any subtree handlers we have and dispose of them */
+    for ( fallback = LIST_FIRST(&ud->fallbacks);
+        fallback != LIST_END(&ud->fallbacks);
+        fallback = nextFallback )
+    {
+        nextFallback = LIST_NEXT(fallback, link);
+        l2dbus_disposeFallback(L, fallback);
+    }
+
+    /* Registered service objects forget the connection */
+    l2dbus_objectIndexFree(ud);
+
     if ( ud->conn != NULL )
     {
         /* Remove the (weak) association between
@@ -1292,8 +1706,12 @@ static const luaL_Reg l2dbus_connMetaTable[] = {
     {"send", l2dbus_connectionSend},
     {"sendWithReply", l2dbus_connectionSendWithReply},
     {"sendWithReplyAndBlock", l2dbus_connectionSendWithReplyAndBlock},
+    {"call", l2dbus_connectionCall},
     {"registerMatch", l2dbus_connectionRegisterMatch},
     {"unregisterMatch", l2dbus_connectionUnregisterMatch},
+    {"registerFallback", l2dbus_connectionRegisterFallback},
+    {"unregisterFallback", l2dbus_connectionUnregisterFallback},
+    {"setMatchPriority", l2dbus_connectionSetMatchPriority},
     {"registerServiceObject", l2dbus_connectionRegisterObject},
     {"unregisterServiceObject", l2dbus_connectionUnregisterObject},
     {"getMaxMessageSize", l2dbus_connectionGetMaxMessageSize},
@@ -30,19 +30,27 @@
 #include "lua.h"
 #include "queue.h"
 #include "l2dbus_match.h"
+#include "l2dbus_fallback.h"
 #include "l2dbus_callback.h"
+#include "l2dbus_objectmanager.h"
 
 /* Forward declarations */
 struct cdbus_Connection;
+struct l2dbus_Dispatcher;
 
 typedef struct l2dbus_Connection
 {
     struct cdbus_Connection*    conn;
     int                         dispUdRef;
+    struct l2dbus_Dispatcher*   dispUd;
     l2dbus_CallbackCtx          cbCtx;
     l2dbus_Match*               nextMatch;
     LIST_HEAD(l2dbus_MatchHead,
                   l2dbus_Match) matches;
+    LIST_HEAD(l2dbus_FallbackHead,
+                  l2dbus_Fallback) fallbacks;
+    /* Registered service objects ordered by path */
+    l2dbus_ObjectIndex          objIndex;
 } l2dbus_Connection;
 
 int l2dbus_newConnection(lua_State* L);
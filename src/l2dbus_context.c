@@ -0,0 +1,116 @@
+/*===========================================================================
+ *
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_context.c
+ * @author         Glenn Schmottlach
+ * @brief          Implementation of the per Lua state module context.
+ *===========================================================================
+ */
+#include "lauxlib.h"
+#include "l2dbus_compat.h"
+#include "l2dbus_context.h"
+#include "l2dbus_defs.h"
+
+/* The registry key used to anchor the module context */
+#define L2DBUS_CONTEXT_REGISTRY_KEY     L2DBUS_META_TABLE_PREFIX "context"
+
+
+/**
+ * @brief Creates (or returns the existing) module context for the Lua state.
+ *
+ * The context is a Lua userdata stored in the registry of the Lua state
+ * so it lives as long as the Lua state itself. Since it is never
+ * finalized it remains valid while other module userdata are being
+ * collected when the Lua state is closed.
+ *
+ * @param [in] L    The Lua state.
+ * @return The module context associated with the Lua state.
+ */
+l2dbus_Context*
+l2dbus_contextNew
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Context* ctx = l2dbus_contextGet(L);
+
+    if ( NULL == ctx )
+    {
+        ctx = (l2dbus_Context*)lua_newuserdata(L, sizeof(*ctx));
+        ctx->cbThread = NULL;
+        ctx->cbThreadRef = LUA_NOREF;
+        ctx->objRegRef = LUA_NOREF;
+        ctx->finalizerRef = LUA_NOREF;
+        ctx->profiler = NULL;
+        ctx->profilerRef = LUA_NOREF;
+        ctx->cbDepth = 0;
+        ctx->curTask = NULL;
+        ctx->dbusDispatchDepth = 0;
+        ctx->introspectStamp = 0U;
+        ctx->introspectTreeStamp = 0U;
+        ctx->replyIdle = NULL;
+        ctx->replyPoolSize = 0;
+        ctx->replyPoolMax = 0;
+        ctx->replyCtxCreated = 0U;
+        ctx->replyCtxReused = 0U;
+        ctx->descInternRef = LUA_NOREF;
+        ctx->gcStepping = 0;
+        ctx->gcStopCount = 0;
+        ctx->gcSentinelUsers = 0;
+        ctx->gcCyclesIdle = 0U;
+        ctx->gcCyclesCallback = 0U;
+        ctx->gcCyclesOther = 0U;
+        lua_setfield(L, LUA_REGISTRYINDEX, L2DBUS_CONTEXT_REGISTRY_KEY);
+    }
+
+    return ctx;
+}
+
+
+/**
+ * @brief Retrieves the module context associated with the Lua state.
+ *
+ * Any thread (coroutine) of a Lua state shares the same registry
+ * so the same context is returned for all of them.
+ *
+ * @param [in] L    The Lua state.
+ * @return The module context or NULL if one has not been created.
+ */
+l2dbus_Context*
+l2dbus_contextGet
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Context* ctx;
+
+    lua_getfield(L, LUA_REGISTRYINDEX, L2DBUS_CONTEXT_REGISTRY_KEY);
+    ctx = (l2dbus_Context*)lua_touserdata(L, -1);
+    lua_pop(L, 1);
+
+    return ctx;
+}
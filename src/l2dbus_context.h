@@ -0,0 +1,110 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_context.h
+ * @author         Glenn Schmottlach
+ * @brief          Definition of the per Lua state module context.
+ *===========================================================================
+ */
+
+#ifndef L2DBUS_CONTEXT_H_
+#define L2DBUS_CONTEXT_H_
+
+#include "lua.h"
+
+/* Forward declarations */
+struct l2dbus_Profiler;
+struct l2dbus_Task;
+struct l2dbus_ReplyContext;
+
+/*
+ * All of the state needed by the module for a given Lua state (VM). The
+ * context is allocated as a Lua userdata and anchored in the registry of
+ * the Lua state so that independent Lua states (possibly running on
+ * different OS threads) never share module state.
+ */
+typedef struct l2dbus_Context
+{
+    /* The Lua thread used to run all callbacks */
+    lua_State*  cbThread;
+    int         cbThreadRef;
+
+    /* Reference to the weak object registry table */
+    int         objRegRef;
+
+    /* Reference to the module finalizer userdata */
+    int         finalizerRef;
+
+    /* The callback profiler (NULL until profiling is first enabled) */
+    struct l2dbus_Profiler* profiler;
+    int         profilerRef;
+
+    /* Number of calls into Lua handlers currently in progress */
+    int         cbDepth;
+
+    /* The scheduler task currently running (NULL if none) */
+    struct l2dbus_Task* curTask;
+
+    /* Number of handlers called from within the D-Bus library's message
+     * dispatch. Nested loop iterations aren't possible while non-zero.
+     */
+    int         dbusDispatchDepth;
+
+    /* Stamps for invalidating cached introspection data. The counter is
+     * advanced whenever an interface or object changes and the tree
+     * stamp records the last time objects were (un)registered.
+     */
+    unsigned long introspectStamp;
+    unsigned long introspectTreeStamp;
+
+    /* Idle reply context states waiting to be re-used (at most
+     * replyPoolMax of them)
+     */
+    struct l2dbus_ReplyContext* replyIdle;
+    int         replyPoolSize;
+    int         replyPoolMax;
+    unsigned long replyCtxCreated;
+    unsigned long replyCtxReused;
+
+    /* Interned interface descriptors by name (a weak-valued Lua table) */
+    int         descInternRef;
+
+    /* Garbage collection scheduled by the dispatchers */
+    int         gcStepping;
+    int         gcStopCount;
+    int         gcSentinelUsers;
+    /* Collection cycles completed during idle steps, callbacks or elsewhere */
+    unsigned long gcCyclesIdle;
+    unsigned long gcCyclesCallback;
+    unsigned long gcCyclesOther;
+
+} l2dbus_Context;
+
+l2dbus_Context* l2dbus_contextNew(lua_State* L);
+l2dbus_Context* l2dbus_contextGet(lua_State* L);
+
+#endif /* Guard for L2DBUS_CONTEXT_H_ */
@@ -31,6 +31,7 @@
  *===========================================================================
  */
 #include <stdlib.h>
+#include <pthread.h>
 #include "lua.h"
 #include "cdbus/cdbus.h"
 #include "l2dbus_compat.h"
@@ -43,16 +44,25 @@
 #include "l2dbus_transcode.h"
 #include "l2dbus_message.h"
 #include "l2dbus_watch.h"
+#include "l2dbus_stream.h"
+#include "l2dbus_profile.h"
+#include "l2dbus_scheduler.h"
 #include "l2dbus_timeout.h"
 #include "l2dbus_trace.h"
 #include "l2dbus_util.h"
 #include "l2dbus_callback.h"
+#include "l2dbus_context.h"
 #include "l2dbus_int64.h"
 #include "l2dbus_uint64.h"
 #include "l2dbus_pendingcall.h"
+#include "l2dbus_replycontext.h"
 #include "l2dbus_serviceobject.h"
 #include "l2dbus_interface.h"
+#include "l2dbus_interfacedesc.h"
 #include "l2dbus_introspection.h"
+#include "l2dbus_properties.h"
+#include "l2dbus_objectmanager.h"
+#include "l2dbus_signalemitter.h"
 
 /**
 The low-level L2DBUS core module.
@@ -72,11 +82,16 @@ The following namespaces are created when the *l2dbus* module is loaded:
 <li>l2dbus.Dispatcher</li>
 <li>l2dbus.Int64</li>
 <li>l2dbus.Interface</li>
+<li>l2dbus.InterfaceDescriptor</li>
 <li>l2dbus.Introspection</li>
 <li>l2dbus.Match</li>
 <li>l2dbus.Message</li>
+<li>l2dbus.ObjectManager</li>
 <li>l2dbus.PendingCall</li>
+<li>l2dbus.Properties</li>
+<li>l2dbus.ReplyContext</li>
 <li>l2dbus.ServiceObject</li>
+<li>l2dbus.SignalEmitter</li>
 <li>l2dbus.Timeout</li>
 <li>l2dbus.Trace</li>
 <li>l2dbus.Uint64</li>
@@ -96,16 +111,44 @@ The following namespaces are created when the *l2dbus* module is loaded:
 #define L2DBUS_SHUTDOWN_CDBUS
 
 
+/*
+ * CDBUS (and D-Bus) are process-wide libraries whereas all of the module
+ * state is kept per Lua state (see l2dbus_context.h). Since several Lua
+ * states may load the module concurrently from different OS threads the
+ * initialization/shutdown of CDBUS must be reference counted.
+ */
+static pthread_mutex_t gCdbusInitLock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned gCdbusInitCount = 0U;
+
+
 /**
- * @brief Used to track the lifetime of the module
+ * @brief Initializes the underlying CDBUS library.
  *
- * Initially the module is not initialized until it's
- * loaded by Lua. This variable references a global
- * Lua userdata item that should be GC'ed when the
- * module is unloaded or the VM shuts down.
+ * Only the first Lua state to load the module actually initializes CDBUS.
  *
+ * @return The CDBUS result code.
  */
-static l2dbus_Bool gModuleFinalizerRef = LUA_NOREF;
+static cdbus_HResult
+l2dbus_initializeCdbus
+    (
+    void
+    )
+{
+    cdbus_HResult rc = CDBUS_RESULT_SUCCESS;
+
+    pthread_mutex_lock(&gCdbusInitLock);
+    if ( 0U == gCdbusInitCount )
+    {
+        rc = cdbus_initialize();
+    }
+    if ( !CDBUS_FAILED(rc) )
+    {
+        ++gCdbusInitCount;
+    }
+    pthread_mutex_unlock(&gCdbusInitLock);
+
+    return rc;
+}
 
 
 /**
@@ -129,13 +172,20 @@ l2dbus_shutdownCdbus
      */
 #ifdef L2DBUS_SHUTDOWN_CDBUS
     cdbus_HResult rc;
-    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "Shutting CDBUS at exit"));
-    rc = cdbus_shutdown();
-    if ( CDBUS_FAILED(rc) )
+
+    pthread_mutex_lock(&gCdbusInitLock);
+    /* Only the last Lua state using CDBUS can shut it down */
+    if ( (0U < gCdbusInitCount) && (0U == --gCdbusInitCount) )
     {
-        /* What else should we do? */
-        L2DBUS_TRACE((L2DBUS_TRC_ERROR, "Failed shutting down CDBUS: 0x%X", rc));
+        L2DBUS_TRACE((L2DBUS_TRC_TRACE, "Shutting CDBUS at exit"));
+        rc = cdbus_shutdown();
+        if ( CDBUS_FAILED(rc) )
+        {
+            /* What else should we do? */
+            L2DBUS_TRACE((L2DBUS_TRC_ERROR, "Failed shutting down CDBUS: 0x%X", rc));
+        }
     }
+    pthread_mutex_unlock(&gCdbusInitLock);
 #endif
 }
 
@@ -158,10 +208,15 @@ l2dbus_shutdown
     lua_State*  L
     )
 {
+    l2dbus_Context* ctx = l2dbus_contextGet(L);
+
     L2DBUS_TRACE((L2DBUS_TRC_TRACE, "Shutting down l2dbus_core"));
 
-    l2dbus_moduleFinalizerUnref(L, gModuleFinalizerRef);
-    gModuleFinalizerRef = LUA_NOREF;
+    if ( NULL != ctx )
+    {
+        l2dbus_moduleFinalizerUnref(L, ctx->finalizerRef);
+        ctx->finalizerRef = LUA_NOREF;
+    }
 
     return 0;
 }
@@ -320,13 +375,17 @@ l2dbus_moduleFinalizerRef
     struct lua_State*  L
     )
 {
-    lua_rawgeti(L, LUA_REGISTRYINDEX, gModuleFinalizerRef);
+    l2dbus_Context* ctx = l2dbus_contextGet(L);
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX,
+                (NULL != ctx) ? ctx->finalizerRef : LUA_NOREF);
     if ( LUA_TUSERDATA == lua_type(L, -1) )
     {
         return luaL_ref(L, LUA_REGISTRYINDEX);
     }
     else
     {
+        lua_pop(L, 1);
         L2DBUS_TRACE((L2DBUS_TRC_ERROR,
             "Trying to reference the module finalizer after it's been released"));
         return LUA_NOREF;
@@ -380,7 +439,8 @@ l2dbus_moduleFinalizerDispose
      * in case the Lua state associated with the callback mechanism is
      * needed to cleanly shutdown CDBUS.
      */
-    l2dbus_callbackShutdown(L);
+    l2dbus_callbackShutdown(L, l2dbus_contextGet(L));
+    l2dbus_replyContextClosePool(l2dbus_contextGet(L));
     return 0;
 }
 
@@ -438,7 +498,9 @@ l2dbus_checkModuleInitialized
     struct lua_State*   L
     )
 {
-    if ( gModuleFinalizerRef == LUA_NOREF )
+    l2dbus_Context* ctx = l2dbus_contextGet(L);
+
+    if ( (NULL == ctx) || (ctx->finalizerRef == LUA_NOREF) )
     {
         luaL_error(L, "l2dbus core module is not initialized!");
     }
@@ -451,6 +513,8 @@ luaopen_l2dbus_core
     lua_State* L
     )
 {
+    l2dbus_Context* ctx;
+
     luaL_checkversion(L);
 
     /* Set the default trace level */
@@ -469,12 +533,17 @@ luaopen_l2dbus_core
                         );
 #endif
 
-    cdbus_HResult rc = cdbus_initialize();
+    cdbus_HResult rc = l2dbus_initializeCdbus();
     if ( CDBUS_FAILED(rc) )
     {
         l2dbus_cdbusError(L, rc, "CDBUS initialization failure");
     }
 
+    /* All module state is held by a context anchored in this
+     * Lua state's registry.
+     */
+    ctx = l2dbus_contextNew(L);
+
     /* Create an userdata type used to shutdown (finalize) the module */
     l2dbus_openModuleFinalizer(L);
 
@@ -484,10 +553,13 @@ luaopen_l2dbus_core
     l2dbus_objectRegistryNew(L);
 
     /* Configure the callback related routines */
-    l2dbus_callbackConfigure(L);
+    l2dbus_callbackConfigure(L, ctx);
 
     luaL_newlib(L, l2dbus_coreMetaTable);
 
+    /* Adds spawn, sleep, awaitAll, etc... */
+    l2dbus_openScheduler(L);
+
     l2dbus_openTrace(L);
     lua_setfield(L, -2, "Trace");
 
@@ -502,6 +574,9 @@ luaopen_l2dbus_core
      * so there is no need to register a table
      */
 
+    l2dbus_openReplyContext(L);
+    lua_setfield(L, -2, "ReplyContext");
+
     l2dbus_openInt64(L);
     lua_setfield(L, -2, "Int64");
 
@@ -517,6 +592,12 @@ luaopen_l2dbus_core
     l2dbus_openWatch(L);
     lua_setfield(L, -2, "Watch");
 
+    l2dbus_openStream(L);
+    lua_setfield(L, -2, "Stream");
+
+    l2dbus_openProfiler(L);
+    lua_setfield(L, -2, "Profiler");
+
     l2dbus_openMessage(L);
     lua_setfield(L, -2, "Message");;
 
@@ -529,16 +610,28 @@ luaopen_l2dbus_core
     l2dbus_openInterface(L);
     lua_setfield(L, -2, "Interface");
 
+    l2dbus_openInterfaceDescriptor(L);
+    lua_setfield(L, -2, "InterfaceDescriptor");
+
 
     l2dbus_openIntrospection(L);
     lua_setfield(L, -2, "Introspection");
 
+    l2dbus_openProperties(L);
+    lua_setfield(L, -2, "Properties");
+
+    l2dbus_openObjectManager(L);
+    lua_setfield(L, -2, "ObjectManager");
+
+    l2dbus_openSignalEmitter(L);
+    lua_setfield(L, -2, "SignalEmitter");
+
 
     /* The module has been successfully initialized */
     l2dbus_objectNew(L, 0, L2DBUS_MODULE_FINALIZER_TYPE_ID);
     L2DBUS_TRACE((L2DBUS_TRC_INFO, "Created module finalizer instance (userdata=%p)",
                 lua_touserdata(L, -1)));
-    gModuleFinalizerRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    ctx->finalizerRef = luaL_ref(L, LUA_REGISTRYINDEX);
 
     return 1;
 }
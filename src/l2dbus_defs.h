@@ -34,5 +34,14 @@
 #define L2DBUS_META_TYPE_ID_FIELD   "__typeId"
 #define L2DBUS_META_TYPE_NAME_FIELD "__type"
 
+/* Storage class for state that must be private to each OS thread */
+#if defined(__GNUC__)
+#define L2DBUS_THREAD_LOCAL __thread
+#elif (__STDC_VERSION__ >= 201112L)
+#define L2DBUS_THREAD_LOCAL _Thread_local
+#else
+#define L2DBUS_THREAD_LOCAL
+#endif
+
 
 #endif /* Guard for L2DBUS_DEFS_H_ */
@@ -31,6 +31,8 @@
  *===========================================================================
  */
 #include <stdlib.h>
+#include <assert.h>
+#include "dbus/dbus.h"
 #include "cdbus/cdbus.h"
 #include "l2dbus_alloc.h"
 #include "l2dbus_compat.h"
@@ -42,218 +44,2041 @@
 #include "l2dbus_debug.h"
 #include "l2dbus_types.h"
 #include "l2dbus_callback.h"
+#include "l2dbus_context.h"
 #include "l2dbus_main-loop.h"
+#include "l2dbus_timerwheel.h"
+#include "l2dbus_watch.h"
+
+/* Default number of times a lower priority class can be passed over */
+#define L2DBUS_DISPATCH_STARVATION_LIMIT    (8U)
+
+/* Default interval (msec) at which idle garbage collection is attempted */
+#define L2DBUS_GC_STEP_INTERVAL             (10)
 
 /**
  The L2DBUS Event Dispatcher Object
 
- This namespace provides a constructor and methods for manipulating the
- D-Bus event Dispatcher object. A Dispatcher is responsible for
- running the event loop that detects incoming D-Bus messages and
- timeouts and also dispatches outgoing messages and signals.
- @namespace l2dbus.Dispatcher
+ This namespace provides a constructor and methods for manipulating the
+ D-Bus event Dispatcher object. A Dispatcher is responsible for
+ running the event loop that detects incoming D-Bus messages and
+ timeouts and also dispatches outgoing messages and signals.
+ @namespace l2dbus.Dispatcher
+ */
+
+
+/*
+ * Data handed to CDBUS and released when the dispatcher is finalized. The
+ * module context identifies the Lua state (registry) holding the reference
+ * to the main loop.
+ */
+typedef struct l2dbus_DispatcherLoopRef
+{
+    l2dbus_Context* modCtx;
+    int             loopRef;
+} l2dbus_DispatcherLoopRef;
+
+
+/*
+ * This function is called when the *last* reference to an underlying
+ * CDBUS dispatcher is called. It's only called in the case when a "foreign"
+ * libev loop is being utilized (e.g. we don't own it but it's owned by
+ * another module like the Lua libev binding).
+ */
+static void
+l2dbus_dispatcherFinalized
+    (
+    void*   data
+    )
+{
+    l2dbus_DispatcherLoopRef* loopRef = (l2dbus_DispatcherLoopRef*)data;
+    if ( NULL != loopRef )
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_TRACE, "Unreferencing the foreign main loop"));
+        luaL_unref(loopRef->modCtx->cbThread, LUA_REGISTRYINDEX,
+                    loopRef->loopRef);
+        l2dbus_free(loopRef);
+    }
+}
+
+
+/*
+ * Returns true if the budget of the current dispatch slice has been used up.
+ */
+static l2dbus_Bool
+l2dbus_dispatcherSliceExhausted
+    (
+    l2dbus_Dispatcher*  dispUd
+    )
+{
+    if ( (0U != dispUd->maxMessages) &&
+        (dispUd->sliceCount >= dispUd->maxMessages) )
+    {
+        return L2DBUS_TRUE;
+    }
+
+    if ( (0.0 < dispUd->maxMsec) &&
+        ((l2dbus_getMonotonicTime() - dispUd->sliceStart) >= dispUd->maxMsec) )
+    {
+        return L2DBUS_TRUE;
+    }
+
+    return L2DBUS_FALSE;
+}
+
+
+/*
+ * Starts a new dispatch slice. The slice ends when the (zero length) slice
+ * timeout fires on the next iteration of the main loop.
+ */
+static void
+l2dbus_dispatcherBeginSlice
+    (
+    l2dbus_Dispatcher*  dispUd
+    )
+{
+    cdbus_HResult rc;
+
+    dispUd->sliceActive = L2DBUS_TRUE;
+    dispUd->sliceCount = 0U;
+    dispUd->sliceStart = l2dbus_getMonotonicTime();
+
+    /* A one-shot timeout may still report that it's enabled after
+     * it has expired so explicitly re-arm it.
+     */
+    cdbus_timeoutEnable(dispUd->sliceTimeout, CDBUS_FALSE);
+    rc = cdbus_timeoutEnable(dispUd->sliceTimeout, CDBUS_TRUE);
+    if ( CDBUS_FAILED(rc) )
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_ERROR,
+            "Failed to arm dispatch slice timeout (0x%X)", rc));
+    }
+}
+
+
+/*
+ * Releases the resources held by a deferred dispatch item.
+ */
+static void
+l2dbus_dispatcherReleaseItem
+    (
+    lua_State*              L,
+    l2dbus_DispatchItem*    item
+    )
+{
+    luaL_unref(L, LUA_REGISTRYINDEX, item->targetRef);
+    luaL_unref(L, LUA_REGISTRYINDEX, item->connRef);
+    if ( NULL != item->msg )
+    {
+        dbus_message_unref(item->msg);
+    }
+    item->func = NULL;
+    item->target = NULL;
+    item->targetRef = LUA_NOREF;
+    item->connRef = LUA_NOREF;
+    item->msg = NULL;
+}
+
+
+/*
+ * Selects the queue from which the next deferred message is delivered.
+ * Higher priority classes are serviced first but a lower class that has
+ * been passed over too many times is serviced once to avoid starvation.
+ */
+static l2dbus_DispatchQueue*
+l2dbus_dispatcherNextQueue
+    (
+    l2dbus_Dispatcher*  dispUd
+    )
+{
+    int prio;
+    l2dbus_DispatchQueue* next = NULL;
+    l2dbus_DispatchQueue* queue;
+
+    for ( prio = 0; prio < L2DBUS_DISPATCH_PRIORITY_COUNT; ++prio )
+    {
+        queue = &dispUd->queues[prio];
+        if ( 0U == queue->count )
+        {
+            continue;
+        }
+
+        if ( NULL == next )
+        {
+            next = queue;
+        }
+        else if ( (0U != dispUd->starvationLimit) &&
+                (queue->skipped >= dispUd->starvationLimit) )
+        {
+            next = queue;
+            break;
+        }
+    }
+
+    /* Age the classes that were passed over */
+    for ( prio = 0; prio < L2DBUS_DISPATCH_PRIORITY_COUNT; ++prio )
+    {
+        queue = &dispUd->queues[prio];
+        if ( queue == next )
+        {
+            queue->skipped = 0U;
+        }
+        else if ( 0U < queue->count )
+        {
+            ++queue->skipped;
+        }
+    }
+
+    return next;
+}
+
+
+/*
+ * Called at the start of the loop iteration following the one in which
+ * a dispatch slice began. Deferred messages are delivered here subject to
+ * the dispatch budget. Any messages that remain are carried over into
+ * the next iteration.
+ */
+static cdbus_Bool
+l2dbus_dispatcherSliceHandler
+    (
+    cdbus_Timeout*  t,
+    void*           user
+    )
+{
+    l2dbus_Dispatcher* dispUd = (l2dbus_Dispatcher*)user;
+    int base;
+    lua_State* L = l2dbus_callbackBegin(&dispUd->cbCtx, &base);
+    l2dbus_DispatchQueue* queue;
+    l2dbus_DispatchItem item;
+
+    assert( NULL != L );
+
+    dispUd->sliceActive = L2DBUS_FALSE;
+
+    if ( 0U < dispUd->queueCount )
+    {
+        l2dbus_dispatcherBeginSlice(dispUd);
+
+        while ( (0U < dispUd->queueCount) &&
+                !l2dbus_dispatcherSliceExhausted(dispUd) )
+        {
+            queue = l2dbus_dispatcherNextQueue(dispUd);
+            item = queue->items[queue->head];
+            queue->head = (queue->head + 1U) % queue->capacity;
+            --queue->count;
+            --dispUd->queueCount;
+
+            /* Cancelled items don't count against the budget */
+            if ( NULL != item.func )
+            {
+                ++dispUd->sliceCount;
+                ++queue->nDelivered;
+                item.func(L, &item);
+            }
+
+            /* Clean up the thread stack */
+            l2dbus_callbackEnd(L, base);
+            l2dbus_dispatcherReleaseItem(L, &item);
+        }
+
+        L2DBUS_TRACE((L2DBUS_TRC_TRACE, "Dispatch slice: delivered=%u backlog=%u",
+                    dispUd->sliceCount, dispUd->queueCount));
+    }
+
+    /* The return value is unused by CDBUS */
+    return CDBUS_TRUE;
+}
+
+
+/**
+ * @brief Resolves the priority class of a message.
+ *
+ * @param [in] dispUd   The Dispatcher userdata.
+ * @param [in] priority The priority assigned by the target of the
+ * message or L2DBUS_DISPATCH_PRIORITY_DEFAULT if none was assigned.
+ * @param [in] msg      The D-Bus message.
+ * @return The priority class of the message.
+ */
+int
+l2dbus_dispatcherResolvePriority
+    (
+    const l2dbus_Dispatcher*    dispUd,
+    int                         priority,
+    struct DBusMessage*         msg
+    )
+{
+    int msgType;
+
+    if ( (0 <= priority) && (L2DBUS_DISPATCH_PRIORITY_COUNT > priority) )
+    {
+        return priority;
+    }
+
+    msgType = dbus_message_get_type(msg);
+    if ( (0 <= msgType) && (DBUS_NUM_MESSAGE_TYPES > msgType) )
+    {
+        return dispUd->typePriority[msgType];
+    }
+
+    return L2DBUS_DISPATCH_PRIORITY_NORMAL;
+}
+
+
+/**
+ * @brief Determines whether the dispatch of messages is currently limited.
+ *
+ * Handlers can use this to avoid the work of resolving the priority
+ * of a message when it will be delivered immediately regardless.
+ *
+ * @param [in] dispUd   The Dispatcher userdata.
+ * @return True if a dispatch budget is configured, nested calls are
+ * enabled or messages are waiting to be delivered.
+ */
+l2dbus_Bool
+l2dbus_dispatcherIsThrottling
+    (
+    const l2dbus_Dispatcher*    dispUd
+    )
+{
+    return (0U < dispUd->queueCount) || (0U != dispUd->maxMessages) ||
+            (0.0 < dispUd->maxMsec) || (0U != dispUd->maxCallDepth);
+}
+
+
+/**
+ * @brief Determines whether a message can be delivered immediately.
+ *
+ * This is called by the message handlers before calling into Lua. If no
+ * dispatch budget is configured then messages are always delivered
+ * immediately. Otherwise each delivered message counts against the budget
+ * of the current loop iteration. Once the budget is exhausted (or there
+ * are already deferred messages of the same or higher priority waiting)
+ * the message should be handed to l2dbus_dispatcherDefer() instead.
+ *
+ * When nested calls are enabled messages are never delivered
+ * immediately. Deferred messages are delivered outside the D-Bus
+ * library's dispatch so their handlers are free to run the loop again.
+ *
+ * @param [in] dispUd   The Dispatcher userdata.
+ * @param [in] priority The (resolved) priority class of the message.
+ * @return True if the message can be delivered now, false if it should
+ * be deferred.
+ */
+l2dbus_Bool
+l2dbus_dispatcherAdmit
+    (
+    l2dbus_Dispatcher*  dispUd,
+    int                 priority
+    )
+{
+    int prio;
+
+    if ( 0U != dispUd->maxCallDepth )
+    {
+        return L2DBUS_FALSE;
+    }
+
+    if ( 0U < dispUd->queueCount )
+    {
+        /* Preserve the order of delivery within a class and never
+         * overtake a higher class.
+         */
+        for ( prio = 0; prio <= priority; ++prio )
+        {
+            if ( 0U < dispUd->queues[prio].count )
+            {
+                return L2DBUS_FALSE;
+            }
+        }
+    }
+    else if ( (0U == dispUd->maxMessages) && (0.0 >= dispUd->maxMsec) )
+    {
+        return L2DBUS_TRUE;
+    }
+
+    if ( !dispUd->sliceActive )
+    {
+        l2dbus_dispatcherBeginSlice(dispUd);
+    }
+
+    if ( l2dbus_dispatcherSliceExhausted(dispUd) )
+    {
+        return L2DBUS_FALSE;
+    }
+
+    ++dispUd->sliceCount;
+
+    return L2DBUS_TRUE;
+}
+
+
+/**
+ * @brief Defers the delivery of a message to a later loop iteration.
+ *
+ * The dispatcher takes ownership of the message reference and any
+ * registry references held by the item. The item is queued according
+ * to its priority class. The time the message is first deferred is
+ * recorded with the queued item.
+ *
+ * @param [in] dispUd   The Dispatcher userdata.
+ * @param [in] item     The item to queue.
+ * @return True if queued or false if memory could not be allocated (in
+ * which case the caller retains ownership of the item).
+ */
+l2dbus_Bool
+l2dbus_dispatcherDefer
+    (
+    l2dbus_Dispatcher*          dispUd,
+    const l2dbus_DispatchItem*  item
+    )
+{
+    l2dbus_DispatchQueue* queue;
+    l2dbus_DispatchItem* items;
+    unsigned capacity;
+    unsigned idx;
+
+    assert( (0 <= item->priority) &&
+            (L2DBUS_DISPATCH_PRIORITY_COUNT > item->priority) );
+    queue = &dispUd->queues[item->priority];
+
+    if ( queue->count == queue->capacity )
+    {
+        capacity = (0U == queue->capacity) ? 16U : (2U * queue->capacity);
+        items = (l2dbus_DispatchItem*)l2dbus_malloc(capacity * sizeof(*items));
+        if ( NULL == items )
+        {
+            return L2DBUS_FALSE;
+        }
+
+        /* Linearize the existing ring into the new buffer */
+        for ( idx = 0U; idx < queue->count; ++idx )
+        {
+            items[idx] = queue->items[(queue->head + idx) % queue->capacity];
+        }
+        l2dbus_free(queue->items);
+        queue->items = items;
+        queue->head = 0U;
+        queue->capacity = capacity;
+    }
+
+    idx = (queue->head + queue->count) % queue->capacity;
+    queue->items[idx] = *item;
+    /* Messages handed back (e.g. after being held) keep their age */
+    if ( 0.0 >= item->queuedAt )
+    {
+        queue->items[idx].queuedAt = l2dbus_getMonotonicTime();
+    }
+    ++queue->count;
+    ++queue->nDeferred;
+    if ( queue->count > queue->peakCount )
+    {
+        queue->peakCount = queue->count;
+    }
+    ++dispUd->queueCount;
+
+    /* Make sure the queue is serviced on the next loop iteration */
+    if ( !dispUd->sliceActive )
+    {
+        l2dbus_dispatcherBeginSlice(dispUd);
+    }
+
+    return L2DBUS_TRUE;
+}
+
+
+/**
+ * @brief Cancels any deferred messages destined for the given target.
+ *
+ * This must be called before a (non-Lua) target that may have
+ * deferred messages is destroyed.
+ *
+ * @param [in] L        The Lua state.
+ * @param [in] dispUd   The Dispatcher userdata.
+ * @param [in] target   The target of the deferred messages.
+ */
+void
+l2dbus_dispatcherCancelDeferred
+    (
+    lua_State*          L,
+    l2dbus_Dispatcher*  dispUd,
+    void*               target
+    )
+{
+    int prio;
+    unsigned idx;
+    l2dbus_DispatchQueue* queue;
+    l2dbus_DispatchItem* item;
+
+    for ( prio = 0; prio < L2DBUS_DISPATCH_PRIORITY_COUNT; ++prio )
+    {
+        queue = &dispUd->queues[prio];
+        for ( idx = 0U; idx < queue->count; ++idx )
+        {
+            item = &queue->items[(queue->head + idx) % queue->capacity];
+            if ( target == item->target )
+            {
+                l2dbus_dispatcherReleaseItem(L, item);
+            }
+        }
+    }
+}
+
+
+/**
+ * @brief Checks that a function argument is a dispatch priority class.
+ *
+ * A **nil** (or missing) argument selects the default priority which is
+ * derived from the type of the message.
+ *
+ * @param [in] L    The Lua state.
+ * @param [in] idx  The stack index of the argument.
+ * @return The priority class or L2DBUS_DISPATCH_PRIORITY_DEFAULT.
+ */
+int
+l2dbus_checkDispatchPriority
+    (
+    lua_State*  L,
+    int         idx
+    )
+{
+    lua_Integer priority;
+
+    if ( lua_isnoneornil(L, idx) )
+    {
+        return L2DBUS_DISPATCH_PRIORITY_DEFAULT;
+    }
+
+    priority = luaL_checkinteger(L, idx);
+    luaL_argcheck(L, (L2DBUS_DISPATCH_PRIORITY_DEFAULT <= priority) &&
+                    (L2DBUS_DISPATCH_PRIORITY_COUNT > priority), idx,
+                    "invalid dispatch priority");
+
+    return (int)priority;
+}
+
+
+/*
+ * Arms the (zero length) timeout that runs deferred functions on the
+ * next iteration of the main loop.
+ */
+static void
+l2dbus_dispatcherArmDeferred
+    (
+    l2dbus_Dispatcher*  dispUd
+    )
+{
+    cdbus_HResult rc;
+
+    if ( !dispUd->deferArmed )
+    {
+        /* A one-shot timeout may still report that it's enabled after
+         * it has expired so explicitly re-arm it.
+         */
+        cdbus_timeoutEnable(dispUd->deferTimeout, CDBUS_FALSE);
+        rc = cdbus_timeoutEnable(dispUd->deferTimeout, CDBUS_TRUE);
+        if ( CDBUS_FAILED(rc) )
+        {
+            L2DBUS_TRACE((L2DBUS_TRC_ERROR,
+                "Failed to arm deferred work timeout (0x%X)", rc));
+        }
+        else
+        {
+            dispUd->deferArmed = L2DBUS_TRUE;
+        }
+    }
+}
+
+
+/*
+ * Releases the references held by a deferred function.
+ */
+static void
+l2dbus_dispatcherReleaseDeferItem
+    (
+    lua_State*          L,
+    l2dbus_DeferItem*   item
+    )
+{
+    luaL_unref(L, LUA_REGISTRYINDEX, item->funcRef);
+    luaL_unref(L, LUA_REGISTRYINDEX, item->argsRef);
+    luaL_unref(L, LUA_REGISTRYINDEX, item->keyRef);
+    item->funcRef = LUA_NOREF;
+    item->argsRef = LUA_NOREF;
+    item->keyRef = LUA_NOREF;
+    item->nArgs = 0;
+}
+
+
+/*
+ * Releases every function of a deferred queue and the queue itself.
+ */
+static void
+l2dbus_dispatcherFreeDeferQueue
+    (
+    lua_State*          L,
+    l2dbus_DeferQueue*  queue
+    )
+{
+    while ( 0U < queue->count )
+    {
+        l2dbus_dispatcherReleaseDeferItem(L, &queue->items[queue->head]);
+        queue->head = (queue->head + 1U) % queue->capacity;
+        --queue->count;
+    }
+    l2dbus_free(queue->items);
+    queue->items = NULL;
+    queue->capacity = 0U;
+    queue->head = 0U;
+
+    luaL_unref(L, LUA_REGISTRYINDEX, queue->keysRef);
+    queue->keysRef = LUA_NOREF;
+}
+
+
+/*
+ * Queues the function at funcIdx along with the arguments from firstArg
+ * to the top of the stack. If a key is given (keyIdx is non-zero) and a
+ * function with the same key is already queued, that function and its
+ * arguments are replaced instead but it keeps its place in the queue.
+ */
+static void
+l2dbus_dispatcherQueueDeferred
+    (
+    lua_State*          L,
+    l2dbus_Dispatcher*  dispUd,
+    l2dbus_DeferQueue*  queue,
+    int                 keyIdx,
+    int                 funcIdx,
+    int                 firstArg
+    )
+{
+    l2dbus_DeferItem* items;
+    l2dbus_DeferItem* item = NULL;
+    unsigned capacity;
+    unsigned idx;
+    int nArgs = lua_gettop(L) - firstArg + 1;
+    unsigned long seq;
+
+    if ( 0 != keyIdx )
+    {
+        if ( LUA_NOREF == queue->keysRef )
+        {
+            lua_newtable(L);
+            queue->keysRef = luaL_ref(L, LUA_REGISTRYINDEX);
+        }
+
+        lua_rawgeti(L, LUA_REGISTRYINDEX, queue->keysRef);
+        lua_pushvalue(L, keyIdx);
+        lua_rawget(L, -2);
+        if ( lua_isnumber(L, -1) )
+        {
+            /* Coalesce with the function that's already queued */
+            seq = (unsigned long)lua_tonumber(L, -1);
+            item = &queue->items[(queue->head +
+                            (unsigned)(seq - queue->headSeq)) % queue->capacity];
+            luaL_unref(L, LUA_REGISTRYINDEX, item->funcRef);
+            luaL_unref(L, LUA_REGISTRYINDEX, item->argsRef);
+            item->argsRef = LUA_NOREF;
+        }
+        lua_pop(L, 2);
+    }
+
+    if ( NULL == item )
+    {
+        if ( queue->count == queue->capacity )
+        {
+            capacity = (0U == queue->capacity) ? 16U : (2U * queue->capacity);
+            items = (l2dbus_DeferItem*)l2dbus_malloc(capacity * sizeof(*items));
+            if ( NULL == items )
+            {
+                luaL_error(L, "Failed to grow the deferred work queue");
+            }
+
+            /* Linearize the existing ring into the new buffer */
+            for ( idx = 0U; idx < queue->count; ++idx )
+            {
+                items[idx] = queue->items[(queue->head + idx) % queue->capacity];
+            }
+            l2dbus_free(queue->items);
+            queue->items = items;
+            queue->head = 0U;
+            queue->capacity = capacity;
+        }
+
+        item = &queue->items[(queue->head + queue->count) % queue->capacity];
+        item->keyRef = LUA_NOREF;
+        item->argsRef = LUA_NOREF;
+
+        if ( 0 != keyIdx )
+        {
+            lua_rawgeti(L, LUA_REGISTRYINDEX, queue->keysRef);
+            lua_pushvalue(L, keyIdx);
+            lua_pushnumber(L, (lua_Number)(queue->headSeq + queue->count));
+            lua_rawset(L, -3);
+            lua_pop(L, 1);
+            lua_pushvalue(L, keyIdx);
+            item->keyRef = luaL_ref(L, LUA_REGISTRYINDEX);
+        }
+        ++queue->count;
+    }
+
+    /* A single argument is referenced directly to avoid creating a table */
+    if ( 1 == nArgs )
+    {
+        lua_pushvalue(L, firstArg);
+        item->argsRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+    else if ( 1 < nArgs )
+    {
+        lua_createtable(L, nArgs, 0);
+        for ( idx = 0U; idx < (unsigned)nArgs; ++idx )
+        {
+            lua_pushvalue(L, firstArg + (int)idx);
+            lua_rawseti(L, -2, (int)idx + 1);
+        }
+        item->argsRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+    item->nArgs = (0 < nArgs) ? nArgs : 0;
+
+    lua_pushvalue(L, funcIdx);
+    item->funcRef = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    l2dbus_dispatcherArmDeferred(dispUd);
+}
+
+
+/*
+ * Removes the function at the head of a deferred queue and calls it. The
+ * call goes through the profiler like any other handler under the given
+ * kind.
+ */
+static void
+l2dbus_dispatcherRunDeferred
+    (
+    lua_State*          L,
+    l2dbus_Context*     modCtx,
+    l2dbus_DeferQueue*  queue,
+    const char*         kind
+    )
+{
+    l2dbus_DeferItem item = queue->items[queue->head];
+    int nArgs = item.nArgs;
+    int idx;
+
+    queue->head = (queue->head + 1U) % queue->capacity;
+    --queue->count;
+    ++queue->headSeq;
+
+    /* The key can be used again as soon as the function starts to run */
+    if ( LUA_NOREF != item.keyRef )
+    {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, queue->keysRef);
+        lua_rawgeti(L, LUA_REGISTRYINDEX, item.keyRef);
+        lua_pushnil(L);
+        lua_rawset(L, -3);
+        lua_pop(L, 1);
+    }
+
+    if ( !lua_checkstack(L, nArgs + 2) )
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_ERROR,
+            "Dropping deferred function with too many arguments (%d)", nArgs));
+        l2dbus_dispatcherReleaseDeferItem(L, &item);
+        return;
+    }
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, item.funcRef);
+    if ( 1 == nArgs )
+    {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, item.argsRef);
+    }
+    else if ( 1 < nArgs )
+    {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, item.argsRef);
+        for ( idx = 1; idx <= nArgs; ++idx )
+        {
+            lua_rawgeti(L, -idx, idx);
+        }
+        lua_remove(L, -(nArgs + 1));
+    }
+    l2dbus_dispatcherReleaseDeferItem(L, &item);
+
+    /* Errors are traced by the call */
+    (void)l2dbus_callbackCall(L, modCtx, nArgs, 0, kind, NULL);
+}
+
+
+/*
+ * Called on the main loop iteration following the one in which functions
+ * were deferred. Only the functions deferred before this iteration are run
+ * so a function that defers itself doesn't starve the main loop. Idle
+ * functions are run once no deferred functions or messages are pending.
+ */
+static cdbus_Bool
+l2dbus_dispatcherDeferHandler
+    (
+    cdbus_Timeout*  t,
+    void*           user
+    )
+{
+    l2dbus_Dispatcher* dispUd = (l2dbus_Dispatcher*)user;
+    int base;
+    lua_State* L = l2dbus_callbackBegin(&dispUd->cbCtx, &base);
+    unsigned count;
+
+    assert( NULL != L );
+
+    dispUd->deferArmed = L2DBUS_FALSE;
+
+    for ( count = dispUd->deferQueue.count;
+        (0U < count) && (0U < dispUd->deferQueue.count); --count )
+    {
+        l2dbus_dispatcherRunDeferred(L, dispUd->cbCtx.modCtx,
+                                    &dispUd->deferQueue, "Deferred");
+        l2dbus_callbackEnd(L, base);
+    }
+
+    if ( (0U == dispUd->deferQueue.count) && (0U == dispUd->queueCount) )
+    {
+        for ( count = dispUd->idleQueue.count;
+            (0U < count) && (0U < dispUd->idleQueue.count); --count )
+        {
+            l2dbus_dispatcherRunDeferred(L, dispUd->cbCtx.modCtx,
+                                        &dispUd->idleQueue, "Idle");
+            l2dbus_callbackEnd(L, base);
+        }
+    }
+
+    if ( (0U < dispUd->deferQueue.count) || (0U < dispUd->idleQueue.count) )
+    {
+        l2dbus_dispatcherArmDeferred(dispUd);
+    }
+
+    /* Clean up the thread stack */
+    l2dbus_callbackEnd(L, base);
+
+    /* The return value is unused by CDBUS */
+    return CDBUS_TRUE;
+}
+
+
+/*
+ * Called when a garbage collection cycle finalizes the sentinel. The cycle
+ * is attributed to whatever was running at that point and a new sentinel
+ * is created to detect the next cycle.
+ */
+static int
+l2dbus_gcSentinelDispose
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Context* ctx = l2dbus_contextGet(L);
+
+    if ( NULL != ctx )
+    {
+        if ( ctx->gcStepping )
+        {
+            ++ctx->gcCyclesIdle;
+        }
+        else if ( 0 < ctx->cbDepth )
+        {
+            ++ctx->gcCyclesCallback;
+        }
+        else
+        {
+            ++ctx->gcCyclesOther;
+        }
+
+        if ( 0 < ctx->gcSentinelUsers )
+        {
+            l2dbus_objectNew(L, 0, L2DBUS_GC_SENTINEL_TYPE_ID);
+            lua_pop(L, 1);
+        }
+    }
+
+    return 0;
+}
+
+
+/*
+ * Stops scheduling garbage collection for the dispatcher and restarts the
+ * collector if it was stopped.
+ */
+static void
+l2dbus_dispatcherStopGcStepping
+    (
+    lua_State*          L,
+    l2dbus_Dispatcher*  dispUd
+    )
+{
+    l2dbus_Context* ctx = dispUd->cbCtx.modCtx;
+
+    if ( NULL != dispUd->gcTimeout )
+    {
+        cdbus_timeoutEnable(dispUd->gcTimeout, CDBUS_FALSE);
+        cdbus_timeoutUnref(dispUd->gcTimeout);
+        dispUd->gcTimeout = NULL;
+        --ctx->gcSentinelUsers;
+    }
+
+    if ( dispUd->gcStopped )
+    {
+        dispUd->gcStopped = L2DBUS_FALSE;
+        if ( 0 == --ctx->gcStopCount )
+        {
+            lua_gc(L, LUA_GCRESTART, 0);
+        }
+    }
+
+    dispUd->gcStepKb = 0;
+}
+
+
+/*
+ * Runs incremental garbage collection steps while the dispatcher is idle,
+ * i.e. no deferred messages or functions are waiting, until the time
+ * budget is used up or the collection cycle completes. If the collector
+ * is stopped a new cycle is only started once the heap has doubled since
+ * the last one completed, and it's run even if the dispatcher is busy once
+ * the heap has doubled again.
+ */
+static cdbus_Bool
+l2dbus_dispatcherGcHandler
+    (
+    cdbus_Timeout*  t,
+    void*           user
+    )
+{
+    l2dbus_Dispatcher* dispUd = (l2dbus_Dispatcher*)user;
+    l2dbus_Context* ctx = dispUd->cbCtx.modCtx;
+    int base;
+    lua_State* L = l2dbus_callbackBegin(&dispUd->cbCtx, &base);
+    l2dbus_Bool idle = (0U == dispUd->queueCount) &&
+                        (0U == dispUd->deferQueue.count);
+    int heapKb = lua_gc(L, LUA_GCCOUNT, 0);
+    double start;
+    double now;
+
+    if ( dispUd->gcStopped && (heapKb < dispUd->gcThresholdKb) )
+    {
+        /* Not enough garbage yet to start (or continue) a cycle */
+    }
+    else if ( idle || (dispUd->gcStopped && (0 < dispUd->gcThresholdKb) &&
+                (heapKb >= 2 * dispUd->gcThresholdKb)) )
+    {
+        ctx->gcStepping = L2DBUS_TRUE;
+        start = l2dbus_getMonotonicTime();
+        do
+        {
+            ++dispUd->gcSteps;
+            if ( lua_gc(L, LUA_GCSTEP, dispUd->gcStepKb) )
+            {
+                /* The cycle has completed */
+                dispUd->gcThresholdKb = 2 * lua_gc(L, LUA_GCCOUNT, 0);
+                break;
+            }
+            now = l2dbus_getMonotonicTime();
+        }
+        while ( (now - start) < dispUd->gcBudgetMsec );
+        ctx->gcStepping = L2DBUS_FALSE;
+
+        /* Lua 5.1 (and LuaJIT) reset the collector's threshold when
+         * stepping which restarts a stopped collector.
+         */
+        if ( 0 < ctx->gcStopCount )
+        {
+            lua_gc(L, LUA_GCSTOP, 0);
+        }
+        dispUd->gcStepMsec += l2dbus_getMonotonicTime() - start;
+    }
+
+    /* Clean up the thread stack */
+    l2dbus_callbackEnd(L, base);
+
+    /* The return value is unused by CDBUS */
+    return CDBUS_TRUE;
+}
+
+
+/**
+ @function new
+
+ Creates a new L2DBUS Dispatcher.
+
+ Constructs a new Dispatcher using the provided main loop.
+
+ @tparam userdata Main loop to be used by the dispatcher.
+ @treturn userdata Dispatcher userdata object
+ */
+int
+l2dbus_newDispatcher
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Dispatcher* dispUd;
+    l2dbus_MainLoopUserData* loopUd;
+    l2dbus_DispatcherLoopRef* loopRef = NULL;
+    int idx;
+
+    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "Create: dispatcher"));
+
+    /* Make sure the module wasn't shutdown */
+    l2dbus_checkModuleInitialized(L);
+
+    loopUd = (l2dbus_MainLoopUserData*)
+                            luaL_checkudata(L, 1, L2DBUS_MAIN_LOOP_MTBL_NAME);
+
+
+    dispUd = (l2dbus_Dispatcher*)l2dbus_objectNew(L, sizeof(*dispUd),
+                                    L2DBUS_DISPATCHER_TYPE_ID);
+    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "Dispatcher userdata=%p", dispUd));
+    if ( NULL == dispUd )
+    {
+        luaL_error(L, "Failed to allocate Dispatcher userdata!");
+    }
+    dispUd->finalizerRef = LUA_NOREF;
+    dispUd->deferQueue.keysRef = LUA_NOREF;
+    dispUd->idleQueue.keysRef = LUA_NOREF;
+    l2dbus_callbackInit(L, &dispUd->cbCtx);
+    l2dbus_watchBatchInit(L, dispUd);
+    dispUd->starvationLimit = L2DBUS_DISPATCH_STARVATION_LIMIT;
+    for ( idx = 0; idx < DBUS_NUM_MESSAGE_TYPES; ++idx )
+    {
+        dispUd->typePriority[idx] = L2DBUS_DISPATCH_PRIORITY_NORMAL;
+    }
+
+    dispUd->disp = cdbus_dispatcherNew(loopUd->loop);
+    if ( NULL == dispUd->disp )
+    {
+        luaL_error(L, "Failed to allocate Dispatcher!");
+    }
+
+    /* Used to detect the end of a dispatch slice (loop iteration) */
+    dispUd->sliceTimeout = cdbus_timeoutNew(dispUd->disp, 0, CDBUS_FALSE,
+                                    l2dbus_dispatcherSliceHandler, dispUd);
+    if ( NULL == dispUd->sliceTimeout )
+    {
+        cdbus_dispatcherUnref(dispUd->disp);
+        dispUd->disp = NULL;
+        luaL_error(L, "Failed to allocate Dispatcher slice timeout!");
+    }
+
+    /* All the Timeouts of the dispatcher share a single loop timer */
+    dispUd->timerWheel = l2dbus_timerWheelNew(dispUd->disp);
+    if ( NULL == dispUd->timerWheel )
+    {
+        cdbus_timeoutUnref(dispUd->sliceTimeout);
+        dispUd->sliceTimeout = NULL;
+        cdbus_dispatcherUnref(dispUd->disp);
+        dispUd->disp = NULL;
+        luaL_error(L, "Failed to allocate Dispatcher timer wheel!");
+    }
+
+    /* Runs deferred and idle functions on the next loop iteration */
+    dispUd->deferTimeout = cdbus_timeoutNew(dispUd->disp, 0, CDBUS_FALSE,
+                                    l2dbus_dispatcherDeferHandler, dispUd);
+    if ( NULL == dispUd->deferTimeout )
+    {
+        l2dbus_timerWheelUnref(dispUd->timerWheel);
+        dispUd->timerWheel = NULL;
+        cdbus_timeoutUnref(dispUd->sliceTimeout);
+        dispUd->sliceTimeout = NULL;
+        cdbus_dispatcherUnref(dispUd->disp);
+        dispUd->disp = NULL;
+        luaL_error(L, "Failed to allocate Dispatcher deferred work timeout!");
+    }
+
+    /* Resumes the tasks spawned on the dispatcher */
+    if ( !l2dbus_schedulerInit(L, &dispUd->sched, dispUd->disp,
+                                dispUd->timerWheel) )
+    {
+        cdbus_timeoutUnref(dispUd->deferTimeout);
+        dispUd->deferTimeout = NULL;
+        l2dbus_timerWheelUnref(dispUd->timerWheel);
+        dispUd->timerWheel = NULL;
+        cdbus_timeoutUnref(dispUd->sliceTimeout);
+        dispUd->sliceTimeout = NULL;
+        cdbus_dispatcherUnref(dispUd->disp);
+        dispUd->disp = NULL;
+        luaL_error(L, "Failed to allocate Dispatcher task scheduler!");
+    }
+
+    /* If we don't own the loop then we need to at least reference it */
+
+    loopRef = (l2dbus_DispatcherLoopRef*)l2dbus_malloc(sizeof(*loopRef));
+    if ( NULL == loopRef )
+    {
+        l2dbus_schedulerDestroy(L, &dispUd->sched);
+        cdbus_timeoutUnref(dispUd->deferTimeout);
+        dispUd->deferTimeout = NULL;
+        l2dbus_timerWheelUnref(dispUd->timerWheel);
+        dispUd->timerWheel = NULL;
+        cdbus_timeoutUnref(dispUd->sliceTimeout);
+        dispUd->sliceTimeout = NULL;
+        cdbus_dispatcherUnref(dispUd->disp);
+        dispUd->disp = NULL;
+        luaL_error(L,
+            "Failed to allocate memory for libev loop reference!");
+    }
+    else
+    {
+        loopRef->modCtx = l2dbus_contextGet(L);
+        lua_pushvalue(L, 1);
+        loopRef->loopRef = luaL_ref(L, LUA_REGISTRYINDEX);
+
+        /* This function is called when the *last* reference to the
+         * CDBUS dispatcher is dropped. At that point we'll break the
+         * strong reference to the loop. If we break the
+         * reference any sooner then there is a chance that as D-Bus is
+         * shut-down an associated Watch may try to access the
+         * loop. If it's already been GC'ed by Lua then it may
+         * not be around and we'll see an assertion.
+         */
+        cdbus_dispatcherSetFinalizer(dispUd->disp,
+                                    l2dbus_dispatcherFinalized,
+                                    loopRef);
+    }
+
+    dispUd->finalizerRef = l2dbus_moduleFinalizerRef(L);
+
+    return 1;
+}
+
+
+/**
+ * A Dispatcher class.
+ * @type Dispatcher
+ */
+
+
+/**
+ @function run
+ @within Dispatcher
+
+ Invokes the dispatcher to process messages and timeouts.
+
+ This method should be called to process one or more events
+ depending on the *run* option provided.
+
+ @tparam userdata disp The Dispatcher instance.
+ @tparam number runOpt One of the constant run options
+ @treturn bool Returns **true** if dispatcher successfully ran
+ one or more event iterations. Returns **false** on error.
+ @treturn ?string|nil An error message in the event of an error
+ */
+static int
+l2dbus_dispatcherRun
+    (
+    lua_State*  L
+    )
+{
+    cdbus_HResult rc;
+    int runOpt = CDBUS_RUN_NO_WAIT;
+    l2dbus_Dispatcher* ud = (l2dbus_Dispatcher*)luaL_checkudata(L,
+                                    1, L2DBUS_DISPATCHER_MTBL_NAME);
+
+    /* Make sure the module wasn't shutdown */
+    l2dbus_checkModuleInitialized(L);
+
+    if ( lua_gettop(L) > 1 )
+    {
+        runOpt = luaL_checkint(L, 2);
+    }
+
+    switch ( runOpt )
+    {
+        case CDBUS_RUN_WAIT:
+        case CDBUS_RUN_NO_WAIT:
+        case CDBUS_RUN_ONCE:
+            break;
+        default:
+            luaL_error(L, "Unknown run option (%d)", runOpt);
+            break;
+    }
+
+    rc = cdbus_dispatcherRun(ud->disp, (cdbus_RunOption)runOpt);
+    if ( CDBUS_FAILED(rc) )
+    {
+        lua_pushboolean(L, L2DBUS_FALSE);
+        lua_pushfstring(L, "Failed to run dispatcher (errCode=%f)", (lua_Number)rc);
+        return 2;
+    }
+
+    lua_pushboolean(L, L2DBUS_TRUE);
+
+    return 1;
+}
+
+
+/**
+ @function stop
+ @within Dispatcher
+
+ Stops the dispatcher and causes @{run} to exit.
+
+ This is used to break out of the dispatch loop entered by calling
+ @{run} on the dispatcher. A Lua error is thrown if the dispatcher
+ cannot be stopped.
+
+ @tparam userdata disp The Dispatcher instance.
+ @treturn bool True if dispatcher stops
+ */
+static int
+l2dbus_dispatcherStop
+    (
+    lua_State*  L
+    )
+{
+    cdbus_HResult rc;
+
+    l2dbus_Dispatcher* ud = (l2dbus_Dispatcher*)luaL_checkudata(L, 1, L2DBUS_DISPATCHER_MTBL_NAME);
+    /* Make sure the module wasn't shutdown */
+    l2dbus_checkModuleInitialized(L);
+
+    rc = cdbus_dispatcherStop(ud->disp);
+    if ( CDBUS_FAILED(rc) )
+    {
+        l2dbus_cdbusError(L, rc, "Failed to stop dispatcher");
+    }
+
+    lua_pushboolean(L, L2DBUS_TRUE);
+
+    return 1;
+}
+
+
+/**
+ @function setBudget
+ @within Dispatcher
+
+ Sets the dispatch budget of each main loop iteration.
+
+ By default a single iteration of the main loop delivers *every* message
+ that has been received. Under a burst of traffic this can starve timers
+ and other watches for a long time. A dispatch budget limits the number
+ of messages and/or the amount of (wall-clock) time spent delivering
+ messages to Lua handlers in a single loop iteration. Messages that exceed
+ the budget are queued and delivered on the following loop iterations
+ (in the order they were received). Passing zero (or nil) for both limits
+ removes the budget.
+
+ **Note:** A method call whose delivery is deferred is considered handled
+ by the D-Bus library. If the handler ultimately does not handle it
+ an *UnknownMethod* error is returned to the caller.
+
+ @tparam userdata disp The Dispatcher instance.
+ @tparam ?number maxMessages The maximum number of messages delivered
+ per loop iteration or zero (nil) for no limit.
+ @tparam ?number maxMsec The maximum time (in milliseconds) spent
+ delivering messages per loop iteration or zero (nil) for no limit.
+ */
+static int
+l2dbus_dispatcherSetBudget
+    (
+    lua_State*  L
+    )
+{
+    lua_Integer maxMessages;
+    lua_Number maxMsec;
+    l2dbus_Dispatcher* ud = (l2dbus_Dispatcher*)luaL_checkudata(L,
+                                    1, L2DBUS_DISPATCHER_MTBL_NAME);
+
+    /* Make sure the module wasn't shutdown */
+    l2dbus_checkModuleInitialized(L);
+
+    maxMessages = luaL_optinteger(L, 2, 0);
+    maxMsec = luaL_optnumber(L, 3, 0.0);
+    luaL_argcheck(L, maxMessages >= 0, 2, "budget cannot be negative");
+    luaL_argcheck(L, maxMsec >= 0.0, 3, "budget cannot be negative");
+
+    ud->maxMessages = (unsigned)maxMessages;
+    ud->maxMsec = (double)maxMsec;
+
+    return 0;
+}
+
+
+/**
+ @function getBudget
+ @within Dispatcher
+
+ Returns the dispatch budget of each main loop iteration.
+
+ @tparam userdata disp The Dispatcher instance.
+ @treturn number The maximum number of messages delivered per loop
+ iteration (zero if unlimited).
+ @treturn number The maximum time (in milliseconds) spent delivering
+ messages per loop iteration (zero if unlimited).
+ */
+static int
+l2dbus_dispatcherGetBudget
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Dispatcher* ud = (l2dbus_Dispatcher*)luaL_checkudata(L,
+                                    1, L2DBUS_DISPATCHER_MTBL_NAME);
+
+    /* Make sure the module wasn't shutdown */
+    l2dbus_checkModuleInitialized(L);
+
+    lua_pushinteger(L, ud->maxMessages);
+    lua_pushnumber(L, ud->maxMsec);
+
+    return 2;
+}
+
+
+/**
+ @function getBacklog
+ @within Dispatcher
+
+ Returns the number of received messages waiting to be delivered.
+
+ These are messages whose delivery was deferred to a later main loop
+ iteration because the dispatch @{setBudget|budget} was exhausted.
+ Applications can use this to adapt to the current load.
+
+ @tparam userdata disp The Dispatcher instance.
+ @treturn number The number of messages waiting to be delivered.
+ */
+static int
+l2dbus_dispatcherGetBacklog
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Dispatcher* ud = (l2dbus_Dispatcher*)luaL_checkudata(L,
+                                    1, L2DBUS_DISPATCHER_MTBL_NAME);
+
+    /* Make sure the module wasn't shutdown */
+    l2dbus_checkModuleInitialized(L);
+
+    lua_pushinteger(L, ud->queueCount);
+
+    return 1;
+}
+
+
+/**
+ @function setTypePriority
+ @within Dispatcher
+
+ Sets the default priority class of a message type.
+
+ When the dispatch @{setBudget|budget} is exhausted messages are queued
+ by priority class and messages of a higher class are delivered first.
+ Unless a priority has been assigned to the receiving
+ @{l2dbus.ServiceObject.setPriority|service object},
+ @{l2dbus.Interface.setPriority|interface}, or
+ @{l2dbus.Connection.setMatchPriority|match} the priority class is
+ determined by the type of the message. By default all message types
+ have a priority of @{PRIORITY_NORMAL}.
+
+ @tparam userdata disp The Dispatcher instance.
+ @tparam number msgType The @{l2dbus.Dbus.MESSAGE_TYPE_METHOD_CALL|type}
+ of message.
+ @tparam number priority The priority class (@{PRIORITY_HIGH},
+ @{PRIORITY_NORMAL}, or @{PRIORITY_LOW}).
+ */
+static int
+l2dbus_dispatcherSetTypePriority
+    (
+    lua_State*  L
+    )
+{
+    lua_Integer msgType;
+    lua_Integer priority;
+    l2dbus_Dispatcher* ud = (l2dbus_Dispatcher*)luaL_checkudata(L,
+                                    1, L2DBUS_DISPATCHER_MTBL_NAME);
+
+    /* Make sure the module wasn't shutdown */
+    l2dbus_checkModuleInitialized(L);
+
+    msgType = luaL_checkinteger(L, 2);
+    priority = luaL_checkinteger(L, 3);
+    luaL_argcheck(L, (DBUS_MESSAGE_TYPE_INVALID < msgType) &&
+                    (DBUS_NUM_MESSAGE_TYPES > msgType), 2,
+                    "invalid message type");
+    luaL_argcheck(L, (0 <= priority) &&
+                    (L2DBUS_DISPATCH_PRIORITY_COUNT > priority), 3,
+                    "invalid dispatch priority");
+
+    ud->typePriority[msgType] = (int)priority;
+
+    return 0;
+}
+
+
+/**
+ @function getTypePriority
+ @within Dispatcher
+
+ Returns the default priority class of a message type.
+
+ @tparam userdata disp The Dispatcher instance.
+ @tparam number msgType The @{l2dbus.Dbus.MESSAGE_TYPE_METHOD_CALL|type}
+ of message.
+ @treturn number The priority class of the message type.
+ */
+static int
+l2dbus_dispatcherGetTypePriority
+    (
+    lua_State*  L
+    )
+{
+    lua_Integer msgType;
+    l2dbus_Dispatcher* ud = (l2dbus_Dispatcher*)luaL_checkudata(L,
+                                    1, L2DBUS_DISPATCHER_MTBL_NAME);
+
+    /* Make sure the module wasn't shutdown */
+    l2dbus_checkModuleInitialized(L);
+
+    msgType = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, (DBUS_MESSAGE_TYPE_INVALID < msgType) &&
+                    (DBUS_NUM_MESSAGE_TYPES > msgType), 2,
+                    "invalid message type");
+
+    lua_pushinteger(L, ud->typePriority[msgType]);
+
+    return 1;
+}
+
+
+/**
+ @function setStarvationLimit
+ @within Dispatcher
+
+ Sets the starvation limit of the lower priority classes.
+
+ While higher priority messages are waiting to be delivered, a deferred
+ message of a lower priority class is delivered after its class has been
+ passed over *limit* times. This guarantees lower priority messages make
+ progress under sustained load. A limit of zero disables this protection
+ and strictly delivers messages by priority.
+
+ @tparam userdata disp The Dispatcher instance.
+ @tparam number limit The starvation limit (default 8).
+ */
+static int
+l2dbus_dispatcherSetStarvationLimit
+    (
+    lua_State*  L
+    )
+{
+    lua_Integer limit;
+    l2dbus_Dispatcher* ud = (l2dbus_Dispatcher*)luaL_checkudata(L,
+                                    1, L2DBUS_DISPATCHER_MTBL_NAME);
+
+    /* Make sure the module wasn't shutdown */
+    l2dbus_checkModuleInitialized(L);
+
+    limit = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, limit >= 0, 2, "limit cannot be negative");
+    ud->starvationLimit = (unsigned)limit;
+
+    return 0;
+}
+
+
+/**
+ @function getStats
+ @within Dispatcher
+
+ Returns statistics about the deferred dispatch queues.
+
+ The returned table has the fields **high**, **normal**, and **low**
+ (one for each priority class) and the field **backlog** which is
+ the total number of messages waiting to be delivered. Each priority
+ class is described by a table with the following fields:
+
+ <ul>
+ <li>depth - The number of messages currently waiting</li>
+ <li>peakDepth - The largest number of messages that were waiting</li>
+ <li>deferred - The total number of messages that were deferred</li>
+ <li>delivered - The total number of deferred messages that were delivered</li>
+ </ul>
+
+ @tparam userdata disp The Dispatcher instance.
+ @treturn table The dispatch statistics.
+ */
+static int
+l2dbus_dispatcherGetStats
+    (
+    lua_State*  L
+    )
+{
+    static const char* const className[L2DBUS_DISPATCH_PRIORITY_COUNT] =
+        { "high", "normal", "low" };
+    const l2dbus_DispatchQueue* queue;
+    int prio;
+    l2dbus_Dispatcher* ud = (l2dbus_Dispatcher*)luaL_checkudata(L,
+                                    1, L2DBUS_DISPATCHER_MTBL_NAME);
+
+    /* Make sure the module wasn't shutdown */
+    l2dbus_checkModuleInitialized(L);
+
+    lua_createtable(L, 0, L2DBUS_DISPATCH_PRIORITY_COUNT + 1);
+    for ( prio = 0; prio < L2DBUS_DISPATCH_PRIORITY_COUNT; ++prio )
+    {
+        queue = &ud->queues[prio];
+        lua_createtable(L, 0, 4);
+        lua_pushinteger(L, queue->count);
+        lua_setfield(L, -2, "depth");
+        lua_pushinteger(L, queue->peakCount);
+        lua_setfield(L, -2, "peakDepth");
+        lua_pushnumber(L, (lua_Number)queue->nDeferred);
+        lua_setfield(L, -2, "deferred");
+        lua_pushnumber(L, (lua_Number)queue->nDelivered);
+        lua_setfield(L, -2, "delivered");
+        lua_setfield(L, -2, className[prio]);
+    }
+    lua_pushinteger(L, ud->queueCount);
+    lua_setfield(L, -2, "backlog");
+
+    return 1;
+}
+
+
+/**
+ @function setTimerResolution
+ @within Dispatcher
+
+ Sets the resolution and coalescing slack of the dispatcher's Timeouts.
+
+ Every @{l2dbus.Timeout|Timeout} of a dispatcher is kept on a timer
+ wheel driven by a single main loop timer. The wheel advances in
+ ticks of the given resolution and a Timeout expires on the first
+ tick at or after its deadline. A coarser resolution means fewer
+ wakeups of the main loop at the cost of precision. In addition a
+ *slack* can be specified that allows an expiration to be postponed
+ (by up to that amount) so it coincides with other expirations and
+ their handlers are called in a single batch. By default the
+ resolution is one millisecond and there is no slack. Armed Timeouts
+ are re-scheduled according to the new settings.
+
+ @tparam userdata disp The Dispatcher instance.
+ @tparam number resolution The length of a tick in milliseconds (at
+ least one).
+ @tparam ?number slack The maximum amount of time (in milliseconds)
+ that an expiration may be postponed or zero (nil) for no slack.
+ */
+static int
+l2dbus_dispatcherSetTimerResolution
+    (
+    lua_State*  L
+    )
+{
+    lua_Number resolution;
+    lua_Number slack;
+    l2dbus_Dispatcher* ud = (l2dbus_Dispatcher*)luaL_checkudata(L,
+                                    1, L2DBUS_DISPATCHER_MTBL_NAME);
+
+    /* Make sure the module wasn't shutdown */
+    l2dbus_checkModuleInitialized(L);
+
+    resolution = luaL_checknumber(L, 2);
+    slack = luaL_optnumber(L, 3, 0.0);
+    luaL_argcheck(L, resolution >= 1.0, 2,
+                    "resolution must be at least one millisecond");
+    luaL_argcheck(L, slack >= 0.0, 3, "slack cannot be negative");
+
+    l2dbus_timerWheelSetResolution(ud->timerWheel, (double)resolution,
+                                    (double)slack);
+
+    return 0;
+}
+
+
+/**
+ @function getTimerResolution
+ @within Dispatcher
+
+ Returns the resolution and coalescing slack of the dispatcher's Timeouts.
+
+ @tparam userdata disp The Dispatcher instance.
+ @treturn number The length of a tick in milliseconds.
+ @treturn number The coalescing slack in milliseconds.
+ @treturn number The number of armed Timeouts.
+ */
+static int
+l2dbus_dispatcherGetTimerResolution
+    (
+    lua_State*  L
+    )
+{
+    double resolution;
+    double slack;
+    l2dbus_Dispatcher* ud = (l2dbus_Dispatcher*)luaL_checkudata(L,
+                                    1, L2DBUS_DISPATCHER_MTBL_NAME);
+
+    /* Make sure the module wasn't shutdown */
+    l2dbus_checkModuleInitialized(L);
+
+    l2dbus_timerWheelGetResolution(ud->timerWheel, &resolution, &slack);
+    lua_pushnumber(L, resolution);
+    lua_pushnumber(L, slack);
+    lua_pushinteger(L, l2dbus_timerWheelCount(ud->timerWheel));
+
+    return 3;
+}
+
+
+/**
+ @function defer
+ @within Dispatcher
+
+ Defers a function to the next iteration of the main loop.
+
+ The function is called with the given arguments once the current
+ iteration of the main loop (e.g. the dispatch of the current message)
+ completes. Deferred functions are called in the order they were
+ deferred. A function deferred while deferred functions are running
+ is called on the following iteration. Errors raised by a deferred
+ function are traced and otherwise ignored.
+
+ @tparam userdata disp The Dispatcher instance.
+ @tparam func fn The function to call.
+ @param ... The arguments passed to the function.
+ */
+static int
+l2dbus_dispatcherDeferFunc
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Dispatcher* ud = (l2dbus_Dispatcher*)luaL_checkudata(L,
+                                    1, L2DBUS_DISPATCHER_MTBL_NAME);
+
+    /* Make sure the module wasn't shutdown */
+    l2dbus_checkModuleInitialized(L);
+
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+    l2dbus_dispatcherQueueDeferred(L, ud, &ud->deferQueue, 0, 2, 3);
+
+    return 0;
+}
+
+
+/**
+ @function deferKeyed
+ @within Dispatcher
+
+ Defers a function to the next iteration of the main loop, coalescing
+ it with any pending function deferred with the same key.
+
+ This behaves like @{defer} except that if a function with the same
+ key is still waiting to be called, it's replaced (along with its
+ arguments) by this one rather than queuing another call. The call
+ keeps its original place in the queue. This is useful to batch work
+ (e.g. the emission of a signal) triggered many times during a single
+ iteration of the main loop.
+
+ @tparam userdata disp The Dispatcher instance.
+ @tparam any key The coalescing key (any value other than **nil**).
+ @tparam func fn The function to call.
+ @param ... The arguments passed to the function.
+ */
+static int
+l2dbus_dispatcherDeferKeyed
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Dispatcher* ud = (l2dbus_Dispatcher*)luaL_checkudata(L,
+                                    1, L2DBUS_DISPATCHER_MTBL_NAME);
+
+    /* Make sure the module wasn't shutdown */
+    l2dbus_checkModuleInitialized(L);
+
+    luaL_argcheck(L, !lua_isnoneornil(L, 2), 2, "key cannot be nil");
+    luaL_checktype(L, 3, LUA_TFUNCTION);
+    l2dbus_dispatcherQueueDeferred(L, ud, &ud->deferQueue, 2, 3, 4);
+
+    return 0;
+}
+
+
+/**
+ @function idle
+ @within Dispatcher
+
+ Calls a function once the main loop is idle.
+
+ The function is called (without arguments) on an iteration of the main
+ loop where no @{defer|deferred} functions or deferred messages (see
+ @{setBudget}) are waiting. Deferring a function that's already waiting
+ to be called has no effect.
+
+ @tparam userdata disp The Dispatcher instance.
+ @tparam func fn The function to call.
  */
+static int
+l2dbus_dispatcherIdle
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Dispatcher* ud = (l2dbus_Dispatcher*)luaL_checkudata(L,
+                                    1, L2DBUS_DISPATCHER_MTBL_NAME);
+
+    /* Make sure the module wasn't shutdown */
+    l2dbus_checkModuleInitialized(L);
 
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+    lua_settop(L, 2);
+    l2dbus_dispatcherQueueDeferred(L, ud, &ud->idleQueue, 2, 2, 3);
 
-/*
- * This function is called when the *last* reference to an underlying
- * CDBUS dispatcher is called. It's only called in the case when a "foreign"
- * libev loop is being utilized (e.g. we don't own it but it's owned by
- * another module like the Lua libev binding).
+    return 0;
+}
+
+
+/**
+ @function getDeferred
+ @within Dispatcher
+
+ Returns the number of functions waiting to be called.
+
+ @tparam userdata disp The Dispatcher instance.
+ @treturn number The number of @{defer|deferred} functions.
+ @treturn number The number of @{idle} functions.
  */
-static void
-l2dbus_dispatcherFinalized
+static int
+l2dbus_dispatcherGetDeferred
     (
-    void*   data
+    lua_State*  L
     )
 {
-    int* loopRef = (int*)data;
-    if ( NULL != loopRef )
-    {
-        L2DBUS_TRACE((L2DBUS_TRC_TRACE, "Unreferencing the foreign main loop"));
-        luaL_unref(l2dbus_callbackGetThread(), LUA_REGISTRYINDEX, *loopRef);
-        l2dbus_free(loopRef);
-    }
+    l2dbus_Dispatcher* ud = (l2dbus_Dispatcher*)luaL_checkudata(L,
+                                    1, L2DBUS_DISPATCHER_MTBL_NAME);
+
+    /* Make sure the module wasn't shutdown */
+    l2dbus_checkModuleInitialized(L);
+
+    lua_pushinteger(L, ud->deferQueue.count);
+    lua_pushinteger(L, ud->idleQueue.count);
+
+    return 2;
 }
 
 
 /**
- @function new
+ @function setGcStepping
+ @within Dispatcher
 
- Creates a new L2DBUS Dispatcher.
+ Schedules incremental garbage collection into idle periods of the main
+ loop.
 
- Constructs a new Dispatcher using the provided main loop.
+ Lua runs its collector in steps proportional to the memory allocated, so
+ a (potentially long) step may occur in the middle of a handler. With
+ idle stepping enabled the dispatcher periodically checks whether it's
+ idle (no deferred messages or functions are waiting) and if so runs
+ collection steps of *stepKb* kilobytes until the collection cycle
+ completes or the time budget is used up.
 
- @tparam userdata Main loop to be used by the dispatcher.
- @treturn userdata Dispatcher userdata object
+ If *stopCollector* is **true** then the regular collector is stopped
+ and garbage is *only* collected by these idle steps. A new collection
+ cycle then starts once the heap has doubled since the previous cycle
+ completed. Should the heap double again without an idle period the steps
+ are run regardless.
+
+ Passing zero (or nil) for *stepKb* disables idle stepping and restarts
+ the collector if it was stopped.
+
+ @tparam userdata disp The Dispatcher instance.
+ @tparam ?number stepKb The size of each collection step (in KB) or zero
+ (nil) to disable idle stepping.
+ @tparam ?number budgetMsec The maximum time (in milliseconds) spent
+ collecting garbage per idle period. Defaults to one millisecond.
+ @tparam ?bool stopCollector Set to **true** to stop the regular
+ collector. Defaults to **false**.
+ @tparam ?number interval How often (in milliseconds) to look for an
+ idle period. Defaults to 10 milliseconds.
  */
-int
-l2dbus_newDispatcher
+static int
+l2dbus_dispatcherSetGcStepping
     (
     lua_State*  L
     )
 {
-    l2dbus_Dispatcher* dispUd;
-    l2dbus_MainLoopUserData* loopUd;
-    int* loopRef = NULL;
-
-    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "Create: dispatcher"));
+    l2dbus_Dispatcher* ud = (l2dbus_Dispatcher*)luaL_checkudata(L,
+                                    1, L2DBUS_DISPATCHER_MTBL_NAME);
+    l2dbus_Context* ctx;
+    lua_Integer stepKb;
+    lua_Number budgetMsec;
+    lua_Integer interval;
+    l2dbus_Bool stopCollector;
+    cdbus_HResult rc;
 
     /* Make sure the module wasn't shutdown */
     l2dbus_checkModuleInitialized(L);
 
-    loopUd = (l2dbus_MainLoopUserData*)
-                            luaL_checkudata(L, 1, L2DBUS_MAIN_LOOP_MTBL_NAME);
+    stepKb = luaL_optinteger(L, 2, 0);
+    budgetMsec = luaL_optnumber(L, 3, 1.0);
+    stopCollector = lua_toboolean(L, 4);
+    interval = luaL_optinteger(L, 5, L2DBUS_GC_STEP_INTERVAL);
+    luaL_argcheck(L, stepKb >= 0, 2, "step size cannot be negative");
+    luaL_argcheck(L, budgetMsec > 0.0, 3, "budget must be positive");
+    luaL_argcheck(L, interval > 0, 5, "interval must be positive");
 
+    ctx = ud->cbCtx.modCtx;
+    l2dbus_dispatcherStopGcStepping(L, ud);
 
-    dispUd = (l2dbus_Dispatcher*)l2dbus_objectNew(L, sizeof(*dispUd),
-                                    L2DBUS_DISPATCHER_TYPE_ID);
-    dispUd->finalizerRef = LUA_NOREF;
-    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "Dispatcher userdata=%p", dispUd));
-    if ( NULL == dispUd )
+    if ( 0 < stepKb )
     {
-        luaL_error(L, "Failed to allocate Dispatcher userdata!");
-    }
+        ud->gcTimeout = cdbus_timeoutNew(ud->disp, (cdbus_Int32)interval,
+                                    CDBUS_TRUE, l2dbus_dispatcherGcHandler, ud);
+        if ( NULL == ud->gcTimeout )
+        {
+            luaL_error(L, "Failed to allocate Dispatcher GC timeout!");
+        }
 
-    dispUd->disp = cdbus_dispatcherNew(loopUd->loop);
-    if ( NULL == dispUd->disp )
-    {
-        luaL_error(L, "Failed to allocate Dispatcher!");
-    }
+        rc = cdbus_timeoutEnable(ud->gcTimeout, CDBUS_TRUE);
+        if ( CDBUS_FAILED(rc) )
+        {
+            cdbus_timeoutUnref(ud->gcTimeout);
+            ud->gcTimeout = NULL;
+            l2dbus_cdbusError(L, rc, "Failed to enable Dispatcher GC timeout");
+        }
 
-    /* If we don't own the loop then we need to at least reference it */
+        /* A sentinel is collected with every cycle to count them */
+        if ( 0 == ctx->gcSentinelUsers++ )
+        {
+            l2dbus_objectNew(L, 0, L2DBUS_GC_SENTINEL_TYPE_ID);
+            lua_pop(L, 1);
+        }
 
-    loopRef = (int*)l2dbus_malloc(sizeof(*loopRef));
-    if ( NULL == loopRef )
-    {
-        cdbus_dispatcherUnref(dispUd->disp);
-        dispUd->disp = NULL;
-        luaL_error(L,
-            "Failed to allocate memory for libev loop reference!");
-    }
-    else
-    {
-        lua_pushvalue(L, 1);
-        *loopRef = luaL_ref(L, LUA_REGISTRYINDEX);
+        ud->gcStepKb = (int)stepKb;
+        ud->gcBudgetMsec = budgetMsec;
+        ud->gcThresholdKb = 0;
 
-        /* This function is called when the *last* reference to the
-         * CDBUS dispatcher is dropped. At that point we'll break the
-         * strong reference to the loop. If we break the
-         * reference any sooner then there is a chance that as D-Bus is
-         * shut-down an associated Watch may try to access the
-         * loop. If it's already been GC'ed by Lua then it may
-         * not be around and we'll see an assertion.
-         */
-        cdbus_dispatcherSetFinalizer(dispUd->disp,
-                                    l2dbus_dispatcherFinalized,
-                                    loopRef);
+        if ( stopCollector )
+        {
+            ud->gcStopped = L2DBUS_TRUE;
+            if ( 0 == ctx->gcStopCount++ )
+            {
+                lua_gc(L, LUA_GCSTOP, 0);
+            }
+        }
     }
 
-    dispUd->finalizerRef = l2dbus_moduleFinalizerRef(L);
-
-    return 1;
+    return 0;
 }
 
 
 /**
- * A Dispatcher class.
- * @type Dispatcher
+ @function getGcStats
+ @within Dispatcher
+
+ Returns statistics about garbage collection.
+
+ A table with the following fields is returned:
+
+ <ul>
+ <li>heapKb - The memory (in KB) currently in use by Lua</li>
+ <li>steps - The number of idle collection steps run by the dispatcher</li>
+ <li>stepMsec - The total time (in milliseconds) spent in idle steps</li>
+ <li>idleCycles - Collection cycles that completed during idle steps</li>
+ <li>callbackCycles - Collection cycles that completed while a Lua
+ handler was running</li>
+ <li>otherCycles - Collection cycles that completed elsewhere</li>
+ </ul>
+
+ Cycles are only counted while idle stepping is enabled on a dispatcher
+ and are shared by all the dispatchers of the Lua state. A cycle is
+ attributed to whatever was running when it *completed*; the cycle
+ counts say nothing about how much collection time was spent inside
+ handlers since the steps of an incremental cycle may be spread over
+ idle periods and handlers alike. Only the time spent in idle steps
+ (*stepMsec*) is measured. Unless the regular collector is stopped it
+ keeps running steps (and completing cycles) from within handlers.
+
+ @tparam userdata disp The Dispatcher instance.
+ @treturn table The garbage collection statistics.
  */
+static int
+l2dbus_dispatcherGetGcStats
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Dispatcher* ud = (l2dbus_Dispatcher*)luaL_checkudata(L,
+                                    1, L2DBUS_DISPATCHER_MTBL_NAME);
+    l2dbus_Context* ctx;
+
+    /* Make sure the module wasn't shutdown */
+    l2dbus_checkModuleInitialized(L);
+
+    ctx = ud->cbCtx.modCtx;
+    lua_createtable(L, 0, 6);
+    lua_pushinteger(L, lua_gc(L, LUA_GCCOUNT, 0));
+    lua_setfield(L, -2, "heapKb");
+    lua_pushnumber(L, (lua_Number)ud->gcSteps);
+    lua_setfield(L, -2, "steps");
+    lua_pushnumber(L, ud->gcStepMsec);
+    lua_setfield(L, -2, "stepMsec");
+    lua_pushnumber(L, (lua_Number)ctx->gcCyclesIdle);
+    lua_setfield(L, -2, "idleCycles");
+    lua_pushnumber(L, (lua_Number)ctx->gcCyclesCallback);
+    lua_setfield(L, -2, "callbackCycles");
+    lua_pushnumber(L, (lua_Number)ctx->gcCyclesOther);
+    lua_setfield(L, -2, "otherCycles");
+
+    return 1;
+}
 
 
 /**
- @function run
+ @function setTaskPoolSize
  @within Dispatcher
 
- Invokes the dispatcher to process messages and timeouts.
+ Sets how many finished tasks are kept for re-use.
 
- This method should be called to process one or more events
- depending on the *run* option provided.
+ The coroutine of a task spawned with @{l2dbus.spawn|spawn} is kept once
+ the task finishes so the next task spawned can re-use it. This sets the
+ maximum number of such idle tasks.
 
  @tparam userdata disp The Dispatcher instance.
- @tparam number runOpt One of the constant run options
- @treturn bool Returns **true** if dispatcher successfully ran
- one or more event iterations. Returns **false** on error.
- @treturn ?string|nil An error message in the event of an error
+ @tparam number size The maximum number of idle tasks kept.
  */
 static int
-l2dbus_dispatcherRun
+l2dbus_dispatcherSetTaskPoolSize
     (
     lua_State*  L
     )
 {
-    cdbus_HResult rc;
-    int runOpt = CDBUS_RUN_NO_WAIT;
     l2dbus_Dispatcher* ud = (l2dbus_Dispatcher*)luaL_checkudata(L,
                                     1, L2DBUS_DISPATCHER_MTBL_NAME);
+    lua_Integer size = luaL_checkinteger(L, 2);
 
     /* Make sure the module wasn't shutdown */
     l2dbus_checkModuleInitialized(L);
 
-    if ( lua_gettop(L) > 1 )
-    {
-        runOpt = luaL_checkint(L, 2);
-    }
+    luaL_argcheck(L, 0 <= size, 2, "pool size must be non-negative");
+    l2dbus_schedulerSetPoolSize(L, &ud->sched, (unsigned)size);
 
-    switch ( runOpt )
-    {
-        case CDBUS_RUN_WAIT:
-        case CDBUS_RUN_NO_WAIT:
-        case CDBUS_RUN_ONCE:
-            break;
-        default:
-            luaL_error(L, "Unknown run option (%d)", runOpt);
-            break;
-    }
+    return 0;
+}
 
-    rc = cdbus_dispatcherRun(ud->disp, (cdbus_RunOption)runOpt);
-    if ( CDBUS_FAILED(rc) )
-    {
-        lua_pushboolean(L, L2DBUS_FALSE);
-        lua_pushfstring(L, "Failed to run dispatcher (errCode=%f)", (lua_Number)rc);
-        return 2;
-    }
 
-    lua_pushboolean(L, L2DBUS_TRUE);
+/**
+ @function getTaskStats
+ @within Dispatcher
+
+ Returns statistics about the tasks run by the dispatcher.
+
+ A table with the following fields is returned:
+
+ <ul>
+ <li>live - Tasks that haven't finished yet</li>
+ <li>ready - Tasks waiting in the run queue</li>
+ <li>pooled - Finished tasks kept for re-use</li>
+ <li>maxPooled - The maximum number of tasks kept for re-use</li>
+ <li>spawned - The number of tasks spawned</li>
+ <li>created - The number of coroutines created to run them</li>
+ <li>completed - Tasks whose function returned</li>
+ <li>failed - Tasks whose function raised an error</li>
+ <li>resumed - The number of times tasks have been resumed</li>
+ </ul>
+
+ @tparam userdata disp The Dispatcher instance.
+ @treturn table The task statistics.
+ */
+static int
+l2dbus_dispatcherGetTaskStats
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Dispatcher* ud = (l2dbus_Dispatcher*)luaL_checkudata(L,
+                                    1, L2DBUS_DISPATCHER_MTBL_NAME);
+
+    /* Make sure the module wasn't shutdown */
+    l2dbus_checkModuleInitialized(L);
+
+    l2dbus_schedulerPushStats(L, &ud->sched);
 
     return 1;
 }
 
 
 /**
- @function stop
+ @function setCallNesting
  @within Dispatcher
 
- Stops the dispatcher and causes @{run} to exit.
+ Configures synchronous calls that keep dispatching while they wait.
 
- This is used to break out of the dispatch loop entered by calling
- @{run} on the dispatcher. A Lua error is thrown if the dispatcher
- cannot be stopped.
+ A @{Connection.call|Connection:call} normally blocks everything
+ until its reply arrives. Once nesting is enabled the call instead runs
+ iterations of the dispatcher so timers, watches, signals and other
+ requests continue to be serviced. A call made from a handler that was
+ itself reached through such an iteration nests one level deeper. Once
+ **maxDepth** levels are active further calls block as before.
+
+ While nesting is enabled every inbound message is delivered through the
+ dispatcher's message queue rather than directly from the D-Bus library
+ which is what allows a handler to re-enter the loop.
+
+ If **holdObjects** is true then requests for a service object whose
+ handler is waiting in a nested call are held back until that handler
+ returns. This protects handlers that aren't written to be re-entered.
 
  @tparam userdata disp The Dispatcher instance.
- @treturn bool True if dispatcher stops
+ @tparam number maxDepth The maximum nesting depth (0 disables nesting).
+ @tparam ?boolean holdObjects True to hold requests for an object with a
+ handler waiting on a call (default false).
  */
 static int
-l2dbus_dispatcherStop
+l2dbus_dispatcherSetCallNesting
     (
     lua_State*  L
     )
 {
-    cdbus_HResult rc;
+    l2dbus_Dispatcher* ud = (l2dbus_Dispatcher*)luaL_checkudata(L,
+                                    1, L2DBUS_DISPATCHER_MTBL_NAME);
+    lua_Integer maxDepth = luaL_checkinteger(L, 2);
 
-    l2dbus_Dispatcher* ud = (l2dbus_Dispatcher*)luaL_checkudata(L, 1, L2DBUS_DISPATCHER_MTBL_NAME);
     /* Make sure the module wasn't shutdown */
     l2dbus_checkModuleInitialized(L);
 
-    rc = cdbus_dispatcherStop(ud->disp);
-    if ( CDBUS_FAILED(rc) )
-    {
-        l2dbus_cdbusError(L, rc, "Failed to stop dispatcher");
-    }
+    luaL_argcheck(L, 0 <= maxDepth, 2, "depth must be non-negative");
+    ud->maxCallDepth = (unsigned)maxDepth;
+    ud->holdObjects = lua_toboolean(L, 3) ? L2DBUS_TRUE : L2DBUS_FALSE;
 
-    lua_pushboolean(L, L2DBUS_TRUE);
+    return 0;
+}
 
-    return 1;
+
+/**
+ @function getCallNesting
+ @within Dispatcher
+
+ Returns the configuration of nested synchronous calls.
+
+ @tparam userdata disp The Dispatcher instance.
+ @treturn number The maximum nesting depth (0 if disabled).
+ @treturn boolean True if requests are held for waiting objects.
+ @treturn number The number of nested calls currently active.
+ */
+static int
+l2dbus_dispatcherGetCallNesting
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Dispatcher* ud = (l2dbus_Dispatcher*)luaL_checkudata(L,
+                                    1, L2DBUS_DISPATCHER_MTBL_NAME);
+
+    /* Make sure the module wasn't shutdown */
+    l2dbus_checkModuleInitialized(L);
+
+    lua_pushinteger(L, (lua_Integer)ud->maxCallDepth);
+    lua_pushboolean(L, ud->holdObjects);
+    lua_pushinteger(L, (lua_Integer)ud->callDepth);
+
+    return 3;
 }
 
 
@@ -273,9 +2098,55 @@ l2dbus_dispatcherDispose
     )
 {
     l2dbus_Dispatcher* ud = (l2dbus_Dispatcher*)luaL_checkudata(L, -1, L2DBUS_DISPATCHER_MTBL_NAME);
+    l2dbus_DispatchQueue* queue;
+    int prio;
 
     L2DBUS_TRACE((L2DBUS_TRC_TRACE, "GC: dispatcher (userdata=%p)", ud));
 
+    /* Drop any messages that were never delivered */
+    for ( prio = 0; prio < L2DBUS_DISPATCH_PRIORITY_COUNT; ++prio )
+    {
+        queue = &ud->queues[prio];
+        while ( 0U < queue->count )
+        {
+            l2dbus_dispatcherReleaseItem(L, &queue->items[queue->head]);
+            queue->head = (queue->head + 1U) % queue->capacity;
+            --queue->count;
+        }
+        l2dbus_free(queue->items);
+        queue->items = NULL;
+        queue->capacity = 0U;
+    }
+    ud->queueCount = 0U;
+
+    if ( ud->sliceTimeout != NULL )
+    {
+        cdbus_timeoutEnable(ud->sliceTimeout, CDBUS_FALSE);
+        cdbus_timeoutUnref(ud->sliceTimeout);
+        ud->sliceTimeout = NULL;
+    }
+
+    l2dbus_watchBatchFree(L, ud);
+
+    /* Functions that never got to run are dropped */
+    if ( ud->deferTimeout != NULL )
+    {
+        cdbus_timeoutEnable(ud->deferTimeout, CDBUS_FALSE);
+        cdbus_timeoutUnref(ud->deferTimeout);
+        ud->deferTimeout = NULL;
+    }
+    l2dbus_dispatcherFreeDeferQueue(L, &ud->deferQueue);
+    l2dbus_dispatcherFreeDeferQueue(L, &ud->idleQueue);
+
+    l2dbus_dispatcherStopGcStepping(L, ud);
+
+    /* Tasks that haven't finished are dropped */
+    l2dbus_schedulerDestroy(L, &ud->sched);
+
+    /* Timeouts that are still alive hold their own reference to the wheel */
+    l2dbus_timerWheelUnref(ud->timerWheel);
+    ud->timerWheel = NULL;
+
     if ( ud->disp != NULL )
     {
         cdbus_dispatcherUnref(ud->disp);
@@ -292,12 +2163,40 @@ l2dbus_dispatcherDispose
 }
 
 
+/*
+ * The sentinel used to count garbage collection cycles
+ */
+static const luaL_Reg l2dbus_gcSentinelMetaTable[] = {
+    {"__gc", l2dbus_gcSentinelDispose},
+    {NULL, NULL},
+};
+
+
 /*
  * Define the methods of the Dispatcher
  */
 static const luaL_Reg l2dbus_dispatcherMetaTable[] = {
     {"run", l2dbus_dispatcherRun},
     {"stop", l2dbus_dispatcherStop},
+    {"setBudget", l2dbus_dispatcherSetBudget},
+    {"getBudget", l2dbus_dispatcherGetBudget},
+    {"getBacklog", l2dbus_dispatcherGetBacklog},
+    {"setTypePriority", l2dbus_dispatcherSetTypePriority},
+    {"getTypePriority", l2dbus_dispatcherGetTypePriority},
+    {"setStarvationLimit", l2dbus_dispatcherSetStarvationLimit},
+    {"getStats", l2dbus_dispatcherGetStats},
+    {"setTimerResolution", l2dbus_dispatcherSetTimerResolution},
+    {"getTimerResolution", l2dbus_dispatcherGetTimerResolution},
+    {"defer", l2dbus_dispatcherDeferFunc},
+    {"deferKeyed", l2dbus_dispatcherDeferKeyed},
+    {"idle", l2dbus_dispatcherIdle},
+    {"getDeferred", l2dbus_dispatcherGetDeferred},
+    {"setGcStepping", l2dbus_dispatcherSetGcStepping},
+    {"getGcStats", l2dbus_dispatcherGetGcStats},
+    {"setTaskPoolSize", l2dbus_dispatcherSetTaskPoolSize},
+    {"getTaskStats", l2dbus_dispatcherGetTaskStats},
+    {"setCallNesting", l2dbus_dispatcherSetCallNesting},
+    {"getCallNesting", l2dbus_dispatcherGetCallNesting},
     {"__gc", l2dbus_dispatcherDispose},
     {NULL, NULL},
 };
@@ -319,6 +2218,8 @@ l2dbus_openDispatcher
 {
     lua_pop(L, l2dbus_createMetatable(L, L2DBUS_DISPATCHER_TYPE_ID,
             l2dbus_dispatcherMetaTable));
+    lua_pop(L, l2dbus_createMetatable(L, L2DBUS_GC_SENTINEL_TYPE_ID,
+            l2dbus_gcSentinelMetaTable));
     lua_createtable(L, 0, 1);
     lua_pushcfunction(L, l2dbus_newDispatcher);
     lua_setfield(L, -2, "new");
@@ -348,6 +2249,35 @@ l2dbus_openDispatcher
  */
     lua_pushinteger(L, CDBUS_RUN_ONCE);
     lua_setfield(L, -2, "DISPATCH_ONCE");
+
+/**
+ @constant PRIORITY_HIGH
+ Deferred messages of this priority class are delivered first.
+ */
+    lua_pushinteger(L, L2DBUS_DISPATCH_PRIORITY_HIGH);
+    lua_setfield(L, -2, "PRIORITY_HIGH");
+
+/**
+ @constant PRIORITY_NORMAL
+ The default priority class of all messages.
+ */
+    lua_pushinteger(L, L2DBUS_DISPATCH_PRIORITY_NORMAL);
+    lua_setfield(L, -2, "PRIORITY_NORMAL");
+
+/**
+ @constant PRIORITY_LOW
+ Deferred messages of this priority class are delivered last.
+ */
+    lua_pushinteger(L, L2DBUS_DISPATCH_PRIORITY_LOW);
+    lua_setfield(L, -2, "PRIORITY_LOW");
+
+/**
+ @constant PRIORITY_DEFAULT
+ Assigning this priority to a service object, interface, or match
+ indicates the priority class is derived from the type of the message.
+ */
+    lua_pushinteger(L, L2DBUS_DISPATCH_PRIORITY_DEFAULT);
+    lua_setfield(L, -2, "PRIORITY_DEFAULT");
 }
 
 
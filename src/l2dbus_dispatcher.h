@@ -32,20 +32,174 @@
  */
 
 #ifndef L2DBUS_DISPATCHER_H_
+#define L2DBUS_DISPATCHER_H_
 #include "lua.h"
+#include "dbus/dbus.h"
+#include "l2dbus_types.h"
+#include "l2dbus_callback.h"
+#include "l2dbus_scheduler.h"
 
 /* Forward declarations */
 struct cdbus_Dispatcher;
+struct cdbus_Timeout;
+struct l2dbus_DispatchItem;
+struct l2dbus_TimerWheel;
+struct l2dbus_ServiceObject;
+
+/*
+ * Priority classes of inbound message dispatch. Deferred messages
+ * of a higher class are delivered before those of a lower class.
+ */
+typedef enum
+{
+    L2DBUS_DISPATCH_PRIORITY_HIGH = 0,
+    L2DBUS_DISPATCH_PRIORITY_NORMAL,
+    L2DBUS_DISPATCH_PRIORITY_LOW,
+    L2DBUS_DISPATCH_PRIORITY_COUNT
+} l2dbus_DispatchPriority;
+
+/* The priority is derived from the type of the message */
+#define L2DBUS_DISPATCH_PRIORITY_DEFAULT    (-1)
+
+/*
+ * Function called to deliver a message whose dispatch was deferred
+ * because the dispatch budget of the current loop iteration was exhausted.
+ */
+typedef void (*l2dbus_DispatchFunc)(lua_State* L,
+                                    struct l2dbus_DispatchItem* item);
+
+typedef struct l2dbus_DispatchItem
+{
+    /* NULL if the item was cancelled */
+    l2dbus_DispatchFunc     func;
+    /* The (possibly non-Lua) object the message is destined for */
+    void*                   target;
+    /* Optional references to anchor the Lua target and connection */
+    int                     targetRef;
+    int                     connRef;
+    struct DBusMessage*     msg;
+    /* One of l2dbus_DispatchPriority */
+    int                     priority;
+    /* Time (msec) the message was first deferred (zero until then) */
+    double                  queuedAt;
+} l2dbus_DispatchItem;
+
+/* Ring buffer of deferred messages of a single priority class */
+typedef struct l2dbus_DispatchQueue
+{
+    l2dbus_DispatchItem*    items;
+    unsigned                head;
+    unsigned                count;
+    unsigned                capacity;
+    /* Number of times passed over for a higher priority class */
+    unsigned                skipped;
+    /* Statistics */
+    unsigned                peakCount;
+    unsigned long           nDeferred;
+    unsigned long           nDelivered;
+} l2dbus_DispatchQueue;
+
+/* A Lua function (and its arguments) deferred to a later loop iteration */
+typedef struct l2dbus_DeferItem
+{
+    int                     funcRef;
+    /* The single argument or a table of them if there are several */
+    int                     argsRef;
+    int                     nArgs;
+    /* The coalescing key or LUA_NOREF */
+    int                     keyRef;
+} l2dbus_DeferItem;
+
+/* Ring buffer of deferred Lua functions */
+typedef struct l2dbus_DeferQueue
+{
+    l2dbus_DeferItem*       items;
+    unsigned                head;
+    unsigned                count;
+    unsigned                capacity;
+    /* Sequence number of the item at the head of the queue */
+    unsigned long           headSeq;
+    /* Table mapping a coalescing key to the sequence number of its item */
+    int                     keysRef;
+} l2dbus_DeferQueue;
 
 typedef struct l2dbus_Dispatcher
 {
     struct cdbus_Dispatcher* disp;
     int finalizerRef;
+    l2dbus_CallbackCtx cbCtx;
+
+    /* Dispatch budget per loop iteration (zero means unlimited) */
+    unsigned maxMessages;
+    double maxMsec;
+
+    /* The current dispatch "slice" (one loop iteration) */
+    l2dbus_Bool sliceActive;
+    unsigned sliceCount;
+    double sliceStart;
+    struct cdbus_Timeout* sliceTimeout;
+
+    /* Deferred messages by priority class */
+    l2dbus_DispatchQueue queues[L2DBUS_DISPATCH_PRIORITY_COUNT];
+    unsigned queueCount;
+    /* A lower class is serviced once after being skipped this many times */
+    unsigned starvationLimit;
+    /* Default priority class of each message type */
+    int typePriority[DBUS_NUM_MESSAGE_TYPES];
+
+    /* Timer wheel shared by the Timeouts of the dispatcher */
+    struct l2dbus_TimerWheel* timerWheel;
+
+    /* Watches signaled during a loop iteration (batched delivery) */
+    l2dbus_CallbackCtx watchBatchCtx;
+    int watchBatchWatchesRef;
+    int watchBatchMasksRef;
+    unsigned watchBatchCount;
+    /* Incremented whenever a batch is delivered or dropped */
+    unsigned long watchBatchSeq;
+    struct cdbus_Timeout* watchBatchTimeout;
+
+    /* Lua functions run on the next loop iteration or once it's idle */
+    l2dbus_DeferQueue deferQueue;
+    l2dbus_DeferQueue idleQueue;
+    l2dbus_Bool deferArmed;
+    struct cdbus_Timeout* deferTimeout;
+
+    /* Incremental garbage collection during idle periods */
+    struct cdbus_Timeout* gcTimeout;
+    int gcStepKb;
+    double gcBudgetMsec;
+    l2dbus_Bool gcStopped;
+    /* The collector's heap size (KB) at which to start the next cycle */
+    int gcThresholdKb;
+    unsigned long gcSteps;
+    double gcStepMsec;
+
+    /* Tasks (coroutines) run by the dispatcher */
+    l2dbus_Scheduler sched;
+
+    /* Synchronous calls that run nested loop iterations (zero disables) */
+    unsigned maxCallDepth;
+    unsigned callDepth;
+    /* Hold requests to an object while its handler waits for a call */
+    l2dbus_Bool holdObjects;
+    /* The service object whose request is being delivered (if any) */
+    struct l2dbus_ServiceObject* activeObject;
 
 } l2dbus_Dispatcher;
 
 int l2dbus_newDispatcher(lua_State* L);
 void l2dbus_openDispatcher(lua_State* L);
 
+int l2dbus_dispatcherResolvePriority(const l2dbus_Dispatcher* dispUd,
+                                    int priority, struct DBusMessage* msg);
+l2dbus_Bool l2dbus_dispatcherIsThrottling(const l2dbus_Dispatcher* dispUd);
+l2dbus_Bool l2dbus_dispatcherAdmit(l2dbus_Dispatcher* dispUd, int priority);
+l2dbus_Bool l2dbus_dispatcherDefer(l2dbus_Dispatcher* dispUd,
+                                const l2dbus_DispatchItem* item);
+void l2dbus_dispatcherCancelDeferred(lua_State* L, l2dbus_Dispatcher* dispUd,
+                                    void* target);
+int l2dbus_checkDispatchPriority(lua_State* L, int idx);
+
 
 #endif /* Guard for L2DBUS_DISPATCHER_H_ */
@@ -0,0 +1,444 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_fallback.c
+ * @author         Glenn Schmottlach
+ * @brief          Implementation of a subtree (fallback) message handler.
+ *===========================================================================
+ */
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include "dbus/dbus.h"
+#include "cdbus/cdbus.h"
+#include "l2dbus_compat.h"
+#include "l2dbus_fallback.h"
+#include "l2dbus_connection.h"
+#include "l2dbus_dispatcher.h"
+#include "l2dbus_core.h"
+#include "l2dbus_trace.h"
+#include "l2dbus_debug.h"
+#include "l2dbus_types.h"
+#include "l2dbus_message.h"
+#include "l2dbus_alloc.h"
+#include "lualib.h"
+
+
+/**
+ * @brief Returns the path of a message relative to the root of a subtree.
+ *
+ * @return The relative path (empty for the root itself) or NULL if the
+ * message isn't addressed to the subtree.
+ */
+static const char*
+l2dbus_fallbackRelativePath
+    (
+    l2dbus_Fallback*    fallback,
+    const char*         path
+    )
+{
+    /* Every path is below the root */
+    if ( 1U == fallback->pathLen )
+    {
+        return (NULL == path) ? NULL : path + 1;
+    }
+
+    if ( (NULL == path) ||
+        (0 != strncmp(path, fallback->path, fallback->pathLen)) )
+    {
+        return NULL;
+    }
+
+    path += fallback->pathLen;
+    if ( '/' == *path )
+    {
+        ++path;
+    }
+    else if ( '\0' != *path )
+    {
+        return NULL;
+    }
+
+    return path;
+}
+
+
+/**
+ * @brief Answers an Introspect request from the introspection function
+ * of a subtree.
+ *
+ * @return DBUS_HANDLER_RESULT_NOT_YET_HANDLED if the function didn't
+ * return the XML for the path.
+ */
+static DBusHandlerResult
+l2dbus_fallbackIntrospect
+    (
+    lua_State*          L,
+    l2dbus_Fallback*    fallback,
+    DBusMessage*        msg,
+    const char*         relPath
+    )
+{
+    DBusHandlerResult rc = DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    DBusMessage* reply;
+    const char* xml;
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, fallback->introspectRef);
+    l2dbus_callbackPushObject(L, &fallback->cbCtx, fallback->connUd->conn);
+    lua_pushstring(L, relPath);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, fallback->cbCtx.userRef);
+
+    if ( (0 == l2dbus_callbackCall(L, fallback->cbCtx.modCtx, 3 /* nArgs */,
+                                1 /* nResults */, "Fallback introspect",
+                                NULL)) && (LUA_TSTRING == lua_type(L, -1)) )
+    {
+        xml = lua_tostring(L, -1);
+        reply = dbus_message_new_method_return(msg);
+        if ( (NULL == reply) || !dbus_message_append_args(reply,
+                                    DBUS_TYPE_STRING, &xml,
+                                    DBUS_TYPE_INVALID) )
+        {
+            rc = DBUS_HANDLER_RESULT_NEED_MEMORY;
+        }
+        else
+        {
+            if ( !dbus_message_get_no_reply(msg) )
+            {
+                dbus_connection_send(cdbus_connectionGetDBus(
+                                    fallback->connUd->conn), reply, NULL);
+            }
+            rc = DBUS_HANDLER_RESULT_HANDLED;
+        }
+
+        if ( NULL != reply )
+        {
+            dbus_message_unref(reply);
+        }
+    }
+    lua_pop(L, 1);
+
+    return rc;
+}
+
+
+/**
+ * @brief Calls the Lua handler of a subtree with a message.
+ *
+ * Introspect requests are answered from the introspection function if the
+ * subtree has one.
+ *
+ * @return The DBusHandlerResult value returned by the Lua handler.
+ */
+static DBusHandlerResult
+l2dbus_fallbackInvoke
+    (
+    lua_State*          L,
+    l2dbus_Fallback*    fallback,
+    DBusMessage*        msg,
+    const char*         relPath
+    )
+{
+    DBusHandlerResult rc = DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+    if ( (LUA_NOREF != fallback->introspectRef) &&
+        dbus_message_is_method_call(msg, DBUS_INTERFACE_INTROSPECTABLE,
+                                    "Introspect") &&
+        dbus_message_has_signature(msg, "") )
+    {
+        rc = l2dbus_fallbackIntrospect(L, fallback, msg, relPath);
+    }
+
+    if ( DBUS_HANDLER_RESULT_NOT_YET_HANDLED == rc )
+    {
+        l2dbus_callbackPushObject(L, &fallback->cbCtx,
+                                fallback->connUd->conn);
+        l2dbus_messageWrap(L, msg, L2DBUS_TRUE);
+        lua_pushstring(L, relPath);
+
+        if ( (0 == l2dbus_callbackInvokeDetail(L, &fallback->cbCtx,
+                                    3 /* nArgs */, 1 /* nResults */,
+                                    "Fallback",
+                                    dbus_message_get_member(msg))) &&
+            lua_isnumber(L, -1) )
+        {
+            rc = (DBusHandlerResult)lua_tointeger(L, -1);
+            switch ( rc )
+            {
+                case DBUS_HANDLER_RESULT_HANDLED:
+                case DBUS_HANDLER_RESULT_NOT_YET_HANDLED:
+                case DBUS_HANDLER_RESULT_NEED_MEMORY:
+                    /* These are understood */
+                    break;
+
+                default:
+                    L2DBUS_TRACE((L2DBUS_TRC_ERROR,
+                        "Unknown fallback callback return code (%d)", rc));
+                    rc = DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+                    break;
+            }
+        }
+    }
+
+    return rc;
+}
+
+
+/**
+ * @brief Delivers a message to a subtree whose dispatch was deferred.
+ *
+ * The D-Bus library has already been told the message was handled so an
+ * error is returned to the caller of a method the handler didn't handle.
+ * The fallback is cancelled from the queue when it's disposed.
+ *
+ * @param [in] L    The Lua state.
+ * @param [in] item The deferred dispatch item.
+ */
+static void
+l2dbus_fallbackDispatchDeferred
+    (
+    lua_State*              L,
+    l2dbus_DispatchItem*    item
+    )
+{
+    l2dbus_Fallback* fallback = (l2dbus_Fallback*)item->target;
+    DBusHandlerResult rc;
+    DBusMessage* errMsg;
+
+    rc = l2dbus_fallbackInvoke(L, fallback, item->msg,
+                                l2dbus_fallbackRelativePath(fallback,
+                                dbus_message_get_path(item->msg)));
+
+    if ( (DBUS_HANDLER_RESULT_HANDLED != rc) &&
+        (DBUS_MESSAGE_TYPE_METHOD_CALL == dbus_message_get_type(item->msg)) &&
+        !dbus_message_get_no_reply(item->msg) )
+    {
+        errMsg = dbus_message_new_error(item->msg, DBUS_ERROR_UNKNOWN_METHOD,
+                                        "Method not handled by subtree");
+        if ( NULL != errMsg )
+        {
+            dbus_connection_send(cdbus_connectionGetDBus(
+                                fallback->connUd->conn), errMsg, NULL);
+            dbus_message_unref(errMsg);
+        }
+    }
+}
+
+
+/**
+ * @brief Delivers a message addressed to a subtree to its Lua handler.
+ *
+ * Called by the D-Bus library for every message whose path is the root of
+ * the subtree or below it (unless a more specific object is registered).
+ * If the dispatch budget of the Dispatcher has been exhausted (or nested
+ * calls are enabled) the message is queued and delivered on a subsequent
+ * main loop iteration.
+ *
+ * @param [in] dbusConn The D-Bus connection that received the message.
+ * @param [in] msg      The D-Bus message.
+ * @param [in] userData The fallback.
+ * @return The DBusHandlerResult value returned by the Lua handler or
+ * DBUS_HANDLER_RESULT_HANDLED if the message was deferred.
+ */
+static DBusHandlerResult
+l2dbus_fallbackHandler
+    (
+    DBusConnection* dbusConn,
+    DBusMessage*    msg,
+    void*           userData
+    )
+{
+    l2dbus_Fallback* fallback = (l2dbus_Fallback*)userData;
+    l2dbus_Dispatcher* dispUd = fallback->connUd->dispUd;
+    DBusHandlerResult rc = DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    const char* relPath;
+    lua_State* L;
+    int base;
+    l2dbus_DispatchItem item;
+    int priority = L2DBUS_DISPATCH_PRIORITY_NORMAL;
+
+    (void)dbusConn;
+
+    relPath = l2dbus_fallbackRelativePath(fallback,
+                                        dbus_message_get_path(msg));
+    if ( NULL == relPath )
+    {
+        return rc;
+    }
+
+    L = l2dbus_callbackBegin(&fallback->cbCtx, &base);
+    assert( NULL != L );
+    l2dbus_callbackEnterDbusDispatch(&fallback->cbCtx);
+
+    if ( l2dbus_dispatcherIsThrottling(dispUd) )
+    {
+        priority = l2dbus_dispatcherResolvePriority(dispUd,
+                                    L2DBUS_DISPATCH_PRIORITY_DEFAULT, msg);
+    }
+
+    if ( l2dbus_dispatcherAdmit(dispUd, priority) )
+    {
+        rc = l2dbus_fallbackInvoke(L, fallback, msg, relPath);
+    }
+    else
+    {
+        item.func = l2dbus_fallbackDispatchDeferred;
+        item.priority = priority;
+        item.target = fallback;
+        item.targetRef = LUA_NOREF;
+        item.connRef = LUA_NOREF;
+        item.msg = dbus_message_ref(msg);
+        item.queuedAt = 0.0;
+        if ( l2dbus_dispatcherDefer(dispUd, &item) )
+        {
+            rc = DBUS_HANDLER_RESULT_HANDLED;
+        }
+        else
+        {
+            dbus_message_unref(item.msg);
+            rc = l2dbus_fallbackInvoke(L, fallback, msg, relPath);
+        }
+    }
+
+    l2dbus_callbackLeaveDbusDispatch(&fallback->cbCtx);
+    l2dbus_callbackEnd(L, base);
+
+    return rc;
+}
+
+
+/**
+ * @brief Registers a handler for every object path below a path.
+ *
+ * @param [in]      L               Lua state
+ * @param [in]      connIdx         Stack index of the Connection userdata.
+ * @param [in]      path            The root of the subtree.
+ * @param [in]      funcIdx         Stack index of the message handler.
+ * @param [in]      introspectIdx   Stack index of the introspection
+ *                                  function or L2DBUS_CALLBACK_NOREF_NEEDED.
+ * @param [in]      userIdx         Stack index of the user token or
+ *                                  L2DBUS_CALLBACK_NOREF_NEEDED.
+ * @param [in,out]  errMsg          Receives a constant error message on
+ *                                  failure.
+ * @return The registered fallback or NULL on failure.
+ */
+l2dbus_Fallback*
+l2dbus_newFallback
+    (
+    lua_State*      L,
+    int             connIdx,
+    const char*     path,
+    int             funcIdx,
+    int             introspectIdx,
+    int             userIdx,
+    const char**    errMsg
+    )
+{
+    DBusObjectPathVTable vtable;
+    l2dbus_Fallback* fallback;
+    l2dbus_Connection* connUd;
+    DBusError dbusError;
+
+    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "Create: fallback"));
+
+    fallback = (l2dbus_Fallback*)l2dbus_calloc(1, sizeof(*fallback));
+    if ( NULL == fallback )
+    {
+        *errMsg = "failed to allocate memory for fallback";
+        return NULL;
+    }
+
+    fallback->path = l2dbus_strDup(path);
+    if ( NULL == fallback->path )
+    {
+        l2dbus_free(fallback);
+        *errMsg = "failed to allocate memory for fallback";
+        return NULL;
+    }
+    fallback->pathLen = strlen(path);
+
+    memset(&vtable, 0, sizeof(vtable));
+    vtable.message_function = l2dbus_fallbackHandler;
+
+    connUd = (l2dbus_Connection*)lua_touserdata(L, connIdx);
+    dbus_error_init(&dbusError);
+    if ( !dbus_connection_try_register_fallback(
+                                    cdbus_connectionGetDBus(connUd->conn),
+                                    path, &vtable, fallback, &dbusError) )
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_WARN, "Failed to register fallback '%s' (%s)",
+                    path, dbus_error_is_set(&dbusError) ?
+                    dbusError.message : ""));
+        dbus_error_free(&dbusError);
+        l2dbus_free(fallback->path);
+        l2dbus_free(fallback);
+        *errMsg = "failed to register fallback (path already in use?)";
+        return NULL;
+    }
+
+    fallback->connUd = connUd;
+    l2dbus_callbackInit(L, &fallback->cbCtx);
+    l2dbus_callbackRef(L, funcIdx, userIdx, &fallback->cbCtx);
+    fallback->introspectRef = LUA_NOREF;
+    if ( L2DBUS_CALLBACK_NOREF_NEEDED != introspectIdx )
+    {
+        lua_pushvalue(L, introspectIdx);
+        fallback->introspectRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+
+    return fallback;
+}
+
+
+/**
+ * @brief Unregisters and frees a fallback.
+ *
+ * @param [in]  L           Lua state
+ * @param [in]  fallback    The fallback to dispose.
+ */
+void
+l2dbus_disposeFallback
+    (
+    lua_State*          L,
+    l2dbus_Fallback*    fallback
+    )
+{
+    if ( NULL != fallback )
+    {
+        if ( !dbus_connection_unregister_object_path(
+                            cdbus_connectionGetDBus(fallback->connUd->conn),
+                            fallback->path) )
+        {
+            L2DBUS_TRACE((L2DBUS_TRC_WARN,
+                        "Failed to unregister fallback '%s'", fallback->path));
+        }
+        l2dbus_dispatcherCancelDeferred(L, fallback->connUd->dispUd, fallback);
+        l2dbus_callbackUnref(L, &fallback->cbCtx);
+        luaL_unref(L, LUA_REGISTRYINDEX, fallback->introspectRef);
+        l2dbus_free(fallback->path);
+        l2dbus_free(fallback);
+    }
+}
@@ -39,7 +39,11 @@
 #include "cdbus/cdbus.h"
 #include "l2dbus_compat.h"
 #include "l2dbus_interface.h"
+#include "l2dbus_interfacedesc.h"
+#include "l2dbus_context.h"
+#include "l2dbus_connection.h"
 #include "l2dbus_serviceobject.h"
+#include "l2dbus_dispatcher.h"
 #include "l2dbus_core.h"
 #include "l2dbus_util.h"
 #include "l2dbus_trace.h"
@@ -48,9 +52,13 @@
 #include "l2dbus_alloc.h"
 #include "l2dbus_object.h"
 #include "l2dbus_message.h"
+#include "l2dbus_replycontext.h"
+#include "l2dbus_transcode.h"
 #include "l2dbus_dbuscompat.h"
 #include "lualib.h"
 
+#define L2DBUS_ERROR_PROCESSING_REQUEST     "org.l2dbus.error.ProcessingRequest"
+
 /**
  L2DBUS Interface
 
@@ -113,18 +121,1165 @@ l2dbus_interfaceDestroyItem
 /**
  * @brief Frees up the elements of an introspection property.
  *
- * This has a property name and signature.
+ * This has a property name and signature.
+ */
+static void
+l2dbus_interfaceDestroyProperty
+    (
+    cdbus_DbusIntrospectProperty* prop
+    )
+{
+    if ( NULL != prop )
+    {
+        l2dbus_free(prop->name);
+        l2dbus_free(prop->signature);
+    }
+}
+
+
+/**
+ * @brief Frees an array of parsed methods or signals.
+ */
+void
+l2dbus_interfaceFreeItems
+    (
+    cdbus_DbusIntrospectItem*   items,
+    size_t                      nItems
+    )
+{
+    size_t idx;
+
+    if ( NULL != items )
+    {
+        for ( idx = 0; idx < nItems; ++idx )
+        {
+            l2dbus_interfaceDestroyItem(&items[idx]);
+        }
+        l2dbus_free(items);
+    }
+}
+
+
+/**
+ * @brief Frees an array of parsed properties.
+ */
+void
+l2dbus_interfaceFreePropertyItems
+    (
+    cdbus_DbusIntrospectProperty*   props,
+    size_t                          nProps
+    )
+{
+    size_t idx;
+
+    if ( NULL != props )
+    {
+        for ( idx = 0; idx < nProps; ++idx )
+        {
+            l2dbus_interfaceDestroyProperty(&props[idx]);
+        }
+        l2dbus_free(props);
+    }
+}
+
+
+/**
+ * @brief Marks the introspection data of an interface as changed.
+ *
+ * Cached introspection data of any object implementing the interface
+ * is regenerated on the next request.
+ */
+static void
+l2dbus_interfaceTouch
+    (
+    l2dbus_Interface*   ud
+    )
+{
+    ud->introspectStamp = ++ud->cbCtx.modCtx->introspectStamp;
+}
+
+
+/**
+ * @brief Raises a Lua error if the description of an interface is shared.
+ *
+ * The members of an interface created from an InterfaceDescriptor are
+ * fixed by the descriptor.
+ */
+static void
+l2dbus_interfaceCheckOwnDesc
+    (
+    lua_State*          L,
+    l2dbus_Interface*   ud
+    )
+{
+    if ( NULL != ud->descUd )
+    {
+        luaL_error(L, "the members of an interface created from a "
+                    "descriptor cannot be changed");
+    }
+}
+
+
+/**
+ * @brief Frees the method table of a description.
+ */
+void
+l2dbus_interfaceDescFreeMethods
+    (
+    l2dbus_InterfaceDesc*   desc
+    )
+{
+    unsigned idx;
+
+    for ( idx = 0; idx < desc->nMethods; ++idx )
+    {
+        l2dbus_free(desc->methods[idx].name);
+        l2dbus_free(desc->methods[idx].inSig);
+        l2dbus_free(desc->methods[idx].outSig);
+    }
+    l2dbus_free(desc->methods);
+    l2dbus_free(desc->buckets);
+    desc->methods = NULL;
+    desc->nMethods = 0;
+    desc->buckets = NULL;
+    desc->nBuckets = 0;
+}
+
+
+/**
+ * @brief Releases the method handlers of an interface.
+ */
+static void
+l2dbus_interfaceFreeHandlers
+    (
+    lua_State*          L,
+    l2dbus_Interface*   ud
+    )
+{
+    unsigned idx;
+
+    if ( NULL != ud->methodRefs )
+    {
+        for ( idx = 0; idx < ud->desc->nMethods; ++idx )
+        {
+            luaL_unref(L, LUA_REGISTRYINDEX, ud->methodRefs[idx]);
+        }
+        l2dbus_free(ud->methodRefs);
+        ud->methodRefs = NULL;
+    }
+    ud->nHandlers = 0;
+}
+
+
+/**
+ * @brief Allocates the (empty) handler table of an interface.
+ *
+ * @return True on success or false if out of memory.
+ */
+static l2dbus_Bool
+l2dbus_interfaceAllocHandlers
+    (
+    l2dbus_Interface*   ud
+    )
+{
+    unsigned idx;
+
+    if ( (NULL == ud->methodRefs) && (0 < ud->desc->nMethods) )
+    {
+        ud->methodRefs = (int*)l2dbus_malloc(ud->desc->nMethods *
+                                            sizeof(*ud->methodRefs));
+        if ( NULL == ud->methodRefs )
+        {
+            return L2DBUS_FALSE;
+        }
+        for ( idx = 0; idx < ud->desc->nMethods; ++idx )
+        {
+            ud->methodRefs[idx] = LUA_NOREF;
+        }
+    }
+
+    return L2DBUS_TRUE;
+}
+
+
+/**
+ * @brief Concatenates the signatures of the arguments of a method that
+ * are transferred in the given direction.
+ *
+ * @return The (allocated) signature or NULL if out of memory.
+ */
+static char*
+l2dbus_interfaceMethodSignature
+    (
+    const cdbus_DbusIntrospectItem* item,
+    int                             xferDir
+    )
+{
+    size_t len = 0;
+    cdbus_UInt32 idx;
+    char* sig;
+
+    for ( idx = 0; idx < item->nArgs; ++idx )
+    {
+        if ( xferDir == (int)item->args[idx].xferDir )
+        {
+            len += strlen(item->args[idx].signature);
+        }
+    }
+
+    sig = (char*)l2dbus_malloc(len + 1);
+    if ( NULL != sig )
+    {
+        sig[0] = '\0';
+        for ( idx = 0; idx < item->nArgs; ++idx )
+        {
+            if ( xferDir == (int)item->args[idx].xferDir )
+            {
+                strcat(sig, item->args[idx].signature);
+            }
+        }
+    }
+
+    return sig;
+}
+
+
+/**
+ * @brief Builds the method table of a description.
+ *
+ * The signatures of every method are calculated once here.
+ *
+ * @param [in] desc     The description.
+ * @param [in] items    The parsed method descriptions.
+ * @param [in] nItems   The number of methods.
+ * @return True on success or false if out of memory.
+ */
+l2dbus_Bool
+l2dbus_interfaceDescBuildMethods
+    (
+    l2dbus_InterfaceDesc*           desc,
+    const cdbus_DbusIntrospectItem* items,
+    size_t                          nItems
+    )
+{
+    l2dbus_InterfaceMethod* method;
+    unsigned nBuckets = 8U;
+    unsigned bucket;
+    size_t idx;
+
+    l2dbus_interfaceDescFreeMethods(desc);
+    if ( 0 == nItems )
+    {
+        return L2DBUS_TRUE;
+    }
+
+    while ( nBuckets < 2U * nItems )
+    {
+        nBuckets *= 2U;
+    }
+
+    desc->methods = (l2dbus_InterfaceMethod*)l2dbus_calloc(nItems,
+                                                    sizeof(*desc->methods));
+    desc->buckets = (int*)l2dbus_malloc(nBuckets * sizeof(*desc->buckets));
+    if ( (NULL == desc->methods) || (NULL == desc->buckets) )
+    {
+        l2dbus_interfaceDescFreeMethods(desc);
+        return L2DBUS_FALSE;
+    }
+    desc->nBuckets = nBuckets;
+    for ( bucket = 0; bucket < nBuckets; ++bucket )
+    {
+        desc->buckets[bucket] = -1;
+    }
+
+    for ( idx = 0; idx < nItems; ++idx )
+    {
+        method = &desc->methods[desc->nMethods];
+        method->name = l2dbus_strDup(items[idx].name);
+        method->inSig = l2dbus_interfaceMethodSignature(&items[idx],
+                                                        CDBUS_XFER_IN);
+        method->outSig = l2dbus_interfaceMethodSignature(&items[idx],
+                                                        CDBUS_XFER_OUT);
+        ++desc->nMethods;
+        if ( (NULL == method->name) || (NULL == method->inSig) ||
+            (NULL == method->outSig) )
+        {
+            l2dbus_interfaceDescFreeMethods(desc);
+            return L2DBUS_FALSE;
+        }
+
+        method->hash = l2dbus_hashString(method->name);
+        bucket = method->hash & (nBuckets - 1U);
+        method->next = desc->buckets[bucket];
+        desc->buckets[bucket] = (int)(desc->nMethods - 1U);
+    }
+
+    return L2DBUS_TRUE;
+}
+
+
+/**
+ * @brief Builds the method table of an interface with its own description.
+ *
+ * Any handler given for a method (the *handler* field of its
+ * description) is referenced.
+ *
+ * @param [in] L        Lua state.
+ * @param [in] ud       The Interface userdata.
+ * @param [in] tblIdx   Stack index of the Lua method descriptions.
+ * @param [in] items    The parsed method descriptions.
+ * @param [in] nItems   The number of methods.
+ * @return True on success or false if out of memory.
+ */
+static l2dbus_Bool
+l2dbus_interfaceBuildMethods
+    (
+    lua_State*                      L,
+    l2dbus_Interface*               ud,
+    int                             tblIdx,
+    const cdbus_DbusIntrospectItem* items,
+    size_t                          nItems
+    )
+{
+    size_t idx;
+
+    tblIdx = lua_absindex(L, tblIdx);
+    l2dbus_interfaceFreeHandlers(L, ud);
+    if ( !l2dbus_interfaceDescBuildMethods(&ud->ownDesc, items, nItems) )
+    {
+        return L2DBUS_FALSE;
+    }
+
+    for ( idx = 0; idx < nItems; ++idx )
+    {
+        lua_rawgeti(L, tblIdx, (int)idx + 1);
+        lua_getfield(L, -1, "handler");
+        if ( LUA_TFUNCTION == lua_type(L, -1) )
+        {
+            if ( !l2dbus_interfaceAllocHandlers(ud) )
+            {
+                lua_pop(L, 2);
+                l2dbus_interfaceDescFreeMethods(&ud->ownDesc);
+                return L2DBUS_FALSE;
+            }
+            ud->methodRefs[idx] = luaL_ref(L, LUA_REGISTRYINDEX);
+            ++ud->nHandlers;
+        }
+        else
+        {
+            lua_pop(L, 1);
+        }
+        lua_pop(L, 1);
+    }
+
+    return L2DBUS_TRUE;
+}
+
+
+/**
+ * @brief Finds a method of an interface by name and input signature.
+ *
+ * Methods sharing a name (overloads) are told apart by their input
+ * signature. Without a signature, or if no overload has the signature,
+ * the method registered first with the name is returned.
+ *
+ * @param [in] ud   The Interface userdata.
+ * @param [in] name The name of the method.
+ * @param [in] sig  The input signature or NULL to match by name only.
+ * @return The method or NULL if the interface has no such method.
+ */
+static l2dbus_InterfaceMethod*
+l2dbus_interfaceFindMethod
+    (
+    l2dbus_Interface*   ud,
+    const char*         name,
+    const char*         sig
+    )
+{
+    const l2dbus_InterfaceDesc* desc = ud->desc;
+    l2dbus_InterfaceMethod* found = NULL;
+    unsigned hash;
+    int idx;
+
+    if ( (0 == desc->nMethods) || (NULL == name) )
+    {
+        return NULL;
+    }
+
+    /* Later methods are linked in front of earlier ones in a bucket */
+    hash = l2dbus_hashString(name);
+    for ( idx = desc->buckets[hash & (desc->nBuckets - 1U)]; 0 <= idx;
+        idx = desc->methods[idx].next )
+    {
+        if ( (desc->methods[idx].hash == hash) &&
+            (0 == strcmp(desc->methods[idx].name, name)) )
+        {
+            if ( (NULL != sig) &&
+                (0 == strcmp(desc->methods[idx].inSig, sig)) )
+            {
+                return &desc->methods[idx];
+            }
+            found = &desc->methods[idx];
+        }
+    }
+
+    return found;
+}
+
+
+/**
+ * @brief Finds the method handler of an interface for a request.
+ *
+ * @return The method or NULL if the request isn't a method call or
+ * the method has no handler of its own.
+ */
+static l2dbus_InterfaceMethod*
+l2dbus_interfaceFindHandler
+    (
+    l2dbus_Interface*   ud,
+    DBusMessage*        msg
+    )
+{
+    l2dbus_InterfaceMethod* method;
+
+    if ( (0 == ud->nHandlers) ||
+        (DBUS_MESSAGE_TYPE_METHOD_CALL != dbus_message_get_type(msg)) )
+    {
+        return NULL;
+    }
+
+    method = l2dbus_interfaceFindMethod(ud, dbus_message_get_member(msg),
+                                        dbus_message_get_signature(msg));
+    if ( (NULL == method) ||
+        (LUA_NOREF == ud->methodRefs[method - ud->desc->methods]) )
+    {
+        return NULL;
+    }
+
+    return method;
+}
+
+
+/**
+ * @brief Frees the property table of a description.
+ */
+void
+l2dbus_interfaceDescFreeProperties
+    (
+    l2dbus_InterfaceDesc*   desc
+    )
+{
+    unsigned idx;
+
+    for ( idx = 0; idx < desc->nProps; ++idx )
+    {
+        l2dbus_free(desc->props[idx].name);
+        l2dbus_free(desc->props[idx].sig);
+    }
+    l2dbus_free(desc->props);
+    l2dbus_free(desc->propBuckets);
+    desc->props = NULL;
+    desc->nProps = 0;
+    desc->propBuckets = NULL;
+    desc->nPropBuckets = 0;
+}
+
+
+/**
+ * @brief Frees the stored property values of an interface.
+ */
+static void
+l2dbus_interfaceFreeValues
+    (
+    l2dbus_Interface*   ud
+    )
+{
+    unsigned idx;
+
+    if ( NULL != ud->values )
+    {
+        for ( idx = 0; idx < ud->desc->nProps; ++idx )
+        {
+            if ( NULL != ud->values[idx].value )
+            {
+                dbus_message_unref(ud->values[idx].value);
+            }
+        }
+        l2dbus_free(ud->values);
+        ud->values = NULL;
+    }
+    ud->nPropValues = 0;
+    ud->batch.nPending = 0;
+}
+
+
+/**
+ * @brief Allocates the (empty) property values of an interface.
+ *
+ * @return True on success or false if out of memory.
+ */
+static l2dbus_Bool
+l2dbus_interfaceAllocValues
+    (
+    l2dbus_Interface*   ud
+    )
+{
+    if ( 0 < ud->desc->nProps )
+    {
+        ud->values = (l2dbus_PropertyValue*)l2dbus_calloc(ud->desc->nProps,
+                                                    sizeof(*ud->values));
+    }
+
+    return (0 == ud->desc->nProps) || (NULL != ud->values);
+}
+
+
+/**
+ * @brief Builds the property table of a description.
+ *
+ * @param [in] desc     The description.
+ * @param [in] items    The parsed property descriptions.
+ * @param [in] nItems   The number of properties.
+ * @return True on success or false if out of memory.
+ */
+l2dbus_Bool
+l2dbus_interfaceDescBuildProperties
+    (
+    l2dbus_InterfaceDesc*               desc,
+    const cdbus_DbusIntrospectProperty* items,
+    size_t                              nItems
+    )
+{
+    l2dbus_InterfaceProperty* prop;
+    unsigned nBuckets = 8U;
+    unsigned bucket;
+    size_t idx;
+
+    l2dbus_interfaceDescFreeProperties(desc);
+    if ( 0 == nItems )
+    {
+        return L2DBUS_TRUE;
+    }
+
+    while ( nBuckets < 2U * nItems )
+    {
+        nBuckets *= 2U;
+    }
+
+    desc->props = (l2dbus_InterfaceProperty*)l2dbus_calloc(nItems,
+                                                    sizeof(*desc->props));
+    desc->propBuckets = (int*)l2dbus_malloc(nBuckets *
+                                            sizeof(*desc->propBuckets));
+    if ( (NULL == desc->props) || (NULL == desc->propBuckets) )
+    {
+        l2dbus_interfaceDescFreeProperties(desc);
+        return L2DBUS_FALSE;
+    }
+    desc->nPropBuckets = nBuckets;
+    for ( bucket = 0; bucket < nBuckets; ++bucket )
+    {
+        desc->propBuckets[bucket] = -1;
+    }
+
+    for ( idx = 0; idx < nItems; ++idx )
+    {
+        prop = &desc->props[desc->nProps];
+        prop->name = l2dbus_strDup(items[idx].name);
+        prop->sig = l2dbus_strDup(items[idx].signature);
+        prop->readable = items[idx].read;
+        prop->writable = items[idx].write;
+        ++desc->nProps;
+        if ( (NULL == prop->name) || (NULL == prop->sig) )
+        {
+            l2dbus_interfaceDescFreeProperties(desc);
+            return L2DBUS_FALSE;
+        }
+
+        prop->hash = l2dbus_hashString(prop->name);
+        bucket = prop->hash & (nBuckets - 1U);
+        prop->next = desc->propBuckets[bucket];
+        desc->propBuckets[bucket] = (int)(desc->nProps - 1U);
+    }
+
+    return L2DBUS_TRUE;
+}
+
+
+/**
+ * @brief Builds the property table of an interface with its own
+ * description.
+ *
+ * Any values stored for the previous properties are discarded.
+ *
+ * @param [in] ud       The Interface userdata.
+ * @param [in] items    The parsed property descriptions.
+ * @param [in] nItems   The number of properties.
+ * @return True on success or false if out of memory.
+ */
+static l2dbus_Bool
+l2dbus_interfaceBuildProperties
+    (
+    l2dbus_Interface*                   ud,
+    const cdbus_DbusIntrospectProperty* items,
+    size_t                              nItems
+    )
+{
+    l2dbus_interfaceFreeValues(ud);
+    if ( !l2dbus_interfaceDescBuildProperties(&ud->ownDesc, items, nItems) )
+    {
+        return L2DBUS_FALSE;
+    }
+    if ( !l2dbus_interfaceAllocValues(ud) )
+    {
+        l2dbus_interfaceDescFreeProperties(&ud->ownDesc);
+        return L2DBUS_FALSE;
+    }
+
+    return L2DBUS_TRUE;
+}
+
+
+/**
+ * @brief Finds a registered property of an interface by name.
+ *
+ * @return The property or NULL if the interface has no such property.
+ */
+l2dbus_InterfaceProperty*
+l2dbus_interfaceFindProperty
+    (
+    l2dbus_Interface*   ud,
+    const char*         name
+    )
+{
+    const l2dbus_InterfaceDesc* desc = ud->desc;
+    unsigned hash;
+    int idx;
+
+    if ( (0 == desc->nProps) || (NULL == name) )
+    {
+        return NULL;
+    }
+
+    hash = l2dbus_hashString(name);
+    for ( idx = desc->propBuckets[hash & (desc->nPropBuckets - 1U)];
+        0 <= idx; idx = desc->props[idx].next )
+    {
+        if ( (desc->props[idx].hash == hash) &&
+            (0 == strcmp(desc->props[idx].name, name)) )
+        {
+            return &desc->props[idx];
+        }
+    }
+
+    return NULL;
+}
+
+
+/**
+ * @brief Appends the stored value of a property as a variant.
+ *
+ * @param [in] ud       The Interface userdata.
+ * @param [in] prop     A property with a stored value.
+ * @param [in] iter     The append iterator of the destination message.
+ * @return True if the value was appended or false if out of memory.
+ */
+l2dbus_Bool
+l2dbus_interfaceAppendProperty
+    (
+    l2dbus_Interface*           ud,
+    l2dbus_InterfaceProperty*   prop,
+    DBusMessageIter*            iter
+    )
+{
+    DBusMessage* value = L2DBUS_INTERFACE_VALUE(ud, prop)->value;
+    DBusMessageIter valueIt;
+    DBusMessageIter variantIt;
+    l2dbus_Bool isAppended = L2DBUS_FALSE;
+
+    assert( NULL != value );
+
+    if ( dbus_message_iter_init(value, &valueIt) &&
+        dbus_message_iter_open_container(iter, DBUS_TYPE_VARIANT, prop->sig,
+                                        &variantIt) )
+    {
+        isAppended = l2dbus_transcodeCopyArg(&valueIt, &variantIt);
+        if ( !dbus_message_iter_close_container(iter, &variantIt) )
+        {
+            isAppended = L2DBUS_FALSE;
+        }
+    }
+
+    return isAppended;
+}
+
+
+/**
+ * @brief Emits one PropertiesChanged signal for the pending changes.
+ *
+ * Changed properties are sent with their current (stored) value and
+ * invalidated ones by name only.
+ *
+ * @return True if a signal was queued to be sent.
+ */
+static l2dbus_Bool
+l2dbus_interfaceFlushChanges
+    (
+    l2dbus_Interface*   ud
+    )
+{
+    l2dbus_PropertyBatch* batch = &ud->batch;
+    DBusMessage* signal = NULL;
+    DBusMessageIter iter;
+    DBusMessageIter arrayIt;
+    DBusMessageIter entryIt;
+    l2dbus_InterfaceProperty* prop;
+    l2dbus_PropertyValue* value;
+    const char* intfName = cdbus_interfaceGetName(ud->intf);
+    l2dbus_Bool isOk;
+    unsigned idx;
+
+    if ( (0U == batch->nPending) || (NULL == batch->connUd) )
+    {
+        return L2DBUS_FALSE;
+    }
+
+    signal = dbus_message_new_signal(batch->path, DBUS_INTERFACE_PROPERTIES,
+                                    "PropertiesChanged");
+    isOk = (NULL != signal);
+    if ( isOk )
+    {
+        dbus_message_iter_init_append(signal, &iter);
+        isOk = dbus_message_iter_append_basic(&iter, DBUS_TYPE_STRING,
+                                            &intfName) &&
+            dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+                    DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+                    DBUS_TYPE_STRING_AS_STRING
+                    DBUS_TYPE_VARIANT_AS_STRING
+                    DBUS_DICT_ENTRY_END_CHAR_AS_STRING, &arrayIt);
+    }
+
+    for ( idx = 0; isOk && (idx < ud->desc->nProps); ++idx )
+    {
+        prop = &ud->desc->props[idx];
+        value = &ud->values[idx];
+        if ( (L2DBUS_PROPERTY_CHANGED == value->pending) &&
+            (NULL != value->value) )
+        {
+            isOk = dbus_message_iter_open_container(&arrayIt,
+                            DBUS_TYPE_DICT_ENTRY, NULL, &entryIt) &&
+                dbus_message_iter_append_basic(&entryIt, DBUS_TYPE_STRING,
+                                            &prop->name) &&
+                l2dbus_interfaceAppendProperty(ud, prop, &entryIt) &&
+                dbus_message_iter_close_container(&arrayIt, &entryIt);
+        }
+    }
+
+    isOk = isOk && dbus_message_iter_close_container(&iter, &arrayIt) &&
+        dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+                                        DBUS_TYPE_STRING_AS_STRING, &arrayIt);
+    for ( idx = 0; isOk && (idx < ud->desc->nProps); ++idx )
+    {
+        prop = &ud->desc->props[idx];
+        value = &ud->values[idx];
+        if ( (L2DBUS_PROPERTY_INVALIDATED == value->pending) ||
+            ((L2DBUS_PROPERTY_CHANGED == value->pending) &&
+            (NULL == value->value)) )
+        {
+            isOk = dbus_message_iter_append_basic(&arrayIt, DBUS_TYPE_STRING,
+                                                &prop->name);
+        }
+    }
+    isOk = isOk && dbus_message_iter_close_container(&iter, &arrayIt);
+
+    /* The changes are dropped even if they couldn't be sent */
+    for ( idx = 0; idx < ud->desc->nProps; ++idx )
+    {
+        ud->values[idx].pending = 0U;
+    }
+    batch->nPending = 0U;
+
+    if ( isOk )
+    {
+        isOk = dbus_connection_send(
+                    cdbus_connectionGetDBus(batch->connUd->conn), signal, NULL);
+    }
+
+    if ( isOk )
+    {
+        ++batch->nSignals;
+    }
+    else
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_ERROR,
+            "Failed to emit PropertiesChanged for interface '%s'", intfName));
+    }
+
+    if ( NULL != signal )
+    {
+        dbus_message_unref(signal);
+    }
+
+    return isOk;
+}
+
+
+/*
+ * Called when the batching window of an interface ends.
+ */
+static cdbus_Bool
+l2dbus_interfaceBatchHandler
+    (
+    cdbus_Timeout*  t,
+    void*           user
+    )
+{
+    l2dbus_Interface* ud = (l2dbus_Interface*)user;
+
+    ud->batch.armed = L2DBUS_FALSE;
+    l2dbus_interfaceFlushChanges(ud);
+
+    /* The return value is unused by CDBUS */
+    return CDBUS_TRUE;
+}
+
+
+/**
+ * @brief Records a change to a property to be announced.
+ *
+ * Nothing is recorded unless batching is enabled. The latest change to
+ * a property within a batch replaces any earlier one.
+ *
+ * @param [in] ud       The Interface userdata.
+ * @param [in] prop     The property that changed.
+ * @param [in] change   L2DBUS_PROPERTY_CHANGED or L2DBUS_PROPERTY_INVALIDATED.
+ */
+static void
+l2dbus_interfaceMarkChanged
+    (
+    l2dbus_Interface*           ud,
+    l2dbus_InterfaceProperty*   prop,
+    unsigned                    change
+    )
+{
+    l2dbus_PropertyBatch* batch = &ud->batch;
+    l2dbus_PropertyValue* value = L2DBUS_INTERFACE_VALUE(ud, prop);
+    cdbus_HResult rc;
+
+    if ( NULL == batch->connUd )
+    {
+        return;
+    }
+
+    ++batch->nChanges;
+    if ( 0U == value->pending )
+    {
+        ++batch->nPending;
+    }
+    value->pending = change;
+
+    if ( !batch->armed )
+    {
+        /* A one-shot timeout may still report that it's enabled after
+         * it has expired so explicitly re-arm it.
+         */
+        cdbus_timeoutEnable(batch->timeout, CDBUS_FALSE);
+        rc = cdbus_timeoutEnable(batch->timeout, CDBUS_TRUE);
+        if ( CDBUS_FAILED(rc) )
+        {
+            L2DBUS_TRACE((L2DBUS_TRC_ERROR,
+                "Failed to arm property batch timeout (0x%X)", rc));
+            l2dbus_interfaceFlushChanges(ud);
+        }
+        else
+        {
+            batch->armed = L2DBUS_TRUE;
+        }
+    }
+}
+
+
+/**
+ * @brief Stops batching changes to the properties of an interface.
+ *
+ * @param [in] L        Lua state.
+ * @param [in] ud       The Interface userdata.
+ * @param [in] flush    Emit the pending changes (otherwise they're dropped).
+ */
+static void
+l2dbus_interfaceStopBatching
+    (
+    lua_State*          L,
+    l2dbus_Interface*   ud,
+    l2dbus_Bool         flush
+    )
+{
+    l2dbus_PropertyBatch* batch = &ud->batch;
+
+    if ( flush )
+    {
+        l2dbus_interfaceFlushChanges(ud);
+    }
+    if ( NULL != batch->timeout )
+    {
+        cdbus_timeoutEnable(batch->timeout, CDBUS_FALSE);
+        cdbus_timeoutUnref(batch->timeout);
+        batch->timeout = NULL;
+    }
+    luaL_unref(L, LUA_REGISTRYINDEX, batch->connRef);
+    batch->connRef = LUA_NOREF;
+    batch->connUd = NULL;
+    l2dbus_free(batch->path);
+    batch->path = NULL;
+    batch->armed = L2DBUS_FALSE;
+}
+
+
+/**
+ * @brief Replaces the stored value of a property.
+ *
+ * @param [in] ud       The Interface userdata.
+ * @param [in] prop     The property.
+ * @param [in] valueIt  An iterator positioned on the new value (which
+ * must match the signature of the property).
+ * @return True if the value was stored or false if out of memory.
+ */
+l2dbus_Bool
+l2dbus_interfaceStoreProperty
+    (
+    l2dbus_Interface*           ud,
+    l2dbus_InterfaceProperty*   prop,
+    DBusMessageIter*            valueIt
+    )
+{
+    DBusMessage* value = dbus_message_new(DBUS_MESSAGE_TYPE_METHOD_RETURN);
+    l2dbus_PropertyValue* stored = L2DBUS_INTERFACE_VALUE(ud, prop);
+    DBusMessageIter appendIt;
+
+    if ( NULL == value )
+    {
+        return L2DBUS_FALSE;
+    }
+
+    dbus_message_iter_init_append(value, &appendIt);
+    if ( !l2dbus_transcodeCopyArg(valueIt, &appendIt) )
+    {
+        dbus_message_unref(value);
+        return L2DBUS_FALSE;
+    }
+
+    if ( NULL == stored->value )
+    {
+        ++ud->nPropValues;
+    }
+    else
+    {
+        dbus_message_unref(stored->value);
+    }
+    stored->value = value;
+    l2dbus_interfaceMarkChanged(ud, prop, L2DBUS_PROPERTY_CHANGED);
+
+    return L2DBUS_TRUE;
+}
+
+
+/**
+ * @brief Decodes the arguments of a request and calls the method handler.
+ *
+ * Called (protected) with the handler, the ReplyContext and the request
+ * message (as light userdata) on the stack. If the handler raises an
+ * error before replying an error reply is sent on its behalf.
+ */
+static int
+l2dbus_interfaceMethodThunk
+    (
+    lua_State*  L
+    )
+{
+    DBusMessage* msg = (DBusMessage*)lua_touserdata(L, 3);
+    l2dbus_ReplyContext* ctx;
+    int nArgs;
+
+    lua_settop(L, 2);
+    lua_pushvalue(L, 2);
+    lua_insert(L, 1);
+    nArgs = l2dbus_transcodeDbusArgsToLua(L, msg);
+    if ( 0 != lua_pcall(L, nArgs + 1, 0, 0) )
+    {
+        /* The handler may have released the context */
+        ctx = l2dbus_replyContextGet(L, 1);
+        if ( (NULL != ctx) && !ctx->replied &&
+            !dbus_message_get_no_reply(msg) )
+        {
+            l2dbus_replyContextSendError(ctx, L2DBUS_ERROR_PROCESSING_REQUEST,
+                        lua_isstring(L, -1) ? lua_tostring(L, -1) : NULL, NULL);
+        }
+        lua_error(L);
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Delivers a request to the handler of a method.
+ *
+ * The signature of the request is checked before the handler is called
+ * with a ReplyContext followed by the decoded arguments. Requests over
+ * the admission limits of the service object are rejected beforehand.
+ *
+ * @param [in] L        The callback thread.
+ * @param [in] ud       The Interface userdata.
+ * @param [in] method   The method being called.
+ * @param [in] connIdx  Stack index of the Connection userdata.
+ * @param [in] obj      The CDBUS service object implementing the interface.
+ * @param [in] msg      The request message.
+ * @param [in] queuedAt Time (msec) the request was deferred by the
+ * Dispatcher or zero if it's delivered as it's received.
+ */
+static void
+l2dbus_interfaceCallMethod
+    (
+    lua_State*              L,
+    l2dbus_Interface*       ud,
+    l2dbus_InterfaceMethod* method,
+    int                     connIdx,
+    struct cdbus_Object*    obj,
+    DBusMessage*            msg,
+    double                  queuedAt
+    )
+{
+    l2dbus_ReplyContext* ctx;
+    l2dbus_ServiceObject* svcUd;
+    l2dbus_Connection* connUd;
+    int ctxIdx;
+
+    connIdx = lua_absindex(L, connIdx);
+    connUd = (l2dbus_Connection*)lua_touserdata(L, connIdx);
+
+    /* Deferred replies are counted against the service object */
+    svcUd = (l2dbus_ServiceObject*)l2dbus_callbackPushObject(L, &ud->cbCtx,
+                                                            obj);
+    if ( (NULL != svcUd) && !l2dbus_admissionEnter(&svcUd->admission,
+                                    cdbus_connectionGetDBus(connUd->conn),
+                                    msg, queuedAt) )
+    {
+        lua_pop(L, 1);
+        return;
+    }
+
+    ctx = l2dbus_replyContextAcquire(L, connIdx, -1, msg, method->outSig);
+    ctxIdx = lua_gettop(L);
+
+    if ( !dbus_message_has_signature(msg, method->inSig) )
+    {
+        if ( !dbus_message_get_no_reply(msg) )
+        {
+            l2dbus_replyContextSendError(ctx, DBUS_ERROR_INVALID_ARGS,
+                                    "Unexpected signature for method", NULL);
+        }
+    }
+    else
+    {
+        lua_pushcfunction(L, l2dbus_interfaceMethodThunk);
+        lua_rawgeti(L, LUA_REGISTRYINDEX,
+                    ud->methodRefs[method - ud->desc->methods]);
+        lua_pushvalue(L, ctxIdx);
+        lua_pushlightuserdata(L, msg);
+        if ( 0 != l2dbus_callbackCallThunk(L, ud->cbCtx.modCtx,
+                                        3 /* nArgs */, 0, "Method",
+                                        method->name) )
+        {
+            /* The arguments couldn't be decoded */
+            ctx = l2dbus_replyContextGet(L, ctxIdx);
+            if ( (NULL != ctx) && !ctx->replied &&
+                !dbus_message_get_no_reply(msg) )
+            {
+                l2dbus_replyContextSendError(ctx, DBUS_ERROR_INVALID_ARGS,
+                                        "Failed to decode arguments", NULL);
+            }
+        }
+    }
+
+    /* Contexts replied to by the handler are recycled */
+    l2dbus_replyContextRelease(L, ctxIdx);
+    if ( NULL != svcUd )
+    {
+        l2dbus_admissionExit(&svcUd->admission, msg);
+    }
+    lua_pop(L, 2);
+}
+
+
+/**
+ * @brief Delivers a method call that was deferred by the Dispatcher.
+ *
+ * The method is looked up again since the interface or its handler may
+ * have been removed in the meantime. As the request was reported as
+ * handled when it was deferred an *UnknownMethod* error is sent if no
+ * method handler is left. Requests arriving while a handler of the
+ * object waits in a nested call are held until it returns.
+ *
+ * @param [in] L    The Lua state used to make the call.
+ * @param [in] item The deferred dispatch item.
  */
 static void
-l2dbus_interfaceDestroyProperty
+l2dbus_interfaceDispatchDeferred
     (
-    cdbus_DbusIntrospectProperty* prop
+    lua_State*              L,
+    l2dbus_DispatchItem*    item
     )
 {
-    if ( NULL != prop )
+    l2dbus_ServiceObject* svcUd = (l2dbus_ServiceObject*)item->target;
+    const char* intfName = dbus_message_get_interface(item->msg);
+    l2dbus_InterfaceMethod* method = NULL;
+    l2dbus_Interface* ud = NULL;
+    l2dbus_ServiceObject* prevActive;
+    l2dbus_Connection* connUd;
+    l2dbus_RefItem* refItem;
+    DBusMessage* errMsg;
+
+    if ( (0U < svcUd->holdCount) &&
+        l2dbus_serviceObjectHoldItem(L, svcUd, item) )
     {
-        l2dbus_free(prop->name);
-        l2dbus_free(prop->signature);
+        return;
+    }
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, item->connRef);
+    connUd = (l2dbus_Connection*)lua_touserdata(L, -1);
+
+    for ( refItem = LIST_FIRST(&svcUd->interfaces.list);
+        (NULL == method) && (refItem != LIST_END(&svcUd->interfaces.list));
+        refItem = LIST_NEXT(refItem, link) )
+    {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, refItem->refIdx);
+        ud = (l2dbus_Interface*)lua_touserdata(L, -1);
+        lua_pop(L, 1);
+        if ( (NULL != ud) && ((NULL == intfName) ||
+            (0 == strcmp(intfName, cdbus_interfaceGetName(ud->intf)))) )
+        {
+            method = l2dbus_interfaceFindHandler(ud, item->msg);
+        }
+    }
+
+    if ( NULL != method )
+    {
+        /* Lets a nested call made by the handler find the object */
+        prevActive = connUd->dispUd->activeObject;
+        connUd->dispUd->activeObject = svcUd;
+        l2dbus_interfaceCallMethod(L, ud, method, -1, svcUd->obj, item->msg,
+                                item->queuedAt);
+        connUd->dispUd->activeObject = prevActive;
+    }
+    else if ( !dbus_message_get_no_reply(item->msg) )
+    {
+        errMsg = dbus_message_new_error(item->msg, DBUS_ERROR_UNKNOWN_METHOD,
+                                        "Method not handled by interface");
+        if ( NULL != errMsg )
+        {
+            dbus_connection_send(cdbus_connectionGetDBus(connUd->conn),
+                                errMsg, NULL);
+            dbus_message_unref(errMsg);
+        }
     }
 }
 
@@ -134,7 +1289,9 @@ l2dbus_interfaceDestroyProperty
 
  This function will try to deliver a callback to a Lua handler function
  when invoked. The handler itself will determine whether or not it
- can handle the request.
+ can handle the request. A method call for a method with its own
+ handler is queued if the dispatch budget of the Dispatcher has been
+ exhausted and delivered on a subsequent main loop iteration.
 
  @param [in] conn     The CDBUS connection associated with this interface
  request.
@@ -144,8 +1301,9 @@ l2dbus_interfaceDestroyProperty
  was registered.
  @return A suitable DBusHandlerResult value. Returning
  DBUS_HANDLER_RESULT_HANDLED indicates the interface handler processed
- the request. Otherwise the service object will be given a chance to
- handle the request.
+ the request (or it was rejected by the admission control of the
+ service object). Otherwise the service object will be given a chance
+ to handle the request.
  */
 static DBusHandlerResult
 l2dbus_interfaceHandler
@@ -156,13 +1314,24 @@ l2dbus_interfaceHandler
         void*                       userdata
     )
 {
-    lua_State* L = l2dbus_callbackGetThread();
-    const char* errMsg = "";
+    /* The callback thread is resolved from the context of the Lua state
+     * that owns the interface.
+     */
+    const l2dbus_CallbackCtx* cbCtx = &((l2dbus_Interface*)userdata)->cbCtx;
+    int base;
+    lua_State* L = l2dbus_callbackBegin(cbCtx, &base);
     DBusHandlerResult rc = DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
     l2dbus_Interface* ud;
+    l2dbus_InterfaceMethod* method;
+    l2dbus_ServiceObject* svcUd = NULL;
+    l2dbus_Connection* connUd;
+    l2dbus_Bool admitted = L2DBUS_FALSE;
+    l2dbus_DispatchItem item;
+    int priority = L2DBUS_DISPATCH_PRIORITY_NORMAL;
 
     /* Leaves the userdata sitting on the top of the stack */
-    ud = l2dbus_objectRegistryGet(L, userdata);
+    ud = l2dbus_callbackPushObject(L, cbCtx, userdata);
+    l2dbus_callbackEnterDbusDispatch(cbCtx);
 
     /* Nil or the Interface userdata is sitting at the top of the
      * stack at this point.
@@ -177,36 +1346,88 @@ l2dbus_interfaceHandler
         L2DBUS_TRACE((L2DBUS_TRC_WARN,
             "Cannot call interface handler because interface has been GC'ed"));
     }
+    /* Else if the method has its own handler then ... */
+    else if ( NULL != (method = l2dbus_interfaceFindHandler(ud, msg)) )
+    {
+        /* Anchors the service object while the request is deferred */
+        svcUd = (l2dbus_ServiceObject*)l2dbus_callbackPushObject(L, cbCtx,
+                                                                obj);
+        connUd = (l2dbus_Connection*)l2dbus_callbackPushObject(L, cbCtx, conn);
+        if ( NULL == connUd )
+        {
+            L2DBUS_TRACE((L2DBUS_TRC_WARN, "Cannot call method handler "
+                "because connection has been GC'ed"));
+        }
+        else
+        {
+            rc = DBUS_HANDLER_RESULT_HANDLED;
+
+            /* Only resolve the priority if delivery might be deferred */
+            if ( (NULL != svcUd) &&
+                l2dbus_dispatcherIsThrottling(connUd->dispUd) )
+            {
+                priority = l2dbus_serviceObjectPriority(L, svcUd,
+                                                    connUd->dispUd, msg);
+            }
+
+            if ( (NULL == svcUd) ||
+                l2dbus_dispatcherAdmit(connUd->dispUd, priority) )
+            {
+                l2dbus_interfaceCallMethod(L, ud, method, -1, obj, msg, 0.0);
+            }
+            else
+            {
+                item.func = l2dbus_interfaceDispatchDeferred;
+                item.priority = priority;
+                item.target = svcUd;
+                lua_pushvalue(L, -2 /* Service object ud */);
+                item.targetRef = luaL_ref(L, LUA_REGISTRYINDEX);
+                lua_pushvalue(L, -1 /* Connection ud */);
+                item.connRef = luaL_ref(L, LUA_REGISTRYINDEX);
+                item.msg = dbus_message_ref(msg);
+                item.queuedAt = 0.0;
+
+                if ( !l2dbus_dispatcherDefer(connUd->dispUd, &item) )
+                {
+                    luaL_unref(L, LUA_REGISTRYINDEX, item.targetRef);
+                    luaL_unref(L, LUA_REGISTRYINDEX, item.connRef);
+                    dbus_message_unref(item.msg);
+                    l2dbus_interfaceCallMethod(L, ud, method, -1, obj, msg,
+                                            0.0);
+                }
+            }
+        }
+    }
     else if ( LUA_NOREF != ud->cbCtx.funcRef )
     {
-        /* Push function and user value on the stack and execute the callback */
-        lua_rawgeti(L, LUA_REGISTRYINDEX, ud->cbCtx.funcRef);
+        /* Anchors the service object while the handler runs */
+        svcUd = (l2dbus_ServiceObject*)l2dbus_callbackPushObject(L, cbCtx,
+                                                                obj);
         /* Push the interface userdata */
         lua_pushvalue(L, -2 /* Interface ud */);
         /* Push the associated Lua userdata wrapper on the stack */
-        l2dbus_objectRegistryGet(L, conn);
-        if ( lua_isnil(L, -1) )
+        connUd = (l2dbus_Connection*)l2dbus_callbackPushObject(L, cbCtx, conn);
+        if ( NULL == connUd )
         {
             L2DBUS_TRACE((L2DBUS_TRC_WARN, "Cannot call interface handler "
                 "because connection has been GC'ed"));
         }
+        else if ( (NULL != svcUd) && !l2dbus_admissionEnter(&svcUd->admission,
+                                    cdbus_connectionGetDBus(connUd->conn),
+                                    msg, 0.0) )
+        {
+            rc = DBUS_HANDLER_RESULT_HANDLED;
+        }
         else
         {
+            admitted = (NULL != svcUd);
             /* Push a Lua wrapper around the message */
             l2dbus_messageWrap(L, msg, L2DBUS_TRUE);
 
-            lua_rawgeti(L, LUA_REGISTRYINDEX, ud->cbCtx.userRef);
-
-            if ( 0 != lua_pcall(L, 4 /* nArgs */, 1 /* nResults */, 0) )
-            {
-                if ( lua_isstring(L, -1) )
-                {
-                    errMsg = lua_tostring(L, -1);
-                }
-                L2DBUS_TRACE((L2DBUS_TRC_ERROR, "Interface callback error: %s",
-                                errMsg));
-            }
-            else
+            if ( 0 == l2dbus_callbackInvokeDetail(L, &ud->cbCtx,
+                                            3 /* nArgs */, 1 /* nResults */,
+                                            "Interface",
+                                            dbus_message_get_member(msg)) )
             {
                 if ( lua_isnumber(L, -1) )
                 {
@@ -228,16 +1449,91 @@ l2dbus_interfaceHandler
                 }
             }
         }
+
+        if ( admitted )
+        {
+            l2dbus_admissionExit(&svcUd->admission, msg);
+        }
     }
 
     /* Clean up the thread stack */
-    lua_settop(L, 0);
+    l2dbus_callbackLeaveDbusDispatch(cbCtx);
+    l2dbus_callbackEnd(L, base);
 
     /* The return value is unused by CDBUS */
     return rc;
 }
 
 
+/**
+ * @brief Makes an interface share the description of a descriptor.
+ *
+ * The members of the descriptor are registered with the CDBUS interface
+ * (which keeps its own copy for introspection) and the interface keeps
+ * a reference to the descriptor.
+ *
+ * @param [in] L        Lua state.
+ * @param [in] ud       The new Interface userdata.
+ * @param [in] descUd   The InterfaceDescriptor userdata.
+ * @param [in] descIdx  Stack index of the InterfaceDescriptor userdata.
+ * @return True on success or false if out of memory.
+ */
+static l2dbus_Bool
+l2dbus_interfaceUseDescriptor
+    (
+    lua_State*                      L,
+    l2dbus_Interface*               ud,
+    l2dbus_InterfaceDescriptor*     descUd,
+    int                             descIdx
+    )
+{
+    if ( !l2dbus_interfaceDescriptorRegister(descUd, ud->intf) )
+    {
+        return L2DBUS_FALSE;
+    }
+
+    ud->desc = &descUd->desc;
+    if ( !l2dbus_interfaceAllocValues(ud) )
+    {
+        ud->desc = &ud->ownDesc;
+        return L2DBUS_FALSE;
+    }
+
+    lua_pushvalue(L, descIdx);
+    ud->descRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    ud->descUd = descUd;
+    ++descUd->nUsers;
+
+    return L2DBUS_TRUE;
+}
+
+
+/**
+ * @brief Resets a newly allocated Interface userdata.
+ *
+ * Every constructor of an Interface (including the native Properties,
+ * Introspectable and ObjectManager interfaces) calls this before filling
+ * in the rest of the userdata.
+ *
+ * @param [in] L    The Lua state.
+ * @param [in] ud   The (zeroed) Interface userdata.
+ */
+void
+l2dbus_interfaceInitUd
+    (
+    lua_State*          L,
+    l2dbus_Interface*   ud
+    )
+{
+    l2dbus_callbackInit(L, &ud->cbCtx);
+    ud->priority = L2DBUS_DISPATCH_PRIORITY_DEFAULT;
+    ud->setterRef = LUA_NOREF;
+    ud->batch.connRef = LUA_NOREF;
+    ud->desc = &ud->ownDesc;
+    ud->descRef = LUA_NOREF;
+}
+
+
 /**
  @function new
 
@@ -271,7 +1567,15 @@ l2dbus_interfaceHandler
  If there are no handlers to satisfy the request or an error occurs the client will
  receive an appropriate error message.
 
- @tparam string interface A valid D-Bus interface name to assign to the interface.
+ An interface can also be created from an @{l2dbus.InterfaceDescriptor}.
+ It then shares the methods, signals and properties of the descriptor with
+ every other interface created from it and these cannot be changed with
+ @{registerMethods} (or the other *register* and *clear* methods). Only the
+ handlers (see @{setMethodHandler}) and the stored property values belong
+ to the interface itself.
+
+ @tparam string|userdata interface A valid D-Bus interface name to assign to
+ the interface or the @{l2dbus.InterfaceDescriptor} describing it.
  @tparam ?func|nil handler An optional interface handler function or **nil** if none desired.
  @tparam ?any userToken Optional client data associated with the handler. Will be passed
  to the handler when its invoked.
@@ -284,6 +1588,7 @@ l2dbus_newInterface
     )
 {
     l2dbus_Interface* intfUd;
+    l2dbus_InterfaceDescriptor* descUd;
     const char* intfName = NULL;
     int userIdx = L2DBUS_CALLBACK_NOREF_NEEDED;
     int funcIdx = L2DBUS_CALLBACK_NOREF_NEEDED;
@@ -294,11 +1599,19 @@ l2dbus_newInterface
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    intfName = luaL_checkstring(L, 1);
-
-    if ( !l2dbus_validateInterface(intfName) )
+    descUd = (l2dbus_InterfaceDescriptor*)l2dbus_isUserData(L, 1,
+                                    L2DBUS_INTERFACE_DESCRIPTOR_MTBL_NAME);
+    if ( NULL != descUd )
+    {
+        intfName = descUd->name;
+    }
+    else
     {
-        luaL_error(L, "invalid D-Bus interface name");
+        intfName = luaL_checkstring(L, 1);
+        if ( !l2dbus_validateInterface(intfName) )
+        {
+            luaL_error(L, "invalid D-Bus interface name");
+        }
     }
 
     /* Check for a handler function */
@@ -324,10 +1637,16 @@ l2dbus_newInterface
     else
     {
         /* Reset the userdata structure */
-        l2dbus_callbackInit(&intfUd->cbCtx);
+        l2dbus_interfaceInitUd(L, intfUd);
 
         l2dbus_callbackRef(L, funcIdx, userIdx, &intfUd->cbCtx);
         intfUd->intf = cdbus_interfaceNew(intfName, l2dbus_interfaceHandler, intfUd);
+        if ( (NULL != intfUd->intf) && (NULL != descUd) &&
+            !l2dbus_interfaceUseDescriptor(L, intfUd, descUd, 1) )
+        {
+            cdbus_interfaceUnref(intfUd->intf);
+            intfUd->intf = NULL;
+        }
 
         if ( NULL == intfUd->intf )
         {
@@ -380,6 +1699,18 @@ l2dbus_interfaceDispose
 
     /* Unreference the function/data associated with a callback */
     l2dbus_callbackUnref(L, &ud->cbCtx);
+    l2dbus_interfaceFreeHandlers(L, ud);
+    /* The connection may already have been finalized */
+    l2dbus_interfaceStopBatching(L, ud, L2DBUS_FALSE);
+    l2dbus_interfaceFreeValues(ud);
+    l2dbus_interfaceDescFreeMethods(&ud->ownDesc);
+    l2dbus_interfaceDescFreeProperties(&ud->ownDesc);
+    luaL_unref(L, LUA_REGISTRYINDEX, ud->setterRef);
+    if ( NULL != ud->descUd )
+    {
+        --ud->descUd->nUsers;
+    }
+    luaL_unref(L, LUA_REGISTRYINDEX, ud->descRef);
 
     return 0;
 }
@@ -466,6 +1797,68 @@ l2dbus_interfaceSetData
 }
 
 
+/**
+ @function setPriority
+ @within Interface
+
+ Sets the dispatch priority class of requests to the interface.
+
+ The priority class determines the order in which messages are delivered
+ when the Dispatcher has deferred their delivery because its dispatch
+ @{l2dbus.Dispatcher.setBudget|budget} was exhausted. By default the
+ priority class is derived from the @{l2dbus.Dispatcher.setTypePriority|type}
+ of the message.
+
+ @tparam userdata interface The Interface.
+ @tparam ?number priority The priority class (e.g.
+ @{l2dbus.Dispatcher.PRIORITY_HIGH|PRIORITY_HIGH}) or **nil** for the
+ @{l2dbus.Dispatcher.PRIORITY_DEFAULT|default}.
+ */
+static int
+l2dbus_interfaceSetPriority
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Interface* ud = (l2dbus_Interface*)luaL_checkudata(L, 1,
+                                        L2DBUS_INTERFACE_MTBL_NAME);
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    ud->priority = l2dbus_checkDispatchPriority(L, 2);
+
+    return 0;
+}
+
+
+/**
+ @function priority
+ @within Interface
+
+ Gets the dispatch priority class of requests to the interface.
+
+ @tparam userdata interface The Interface.
+ @treturn number The priority class.
+ */
+static int
+l2dbus_interfaceGetPriority
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Interface* ud = (l2dbus_Interface*)luaL_checkudata(L, 1,
+                                        L2DBUS_INTERFACE_MTBL_NAME);
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    lua_pushinteger(L, ud->priority);
+
+    return 1;
+}
+
+
 /**
  @function getData
  @within Interface
@@ -535,6 +1928,9 @@ Possible values for the *access* field include *r* (read), *w* (write), *rw* or
  @table IntrospectItem
  @field name (string) [Req] The name of the method or signal
  @field args (array) [Opt] An array of arguments of type @{IntrospectArg}
+ @field handler (func) [Opt] For methods only, a function called with
+ an @{l2dbus.ReplyContext} followed by the decoded arguments of each
+ request for this method. See @{registerMethods}.
  */
 
 
@@ -555,7 +1951,7 @@ Possible values for the *access* field include *r* (read), *w* (write), *rw* or
  constant string with the reason for the failure. This should *not* be freed.
  @return Returns true if the item was parsed successfully, false otherwise.
  */
-static l2dbus_Bool
+l2dbus_Bool
 l2dbus_interfaceParseItems
     (
     lua_State*                  L,
@@ -757,6 +2153,128 @@ l2dbus_interfaceParseItems
 }
 
 
+/**
+ @brief Parses a table of interface properties.
+
+ @param [in]        L           Lua state.
+ @param [in]        propsIdx    Index on Lua stack to the property table.
+ @param [in,out]    props       Returns a pointer to an array of properties.
+ @param [in,out]    nProps      Returns the number of properties in the
+ 'props' array.
+ @param [in,out]    whyFail     On failure it will point to a constant
+ string with the reason for the failure. This should *not* be freed.
+ @return Returns true if the properties were parsed successfully, false
+ otherwise. The array must be freed by the caller in either case.
+ */
+l2dbus_Bool
+l2dbus_interfaceParseProperties
+    (
+    lua_State*                      L,
+    int                             propsIdx,
+    cdbus_DbusIntrospectProperty**  props,
+    size_t*                         nProps,
+    const char**                    whyFail
+    )
+{
+    size_t propIdx;
+    const char* access;
+    const char* reason = "unknown failure";
+    l2dbus_Bool isValid = L2DBUS_FALSE;
+    int stackTop = lua_gettop(L);
+
+    propsIdx = lua_absindex(L, propsIdx);
+    *props = NULL;
+    *nProps = lua_rawlen(L, propsIdx);
+    /* I guess it's valid to register no items */
+    if ( 0 == *nProps )
+    {
+        return L2DBUS_TRUE;
+    }
+
+    *props = (cdbus_DbusIntrospectProperty*)l2dbus_calloc(*nProps,
+                                                        sizeof(**props));
+    if ( NULL == *props )
+    {
+        *nProps = 0;
+        reason = "failed to allocate memory for properties";
+    }
+    else
+    {
+        for ( propIdx = 0; propIdx < *nProps; ++propIdx )
+        {
+            lua_settop(L, stackTop);
+            lua_rawgeti(L, propsIdx, propIdx+1);
+            if ( LUA_TTABLE != lua_type(L, -1) )
+            {
+                /* Unexpected Lua type - bail out */
+                reason = "unexpected (non-table) type found for arg #2";
+                break;
+            }
+
+            lua_getfield(L, -1, "name");
+            if ( !lua_isstring(L, -1) )
+            {
+                reason = "missing property name";
+                break;
+            }
+            (*props)[propIdx].name = l2dbus_strDup(lua_tostring(L, -1));
+            lua_pop(L, 1);
+
+            lua_getfield(L, -1, "sig");
+            if ( !lua_isstring(L, -1) )
+            {
+                reason = "missing signature";
+                break;
+            }
+            (*props)[propIdx].signature = l2dbus_strDup(lua_tostring(L, -1));
+            if ( !dbus_signature_validate((*props)[propIdx].signature, NULL) )
+            {
+                reason = "invalid signature";
+                break;
+            }
+            lua_pop(L, 1);
+
+            lua_getfield(L, -1, "access");
+            if ( !lua_isstring(L, -1) )
+            {
+                reason = "missing access rights";
+                break;
+            }
+            access = lua_tostring(L, -1);
+            if ( (0 == strncmp(access, "r", 1)) || (0 == strncmp(access, "rw", 2)) ||
+                (0 == strncmp(access, "wr", 2)) )
+            {
+                (*props)[propIdx].read = CDBUS_TRUE;
+            }
+            if ( (0 == strncmp(access, "w", 1)) || (0 == strncmp(access, "rw", 2)) ||
+                (0 == strncmp(access, "wr", 2)) )
+            {
+                (*props)[propIdx].write = CDBUS_TRUE;
+            }
+
+            if ( !(*props)[propIdx].write && !(*props)[propIdx].read )
+            {
+                reason = "property must have read/write or both access";
+                break;
+            }
+        }
+
+        /* If all the properties were assigned then */
+        isValid = (propIdx == *nProps);
+    }
+
+    if ( !isValid )
+    {
+        *whyFail = reason;
+    }
+
+    /* Reset the top */
+    lua_settop(L, stackTop);
+
+    return isValid;
+}
+
+
 /**
  @function registerMethods
  @within Interface
@@ -794,6 +2312,27 @@ l2dbus_interfaceParseItems
  individual elements of the introspection table. Any error parsing or
  registering the methods will result in a Lua error being thrown.
 
+ A method that specifies a *handler* is dispatched directly from C.
+ The signature of a request is checked against the *in* arguments
+ of the method (an **org.freedesktop.DBus.Error.InvalidArgs** error is
+ returned on a mismatch) and the handler is called as:
+
+    handler(ctx, arg1, arg2, ..., argN)
+
+ where *ctx* is an @{l2dbus.ReplyContext} used to reply. If the handler
+ raises an error before replying an **org.l2dbus.error.ProcessingRequest**
+ error is returned to the caller. Requests for methods without a
+ handler are passed to the handler of the interface. Like the handler of
+ a @{l2dbus.ServiceObject|service object}, method handlers are subject
+ to the @{l2dbus.Dispatcher.setBudget|dispatch budget} and priority of
+ the Dispatcher. Methods sharing a name are told apart by their *in*
+ arguments.
+
+ Registering the methods again drops the handlers of the previous ones.
+ Handlers can also be set afterwards with @{setMethodHandler}. A Lua
+ error is thrown if the interface was created from an
+ @{l2dbus.InterfaceDescriptor}.
+
  @tparam userdata interface The Interface on which to register methods.
  @tparam table methods The introspection data for the methods being
  registered with this interface.
@@ -805,7 +2344,6 @@ l2dbus_interfaceRegisterMethods
     )
 {
     size_t nMethods = 0;
-    size_t methIdx;
     cdbus_DbusIntrospectItem* methods = NULL;
     const char* reason = "";
 
@@ -816,6 +2354,7 @@ l2dbus_interfaceRegisterMethods
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
+    l2dbus_interfaceCheckOwnDesc(L, ifUd);
 
     if ( l2dbus_interfaceParseItems(L, 2, &methods, &nMethods, L2DBUS_TRUE, &reason) )
     {
@@ -824,21 +2363,129 @@ l2dbus_interfaceRegisterMethods
         {
             reason = "failed to register methods in CDBUS";
         }
+        else if ( !l2dbus_interfaceBuildMethods(L, ifUd, 2, methods, nMethods) )
+        {
+            cdbus_interfaceClearMethods(ifUd->intf);
+            isRegistered = L2DBUS_FALSE;
+            reason = "failed to allocate memory for method table";
+        }
+    }
+
+    /* Always free up the methods */
+    l2dbus_interfaceFreeItems(methods, nMethods);
+
+    /* A failed registration may have replaced the previous items */
+    l2dbus_interfaceTouch(ifUd);
+
+    if ( !isRegistered )
+    {
+        luaL_error(L, reason);
+    }
+
+    return 0;
+}
+
+
+/**
+ @function clearMethods
+ @within Interface
+
+ Clears or erases the methods supported by the interface.
+
+ @tparam userdata interface The Interface on which to clear the methods.
+ @treturn bool Returns **true** if the methods are cleared successfully,
+ **false** otherwise.
+ */
+static int
+l2dbus_interfaceClearMethods
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Interface* ifUd = (l2dbus_Interface*)luaL_checkudata(L, 1,
+                                            L2DBUS_INTERFACE_MTBL_NAME);
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+    l2dbus_interfaceCheckOwnDesc(L, ifUd);
+
+    l2dbus_interfaceFreeHandlers(L, ifUd);
+    l2dbus_interfaceDescFreeMethods(&ifUd->ownDesc);
+    l2dbus_interfaceTouch(ifUd);
+    lua_pushboolean(L, cdbus_interfaceClearMethods(ifUd->intf));
+
+    return 1;
+}
+
+
+/**
+ @function setMethodHandler
+ @within Interface
+
+ Sets the handler of a method.
+
+ The handler is called as described for the *handler* field of the
+ @{registerMethods|method description}. Unlike the description, which
+ may be shared through an @{l2dbus.InterfaceDescriptor}, the handler
+ belongs to this interface alone.
+
+ Methods of the same name (overloads) are told apart by the signature
+ of their input arguments. Requests are delivered to the overload whose
+ input signature matches the request. Without a signature the handler
+ is set for the method described first with the name.
+
+ @tparam userdata interface The Interface.
+ @tparam string method The name of a method of the interface.
+ @tparam ?func handler The handler or **nil** to pass requests for the
+ method to the handler of the interface again.
+ @tparam ?string signature The input signature of the method overload.
+ */
+static int
+l2dbus_interfaceSetMethodHandler
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Interface* ifUd = (l2dbus_Interface*)luaL_checkudata(L, 1,
+                                        L2DBUS_INTERFACE_MTBL_NAME);
+    const char* name = luaL_checkstring(L, 2);
+    const char* sig = luaL_optstring(L, 4, NULL);
+    l2dbus_InterfaceMethod* method;
+    int* funcRef;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    if ( !lua_isnoneornil(L, 3) )
+    {
+        luaL_checktype(L, 3, LUA_TFUNCTION);
     }
 
-    /* Always free up the methods */
-    if ( NULL != methods )
+    method = l2dbus_interfaceFindMethod(ifUd, name, sig);
+    if ( NULL == method )
     {
-        for ( methIdx = 0; methIdx < nMethods; ++methIdx )
-        {
-            l2dbus_interfaceDestroyItem(&methods[methIdx]);
-        }
-        l2dbus_free(methods);
+        luaL_argerror(L, 2, "unknown method");
+    }
+    if ( (NULL != sig) && (0 != strcmp(method->inSig, sig)) )
+    {
+        luaL_argerror(L, 4, "no method with this signature");
+    }
+    if ( !l2dbus_interfaceAllocHandlers(ifUd) )
+    {
+        luaL_error(L, "Failed to allocate method handlers");
     }
 
-    if ( !isRegistered )
+    funcRef = &ifUd->methodRefs[method - ifUd->desc->methods];
+    if ( LUA_NOREF != *funcRef )
     {
-        luaL_error(L, reason);
+        luaL_unref(L, LUA_REGISTRYINDEX, *funcRef);
+        *funcRef = LUA_NOREF;
+        --ifUd->nHandlers;
+    }
+    if ( !lua_isnoneornil(L, 3) )
+    {
+        lua_pushvalue(L, 3);
+        *funcRef = luaL_ref(L, LUA_REGISTRYINDEX);
+        ++ifUd->nHandlers;
     }
 
     return 0;
@@ -846,27 +2493,28 @@ l2dbus_interfaceRegisterMethods
 
 
 /**
- @function clearMethods
+ @function descriptor
  @within Interface
 
- Clears or erases the methods supported by the interface.
+ Returns the descriptor the interface was created from.
 
- @tparam userdata interface The Interface on which to clear the methods.
- @treturn bool Returns **true** if the methods are cleared successfully,
- **false** otherwise.
+ @tparam userdata interface The Interface.
+ @treturn ?userdata The @{l2dbus.InterfaceDescriptor} or **nil** if the
+ interface has its own description.
  */
 static int
-l2dbus_interfaceClearMethods
+l2dbus_interfaceGetDescriptor
     (
     lua_State*  L
     )
 {
     l2dbus_Interface* ifUd = (l2dbus_Interface*)luaL_checkudata(L, 1,
-                                            L2DBUS_INTERFACE_MTBL_NAME);
+                                        L2DBUS_INTERFACE_MTBL_NAME);
+
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    lua_pushboolean(L, cdbus_interfaceClearMethods(ifUd->intf));
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ifUd->descRef);
 
     return 1;
 }
@@ -918,7 +2566,6 @@ l2dbus_interfaceRegisterSignals
     )
 {
     size_t nSignals = 0;
-    size_t sigIdx;
     cdbus_DbusIntrospectItem* signals = NULL;
     const char* reason = "";
 
@@ -929,6 +2576,7 @@ l2dbus_interfaceRegisterSignals
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
+    l2dbus_interfaceCheckOwnDesc(L, ifUd);
 
     if ( l2dbus_interfaceParseItems(L, 2, &signals, &nSignals, L2DBUS_FALSE, &reason) )
     {
@@ -940,14 +2588,10 @@ l2dbus_interfaceRegisterSignals
     }
 
     /* Always free up the signals */
-    if ( NULL != signals )
-    {
-        for ( sigIdx = 0; sigIdx < nSignals; ++sigIdx )
-        {
-            l2dbus_interfaceDestroyItem(&signals[sigIdx]);
-        }
-        l2dbus_free(signals);
-    }
+    l2dbus_interfaceFreeItems(signals, nSignals);
+
+    /* A failed registration may have replaced the previous items */
+    l2dbus_interfaceTouch(ifUd);
 
     if ( !isRegistered )
     {
@@ -978,7 +2622,9 @@ l2dbus_interfaceClearSignals
                                             L2DBUS_INTERFACE_MTBL_NAME);
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
+    l2dbus_interfaceCheckOwnDesc(L, ifUd);
 
+    l2dbus_interfaceTouch(ifUd);
     lua_pushboolean(L, cdbus_interfaceClearSignals(ifUd->intf));
 
     return 1;
@@ -1030,9 +2676,7 @@ l2dbus_interfaceRegisterProperties
     lua_State*  L
     )
 {
-    size_t  nProps;
-    size_t  propIdx;
-    const char* access;
+    size_t  nProps = 0;
     l2dbus_Bool isRegistered = L2DBUS_FALSE;
     const char* reason = "unknown failure";
     cdbus_DbusIntrospectProperty* props = NULL;
@@ -1043,100 +2687,28 @@ l2dbus_interfaceRegisterProperties
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
+    l2dbus_interfaceCheckOwnDesc(L, ifUd);
 
-    nProps = lua_rawlen(L, 2);
-    /* I guess it's valid to register no items */
-    if ( 0 == nProps )
-    {
-        isRegistered = L2DBUS_TRUE;
-    }
-    else
+    if ( l2dbus_interfaceParseProperties(L, 2, &props, &nProps, &reason) )
     {
-        props = (cdbus_DbusIntrospectProperty*)l2dbus_calloc(nProps, sizeof(*props));
-        if ( NULL == props )
+        isRegistered = cdbus_interfaceRegisterProperties(ifUd->intf, props, nProps);
+        if ( !isRegistered )
         {
-            reason = "failed to allocate memory for properties";
+            reason = "failed to register properties in CDBUS";
         }
-        else
+        else if ( !l2dbus_interfaceBuildProperties(ifUd, props, nProps) )
         {
-            for ( propIdx = 0; propIdx < nProps; ++propIdx )
-            {
-                lua_rawgeti(L, 2, propIdx+1);
-                if ( LUA_TTABLE != lua_type(L, -1) )
-                {
-                    /* Unexpected Lua type - bail out */
-                    reason = "unexpected (non-table) type found for arg #2";
-                    break;
-                }
-
-                lua_getfield(L, -1, "name");
-                if ( !lua_isstring(L, -1) )
-                {
-                    reason = "missing property name";
-                    break;
-                }
-                props[propIdx].name = l2dbus_strDup(lua_tostring(L, -1));
-                lua_pop(L, 1);
-
-                lua_getfield(L, -1, "sig");
-                if ( !lua_isstring(L, -1) )
-                {
-                    reason = "missing signature";
-                    break;
-                }
-                props[propIdx].signature = l2dbus_strDup(lua_tostring(L, -1));
-                if ( !dbus_signature_validate(props[propIdx].signature, NULL) )
-                {
-                    reason = "invalid signature";
-                    break;
-                }
-                lua_pop(L, 1);
-
-                lua_getfield(L, -1, "access");
-                if ( !lua_isstring(L, -1) )
-                {
-                    reason = "missing access rights";
-                    break;
-                }
-                access = lua_tostring(L, -1);
-                if ( (0 == strncmp(access, "r", 1)) || (0 == strncmp(access, "rw", 2)) ||
-                    (0 == strncmp(access, "wr", 2)) )
-                {
-                    props[propIdx].read = CDBUS_TRUE;
-                }
-                if ( (0 == strncmp(access, "w", 1)) || (0 == strncmp(access, "rw", 2)) ||
-                    (0 == strncmp(access, "wr", 2)) )
-                {
-                    props[propIdx].write = CDBUS_TRUE;
-                }
-
-                if ( !props[propIdx].write && !props[propIdx].read )
-                {
-                    reason = "property must have read/write or both access";
-                    break;
-                }
-
-                /* Pop the last field and the property table */
-                lua_pop(L, 2);
-            }
-
-            /* If all the properties were assigned then */
-            if ( propIdx == nProps )
-            {
-                isRegistered = cdbus_interfaceRegisterProperties(ifUd->intf, props, nProps);
-            }
+            cdbus_interfaceClearProperties(ifUd->intf);
+            isRegistered = L2DBUS_FALSE;
+            reason = "failed to allocate memory for property table";
         }
     }
 
-    /* Always free up the signals */
-    if ( NULL != props )
-    {
-        for ( propIdx = 0; propIdx < nProps; ++propIdx )
-        {
-            l2dbus_interfaceDestroyProperty(&props[propIdx]);
-        }
-        l2dbus_free(props);
-    }
+    /* Always free up the properties */
+    l2dbus_interfaceFreePropertyItems(props, nProps);
+
+    /* A failed registration may have replaced the previous items */
+    l2dbus_interfaceTouch(ifUd);
 
     if ( !isRegistered )
     {
@@ -1167,13 +2739,376 @@ l2dbus_interfaceClearProperties
                                             L2DBUS_INTERFACE_MTBL_NAME);
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
+    l2dbus_interfaceCheckOwnDesc(L, ifUd);
 
+    l2dbus_interfaceTouch(ifUd);
+    l2dbus_interfaceFreeValues(ifUd);
+    l2dbus_interfaceDescFreeProperties(&ifUd->ownDesc);
     lua_pushboolean(L, cdbus_interfaceClearProperties(ifUd->intf));
 
     return 1;
 }
 
 
+/**
+ @function setProperty
+ @within Interface
+
+ Stores the value of a property.
+
+ The value is marshalled once using the signature the property was
+ @{registerProperties|registered} with and kept by the interface. Once
+ a value is stored an @{l2dbus.Properties|Properties} interface on the
+ same service object answers **Get**, **GetAll** and **Set** requests for
+ it directly from the stored value without calling into Lua (unless a
+ @{setPropertySetter|setter} has been set). Registering the properties
+ again discards all the stored values.
+
+ @tparam userdata interface The Interface that owns the property.
+ @tparam string name The name of the property.
+ @tparam any value The value of the property.
+ @treturn bool Returns **true** if the value is stored. A Lua error
+ is thrown if the property is unknown or the value cannot be marshalled.
+ */
+static int
+l2dbus_interfaceSetProperty
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Interface* ifUd = (l2dbus_Interface*)luaL_checkudata(L, 1,
+                                        L2DBUS_INTERFACE_MTBL_NAME);
+    const char* name = luaL_checkstring(L, 2);
+    l2dbus_InterfaceProperty* prop;
+    l2dbus_PropertyValue* stored;
+    DBusMessage* value;
+
+    luaL_checkany(L, 3);
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    prop = l2dbus_interfaceFindProperty(ifUd, name);
+    if ( NULL == prop )
+    {
+        luaL_argerror(L, 2, "unknown property");
+    }
+
+    value = dbus_message_new(DBUS_MESSAGE_TYPE_METHOD_RETURN);
+    if ( NULL == value )
+    {
+        luaL_error(L, "Failed to allocate property value");
+    }
+
+    /* The wrapper owns the message should marshalling fail */
+    l2dbus_messageWrap(L, value, L2DBUS_FALSE);
+    l2dbus_transcodeLuaArgsToDbusBySignature(L, value, 3, 1, prop->sig);
+
+    stored = L2DBUS_INTERFACE_VALUE(ifUd, prop);
+    if ( NULL == stored->value )
+    {
+        ++ifUd->nPropValues;
+    }
+    else
+    {
+        dbus_message_unref(stored->value);
+    }
+    stored->value = dbus_message_ref(value);
+    l2dbus_interfaceMarkChanged(ifUd, prop, L2DBUS_PROPERTY_CHANGED);
+    lua_pushboolean(L, L2DBUS_TRUE);
+
+    return 1;
+}
+
+
+/**
+ @function getProperty
+ @within Interface
+
+ Returns the stored value of a property.
+
+ @tparam userdata interface The Interface that owns the property.
+ @tparam string name The name of the property.
+ @treturn any The value of the property or **nil** if the property is
+ unknown or no value has been @{setProperty|stored}.
+ */
+static int
+l2dbus_interfaceGetProperty
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Interface* ifUd = (l2dbus_Interface*)luaL_checkudata(L, 1,
+                                        L2DBUS_INTERFACE_MTBL_NAME);
+    const char* name = luaL_checkstring(L, 2);
+    l2dbus_InterfaceProperty* prop;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    prop = l2dbus_interfaceFindProperty(ifUd, name);
+    if ( (NULL == prop) ||
+        (NULL == L2DBUS_INTERFACE_VALUE(ifUd, prop)->value) ||
+        (0 == l2dbus_transcodeDbusArgsToLua(L,
+                                L2DBUS_INTERFACE_VALUE(ifUd, prop)->value)) )
+    {
+        lua_pushnil(L);
+    }
+
+    return 1;
+}
+
+
+/**
+ @function setPropertySetter
+ @within Interface
+
+ Sets a hook that's called before a value set by a client is stored.
+
+ Without a hook a **Set** request for a property with a
+ @{setProperty|stored} value is stored without calling into Lua. With
+ a hook the request is stored only if the hook accepts it. The hook
+ is called as:
+
+    function setter(interface, name, value)
+
+ Returning **false** rejects the value and the client receives an
+ **org.freedesktop.DBus.Error.InvalidArgs** error. Any other return
+ value stores it. A hook that raises an error also rejects the value.
+
+ @tparam userdata interface The Interface that owns the properties.
+ @tparam ?func setter The hook or **nil** to remove it.
+ */
+static int
+l2dbus_interfaceSetPropertySetter
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Interface* ifUd = (l2dbus_Interface*)luaL_checkudata(L, 1,
+                                        L2DBUS_INTERFACE_MTBL_NAME);
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    if ( !lua_isnoneornil(L, 2) )
+    {
+        luaL_checktype(L, 2, LUA_TFUNCTION);
+    }
+
+    luaL_unref(L, LUA_REGISTRYINDEX, ifUd->setterRef);
+    ifUd->setterRef = LUA_NOREF;
+    if ( !lua_isnoneornil(L, 2) )
+    {
+        lua_pushvalue(L, 2);
+        ifUd->setterRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+
+    return 0;
+}
+
+
+/**
+ @function invalidateProperty
+ @within Interface
+
+ Discards the stored value of a property.
+
+ Requests for the property are passed to Lua again. If changes are
+ @{setPropertyBatching|batched} the property is announced as invalidated
+ (by name and without a value) unless a new value is stored before the
+ batch is emitted.
+
+ @tparam userdata interface The Interface that owns the property.
+ @tparam string name The name of the property.
+ */
+static int
+l2dbus_interfaceInvalidateProperty
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Interface* ifUd = (l2dbus_Interface*)luaL_checkudata(L, 1,
+                                        L2DBUS_INTERFACE_MTBL_NAME);
+    const char* name = luaL_checkstring(L, 2);
+    l2dbus_InterfaceProperty* prop;
+    l2dbus_PropertyValue* stored;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    prop = l2dbus_interfaceFindProperty(ifUd, name);
+    if ( NULL == prop )
+    {
+        luaL_argerror(L, 2, "unknown property");
+    }
+
+    stored = L2DBUS_INTERFACE_VALUE(ifUd, prop);
+    if ( NULL != stored->value )
+    {
+        dbus_message_unref(stored->value);
+        stored->value = NULL;
+        --ifUd->nPropValues;
+    }
+    l2dbus_interfaceMarkChanged(ifUd, prop, L2DBUS_PROPERTY_INVALIDATED);
+
+    return 0;
+}
+
+
+/**
+ @function setPropertyBatching
+ @within Interface
+
+ Batches the PropertiesChanged signals of the interface.
+
+ Once enabled every value stored with @{setProperty} (or by a client
+ through an @{l2dbus.Properties|Properties} interface) and every
+ @{invalidateProperty|invalidated} property is recorded instead of being
+ announced immediately. At the end of the batching window a single
+ **org.freedesktop.DBus.Properties.PropertiesChanged** signal is emitted
+ from the object path with the latest value of every changed property and
+ the names of the invalidated ones.
+
+ Calling the method again replaces the previous settings after emitting
+ the pending changes. Passing **nil** for the connection stops batching.
+
+ The stored property values belong to the interface so a batch is
+ emitted from a single object path. Batching is therefore refused for an
+ interface that has been added to more than one
+ @{l2dbus.ServiceObject|ServiceObject} and, while it's enabled, the
+ interface cannot be added to a second object.
+
+ @tparam userdata interface The Interface.
+ @tparam ?userdata conn The @{l2dbus.Connection|Connection} the signal is
+ sent on or **nil** to stop batching.
+ @tparam string path The object path of the service object implementing
+ the interface.
+ @tparam ?number windowMsec How long changes are collected in
+ milliseconds. The default (0) collects the changes made during one
+ iteration of the main loop.
+ */
+static int
+l2dbus_interfaceSetPropertyBatching
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Interface* ifUd = (l2dbus_Interface*)luaL_checkudata(L, 1,
+                                        L2DBUS_INTERFACE_MTBL_NAME);
+    l2dbus_PropertyBatch* batch = &ifUd->batch;
+    l2dbus_Connection* connUd;
+    const char* path;
+    lua_Integer windowMsec;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    l2dbus_interfaceStopBatching(L, ifUd, L2DBUS_TRUE);
+    if ( lua_isnoneornil(L, 2) )
+    {
+        return 0;
+    }
+
+    if ( 1U < ifUd->nObjects )
+    {
+        luaL_error(L, "Cannot batch the properties of an interface shared "
+                    "by several objects");
+    }
+
+    connUd = (l2dbus_Connection*)luaL_checkudata(L, 2,
+                                        L2DBUS_CONNECTION_MTBL_NAME);
+    path = luaL_checkstring(L, 3);
+    windowMsec = luaL_optinteger(L, 4, 0);
+    luaL_argcheck(L, windowMsec >= 0, 4, "window must not be negative");
+    if ( !l2dbus_validatePath(path) )
+    {
+        luaL_argerror(L, 3, "invalid D-Bus object path");
+    }
+
+    batch->path = l2dbus_strDup(path);
+    batch->timeout = cdbus_timeoutNew(connUd->dispUd->disp,
+                                    (cdbus_Int32)windowMsec, CDBUS_FALSE,
+                                    l2dbus_interfaceBatchHandler, ifUd);
+    if ( (NULL == batch->path) || (NULL == batch->timeout) )
+    {
+        l2dbus_interfaceStopBatching(L, ifUd, L2DBUS_FALSE);
+        luaL_error(L, "Failed to allocate property batch");
+    }
+
+    lua_pushvalue(L, 2);
+    batch->connRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    batch->connUd = connUd;
+    batch->windowMsec = (int)windowMsec;
+
+    return 0;
+}
+
+
+/**
+ @function flushPropertyChanges
+ @within Interface
+
+ Emits the pending (batched) property changes immediately.
+
+ @tparam userdata interface The Interface.
+ @treturn bool Returns **true** if a PropertiesChanged signal was queued
+ to be sent or **false** if nothing was pending.
+ */
+static int
+l2dbus_interfaceFlushPropertyChanges
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Interface* ifUd = (l2dbus_Interface*)luaL_checkudata(L, 1,
+                                        L2DBUS_INTERFACE_MTBL_NAME);
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    lua_pushboolean(L, l2dbus_interfaceFlushChanges(ifUd));
+
+    return 1;
+}
+
+
+/**
+ @function getPropertyBatchStats
+ @within Interface
+
+ Returns the statistics of the batched property changes.
+
+ @tparam userdata interface The Interface.
+ @treturn table A table with the fields *changes* (the number of
+ changes recorded), *signals* (the number of PropertiesChanged signals
+ emitted), and *pending* (the number of properties with a change that
+ hasn't been emitted yet).
+ */
+static int
+l2dbus_interfaceGetPropertyBatchStats
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Interface* ifUd = (l2dbus_Interface*)luaL_checkudata(L, 1,
+                                        L2DBUS_INTERFACE_MTBL_NAME);
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    lua_createtable(L, 0, 3);
+    lua_pushnumber(L, (lua_Number)ifUd->batch.nChanges);
+    lua_setfield(L, -2, "changes");
+    lua_pushnumber(L, (lua_Number)ifUd->batch.nSignals);
+    lua_setfield(L, -2, "signals");
+    lua_pushinteger(L, (lua_Integer)ifUd->batch.nPending);
+    lua_setfield(L, -2, "pending");
+
+    return 1;
+}
+
+
 /**
  @function introspect
  @within Interface
@@ -1224,12 +3159,23 @@ static const luaL_Reg l2dbus_interfaceMetaTable[] = {
     {"name", l2dbus_interfaceGetName},
     {"setData", l2dbus_interfaceSetData},
     {"data", l2dbus_interfaceGetData},
+    {"setPriority", l2dbus_interfaceSetPriority},
+    {"priority", l2dbus_interfaceGetPriority},
     {"registerMethods", l2dbus_interfaceRegisterMethods},
     {"clearMethods", l2dbus_interfaceClearMethods},
+    {"setMethodHandler", l2dbus_interfaceSetMethodHandler},
+    {"descriptor", l2dbus_interfaceGetDescriptor},
     {"registerSignals", l2dbus_interfaceRegisterSignals},
     {"clearSignals", l2dbus_interfaceClearSignals},
     {"registerProperties", l2dbus_interfaceRegisterProperties},
     {"clearProperties", l2dbus_interfaceClearProperties},
+    {"setProperty", l2dbus_interfaceSetProperty},
+    {"getProperty", l2dbus_interfaceGetProperty},
+    {"setPropertySetter", l2dbus_interfaceSetPropertySetter},
+    {"invalidateProperty", l2dbus_interfaceInvalidateProperty},
+    {"setPropertyBatching", l2dbus_interfaceSetPropertyBatching},
+    {"flushPropertyChanges", l2dbus_interfaceFlushPropertyChanges},
+    {"getPropertyBatchStats", l2dbus_interfaceGetPropertyBatchStats},
     {"introspect", l2dbus_interfaceIntrospect},
     {"__gc", l2dbus_interfaceDispose},
     {NULL, NULL},
@@ -35,17 +35,153 @@
 #define L2DBUS_INTERFACE_H_
 
 #include "lua.h"
+#include "cdbus/cdbus.h"
+#include "l2dbus_types.h"
 #include "l2dbus_callback.h"
 
 /* Forward declarations */
 struct cdbus_Interface;
+struct cdbus_Timeout;
+struct l2dbus_Connection;
+struct l2dbus_InterfaceDescriptor;
+struct DBusMessage;
+struct DBusMessageIter;
+
+/* A method described by an interface */
+typedef struct l2dbus_InterfaceMethod
+{
+    char*                               name;
+    /* Signatures of the request and reply */
+    char*                               inSig;
+    char*                               outSig;
+    unsigned                            hash;
+    /* Index of the next method in the hash bucket or -1 */
+    int                                 next;
+} l2dbus_InterfaceMethod;
+
+/* A property described by an interface */
+typedef struct l2dbus_InterfaceProperty
+{
+    char*                               name;
+    char*                               sig;
+    unsigned                            hash;
+    /* Index of the next property in the hash bucket or -1 */
+    int                                 next;
+    l2dbus_Bool                         readable;
+    l2dbus_Bool                         writable;
+} l2dbus_InterfaceProperty;
+
+/* The value of a property held by one interface */
+typedef struct l2dbus_PropertyValue
+{
+    /* Holds the marshalled value or NULL if it isn't stored */
+    struct DBusMessage*                 value;
+    /* Change waiting to be announced (L2DBUS_PROPERTY_xxx) */
+    unsigned                            pending;
+} l2dbus_PropertyValue;
+
+/* The methods and properties of an interface hashed by name. A
+ * description belonging to an InterfaceDescriptor is shared by all the
+ * interfaces created from it and is never modified.
+ */
+typedef struct l2dbus_InterfaceDesc
+{
+    l2dbus_InterfaceMethod*             methods;
+    unsigned                            nMethods;
+    int*                                buckets;
+    unsigned                            nBuckets;
+    l2dbus_InterfaceProperty*           props;
+    unsigned                            nProps;
+    int*                                propBuckets;
+    unsigned                            nPropBuckets;
+} l2dbus_InterfaceDesc;
+
+#define L2DBUS_PROPERTY_CHANGED         (1U)
+#define L2DBUS_PROPERTY_INVALIDATED     (2U)
+
+/* Batched emission of the PropertiesChanged signal */
+typedef struct l2dbus_PropertyBatch
+{
+    /* The connection and object path of the signal (NULL if disabled) */
+    struct l2dbus_Connection*           connUd;
+    int                                 connRef;
+    char*                               path;
+    /* Changes are collected for this long (zero for one loop iteration) */
+    int                                 windowMsec;
+    struct cdbus_Timeout*               timeout;
+    l2dbus_Bool                         armed;
+    unsigned                            nPending;
+    /* Statistics */
+    unsigned long                       nChanges;
+    unsigned long                       nSignals;
+} l2dbus_PropertyBatch;
 
 typedef struct l2dbus_Interface
 {
     struct cdbus_Interface*             intf;
     l2dbus_CallbackCtx                  cbCtx;
+    int                                 priority;
+    /* The description of the interface (ownDesc unless it's shared) */
+    const l2dbus_InterfaceDesc*         desc;
+    l2dbus_InterfaceDesc                ownDesc;
+    /* The shared InterfaceDescriptor (NULL if none) and its reference */
+    struct l2dbus_InterfaceDescriptor*  descUd;
+    int                                 descRef;
+    /* Handlers indexed like the methods (NULL if no method has one) */
+    int*                                methodRefs;
+    /* Number of methods with their own handler */
+    unsigned                            nHandlers;
+    /* Stamp of the last change to the introspection data */
+    unsigned long                       introspectStamp;
+    /* Stored values indexed like the properties */
+    l2dbus_PropertyValue*               values;
+    unsigned                            nPropValues;
+    /* Optional hook called before a remote Set is stored */
+    int                                 setterRef;
+    l2dbus_PropertyBatch                batch;
+    /* Number of service objects the interface has been added to */
+    unsigned                            nObjects;
+    /* True for an ObjectManager interface */
+    l2dbus_Bool                         isObjectManager;
 } l2dbus_Interface;
 
+/* The value held by an interface for one of its properties */
+#define L2DBUS_INTERFACE_VALUE(ud, prop) \
+    (&(ud)->values[(prop) - (ud)->desc->props])
+
+void l2dbus_interfaceInitUd(lua_State* L, l2dbus_Interface* ud);
+
+l2dbus_InterfaceProperty* l2dbus_interfaceFindProperty(l2dbus_Interface* ud,
+                                                        const char* name);
+l2dbus_Bool l2dbus_interfaceAppendProperty(l2dbus_Interface* ud,
+                                        l2dbus_InterfaceProperty* prop,
+                                        struct DBusMessageIter* iter);
+l2dbus_Bool l2dbus_interfaceStoreProperty(l2dbus_Interface* ud,
+                                        l2dbus_InterfaceProperty* prop,
+                                        struct DBusMessageIter* valueIt);
+
+l2dbus_Bool l2dbus_interfaceParseItems(lua_State* L, int itemsIdx,
+                                    cdbus_DbusIntrospectItem** items,
+                                    size_t* nItems,
+                                    l2dbus_Bool parseAsMethods,
+                                    const char** whyFail);
+l2dbus_Bool l2dbus_interfaceParseProperties(lua_State* L, int propsIdx,
+                                    cdbus_DbusIntrospectProperty** props,
+                                    size_t* nProps,
+                                    const char** whyFail);
+void l2dbus_interfaceFreeItems(cdbus_DbusIntrospectItem* items,
+                                size_t nItems);
+void l2dbus_interfaceFreePropertyItems(cdbus_DbusIntrospectProperty* props,
+                                size_t nProps);
+l2dbus_Bool l2dbus_interfaceDescBuildMethods(l2dbus_InterfaceDesc* desc,
+                                    const cdbus_DbusIntrospectItem* items,
+                                    size_t nItems);
+l2dbus_Bool l2dbus_interfaceDescBuildProperties(l2dbus_InterfaceDesc* desc,
+                                    const cdbus_DbusIntrospectProperty* items,
+                                    size_t nItems);
+void l2dbus_interfaceDescFreeMethods(l2dbus_InterfaceDesc* desc);
+void l2dbus_interfaceDescFreeProperties(l2dbus_InterfaceDesc* desc);
+
 void l2dbus_openInterface(lua_State* L);
 
 #endif /* Guard for L2DBUS_INTERFACE_H_ */
@@ -0,0 +1,449 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_interfacedesc.c
+ * @author         Glenn Schmottlach
+ * @brief          Implementation of a shared (immutable) interface descriptor.
+ *===========================================================================
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "cdbus/cdbus.h"
+#include "l2dbus_compat.h"
+#include "l2dbus_interfacedesc.h"
+#include "l2dbus_context.h"
+#include "l2dbus_core.h"
+#include "l2dbus_object.h"
+#include "l2dbus_util.h"
+#include "l2dbus_dbuscompat.h"
+#include "l2dbus_trace.h"
+#include "l2dbus_debug.h"
+#include "l2dbus_alloc.h"
+#include "lauxlib.h"
+
+/**
+ L2DBUS InterfaceDescriptor
+
+ An InterfaceDescriptor holds the methods, signals and properties of a
+ D-Bus interface. The description is parsed and hashed once and every
+ @{l2dbus.Interface|Interface} created from the descriptor shares it
+ rather than keeping a copy of its own. This matters when many service
+ objects implement the same interface. The descriptor is immutable:
+ handlers and property values still belong to each interface.
+
+ Descriptors can be *interned* by interface name so that independent
+ parts of an application creating the same interface share a single
+ descriptor. An interned descriptor lives as long as something
+ (typically an Interface) references it.
+
+ @namespace l2dbus.InterfaceDescriptor
+ */
+
+
+/**
+ * @brief Registers the members of a descriptor with a CDBUS interface.
+ *
+ * CDBUS keeps its own copy of the members to generate the introspection
+ * data of the interface.
+ *
+ * @param [in] descUd   The InterfaceDescriptor userdata.
+ * @param [in] intf     The CDBUS interface.
+ * @return True if the members were registered or false if out of memory.
+ */
+l2dbus_Bool
+l2dbus_interfaceDescriptorRegister
+    (
+    l2dbus_InterfaceDescriptor* descUd,
+    struct cdbus_Interface*     intf
+    )
+{
+    return ((0 == descUd->nMethodItems) ||
+            cdbus_interfaceRegisterMethods(intf, descUd->methodItems,
+                                        descUd->nMethodItems)) &&
+        ((0 == descUd->nSignalItems) ||
+            cdbus_interfaceRegisterSignals(intf, descUd->signalItems,
+                                        descUd->nSignalItems)) &&
+        ((0 == descUd->nPropItems) ||
+            cdbus_interfaceRegisterProperties(intf, descUd->propItems,
+                                        descUd->nPropItems));
+}
+
+
+/**
+ * @brief Creates an InterfaceDescriptor from a Lua description.
+ *
+ * The new descriptor is left on the top of the stack. A Lua error is
+ * thrown if the description is invalid.
+ *
+ * @param [in] L        Lua state.
+ * @param [in] nameIdx  Stack index of the interface name.
+ * @param [in] descIdx  Stack index of the description table.
+ * @return The InterfaceDescriptor userdata.
+ */
+static l2dbus_InterfaceDescriptor*
+l2dbus_interfaceDescriptorCreate
+    (
+    lua_State*  L,
+    int         nameIdx,
+    int         descIdx
+    )
+{
+    const char* name = luaL_checkstring(L, nameIdx);
+    const char* reason = "failed to allocate interface descriptor";
+    l2dbus_InterfaceDescriptor* ud;
+    l2dbus_Bool isOk;
+
+    if ( !l2dbus_validateInterface(name) )
+    {
+        luaL_argerror(L, nameIdx, "invalid D-Bus interface name");
+    }
+    luaL_checktype(L, descIdx, LUA_TTABLE);
+    descIdx = lua_absindex(L, descIdx);
+
+    ud = (l2dbus_InterfaceDescriptor*)l2dbus_objectNew(L, sizeof(*ud),
+                                    L2DBUS_INTERFACE_DESCRIPTOR_TYPE_ID);
+    if ( NULL == ud )
+    {
+        luaL_error(L, "Failed to create interface descriptor userdata!");
+    }
+
+    L2DBUS_TRACE((L2DBUS_TRC_TRACE,
+                "Create: interface descriptor (userdata=%p)", ud));
+
+    ud->name = l2dbus_strDup(name);
+    isOk = (NULL != ud->name);
+
+    /* The descriptor is disposed of by the GC if parsing fails */
+    lua_getfield(L, descIdx, "methods");
+    if ( isOk && !lua_isnil(L, -1) )
+    {
+        isOk = l2dbus_interfaceParseItems(L, -1, &ud->methodItems,
+                            &ud->nMethodItems, L2DBUS_TRUE, &reason);
+    }
+    lua_pop(L, 1);
+
+    lua_getfield(L, descIdx, "signals");
+    if ( isOk && !lua_isnil(L, -1) )
+    {
+        isOk = l2dbus_interfaceParseItems(L, -1, &ud->signalItems,
+                            &ud->nSignalItems, L2DBUS_FALSE, &reason);
+    }
+    lua_pop(L, 1);
+
+    lua_getfield(L, descIdx, "properties");
+    if ( isOk && !lua_isnil(L, -1) )
+    {
+        if ( LUA_TTABLE != lua_type(L, -1) )
+        {
+            isOk = L2DBUS_FALSE;
+            reason = "unexpected argument (table expected)";
+        }
+        else
+        {
+            isOk = l2dbus_interfaceParseProperties(L, -1, &ud->propItems,
+                                                &ud->nPropItems, &reason);
+        }
+    }
+    lua_pop(L, 1);
+
+    if ( isOk &&
+        (!l2dbus_interfaceDescBuildMethods(&ud->desc, ud->methodItems,
+                                        ud->nMethodItems) ||
+        !l2dbus_interfaceDescBuildProperties(&ud->desc, ud->propItems,
+                                        ud->nPropItems)) )
+    {
+        isOk = L2DBUS_FALSE;
+        reason = "failed to allocate memory for interface descriptor";
+    }
+
+    if ( !isOk )
+    {
+        luaL_error(L, "%s", reason);
+    }
+
+    return ud;
+}
+
+
+/**
+ This table describes the members of an interface. The format of each
+ field is the one accepted by the corresponding *register* method of an
+ @{l2dbus.Interface|Interface}. The *handler* field of a method is
+ ignored since handlers belong to each interface.
+
+ @table InterfaceDescription
+ @field methods (array) [Opt] The methods (see @{l2dbus.Interface.registerMethods}).
+ @field signals (array) [Opt] The signals (see @{l2dbus.Interface.registerSignals}).
+ @field properties (array) [Opt] The properties (see @{l2dbus.Interface.registerProperties}).
+ */
+
+
+/**
+ @function new
+ @within l2dbus.InterfaceDescriptor
+
+ Creates a new InterfaceDescriptor.
+
+ The descriptor is **not** interned. A Lua error is thrown if the
+ description is invalid.
+
+ @tparam string name A valid D-Bus interface name.
+ @tparam table description The @{InterfaceDescription|description} of the
+ members of the interface.
+ @treturn userdata The InterfaceDescriptor userdata.
+ */
+static int
+l2dbus_newInterfaceDescriptor
+    (
+    lua_State*  L
+    )
+{
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    l2dbus_interfaceDescriptorCreate(L, 1, 2);
+
+    return 1;
+}
+
+
+/**
+ @function intern
+ @within l2dbus.InterfaceDescriptor
+
+ Returns the interned descriptor of an interface.
+
+ If a descriptor for the interface is already interned it is returned
+ and the description is ignored. Otherwise a new descriptor is created
+ from the description and interned. The description of an interface
+ name is expected to be the same wherever it is interned.
+
+ @tparam string name A valid D-Bus interface name.
+ @tparam table description The @{InterfaceDescription|description} of the
+ members of the interface.
+ @treturn userdata The InterfaceDescriptor userdata.
+ */
+static int
+l2dbus_interfaceDescriptorIntern
+    (
+    lua_State*  L
+    )
+{
+    const char* name = luaL_checkstring(L, 1);
+    l2dbus_Context* modCtx;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    modCtx = l2dbus_contextGet(L);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, modCtx->descInternRef);
+    lua_getfield(L, -1, name);
+    if ( lua_isnil(L, -1) )
+    {
+        lua_pop(L, 1);
+        l2dbus_interfaceDescriptorCreate(L, 1, 2);
+        lua_pushvalue(L, -1);
+        lua_setfield(L, -3, name);
+    }
+
+    return 1;
+}
+
+
+/**
+ @function lookup
+ @within l2dbus.InterfaceDescriptor
+
+ Returns the interned descriptor of an interface if there is one.
+
+ @tparam string name The D-Bus interface name.
+ @treturn ?userdata The interned InterfaceDescriptor or **nil**.
+ */
+static int
+l2dbus_interfaceDescriptorLookup
+    (
+    lua_State*  L
+    )
+{
+    const char* name = luaL_checkstring(L, 1);
+    l2dbus_Context* modCtx;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    modCtx = l2dbus_contextGet(L);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, modCtx->descInternRef);
+    lua_getfield(L, -1, name);
+
+    return 1;
+}
+
+
+/**
+ * The L2DBUS InterfaceDescriptor class.
+ * @type InterfaceDescriptor
+ */
+
+/**
+ @function name
+ @within InterfaceDescriptor
+
+ Returns the name of the interface described.
+
+ @tparam userdata descriptor The InterfaceDescriptor.
+ @treturn string The D-Bus interface name.
+ */
+static int
+l2dbus_interfaceDescriptorGetName
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_InterfaceDescriptor* ud = (l2dbus_InterfaceDescriptor*)
+        luaL_checkudata(L, 1, L2DBUS_INTERFACE_DESCRIPTOR_MTBL_NAME);
+
+    lua_pushstring(L, ud->name);
+
+    return 1;
+}
+
+
+/**
+ @function getStats
+ @within InterfaceDescriptor
+
+ Returns the statistics of the descriptor.
+
+ @tparam userdata descriptor The InterfaceDescriptor.
+ @treturn table A table with the number of interfaces sharing the
+ descriptor (*users*) and the number of *methods*, *signals* and
+ *properties* it describes.
+ */
+static int
+l2dbus_interfaceDescriptorGetStats
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_InterfaceDescriptor* ud = (l2dbus_InterfaceDescriptor*)
+        luaL_checkudata(L, 1, L2DBUS_INTERFACE_DESCRIPTOR_MTBL_NAME);
+
+    lua_createtable(L, 0, 4);
+    lua_pushnumber(L, (lua_Number)ud->nUsers);
+    lua_setfield(L, -2, "users");
+    lua_pushinteger(L, (lua_Integer)ud->nMethodItems);
+    lua_setfield(L, -2, "methods");
+    lua_pushinteger(L, (lua_Integer)ud->nSignalItems);
+    lua_setfield(L, -2, "signals");
+    lua_pushinteger(L, (lua_Integer)ud->nPropItems);
+    lua_setfield(L, -2, "properties");
+
+    return 1;
+}
+
+
+/**
+ * @brief Called by Lua VM to GC/reclaim the InterfaceDescriptor userdata.
+ *
+ * @return nil
+ */
+static int
+l2dbus_interfaceDescriptorDispose
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_InterfaceDescriptor* ud = (l2dbus_InterfaceDescriptor*)
+        luaL_checkudata(L, -1, L2DBUS_INTERFACE_DESCRIPTOR_MTBL_NAME);
+
+    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "GC: interface descriptor (userdata=%p)",
+                ud));
+
+    l2dbus_interfaceDescFreeMethods(&ud->desc);
+    l2dbus_interfaceDescFreeProperties(&ud->desc);
+    l2dbus_interfaceFreeItems(ud->methodItems, ud->nMethodItems);
+    ud->methodItems = NULL;
+    ud->nMethodItems = 0;
+    l2dbus_interfaceFreeItems(ud->signalItems, ud->nSignalItems);
+    ud->signalItems = NULL;
+    ud->nSignalItems = 0;
+    l2dbus_interfaceFreePropertyItems(ud->propItems, ud->nPropItems);
+    ud->propItems = NULL;
+    ud->nPropItems = 0;
+    l2dbus_free(ud->name);
+    ud->name = NULL;
+
+    return 0;
+}
+
+
+/*
+ * Define the methods of the InterfaceDescriptor
+ */
+static const luaL_Reg l2dbus_interfaceDescriptorMetaTable[] = {
+    {"name", l2dbus_interfaceDescriptorGetName},
+    {"getStats", l2dbus_interfaceDescriptorGetStats},
+    {"__gc", l2dbus_interfaceDescriptorDispose},
+    {NULL, NULL},
+};
+
+
+/**
+ * @brief "Opens" the InterfaceDescriptor sub-module.
+ *
+ * This function creates a metatable entry for the InterfaceDescriptor
+ * userdata and the (weak) table of interned descriptors. It leaves a
+ * table with the functions of the sub-module on the stack.
+ *
+ * @return None
+ */
+void
+l2dbus_openInterfaceDescriptor
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Context* modCtx = l2dbus_contextGet(L);
+
+    lua_pop(L, l2dbus_createMetatable(L, L2DBUS_INTERFACE_DESCRIPTOR_TYPE_ID,
+            l2dbus_interfaceDescriptorMetaTable));
+
+    lua_newtable(L);
+    lua_createtable(L, 0, 1);
+    lua_pushstring(L, "v");
+    lua_setfield(L, -2, "__mode");
+    lua_setmetatable(L, -2);
+    modCtx->descInternRef = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    lua_createtable(L, 0, 3);
+    lua_pushcfunction(L, l2dbus_newInterfaceDescriptor);
+    lua_setfield(L, -2, "new");
+    lua_pushcfunction(L, l2dbus_interfaceDescriptorIntern);
+    lua_setfield(L, -2, "intern");
+    lua_pushcfunction(L, l2dbus_interfaceDescriptorLookup);
+    lua_setfield(L, -2, "lookup");
+}
@@ -0,0 +1,64 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_interfacedesc.h
+ * @author         Glenn Schmottlach
+ * @brief          Definition of a shared (immutable) interface descriptor.
+ *===========================================================================
+ */
+
+#ifndef L2DBUS_INTERFACEDESC_H_
+#define L2DBUS_INTERFACEDESC_H_
+
+#include "lua.h"
+#include "cdbus/cdbus.h"
+#include "l2dbus_types.h"
+#include "l2dbus_interface.h"
+
+typedef struct l2dbus_InterfaceDescriptor
+{
+    char*                               name;
+    /* The method and property tables shared by the interfaces */
+    l2dbus_InterfaceDesc                desc;
+    /* The parsed members registered with the CDBUS interface of each user */
+    cdbus_DbusIntrospectItem*           methodItems;
+    size_t                              nMethodItems;
+    cdbus_DbusIntrospectItem*           signalItems;
+    size_t                              nSignalItems;
+    cdbus_DbusIntrospectProperty*       propItems;
+    size_t                              nPropItems;
+    /* Number of interfaces created from the descriptor */
+    unsigned long                       nUsers;
+} l2dbus_InterfaceDescriptor;
+
+l2dbus_Bool l2dbus_interfaceDescriptorRegister(
+                                    l2dbus_InterfaceDescriptor* descUd,
+                                    struct cdbus_Interface* intf);
+
+void l2dbus_openInterfaceDescriptor(lua_State* L);
+
+#endif /* Guard for L2DBUS_INTERFACEDESC_H_ */
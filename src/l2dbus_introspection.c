@@ -35,6 +35,7 @@
 #include <assert.h>
 #include <ctype.h>
 #include <string.h>
+#include "dbus/dbus.h"
 #include "cdbus/cdbus.h"
 #include "l2dbus_compat.h"
 #include "l2dbus_trace.h"
@@ -42,6 +43,7 @@
 #include "l2dbus_types.h"
 #include "l2dbus_introspection.h"
 #include "l2dbus_interface.h"
+#include "l2dbus_serviceobject.h"
 #include "l2dbus_core.h"
 #include "l2dbus_object.h"
 #include "lualib.h"
@@ -60,10 +62,86 @@
  with a service object makes the resulting service object *introspectable* in
  D-Bus terms.
 
+ Introspect requests are answered directly from C using the introspection
+ data cached by the service object (see
+ @{l2dbus.ServiceObject.introspect|ServiceObject:introspect}).
+
  @namespace l2dbus.Introspection
  */
 
 
+/**
+ * @brief Answers Introspect requests for a service object.
+ *
+ * @param [in] conn     The CDBUS connection that received the request.
+ * @param [in] obj      The CDBUS service object being introspected.
+ * @param [in] msg      The D-Bus request message.
+ * @param [in] userdata The Introspection (Interface) userdata.
+ * @return DBUS_HANDLER_RESULT_HANDLED if the request was answered.
+ */
+static DBusHandlerResult
+l2dbus_introspectionHandler
+    (
+        struct cdbus_Connection*    conn,
+        struct cdbus_Object*        obj,
+        DBusMessage*                msg,
+        void*                       userdata
+    )
+{
+    const l2dbus_CallbackCtx* cbCtx = &((l2dbus_Interface*)userdata)->cbCtx;
+    l2dbus_ServiceObject* svcObjUd = (l2dbus_ServiceObject*)cdbus_objectGetData(obj);
+    DBusHandlerResult rc = DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    DBusMessage* reply;
+    const char* xml;
+    int base;
+    lua_State* L;
+
+    if ( (NULL == svcObjUd) ||
+        !dbus_message_is_method_call(msg, DBUS_INTERFACE_INTROSPECTABLE,
+                                    "Introspect") )
+    {
+        return rc;
+    }
+
+    L = l2dbus_callbackBegin(cbCtx, &base);
+    xml = l2dbus_serviceObjectIntrospectCached(L, svcObjUd, conn,
+                                            dbus_message_get_path(msg), NULL);
+    l2dbus_callbackEnd(L, base);
+
+    if ( NULL == xml )
+    {
+        reply = dbus_message_new_error(msg, DBUS_ERROR_FAILED,
+                                    "Introspection data is unavailable");
+    }
+    else
+    {
+        reply = dbus_message_new_method_return(msg);
+        if ( (NULL != reply) && !dbus_message_append_args(reply,
+                                DBUS_TYPE_STRING, &xml, DBUS_TYPE_INVALID) )
+        {
+            dbus_message_unref(reply);
+            reply = NULL;
+        }
+    }
+
+    if ( NULL == reply )
+    {
+        rc = DBUS_HANDLER_RESULT_NEED_MEMORY;
+    }
+    else
+    {
+        if ( !dbus_message_get_no_reply(msg) )
+        {
+            dbus_connection_send(cdbus_connectionGetDBus(conn), reply, NULL);
+        }
+        dbus_message_unref(reply);
+        rc = DBUS_HANDLER_RESULT_HANDLED;
+    }
+
+    return rc;
+}
+
+
 /**
  @function new
 
@@ -84,6 +162,8 @@ l2dbus_newIntrospection
     )
 {
     l2dbus_Interface* intfUd;
+    cdbus_DbusIntrospectArgs xmlArg = { "xml_data", "s", CDBUS_XFER_OUT };
+    cdbus_DbusIntrospectItem introspect = { "Introspect", &xmlArg, 1 };
 
     L2DBUS_TRACE((L2DBUS_TRC_TRACE, "Create: introspection"));
 
@@ -102,9 +182,16 @@ l2dbus_newIntrospection
     else
     {
         /* Reset the userdata structure */
-        l2dbus_callbackInit(&intfUd->cbCtx);
+        l2dbus_interfaceInitUd(L, intfUd);
 
-        intfUd->intf = cdbus_introspectNew();
+        intfUd->intf = cdbus_interfaceNew(DBUS_INTERFACE_INTROSPECTABLE,
+                                        l2dbus_introspectionHandler, intfUd);
+        if ( (NULL != intfUd->intf) &&
+            !cdbus_interfaceRegisterMethods(intfUd->intf, &introspect, 1) )
+        {
+            cdbus_interfaceUnref(intfUd->intf);
+            intfUd->intf = NULL;
+        }
 
         if ( NULL == intfUd->intf )
         {
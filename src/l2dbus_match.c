@@ -38,6 +38,7 @@
 #include "l2dbus_compat.h"
 #include "l2dbus_match.h"
 #include "l2dbus_connection.h"
+#include "l2dbus_dispatcher.h"
 #include "l2dbus_core.h"
 #include "l2dbus_object.h"
 #include "l2dbus_util.h"
@@ -116,11 +117,55 @@
  @field value (string) The D-Bus *string* or *object path*.
  */
 
+/**
+ * @brief Calls the Lua handler function of a match rule.
+ *
+ * @param [in] L        The Lua state used to make the call.
+ * @param [in] match    The match rule that matched.
+ * @param [in] msg      The D-Bus message that matched.
+ */
+static void
+l2dbus_matchInvoke
+    (
+    lua_State*      L,
+    l2dbus_Match*   match,
+    DBusMessage*    msg
+    )
+{
+    lua_pushlightuserdata(L, match);
+
+    /* Leaves a Message userdata object on the stack */
+    l2dbus_messageWrap(L, msg, L2DBUS_TRUE);
+
+    l2dbus_callbackInvokeDetail(L, &match->cbCtx, 2 /* nArgs */, 0, "Match",
+                                dbus_message_get_member(msg));
+}
+
+
+/**
+ * @brief Delivers a matched message that was deferred by the Dispatcher.
+ *
+ * @param [in] L    The Lua state used to make the call.
+ * @param [in] item The deferred dispatch item.
+ */
+static void
+l2dbus_matchDispatchDeferred
+    (
+    lua_State*              L,
+    l2dbus_DispatchItem*    item
+    )
+{
+    l2dbus_matchInvoke(L, (l2dbus_Match*)item->target, item->msg);
+}
+
+
 /**
  * @brief Process rule matches and dispatch to Lua handler function.
  *
  * This function is called whenever a match rule is matched and needs
- * to be dispatched to a Lua handler function.
+ * to be dispatched to a Lua handler function. If the dispatch budget of
+ * the Dispatcher has been exhausted the message is queued and delivered
+ * on a subsequent main loop iteration.
  *
  * @param [in] conn The CDBUS connection on which the message matched.
  * @param [in] hnd An opaque CDBUS match handle.
@@ -136,35 +181,54 @@ l2dbus_matchHandler
     void*               userData
     )
 {
-    lua_State* L = l2dbus_callbackGetThread();
-    const char* errMsg = "";
     l2dbus_Match* match = (l2dbus_Match*)userData;
-
-    assert( NULL != L );
+    lua_State* L;
+    int base;
+    l2dbus_DispatchItem item;
+    int priority = L2DBUS_DISPATCH_PRIORITY_NORMAL;
 
     if ( NULL != match)
     {
-        /* Push function and user value on the stack and execute the callback */
-        lua_rawgeti(L, LUA_REGISTRYINDEX, match->cbCtx.funcRef);
-        lua_pushlightuserdata(L, match);
-
-        /* Leaves a Message userdata object on the stack */
-        l2dbus_messageWrap(L, msg, L2DBUS_TRUE);
-
-        lua_rawgeti(L, LUA_REGISTRYINDEX, match->cbCtx.userRef);
+        /* The callback thread is resolved from the context of the Lua
+         * state that registered the match.
+         */
+        L = l2dbus_callbackBegin(&match->cbCtx, &base);
+        assert( NULL != L );
+        l2dbus_callbackEnterDbusDispatch(&match->cbCtx);
+
+        if ( l2dbus_dispatcherIsThrottling(match->dispUd) )
+        {
+            priority = l2dbus_dispatcherResolvePriority(match->dispUd,
+                                                    match->priority, msg);
+        }
 
-        if ( 0 != lua_pcall(L, 3 /* nArgs */, 0, 0) )
+        if ( l2dbus_dispatcherAdmit(match->dispUd, priority) )
+        {
+            l2dbus_matchInvoke(L, match, msg);
+        }
+        else
         {
-            if ( lua_isstring(L, -1) )
+            /* The match is cancelled from the queue when it's disposed
+             * so no reference needs to be held here.
+             */
+            item.func = l2dbus_matchDispatchDeferred;
+            item.priority = priority;
+            item.target = match;
+            item.targetRef = LUA_NOREF;
+            item.connRef = LUA_NOREF;
+            item.msg = dbus_message_ref(msg);
+            item.queuedAt = 0.0;
+            if ( !l2dbus_dispatcherDefer(match->dispUd, &item) )
             {
-                errMsg = lua_tostring(L, -1);
+                dbus_message_unref(item.msg);
+                l2dbus_matchInvoke(L, match, msg);
             }
-            L2DBUS_TRACE((L2DBUS_TRC_ERROR, "Match callback error: %s", errMsg));
         }
-    }
 
-    /* Clean up the thread stack */
-    lua_settop(L, 0);
+        /* Clean up the thread stack */
+        l2dbus_callbackLeaveDbusDispatch(&match->cbCtx);
+        l2dbus_callbackEnd(L, base);
+    }
 }
 
 
@@ -514,7 +578,9 @@ l2dbus_newMatch
             {
                 lua_pushvalue(L, connIdx);
                 match->connRef = luaL_ref(L, LUA_REGISTRYINDEX);
-                l2dbus_callbackInit(&match->cbCtx);
+                match->dispUd = connUd->dispUd;
+                match->priority = L2DBUS_DISPATCH_PRIORITY_DEFAULT;
+                l2dbus_callbackInit(L, &match->cbCtx);
                 l2dbus_callbackRef(L, funcIdx, userIdx, &match->cbCtx);
             }
         }
@@ -565,6 +631,8 @@ l2dbus_disposeMatch
         {
             L2DBUS_TRACE((L2DBUS_TRC_WARN, "Failed to unregister match (0x%x)", rc));
         }
+        /* Drop any messages still waiting to be delivered to this match */
+        l2dbus_dispatcherCancelDeferred(L, match->dispUd, match);
         l2dbus_callbackUnref(L, &match->cbCtx);
         /* Pop of the connection userdata */
         lua_pop(L, 1);
@@ -42,11 +42,15 @@
 /* Forward declarations */
 struct cdbus_MatchRule;
 
+struct l2dbus_Dispatcher;
+
 typedef struct l2dbus_Match
 {
     int                         connRef;
+    struct l2dbus_Dispatcher*   dispUd;
     l2dbus_CallbackCtx          cbCtx;
     cdbus_Handle                matchHnd;
+    int                         priority;
     LIST_ENTRY(l2dbus_Match)    link;
 } l2dbus_Match;
 
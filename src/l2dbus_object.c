@@ -35,8 +35,36 @@
 #include "lauxlib.h"
 #include "l2dbus_object.h"
 #include "l2dbus_compat.h"
+#include "l2dbus_context.h"
+
+
+/**
+ * @brief Pushes the object registry table of the Lua state on the stack.
+ *
+ * Throws a Lua error if the object registry has not been created.
+ *
+ * @param [in] L    The Lua state.
+ */
+static void
+l2dbus_objectRegistryPush
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Context* ctx = l2dbus_contextGet(L);
+
+    if ( NULL == ctx )
+    {
+        luaL_error(L, "Object Registry not initialized!");
+    }
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ctx->objRegRef);
+    if ( lua_type(L, -1) != LUA_TTABLE )
+    {
+        luaL_error(L, "Object Registry not initialized!");
+    }
+}
 
-static int gObjRegRef = LUA_NOREF;
 
 void
 l2dbus_objectRegistryNew
@@ -44,6 +72,8 @@ l2dbus_objectRegistryNew
     lua_State*  L
     )
 {
+    l2dbus_Context* ctx = l2dbus_contextNew(L);
+
     /* Create an object with a weak value that references object handles */
     lua_newtable(L);
     lua_createtable(L, 0, 1);
@@ -51,7 +81,7 @@ l2dbus_objectRegistryNew
     lua_setfield(L, -2, "__mode");
     lua_setmetatable(L, -2);
 
-    gObjRegRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    ctx->objRegRef = luaL_ref(L, LUA_REGISTRYINDEX);
 }
 
 
@@ -62,11 +92,7 @@ l2dbus_objectRegistryCount
     )
 {
     int objCount = 0;
-    lua_rawgeti(L, LUA_REGISTRYINDEX, gObjRegRef);
-    if ( lua_type(L, -1) != LUA_TTABLE )
-    {
-        luaL_error(L, "Object Registry not initialized!");
-    }
+    l2dbus_objectRegistryPush(L);
 
     lua_pushnil(L);
     while ( lua_next(L, -2) != 0 )
@@ -91,11 +117,7 @@ l2dbus_objectRegistryAdd
 {
     /* Get the absolute index of the object */
     objIdx = lua_absindex(L, objIdx);
-    lua_rawgeti(L, LUA_REGISTRYINDEX, gObjRegRef);
-    if ( lua_type(L, -1) != LUA_TTABLE )
-    {
-        luaL_error(L, "Object Registry not initialized!");
-    }
+    l2dbus_objectRegistryPush(L);
 
     /* Use the obj pointer (lightuserdata) as the key and
      * the object stack index as the value.
@@ -115,11 +137,7 @@ l2dbus_objectRegistryGet
     void*       key
     )
 {
-    lua_rawgeti(L, LUA_REGISTRYINDEX, gObjRegRef);
-    if ( lua_type(L, -1) != LUA_TTABLE )
-    {
-        luaL_error(L, "Object Registry not initialized!");
-    }
+    l2dbus_objectRegistryPush(L);
 
     lua_pushlightuserdata(L, key);
     lua_rawget(L, -2);
@@ -140,11 +158,7 @@ l2dbus_objectRegistryRemove
     void*       key
     )
 {
-    lua_rawgeti(L, LUA_REGISTRYINDEX, gObjRegRef);
-    if ( lua_type(L, -1) != LUA_TTABLE )
-    {
-        luaL_error(L, "Object Registry not initialized!");
-    }
+    l2dbus_objectRegistryPush(L);
 
     lua_pushlightuserdata(L, key);
     lua_pushnil(L);
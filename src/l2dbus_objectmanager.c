@@ -0,0 +1,1298 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_objectmanager.c
+ * @author         Glenn Schmottlach
+ * @brief          Implementation of a native D-Bus ObjectManager interface.
+ *===========================================================================
+ */
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include "dbus/dbus.h"
+#include "cdbus/cdbus.h"
+#include "l2dbus_compat.h"
+#include "l2dbus_trace.h"
+#include "l2dbus_debug.h"
+#include "l2dbus_types.h"
+#include "l2dbus_alloc.h"
+#include "l2dbus_objectmanager.h"
+#include "l2dbus_connection.h"
+#include "l2dbus_dispatcher.h"
+#include "l2dbus_interface.h"
+#include "l2dbus_serviceobject.h"
+#include "l2dbus_callback.h"
+#include "l2dbus_core.h"
+#include "l2dbus_object.h"
+#include "lualib.h"
+
+
+/**
+ L2DBUS ObjectManager
+
+ This section describes a Lua ObjectManager class.
+
+ The ObjectManager class is an implementation of the
+ <a href="http://dbus.freedesktop.org/doc/dbus-specification.html#standard-interfaces-objectmanager">ObjectManager</a>
+ interface. Added to a service object it answers **GetManagedObjects**
+ from the @{l2dbus.ServiceObject|service objects} registered on the
+ connection below the object's path without calling into Lua. Property
+ values are taken from those stored with
+ @{l2dbus.Interface.setProperty|Interface:setProperty}.
+
+ The **InterfacesAdded** and **InterfacesRemoved** signals are emitted
+ automatically when a service object is registered or unregistered below
+ a manager, or an interface is added to or removed from a registered
+ object. Announcing the registration of objects can optionally be batched
+ (see @{setBatching}) so that an object gets to set the values of its
+ properties before it's announced.
+
+ @namespace l2dbus.ObjectManager
+ */
+
+
+/**
+ * @brief Compares the path of an indexed object with (part of) a path.
+ *
+ * @return Less than, equal to, or greater than zero like strcmp().
+ */
+static int
+l2dbus_objectIndexCompare
+    (
+    const char* entryPath,
+    const char* path,
+    size_t      len
+    )
+{
+    int cmp = strncmp(entryPath, path, len);
+
+    if ( (0 == cmp) && ('\0' != entryPath[len]) )
+    {
+        cmp = 1;
+    }
+
+    return cmp;
+}
+
+
+/**
+ * @brief Looks up an object in the index by (the first len characters
+ * of) its path.
+ *
+ * @param [in]  index   The object index of a connection.
+ * @param [in]  path    The object path.
+ * @param [in]  len     The length of the path.
+ * @param [out] pos     Optionally set to the position of the object or
+ *                      where it would be inserted.
+ * @return The indexed object or NULL if it isn't found.
+ */
+static l2dbus_IndexedObject*
+l2dbus_objectIndexFind
+    (
+    l2dbus_ObjectIndex* index,
+    const char*         path,
+    size_t              len,
+    unsigned*           pos
+    )
+{
+    unsigned lo = 0U;
+    unsigned hi = index->nObjects;
+    unsigned mid;
+    int cmp;
+
+    while ( lo < hi )
+    {
+        mid = lo + ((hi - lo) / 2U);
+        cmp = l2dbus_objectIndexCompare(index->objects[mid].path, path, len);
+        if ( 0 == cmp )
+        {
+            lo = mid;
+            break;
+        }
+        else if ( 0 > cmp )
+        {
+            lo = mid + 1U;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    if ( NULL != pos )
+    {
+        *pos = lo;
+    }
+
+    return ((lo < index->nObjects) &&
+        (0 == l2dbus_objectIndexCompare(index->objects[lo].path, path, len))) ?
+        &index->objects[lo] : NULL;
+}
+
+
+/**
+ * @brief Removes an object from the index of a connection.
+ */
+static void
+l2dbus_objectIndexErase
+    (
+    l2dbus_Connection*  connUd,
+    unsigned            pos
+    )
+{
+    l2dbus_ObjectIndex* index = &connUd->objIndex;
+    l2dbus_ServiceObject* svcUd = index->objects[pos].svcUd;
+    unsigned idx;
+
+    --index->nObjects;
+    memmove(&index->objects[pos], &index->objects[pos + 1U],
+            (index->nObjects - pos) * sizeof(index->objects[0]));
+
+    for ( idx = 0U; idx < svcUd->nRegConns; ++idx )
+    {
+        if ( svcUd->regConns[idx] == connUd )
+        {
+            svcUd->regConns[idx] = svcUd->regConns[--svcUd->nRegConns];
+            break;
+        }
+    }
+}
+
+
+/**
+ * @brief Sends a signal from every manager of an object.
+ *
+ * The managers are the registered ancestors of the object with an
+ * ObjectManager interface. Each is sent its own copy of the signal.
+ *
+ * @param [in] connUd   The connection the object is registered with.
+ * @param [in] path     The path of the object.
+ * @param [in] signal   The signal or NULL to only count the managers.
+ * @return The number of managers.
+ */
+static unsigned
+l2dbus_objectManagerSend
+    (
+    l2dbus_Connection*  connUd,
+    const char*         path,
+    DBusMessage*        signal
+    )
+{
+    l2dbus_ObjectIndex* index = &connUd->objIndex;
+    l2dbus_IndexedObject* entry;
+    DBusMessage* copy;
+    size_t pathLen = strlen(path);
+    size_t len;
+    unsigned nManagers = 0U;
+
+    for ( len = 1U; len < pathLen; ++len )
+    {
+        /* The root or a parent path */
+        if ( (1U != len) && ('/' != path[len]) )
+        {
+            continue;
+        }
+
+        entry = l2dbus_objectIndexFind(index, path, len, NULL);
+        if ( (NULL == entry) || (0U == entry->svcUd->nManagers) )
+        {
+            continue;
+        }
+
+        ++nManagers;
+        if ( NULL != signal )
+        {
+            copy = dbus_message_copy(signal);
+            if ( (NULL != copy) && dbus_message_set_path(copy, entry->path) &&
+                dbus_connection_send(cdbus_connectionGetDBus(connUd->conn),
+                                    copy, NULL) )
+            {
+                ++index->nSignals;
+            }
+            else
+            {
+                L2DBUS_TRACE((L2DBUS_TRC_ERROR,
+                    "Failed to send ObjectManager signal from '%s'",
+                    entry->path));
+            }
+
+            if ( NULL != copy )
+            {
+                dbus_message_unref(copy);
+            }
+        }
+    }
+
+    return nManagers;
+}
+
+
+/**
+ * @brief Appends the stored properties of an interface as an entry
+ * of an a{sa{sv}} dictionary.
+ */
+static l2dbus_Bool
+l2dbus_objectManagerAppendInterface
+    (
+    DBusMessageIter*    dictIt,
+    l2dbus_Interface*   intfUd
+    )
+{
+    const char* name = cdbus_interfaceGetName(intfUd->intf);
+    l2dbus_InterfaceProperty* prop;
+    DBusMessageIter entryIt;
+    DBusMessageIter propsIt;
+    DBusMessageIter propIt;
+    l2dbus_Bool isOk;
+    unsigned idx;
+
+    isOk = dbus_message_iter_open_container(dictIt, DBUS_TYPE_DICT_ENTRY,
+                                            NULL, &entryIt) &&
+        dbus_message_iter_append_basic(&entryIt, DBUS_TYPE_STRING, &name) &&
+        dbus_message_iter_open_container(&entryIt, DBUS_TYPE_ARRAY, "{sv}",
+                                        &propsIt);
+
+    for ( idx = 0U; isOk && (idx < intfUd->desc->nProps); ++idx )
+    {
+        prop = &intfUd->desc->props[idx];
+        if ( prop->readable && (NULL != intfUd->values[idx].value) )
+        {
+            isOk = dbus_message_iter_open_container(&propsIt,
+                            DBUS_TYPE_DICT_ENTRY, NULL, &propIt) &&
+                dbus_message_iter_append_basic(&propIt, DBUS_TYPE_STRING,
+                                            &prop->name) &&
+                l2dbus_interfaceAppendProperty(intfUd, prop, &propIt) &&
+                dbus_message_iter_close_container(&propsIt, &propIt);
+        }
+    }
+
+    return isOk && dbus_message_iter_close_container(&entryIt, &propsIt) &&
+        dbus_message_iter_close_container(dictIt, &entryIt);
+}
+
+
+/**
+ * @brief Appends the interfaces of a service object as an a{sa{sv}}
+ * dictionary.
+ *
+ * @param [in] L        Lua state.
+ * @param [in] iter     Where the dictionary is appended.
+ * @param [in] svcUd    The service object.
+ * @param [in] intfUd   The only interface to append or NULL for all.
+ * @return True if the dictionary was appended.
+ */
+static l2dbus_Bool
+l2dbus_objectManagerAppendObject
+    (
+    lua_State*              L,
+    DBusMessageIter*        iter,
+    l2dbus_ServiceObject*   svcUd,
+    l2dbus_Interface*       intfUd
+    )
+{
+    DBusMessageIter dictIt;
+    l2dbus_RefItem* item;
+    l2dbus_Bool isOk;
+
+    isOk = dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+                                            "{sa{sv}}", &dictIt);
+    if ( NULL != intfUd )
+    {
+        isOk = isOk && l2dbus_objectManagerAppendInterface(&dictIt, intfUd);
+    }
+    else
+    {
+        LIST_FOREACH(item, &svcUd->interfaces.list, link)
+        {
+            lua_rawgeti(L, LUA_REGISTRYINDEX, item->refIdx);
+            intfUd = (l2dbus_Interface*)lua_touserdata(L, -1);
+            lua_pop(L, 1);
+            isOk = isOk && (NULL != intfUd) &&
+                l2dbus_objectManagerAppendInterface(&dictIt, intfUd);
+        }
+    }
+
+    return isOk && dbus_message_iter_close_container(iter, &dictIt);
+}
+
+
+/**
+ * @brief Creates the InterfacesAdded signal for (an interface of) an
+ * object.
+ *
+ * @return The signal (sent from the object's path) or NULL on failure.
+ */
+static DBusMessage*
+l2dbus_objectManagerNewAdded
+    (
+    lua_State*              L,
+    const char*             path,
+    l2dbus_ServiceObject*   svcUd,
+    l2dbus_Interface*       intfUd
+    )
+{
+    DBusMessage* signal = dbus_message_new_signal(path,
+                                    L2DBUS_OBJECT_MANAGER_INTERFACE,
+                                    "InterfacesAdded");
+    DBusMessageIter iter;
+
+    if ( NULL != signal )
+    {
+        dbus_message_iter_init_append(signal, &iter);
+        if ( !dbus_message_iter_append_basic(&iter, DBUS_TYPE_OBJECT_PATH,
+                                            &path) ||
+            !l2dbus_objectManagerAppendObject(L, &iter, svcUd, intfUd) )
+        {
+            dbus_message_unref(signal);
+            signal = NULL;
+        }
+    }
+
+    return signal;
+}
+
+
+/**
+ * @brief Creates the InterfacesRemoved signal for (an interface of) an
+ * object.
+ *
+ * @return The signal (sent from the object's path) or NULL on failure.
+ */
+static DBusMessage*
+l2dbus_objectManagerNewRemoved
+    (
+    lua_State*              L,
+    const char*             path,
+    l2dbus_ServiceObject*   svcUd,
+    l2dbus_Interface*       intfUd
+    )
+{
+    DBusMessage* signal = dbus_message_new_signal(path,
+                                    L2DBUS_OBJECT_MANAGER_INTERFACE,
+                                    "InterfacesRemoved");
+    DBusMessageIter iter;
+    DBusMessageIter namesIt;
+    l2dbus_RefItem* item;
+    const char* name;
+    l2dbus_Bool isOk = (NULL != signal);
+
+    if ( isOk )
+    {
+        dbus_message_iter_init_append(signal, &iter);
+        isOk = dbus_message_iter_append_basic(&iter, DBUS_TYPE_OBJECT_PATH,
+                                            &path) &&
+            dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+                                        DBUS_TYPE_STRING_AS_STRING, &namesIt);
+    }
+
+    if ( isOk && (NULL != intfUd) )
+    {
+        name = cdbus_interfaceGetName(intfUd->intf);
+        isOk = dbus_message_iter_append_basic(&namesIt, DBUS_TYPE_STRING,
+                                            &name);
+    }
+    else if ( isOk )
+    {
+        LIST_FOREACH(item, &svcUd->interfaces.list, link)
+        {
+            lua_rawgeti(L, LUA_REGISTRYINDEX, item->refIdx);
+            intfUd = (l2dbus_Interface*)lua_touserdata(L, -1);
+            lua_pop(L, 1);
+            if ( isOk && (NULL != intfUd) )
+            {
+                name = cdbus_interfaceGetName(intfUd->intf);
+                isOk = dbus_message_iter_append_basic(&namesIt,
+                                                DBUS_TYPE_STRING, &name);
+            }
+        }
+    }
+
+    if ( isOk )
+    {
+        isOk = dbus_message_iter_close_container(&iter, &namesIt);
+    }
+
+    if ( !isOk && (NULL != signal) )
+    {
+        dbus_message_unref(signal);
+        signal = NULL;
+    }
+
+    return signal;
+}
+
+
+/**
+ * @brief Emits the batched announcements of a connection.
+ *
+ * Objects that were unregistered again before they were announced are
+ * skipped. An announced object is reported with the interfaces and
+ * property values it has now.
+ *
+ * @return The number of signals sent.
+ */
+static unsigned
+l2dbus_objectManagerFlush
+    (
+    l2dbus_Connection*  connUd
+    )
+{
+    l2dbus_ObjectIndex* index = &connUd->objIndex;
+    l2dbus_ManagerChange* change;
+    l2dbus_IndexedObject* entry;
+    DBusMessage* signal;
+    unsigned nSent = 0U;
+    unsigned idx;
+    lua_State* L;
+    int base;
+
+    if ( index->armed )
+    {
+        cdbus_timeoutEnable(index->timeout, CDBUS_FALSE);
+        index->armed = L2DBUS_FALSE;
+    }
+
+    for ( idx = 0U; idx < index->nChanges; ++idx )
+    {
+        change = &index->changes[idx];
+        if ( NULL != change->removed )
+        {
+            nSent += l2dbus_objectManagerSend(connUd, change->path,
+                                            change->removed);
+            dbus_message_unref(change->removed);
+        }
+        else
+        {
+            entry = l2dbus_objectIndexFind(index, change->path,
+                                        strlen(change->path), NULL);
+            if ( (NULL != entry) && entry->pendingAdd )
+            {
+                entry->pendingAdd = L2DBUS_FALSE;
+                L = l2dbus_callbackBegin(&entry->svcUd->cbCtx, &base);
+                signal = l2dbus_objectManagerNewAdded(L, change->path,
+                                                    entry->svcUd, NULL);
+                l2dbus_callbackEnd(L, base);
+                if ( NULL != signal )
+                {
+                    nSent += l2dbus_objectManagerSend(connUd, change->path,
+                                                    signal);
+                    dbus_message_unref(signal);
+                }
+            }
+        }
+        l2dbus_free(change->path);
+    }
+    index->nChanges = 0U;
+
+    return nSent;
+}
+
+
+/**
+ * @brief Called when the batching window of a connection ends.
+ */
+static cdbus_Bool
+l2dbus_objectManagerBatchHandler
+    (
+    cdbus_Timeout*  t,
+    void*           user
+    )
+{
+    l2dbus_Connection* connUd = (l2dbus_Connection*)user;
+
+    connUd->objIndex.armed = L2DBUS_FALSE;
+    l2dbus_objectManagerFlush(connUd);
+
+    /* The return value is unused by CDBUS */
+    return CDBUS_TRUE;
+}
+
+
+/**
+ * @brief Adds an announcement to the batch of a connection.
+ *
+ * @param [in] connUd   The connection.
+ * @param [in] path     The path of the object.
+ * @param [in] removed  The InterfacesRemoved signal (owned by the batch
+ *                      if queued) or NULL for an addition.
+ * @return True if the announcement was queued.
+ */
+static l2dbus_Bool
+l2dbus_objectManagerQueue
+    (
+    l2dbus_Connection*  connUd,
+    const char*         path,
+    DBusMessage*        removed
+    )
+{
+    l2dbus_ObjectIndex* index = &connUd->objIndex;
+    l2dbus_ManagerChange* changes;
+    l2dbus_ManagerChange* change;
+    unsigned maxChanges;
+    cdbus_HResult rc;
+
+    if ( index->nChanges == index->maxChanges )
+    {
+        maxChanges = (0U == index->maxChanges) ? 16U : 2U * index->maxChanges;
+        changes = (l2dbus_ManagerChange*)l2dbus_realloc(index->changes,
+                                        maxChanges * sizeof(*changes));
+        if ( NULL == changes )
+        {
+            return L2DBUS_FALSE;
+        }
+        index->changes = changes;
+        index->maxChanges = maxChanges;
+    }
+
+    change = &index->changes[index->nChanges];
+    change->path = l2dbus_strDup(path);
+    if ( NULL == change->path )
+    {
+        return L2DBUS_FALSE;
+    }
+
+    if ( !index->armed )
+    {
+        /* A one-shot timeout may still report that it's enabled after
+         * it has expired so explicitly re-arm it.
+         */
+        cdbus_timeoutEnable(index->timeout, CDBUS_FALSE);
+        rc = cdbus_timeoutEnable(index->timeout, CDBUS_TRUE);
+        if ( CDBUS_FAILED(rc) )
+        {
+            L2DBUS_TRACE((L2DBUS_TRC_ERROR,
+                "Failed to arm ObjectManager batch timeout (0x%X)", rc));
+            l2dbus_free(change->path);
+            return L2DBUS_FALSE;
+        }
+        index->armed = L2DBUS_TRUE;
+    }
+
+    change->removed = removed;
+    ++index->nChanges;
+
+    return L2DBUS_TRUE;
+}
+
+
+/**
+ * @brief Stops batching the announcements of a connection.
+ *
+ * @param [in] connUd   The connection.
+ * @param [in] flush    Emit the pending announcements (otherwise they're
+ *                      dropped).
+ */
+static void
+l2dbus_objectManagerStopBatching
+    (
+    l2dbus_Connection*  connUd,
+    l2dbus_Bool         flush
+    )
+{
+    l2dbus_ObjectIndex* index = &connUd->objIndex;
+    unsigned idx;
+
+    if ( flush )
+    {
+        l2dbus_objectManagerFlush(connUd);
+    }
+
+    for ( idx = 0U; idx < index->nChanges; ++idx )
+    {
+        if ( NULL != index->changes[idx].removed )
+        {
+            dbus_message_unref(index->changes[idx].removed);
+        }
+        l2dbus_free(index->changes[idx].path);
+    }
+    index->nChanges = 0U;
+
+    for ( idx = 0U; idx < index->nObjects; ++idx )
+    {
+        index->objects[idx].pendingAdd = L2DBUS_FALSE;
+    }
+
+    if ( NULL != index->timeout )
+    {
+        cdbus_timeoutEnable(index->timeout, CDBUS_FALSE);
+        cdbus_timeoutUnref(index->timeout);
+        index->timeout = NULL;
+    }
+    index->windowMsec = -1;
+    index->armed = L2DBUS_FALSE;
+}
+
+
+/**
+ * @brief Initializes the (empty) object index of a connection.
+ */
+void
+l2dbus_objectIndexInit
+    (
+    l2dbus_ObjectIndex* index
+    )
+{
+    memset(index, 0, sizeof(*index));
+    index->windowMsec = -1;
+}
+
+
+/**
+ * @brief Releases the object index of a connection.
+ *
+ * Pending announcements are dropped and the objects still in the index
+ * forget the connection.
+ */
+void
+l2dbus_objectIndexFree
+    (
+    l2dbus_Connection*  connUd
+    )
+{
+    l2dbus_ObjectIndex* index = &connUd->objIndex;
+
+    l2dbus_objectManagerStopBatching(connUd, L2DBUS_FALSE);
+    while ( 0U < index->nObjects )
+    {
+        l2dbus_objectIndexErase(connUd, index->nObjects - 1U);
+    }
+
+    l2dbus_free(index->objects);
+    index->objects = NULL;
+    index->maxObjects = 0U;
+    l2dbus_free(index->changes);
+    index->changes = NULL;
+    index->maxChanges = 0U;
+}
+
+
+/**
+ * @brief Adds a newly registered service object to the index of a
+ * connection and announces it to its managers.
+ *
+ * @param [in] L        Lua state.
+ * @param [in] connUd   The connection the object was registered with.
+ * @param [in] svcUd    The service object.
+ */
+void
+l2dbus_objectIndexAdd
+    (
+    lua_State*              L,
+    l2dbus_Connection*      connUd,
+    l2dbus_ServiceObject*   svcUd
+    )
+{
+    l2dbus_ObjectIndex* index = &connUd->objIndex;
+    const char* path = cdbus_objectGetPath(svcUd->obj);
+    l2dbus_IndexedObject* entry;
+    l2dbus_IndexedObject* objects;
+    l2dbus_Connection** regConns;
+    DBusMessage* signal;
+    unsigned maxItems;
+    unsigned pos;
+
+    if ( NULL != l2dbus_objectIndexFind(index, path, strlen(path), &pos) )
+    {
+        return;
+    }
+
+    if ( index->nObjects == index->maxObjects )
+    {
+        maxItems = (0U == index->maxObjects) ? 16U : 2U * index->maxObjects;
+        objects = (l2dbus_IndexedObject*)l2dbus_realloc(index->objects,
+                                            maxItems * sizeof(*objects));
+        if ( NULL == objects )
+        {
+            L2DBUS_TRACE((L2DBUS_TRC_ERROR,
+                "Failed to index service object '%s'", path));
+            return;
+        }
+        index->objects = objects;
+        index->maxObjects = maxItems;
+    }
+
+    if ( svcUd->nRegConns == svcUd->maxRegConns )
+    {
+        maxItems = (0U == svcUd->maxRegConns) ? 2U : 2U * svcUd->maxRegConns;
+        regConns = (l2dbus_Connection**)l2dbus_realloc(svcUd->regConns,
+                                            maxItems * sizeof(*regConns));
+        if ( NULL == regConns )
+        {
+            L2DBUS_TRACE((L2DBUS_TRC_ERROR,
+                "Failed to index service object '%s'", path));
+            return;
+        }
+        svcUd->regConns = regConns;
+        svcUd->maxRegConns = maxItems;
+    }
+
+    memmove(&index->objects[pos + 1U], &index->objects[pos],
+            (index->nObjects - pos) * sizeof(index->objects[0]));
+    entry = &index->objects[pos];
+    entry->path = path;
+    entry->svcUd = svcUd;
+    entry->pendingAdd = L2DBUS_FALSE;
+    ++index->nObjects;
+    svcUd->regConns[svcUd->nRegConns++] = connUd;
+    ++index->nAdded;
+
+    if ( LIST_EMPTY(&svcUd->interfaces.list) ||
+        (0U == l2dbus_objectManagerSend(connUd, path, NULL)) )
+    {
+        return;
+    }
+
+    if ( (0 <= index->windowMsec) &&
+        l2dbus_objectManagerQueue(connUd, path, NULL) )
+    {
+        entry->pendingAdd = L2DBUS_TRUE;
+    }
+    else
+    {
+        l2dbus_objectManagerFlush(connUd);
+        signal = l2dbus_objectManagerNewAdded(L, path, svcUd, NULL);
+        if ( NULL != signal )
+        {
+            l2dbus_objectManagerSend(connUd, path, signal);
+            dbus_message_unref(signal);
+        }
+    }
+}
+
+
+/**
+ * @brief Removes an unregistered service object from the index of a
+ * connection and announces it to its managers.
+ *
+ * An object that was never announced (because its announcement was still
+ * batched) is removed silently.
+ *
+ * @param [in] L        Lua state.
+ * @param [in] connUd   The connection the object was unregistered from.
+ * @param [in] svcUd    The service object.
+ */
+void
+l2dbus_objectIndexRemove
+    (
+    lua_State*              L,
+    l2dbus_Connection*      connUd,
+    l2dbus_ServiceObject*   svcUd
+    )
+{
+    l2dbus_ObjectIndex* index = &connUd->objIndex;
+    const char* path = cdbus_objectGetPath(svcUd->obj);
+    l2dbus_IndexedObject* entry;
+    DBusMessage* signal;
+    l2dbus_Bool isPending;
+    unsigned pos;
+
+    entry = l2dbus_objectIndexFind(index, path, strlen(path), &pos);
+    if ( (NULL == entry) || (entry->svcUd != svcUd) )
+    {
+        return;
+    }
+
+    isPending = entry->pendingAdd;
+    l2dbus_objectIndexErase(connUd, pos);
+    ++index->nRemoved;
+
+    if ( isPending || LIST_EMPTY(&svcUd->interfaces.list) ||
+        (0U == l2dbus_objectManagerSend(connUd, path, NULL)) )
+    {
+        return;
+    }
+
+    signal = l2dbus_objectManagerNewRemoved(L, path, svcUd, NULL);
+    if ( (NULL != signal) && !((0 <= index->windowMsec) &&
+        l2dbus_objectManagerQueue(connUd, path, signal)) )
+    {
+        l2dbus_objectManagerFlush(connUd);
+        l2dbus_objectManagerSend(connUd, path, signal);
+        dbus_message_unref(signal);
+    }
+}
+
+
+/**
+ * @brief Silently removes a service object from the index of every
+ * connection it's registered with.
+ *
+ * Called when the service object is garbage collected.
+ */
+void
+l2dbus_objectIndexDropObject
+    (
+    l2dbus_ServiceObject*   svcUd
+    )
+{
+    const char* path = cdbus_objectGetPath(svcUd->obj);
+    l2dbus_Connection* connUd;
+    l2dbus_IndexedObject* entry;
+    unsigned pos;
+
+    while ( 0U < svcUd->nRegConns )
+    {
+        connUd = svcUd->regConns[svcUd->nRegConns - 1U];
+        entry = l2dbus_objectIndexFind(&connUd->objIndex, path,
+                                    strlen(path), &pos);
+        if ( (NULL != entry) && (entry->svcUd == svcUd) )
+        {
+            l2dbus_objectIndexErase(connUd, pos);
+        }
+        else
+        {
+            --svcUd->nRegConns;
+        }
+    }
+
+    l2dbus_free(svcUd->regConns);
+    svcUd->regConns = NULL;
+    svcUd->maxRegConns = 0U;
+}
+
+
+/**
+ * @brief Announces an interface added to or removed from a registered
+ * service object.
+ *
+ * Objects whose own announcement is still batched are skipped since the
+ * batched InterfacesAdded signal reports the interfaces at the time it's
+ * sent.
+ *
+ * @param [in] L        Lua state.
+ * @param [in] svcUd    The service object.
+ * @param [in] intfUd   The interface.
+ * @param [in] isAdded  True if the interface was added.
+ */
+void
+l2dbus_objectManagerInterfaceChanged
+    (
+    lua_State*              L,
+    l2dbus_ServiceObject*   svcUd,
+    l2dbus_Interface*       intfUd,
+    l2dbus_Bool             isAdded
+    )
+{
+    const char* path = cdbus_objectGetPath(svcUd->obj);
+    l2dbus_Connection* connUd;
+    l2dbus_IndexedObject* entry;
+    DBusMessage* signal;
+    unsigned idx;
+
+    for ( idx = 0U; idx < svcUd->nRegConns; ++idx )
+    {
+        connUd = svcUd->regConns[idx];
+        entry = l2dbus_objectIndexFind(&connUd->objIndex, path, strlen(path),
+                                    NULL);
+        if ( (NULL == entry) || entry->pendingAdd ||
+            (0U == l2dbus_objectManagerSend(connUd, path, NULL)) )
+        {
+            continue;
+        }
+
+        signal = isAdded ?
+            l2dbus_objectManagerNewAdded(L, path, svcUd, intfUd) :
+            l2dbus_objectManagerNewRemoved(L, path, svcUd, intfUd);
+        if ( NULL != signal )
+        {
+            /* Keep the announcements in order */
+            l2dbus_objectManagerFlush(connUd);
+            l2dbus_objectManagerSend(connUd, path, signal);
+            dbus_message_unref(signal);
+        }
+    }
+}
+
+
+/**
+ * @brief Answers a GetManagedObjects request from the object index.
+ */
+static DBusHandlerResult
+l2dbus_objectManagerGetManagedObjects
+    (
+    lua_State*                  L,
+    struct cdbus_Connection*    conn,
+    l2dbus_Connection*          connUd,
+    DBusMessage*                msg,
+    const char*                 path
+    )
+{
+    l2dbus_ObjectIndex* index = &connUd->objIndex;
+    DBusMessage* reply;
+    DBusMessageIter iter;
+    DBusMessageIter dictIt;
+    DBusMessageIter entryIt;
+    l2dbus_IndexedObject* entry;
+    l2dbus_Bool isOk;
+    size_t prefixLen;
+    unsigned idx;
+
+    ++index->nQueries;
+
+    /* Batched announcements go out before the reply */
+    l2dbus_objectManagerFlush(connUd);
+
+    reply = dbus_message_new_method_return(msg);
+    isOk = (NULL != reply);
+    if ( isOk )
+    {
+        dbus_message_iter_init_append(reply, &iter);
+        isOk = dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+                                            "{oa{sa{sv}}}", &dictIt);
+    }
+
+    /* Descendants share the prefix "<path>/" and, since '/' sorts before
+     * any other character allowed in a path, immediately follow the
+     * manager's own path in the index.
+     */
+    prefixLen = (0 == strcmp(path, "/")) ? 0U : strlen(path);
+    l2dbus_objectIndexFind(index, path, strlen(path), &idx);
+    for ( ; isOk && (idx < index->nObjects); ++idx )
+    {
+        entry = &index->objects[idx];
+        if ( (0 != strncmp(entry->path, path, prefixLen)) ||
+            (('/' != entry->path[prefixLen]) &&
+            ('\0' != entry->path[prefixLen])) )
+        {
+            break;
+        }
+
+        /* Skip the manager itself */
+        if ( ('/' == entry->path[prefixLen]) &&
+            ('\0' != entry->path[prefixLen + 1U]) )
+        {
+            isOk = dbus_message_iter_open_container(&dictIt,
+                            DBUS_TYPE_DICT_ENTRY, NULL, &entryIt) &&
+                dbus_message_iter_append_basic(&entryIt,
+                            DBUS_TYPE_OBJECT_PATH, &entry->path) &&
+                l2dbus_objectManagerAppendObject(L, &entryIt,
+                                                entry->svcUd, NULL) &&
+                dbus_message_iter_close_container(&dictIt, &entryIt);
+        }
+    }
+
+    if ( isOk )
+    {
+        isOk = dbus_message_iter_close_container(&iter, &dictIt);
+    }
+
+    if ( !isOk )
+    {
+        if ( NULL != reply )
+        {
+            dbus_message_unref(reply);
+        }
+        return DBUS_HANDLER_RESULT_NEED_MEMORY;
+    }
+
+    if ( !dbus_message_get_no_reply(msg) )
+    {
+        dbus_connection_send(cdbus_connectionGetDBus(conn), reply, NULL);
+    }
+    dbus_message_unref(reply);
+
+    return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+
+/**
+ * @brief Answers ObjectManager requests for a service object.
+ *
+ * @param [in] conn     The CDBUS connection that received the request.
+ * @param [in] obj      The CDBUS service object.
+ * @param [in] msg      The D-Bus request message.
+ * @param [in] userdata The ObjectManager (Interface) userdata.
+ * @return DBUS_HANDLER_RESULT_HANDLED if the request was answered.
+ */
+static DBusHandlerResult
+l2dbus_objectManagerHandler
+    (
+        struct cdbus_Connection*    conn,
+        struct cdbus_Object*        obj,
+        DBusMessage*                msg,
+        void*                       userdata
+    )
+{
+    const l2dbus_CallbackCtx* cbCtx = &((l2dbus_Interface*)userdata)->cbCtx;
+    DBusHandlerResult rc = DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    l2dbus_Connection* connUd;
+    lua_State* L;
+    int base;
+
+    if ( (DBUS_MESSAGE_TYPE_METHOD_CALL != dbus_message_get_type(msg)) ||
+        !dbus_message_has_member(msg, "GetManagedObjects") ||
+        !dbus_message_has_signature(msg, "") )
+    {
+        return rc;
+    }
+
+    L = l2dbus_callbackBegin(cbCtx, &base);
+    connUd = (l2dbus_Connection*)l2dbus_callbackPushObject(L, cbCtx, conn);
+    if ( NULL != connUd )
+    {
+        rc = l2dbus_objectManagerGetManagedObjects(L, conn, connUd, msg,
+                                                cdbus_objectGetPath(obj));
+    }
+    l2dbus_callbackEnd(L, base);
+
+    return rc;
+}
+
+
+/**
+ @function new
+
+ Creates a new ObjectManager interface.
+
+ The interface describes the **GetManagedObjects** method and the
+ **InterfacesAdded** and **InterfacesRemoved** signals of the D-Bus
+ <a href="http://dbus.freedesktop.org/doc/dbus-specification.html#standard-interfaces-objectmanager">ObjectManager</a>
+ interface. Added to a service object it manages the service objects
+ registered below the object's path on the same connection.
+
+ @treturn userdata The userdata object representing the ObjectManager
+ interface.
+ */
+static int
+l2dbus_newObjectManager
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Interface* intfUd;
+    cdbus_DbusIntrospectArgs getArgs[] = {
+        { "objects", "a{oa{sa{sv}}}", CDBUS_XFER_OUT } };
+    cdbus_DbusIntrospectArgs addedArgs[] = {
+        { "object", "o", CDBUS_XFER_OUT },
+        { "interfaces", "a{sa{sv}}", CDBUS_XFER_OUT } };
+    cdbus_DbusIntrospectArgs removedArgs[] = {
+        { "object", "o", CDBUS_XFER_OUT },
+        { "interfaces", "as", CDBUS_XFER_OUT } };
+    cdbus_DbusIntrospectItem methods[] = {
+        { "GetManagedObjects", getArgs, 1 } };
+    cdbus_DbusIntrospectItem signals[] = {
+        { "InterfacesAdded", addedArgs, 2 },
+        { "InterfacesRemoved", removedArgs, 2 } };
+
+    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "Create: object manager"));
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    intfUd = (l2dbus_Interface*)l2dbus_objectNew(L, sizeof(*intfUd),
+                                             L2DBUS_INTERFACE_TYPE_ID);
+    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "ObjectManager userdata=%p", intfUd));
+
+    if ( NULL == intfUd )
+    {
+        luaL_error(L, "Failed to create object manager userdata!");
+    }
+    else
+    {
+        /* Reset the userdata structure */
+        l2dbus_interfaceInitUd(L, intfUd);
+        intfUd->isObjectManager = L2DBUS_TRUE;
+
+        intfUd->intf = cdbus_interfaceNew(L2DBUS_OBJECT_MANAGER_INTERFACE,
+                                        l2dbus_objectManagerHandler, intfUd);
+        if ( (NULL != intfUd->intf) &&
+            (!cdbus_interfaceRegisterMethods(intfUd->intf, methods, 1) ||
+            !cdbus_interfaceRegisterSignals(intfUd->intf, signals, 2)) )
+        {
+            cdbus_interfaceUnref(intfUd->intf);
+            intfUd->intf = NULL;
+        }
+
+        if ( NULL == intfUd->intf )
+        {
+            /* Release any references we may still have */
+            l2dbus_callbackUnref(L, &intfUd->cbCtx);
+            luaL_error(L, "Failed to allocate object manager interface");
+        }
+        else
+        {
+            /* Create a (weak) mapping between the interface userdata pointer and
+             * itself.
+             */
+            l2dbus_objectRegistryAdd(L, intfUd, -1);
+        }
+    }
+
+    return 1;
+}
+
+
+/**
+ @function setBatching
+
+ Batches the announcement of objects registered with a connection.
+
+ While batching is enabled the **InterfacesAdded** signal of a newly
+ registered service object is held back until the batching window ends,
+ so the signal reports the interfaces and stored property values the
+ object has by then. An object that is unregistered again before it's
+ announced isn't reported at all. Announcements are also sent (in order)
+ before any other ObjectManager signal on the connection or a reply to
+ **GetManagedObjects**.
+
+ Calling this function again flushes the pending announcements.
+
+ @tparam userdata conn The @{l2dbus.Connection|Connection}.
+ @tparam ?number|nil windowMsec How long (in milliseconds) announcements
+ are collected (zero for one main loop iteration) or **nil** to stop
+ batching.
+ */
+static int
+l2dbus_objectManagerSetBatching
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Connection* connUd = (l2dbus_Connection*)luaL_checkudata(L, 1,
+                                        L2DBUS_CONNECTION_MTBL_NAME);
+    lua_Integer windowMsec;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    l2dbus_objectManagerStopBatching(connUd, L2DBUS_TRUE);
+    if ( lua_isnoneornil(L, 2) )
+    {
+        return 0;
+    }
+
+    windowMsec = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, windowMsec >= 0, 2, "window must not be negative");
+
+    connUd->objIndex.timeout = cdbus_timeoutNew(connUd->dispUd->disp,
+                                    (cdbus_Int32)windowMsec, CDBUS_FALSE,
+                                    l2dbus_objectManagerBatchHandler, connUd);
+    if ( NULL == connUd->objIndex.timeout )
+    {
+        luaL_error(L, "Failed to allocate object manager batch");
+    }
+    connUd->objIndex.windowMsec = (int)windowMsec;
+
+    return 0;
+}
+
+
+/**
+ @function flush
+
+ Sends the batched announcements of a connection immediately.
+
+ @tparam userdata conn The @{l2dbus.Connection|Connection}.
+ @treturn number The number of signals sent.
+ */
+static int
+l2dbus_objectManagerFlushLua
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Connection* connUd = (l2dbus_Connection*)luaL_checkudata(L, 1,
+                                        L2DBUS_CONNECTION_MTBL_NAME);
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    lua_pushinteger(L, (lua_Integer)l2dbus_objectManagerFlush(connUd));
+
+    return 1;
+}
+
+
+/**
+ @function getStats
+
+ Returns the statistics of the object index of a connection.
+
+ @tparam userdata conn The @{l2dbus.Connection|Connection}.
+ @treturn table A table with the fields *objects* (the number of
+ registered service objects), *added* and *removed* (the number of
+ registrations and unregistrations), *signals* (the number of
+ InterfacesAdded/InterfacesRemoved signals sent), *queries* (the number
+ of GetManagedObjects requests answered) and *pending* (the number of
+ batched announcements).
+ */
+static int
+l2dbus_objectManagerGetStats
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Connection* connUd = (l2dbus_Connection*)luaL_checkudata(L, 1,
+                                        L2DBUS_CONNECTION_MTBL_NAME);
+    l2dbus_ObjectIndex* index = &connUd->objIndex;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    lua_createtable(L, 0, 6);
+    lua_pushinteger(L, (lua_Integer)index->nObjects);
+    lua_setfield(L, -2, "objects");
+    lua_pushnumber(L, (lua_Number)index->nAdded);
+    lua_setfield(L, -2, "added");
+    lua_pushnumber(L, (lua_Number)index->nRemoved);
+    lua_setfield(L, -2, "removed");
+    lua_pushnumber(L, (lua_Number)index->nSignals);
+    lua_setfield(L, -2, "signals");
+    lua_pushnumber(L, (lua_Number)index->nQueries);
+    lua_setfield(L, -2, "queries");
+    lua_pushinteger(L, (lua_Integer)index->nChanges);
+    lua_setfield(L, -2, "pending");
+
+    return 1;
+}
+
+
+/**
+ * @brief Creates the ObjectManager sub-module.
+ *
+ * This function simulates opening the ObjectManager sub-module. The
+ * ObjectManager userdata shares the metatable of the Interface class.
+ *
+ * @return A table defining the ObjectManager sub-module.
+ *
+ */
+void
+l2dbus_openObjectManager
+    (
+    lua_State*  L
+    )
+{
+    lua_newtable(L);
+    lua_pushcfunction(L, l2dbus_newObjectManager);
+    lua_setfield(L, -2, "new");
+    lua_pushcfunction(L, l2dbus_objectManagerSetBatching);
+    lua_setfield(L, -2, "setBatching");
+    lua_pushcfunction(L, l2dbus_objectManagerFlushLua);
+    lua_setfield(L, -2, "flush");
+    lua_pushcfunction(L, l2dbus_objectManagerGetStats);
+    lua_setfield(L, -2, "getStats");
+}
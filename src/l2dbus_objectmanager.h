@@ -0,0 +1,101 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_objectmanager.h
+ * @author         Glenn Schmottlach
+ * @brief          Definition of a native D-Bus ObjectManager interface.
+ *===========================================================================
+ */
+
+#ifndef L2DBUS_OBJECTMANAGER_H_
+#define L2DBUS_OBJECTMANAGER_H_
+
+#include "lua.h"
+#include "l2dbus_types.h"
+
+#define L2DBUS_OBJECT_MANAGER_INTERFACE "org.freedesktop.DBus.ObjectManager"
+
+/* Forward declarations */
+struct cdbus_Timeout;
+struct DBusMessage;
+struct l2dbus_Connection;
+struct l2dbus_ServiceObject;
+struct l2dbus_Interface;
+
+/* A service object registered with a connection */
+typedef struct l2dbus_IndexedObject
+{
+    /* Owned by the CDBUS object */
+    const char*                         path;
+    struct l2dbus_ServiceObject*        svcUd;
+    /* The (batched) InterfacesAdded signal hasn't been sent yet */
+    l2dbus_Bool                         pendingAdd;
+} l2dbus_IndexedObject;
+
+/* A batched InterfacesAdded or InterfacesRemoved announcement */
+typedef struct l2dbus_ManagerChange
+{
+    char*                               path;
+    /* The InterfacesRemoved signal or NULL for an addition */
+    struct DBusMessage*                 removed;
+} l2dbus_ManagerChange;
+
+/* The objects registered with a connection ordered by their path */
+typedef struct l2dbus_ObjectIndex
+{
+    l2dbus_IndexedObject*               objects;
+    unsigned                            nObjects;
+    unsigned                            maxObjects;
+    /* Announcements are collected for this long (negative if disabled) */
+    int                                 windowMsec;
+    struct cdbus_Timeout*               timeout;
+    l2dbus_Bool                         armed;
+    l2dbus_ManagerChange*               changes;
+    unsigned                            nChanges;
+    unsigned                            maxChanges;
+    /* Statistics */
+    unsigned long                       nAdded;
+    unsigned long                       nRemoved;
+    unsigned long                       nSignals;
+    unsigned long                       nQueries;
+} l2dbus_ObjectIndex;
+
+void l2dbus_objectIndexInit(l2dbus_ObjectIndex* index);
+void l2dbus_objectIndexFree(struct l2dbus_Connection* connUd);
+void l2dbus_objectIndexAdd(lua_State* L, struct l2dbus_Connection* connUd,
+                        struct l2dbus_ServiceObject* svcUd);
+void l2dbus_objectIndexRemove(lua_State* L, struct l2dbus_Connection* connUd,
+                        struct l2dbus_ServiceObject* svcUd);
+void l2dbus_objectIndexDropObject(struct l2dbus_ServiceObject* svcUd);
+void l2dbus_objectManagerInterfaceChanged(lua_State* L,
+                        struct l2dbus_ServiceObject* svcUd,
+                        struct l2dbus_Interface* intfUd,
+                        l2dbus_Bool isAdded);
+
+void l2dbus_openObjectManager(lua_State* L);
+
+#endif /* Guard for L2DBUS_OBJECTMANAGER_H_ */
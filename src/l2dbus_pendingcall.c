@@ -46,6 +46,7 @@
 #include "l2dbus_debug.h"
 #include "l2dbus_types.h"
 #include "l2dbus_message.h"
+#include "l2dbus_scheduler.h"
 #include "lualib.h"
 
 /**
@@ -76,9 +77,14 @@ l2dbus_pendingCallHandler
     void*               user
     )
 {
-    lua_State* L = l2dbus_callbackGetThread();
-    const char* errMsg = "";
-    l2dbus_PendingCall* ud = l2dbus_objectRegistryGet(L, user);
+    /* The callback thread is resolved from the context of the Lua state
+     * that owns the pending call.
+     */
+    const l2dbus_CallbackCtx* cbCtx = &((l2dbus_PendingCall*)user)->cbCtx;
+    int base;
+    lua_State* L = l2dbus_callbackBegin(cbCtx, &base);
+    l2dbus_PendingCall* ud = l2dbus_callbackPushObject(L, cbCtx, user);
+    l2dbus_Task* waiter;
 
     /* Nil or the PendingCall userdata is sitting at the top of the
      * stack at this point.
@@ -97,23 +103,26 @@ l2dbus_pendingCallHandler
     }
     else
     {
-        // Push function and user value on the stack and execute the callback
-        lua_rawgeti(L, LUA_REGISTRYINDEX, ud->cbCtx.funcRef);
-        lua_pushvalue(L, -2 /* PendingCall ud */);
-        lua_rawgeti(L, LUA_REGISTRYINDEX, ud->cbCtx.userRef);
-
-        if ( 0 != lua_pcall(L, 2 /* nArgs */, 0, 0) )
+        /* A task awaiting the reply is resumed by its scheduler */
+        waiter = ud->waiter;
+        if ( NULL != waiter )
         {
-            if ( lua_isstring(L, -1) )
-            {
-                errMsg = lua_tostring(L, -1);
-            }
-            L2DBUS_TRACE((L2DBUS_TRC_ERROR, "Pending call callback error: %s", errMsg));
+            ud->waiter = NULL;
+            l2dbus_taskWake(waiter);
         }
     }
 
+    if ( (NULL != ud) && (LUA_NOREF != ud->cbCtx.funcRef) )
+    {
+        // Push the PendingCall ud and execute the callback
+        lua_pushvalue(L, -1);
+        l2dbus_callbackEnterDbusDispatch(cbCtx);
+        l2dbus_callbackInvoke(L, &ud->cbCtx, 1 /* nArgs */, 0, "Pending call");
+        l2dbus_callbackLeaveDbusDispatch(cbCtx);
+    }
+
     /* Clean up the thread stack */
-    lua_settop(L, 0);
+    l2dbus_callbackEnd(L, base);
 }
 
 
@@ -156,8 +165,9 @@ l2dbus_newPendingCall
     else
     {
         /* Reset the userdata structure */
-        l2dbus_callbackInit(&pcUd->cbCtx);
+        l2dbus_callbackInit(L, &pcUd->cbCtx);
         pcUd->pendingCall = dbusPending;
+        pcUd->waiter = NULL;
         /* Add a reference to the connection userdata */
         lua_pushvalue(L, connIdx);
         pcUd->connRef = luaL_ref(L, LUA_REGISTRYINDEX);
@@ -170,6 +180,40 @@ l2dbus_newPendingCall
 }
 
 
+/**
+ * @brief Registers the task awaiting the reply of a pending call.
+ *
+ * The task is woken (see l2dbus_taskWake()) once the reply is received
+ * or the call times out. A notification function set with setNotify is
+ * still called.
+ *
+ * @param [in] ud   The PendingCall userdata.
+ * @param [in] task The awaiting task.
+ * @return L2DBUS_TRUE if the task will be woken or L2DBUS_FALSE if the
+ * notification handler couldn't be registered.
+ */
+l2dbus_Bool
+l2dbus_pendingCallSetWaiter
+    (
+    l2dbus_PendingCall* ud,
+    l2dbus_Task*        task
+    )
+{
+    assert( NULL != ud );
+
+    if ( !dbus_pending_call_set_notify(ud->pendingCall,
+          l2dbus_pendingCallHandler, ud, NULL) )
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_ERROR, "Failed to register pending call "
+                      "notification handler"));
+        return L2DBUS_FALSE;
+    }
+
+    ud->waiter = task;
+    return L2DBUS_TRUE;
+}
+
+
 /**
  * A D-Bus PendingCall class.
  * @type PendingCall
@@ -271,6 +315,17 @@ l2dbus_pendingCallCancel
 
     dbus_pending_call_cancel(ud->pendingCall);
     l2dbus_callbackUnref(L, &ud->cbCtx);
+    ud->cbCtx.funcRef = LUA_NOREF;
+    ud->cbCtx.userRef = LUA_NOREF;
+
+    /* The handler won't be called so an awaiting task is resumed (without
+     * a reply) right away.
+     */
+    if ( NULL != ud->waiter )
+    {
+        l2dbus_taskWake(ud->waiter);
+        ud->waiter = NULL;
+    }
 
     L2DBUS_TRACE((L2DBUS_TRC_TRACE, "Pending call cancelled"));
 
@@ -400,6 +455,35 @@ l2dbus_pendingCallBlock
 }
 
 
+/**
+ @function await
+ @within PendingCall
+
+ Waits for the reply without blocking the main loop.
+
+ When called from a task started by @{l2dbus.spawn|spawn} the task is
+ suspended until the reply is received (or the call times out) while the
+ Dispatcher goes on processing other events. Called from anywhere else
+ this behaves like @{block} followed by @{stealReply}. A pending call
+ can only be awaited by one task at a time.
+
+ @tparam userdata pending The PendingCall object.
+ @treturn userdata|nil The reply message or **nil** if the call
+ was cancelled.
+ */
+static int
+l2dbus_pendingCallAwait
+    (
+    lua_State*  L
+    )
+{
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    return l2dbus_taskAwait(L, 1, 1);
+}
+
+
 /**
  * @brief Called by the Lua VM to GC/dispose of the PendingCall
  *
@@ -452,6 +536,7 @@ static const luaL_Reg l2dbus_pendingCallMetaTable[] = {
     {"isCompleted", l2dbus_pendingCallIsCompleted},
     {"stealReply", l2dbus_pendingCallStealReply},
     {"block", l2dbus_pendingCallBlock},
+    {"await", l2dbus_pendingCallAwait},
     {"__gc", l2dbus_pendingCallDispose},
     {NULL, NULL},
 };
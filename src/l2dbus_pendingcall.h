@@ -36,19 +36,25 @@
 
 #include "lua.h"
 #include "l2dbus_callback.h"
+#include "l2dbus_types.h"
 
 /* Forward declarations */
 struct DBusPendingCall;
+struct l2dbus_Task;
 
 typedef struct l2dbus_PendingCall
 {
     struct DBusPendingCall* pendingCall;
     int                     connRef;
     l2dbus_CallbackCtx      cbCtx;
+    /* The task awaiting the reply (if any) */
+    struct l2dbus_Task*     waiter;
 } l2dbus_PendingCall;
 
 int l2dbus_newPendingCall(lua_State* L, struct DBusPendingCall* pc,
                             int connIdx);
+l2dbus_Bool l2dbus_pendingCallSetWaiter(l2dbus_PendingCall* ud,
+                                    struct l2dbus_Task* task);
 void l2dbus_openPendingCall(lua_State* L);
 
 #endif /* Guard for L2DBUS_PENDINGCALL_H_ */
@@ -0,0 +1,601 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_profile.c
+ * @author         Glenn Schmottlach
+ * @brief          Implementation of the callback profiler.
+ *===========================================================================
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+#include "l2dbus_compat.h"
+#include "l2dbus_profile.h"
+#include "l2dbus_context.h"
+#include "l2dbus_core.h"
+#include "l2dbus_util.h"
+#include "l2dbus_trace.h"
+#include "l2dbus_debug.h"
+#include "l2dbus_defs.h"
+#include "lauxlib.h"
+
+/**
+ L2DBUS Profiler
+
+ This section describes the L2DBUS callback profiler.
+
+ When enabled, every call from the module into a Lua handler (a match rule,
+ service object, interface, timeout, watch, stream or pending call handler
+ as well as functions run by @{l2dbus.Dispatcher.defer|Dispatcher:defer}
+ and @{l2dbus.Dispatcher.idle|Dispatcher:idle}) is timed using a monotonic clock. The durations are accumulated per handler
+ where a handler is identified by its kind, the Lua function and, for
+ service objects and interfaces, the D-Bus member being handled. A
+ @{getReport|report} lists the handlers that consumed the most main loop
+ time.
+
+ A threshold can also be set above which a call is considered *slow*.
+ Slow calls are traced (as a warning) and optionally reported to a Lua
+ function so that handlers blocking the main loop can be found before
+ clients start to time out.
+
+ Profiling is disabled by default and costs a single test per callback
+ while it's disabled.
+
+ @namespace l2dbus.Profiler
+ */
+
+
+/*
+ * Returns the profiler of the Lua state, creating it if requested.
+ */
+static l2dbus_Profiler*
+l2dbus_profileGet
+    (
+    lua_State*      L,
+    l2dbus_Bool     create
+    )
+{
+    l2dbus_Context* ctx = l2dbus_contextGet(L);
+    l2dbus_Profiler* prof;
+    int idx;
+
+    assert( NULL != ctx );
+
+    if ( (NULL == ctx->profiler) && create )
+    {
+        prof = (l2dbus_Profiler*)lua_newuserdata(L, sizeof(*prof));
+        memset(prof, 0, sizeof(*prof));
+        prof->slowFuncRef = LUA_NOREF;
+        for ( idx = 0; idx < L2DBUS_PROFILE_NUM_BUCKETS; ++idx )
+        {
+            prof->buckets[idx] = -1;
+        }
+        ctx->profilerRef = luaL_ref(L, LUA_REGISTRYINDEX);
+        ctx->profiler = prof;
+    }
+
+    return ctx->profiler;
+}
+
+
+/**
+ * @brief Finds (or adds) the profile entry of a handler.
+ *
+ * @param [in] L        The Lua state.
+ * @param [in] prof     The profiler.
+ * @param [in] funcIdx  Stack index of the Lua handler function.
+ * @param [in] kind     The kind of handler (a static string).
+ * @param [in] detail   Optional detail (e.g. the D-Bus member) or NULL.
+ * @return The profile entry or NULL if the profiler is full.
+ */
+l2dbus_ProfileEntry*
+l2dbus_profileLookup
+    (
+    lua_State*          L,
+    l2dbus_Profiler*    prof,
+    int                 funcIdx,
+    const char*         kind,
+    const char*         detail
+    )
+{
+    const void* func = lua_topointer(L, funcIdx);
+    unsigned detailHash = l2dbus_hashString(detail);
+    unsigned bucket = (unsigned)(((size_t)func >> 4) ^ detailHash ^
+                        ((size_t)kind >> 3)) % L2DBUS_PROFILE_NUM_BUCKETS;
+    l2dbus_ProfileEntry* entry;
+    lua_Debug ar;
+    int idx;
+
+    for ( idx = prof->buckets[bucket]; 0 <= idx; idx = entry->next )
+    {
+        entry = &prof->entries[idx];
+        if ( (entry->func == func) && (entry->kind == kind) &&
+            (entry->detailHash == detailHash) &&
+            (0 == strncmp(entry->detail, (NULL == detail) ? "" : detail,
+                        sizeof(entry->detail) - 1U)) )
+        {
+            return entry;
+        }
+    }
+
+    if ( L2DBUS_PROFILE_MAX_ENTRIES <= prof->nEntries )
+    {
+        return NULL;
+    }
+
+    entry = &prof->entries[prof->nEntries];
+    memset(entry, 0, sizeof(*entry));
+    entry->func = func;
+    entry->kind = kind;
+    entry->detailHash = detailHash;
+    if ( NULL != detail )
+    {
+        strncpy(entry->detail, detail, sizeof(entry->detail) - 1U);
+    }
+
+    /* The source location of the function identifies the handler in reports */
+    lua_pushvalue(L, funcIdx);
+    if ( lua_isfunction(L, -1) && (0 != lua_getinfo(L, ">S", &ar)) )
+    {
+        snprintf(entry->source, sizeof(entry->source), "%s:%d",
+                ar.short_src, ar.linedefined);
+    }
+    else
+    {
+        lua_pop(L, 1);
+        strncpy(entry->source, "?", sizeof(entry->source) - 1U);
+    }
+
+    entry->next = prof->buckets[bucket];
+    prof->buckets[bucket] = prof->nEntries;
+    ++prof->nEntries;
+
+    return entry;
+}
+
+
+/**
+ * @brief Records the duration of a call to a handler.
+ *
+ * If the call exceeded the slow call threshold it's traced and reported
+ * to the slow call handler (if any).
+ *
+ * @param [in] L            The Lua state.
+ * @param [in] prof         The profiler.
+ * @param [in] entry        The entry of the handler or NULL if untracked.
+ * @param [in] kind         The kind of handler.
+ * @param [in] elapsedMsec  The duration of the call.
+ */
+void
+l2dbus_profileRecord
+    (
+    lua_State*              L,
+    l2dbus_Profiler*        prof,
+    l2dbus_ProfileEntry*    entry,
+    const char*             kind,
+    double                  elapsedMsec
+    )
+{
+    const char* source = (NULL != entry) ? entry->source : "?";
+    const char* detail = (NULL != entry) ? entry->detail : "";
+    int top;
+
+    /* The statistics may have been reset while the handler was running */
+    if ( (NULL != entry) && ((entry - prof->entries) >= prof->nEntries) )
+    {
+        entry = NULL;
+        source = "?";
+        detail = "";
+    }
+
+    if ( NULL == entry )
+    {
+        ++prof->nUntracked;
+    }
+    else
+    {
+        ++entry->nCalls;
+        entry->totalMsec += elapsedMsec;
+        if ( elapsedMsec > entry->maxMsec )
+        {
+            entry->maxMsec = elapsedMsec;
+        }
+    }
+
+    if ( (0.0 < prof->slowMsec) && (elapsedMsec >= prof->slowMsec) )
+    {
+        if ( NULL != entry )
+        {
+            ++entry->nSlow;
+        }
+
+        L2DBUS_TRACE((L2DBUS_TRC_WARN, "Slow %s callback %s %s took %.3f msec",
+                    kind, source, detail, elapsedMsec));
+
+        if ( LUA_NOREF != prof->slowFuncRef )
+        {
+            top = lua_gettop(L);
+            lua_rawgeti(L, LUA_REGISTRYINDEX, prof->slowFuncRef);
+            lua_pushstring(L, kind);
+            lua_pushstring(L, source);
+            if ( '\0' != detail[0] )
+            {
+                lua_pushstring(L, detail);
+            }
+            else
+            {
+                lua_pushnil(L);
+            }
+            lua_pushnumber(L, elapsedMsec);
+            if ( 0 != lua_pcall(L, 4 /* nArgs */, 0, 0) )
+            {
+                L2DBUS_TRACE((L2DBUS_TRC_ERROR,
+                            "Slow callback handler error: %s",
+                            lua_isstring(L, -1) ? lua_tostring(L, -1) : ""));
+            }
+            lua_settop(L, top);
+        }
+    }
+}
+
+
+/**
+ @function setEnable
+
+ Enables or disables profiling of callbacks.
+
+ Disabling the profiler keeps the statistics gathered so far.
+
+ @tparam bool option Set to **true** to enable profiling or **false**
+ to disable it.
+ */
+static int
+l2dbus_profileSetEnable
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Profiler* prof;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    luaL_checktype(L, 1, LUA_TBOOLEAN);
+    prof = l2dbus_profileGet(L, lua_toboolean(L, 1));
+    if ( NULL != prof )
+    {
+        prof->enabled = lua_toboolean(L, 1);
+    }
+
+    return 0;
+}
+
+
+/**
+ @function isEnabled
+
+ Returns whether callbacks are being profiled.
+
+ @treturn bool Returns **true** if profiling is enabled.
+ */
+static int
+l2dbus_profileIsEnabled
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Profiler* prof;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    prof = l2dbus_profileGet(L, L2DBUS_FALSE);
+    lua_pushboolean(L, (NULL != prof) && prof->enabled);
+
+    return 1;
+}
+
+
+/**
+ @function setSlowThreshold
+
+ Sets the duration above which a call to a handler is considered slow.
+
+ Slow calls are traced as warnings. If a function is provided it's also
+ called for every slow call. It has the signature:
+
+    function onSlow(kind, handler, member, msec)
+
+ Where:
+
+ <ul>
+ <li>*kind*     - The kind of handler, e.g. "Match", "Interface" or
+ "Timeout"</li>
+ <li>*handler*  - The source location of the Lua handler function</li>
+ <li>*member*   - The D-Bus member being handled or **nil**</li>
+ <li>*msec*     - How long the call took in milliseconds</li>
+ </ul>
+
+ The threshold only applies while profiling is @{setEnable|enabled}.
+
+ @tparam number msec The threshold in milliseconds or zero to not detect
+ slow calls.
+ @tparam ?func handler The optional function called for each slow call.
+ */
+static int
+l2dbus_profileSetSlowThreshold
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Profiler* prof;
+    lua_Number msec = luaL_checknumber(L, 1);
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    luaL_argcheck(L, 0.0 <= msec, 1, "threshold cannot be negative");
+    if ( !lua_isnoneornil(L, 2) )
+    {
+        luaL_checktype(L, 2, LUA_TFUNCTION);
+    }
+
+    prof = l2dbus_profileGet(L, L2DBUS_TRUE);
+    prof->slowMsec = msec;
+    luaL_unref(L, LUA_REGISTRYINDEX, prof->slowFuncRef);
+    prof->slowFuncRef = LUA_NOREF;
+    if ( !lua_isnoneornil(L, 2) )
+    {
+        lua_pushvalue(L, 2);
+        prof->slowFuncRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+
+    return 0;
+}
+
+
+/* The sort order of the report (qsort() doesn't take a context) */
+static L2DBUS_THREAD_LOCAL int gsProfileSortBy;
+
+enum
+{
+    L2DBUS_PROFILE_SORT_TOTAL,
+    L2DBUS_PROFILE_SORT_MAX,
+    L2DBUS_PROFILE_SORT_CALLS,
+    L2DBUS_PROFILE_SORT_SLOW
+};
+
+
+static int
+l2dbus_profileCompare
+    (
+    const void* a,
+    const void* b
+    )
+{
+    const l2dbus_ProfileEntry* ea = *(const l2dbus_ProfileEntry* const*)a;
+    const l2dbus_ProfileEntry* eb = *(const l2dbus_ProfileEntry* const*)b;
+    double va;
+    double vb;
+
+    switch ( gsProfileSortBy )
+    {
+        case L2DBUS_PROFILE_SORT_MAX:
+            va = ea->maxMsec;
+            vb = eb->maxMsec;
+            break;
+
+        case L2DBUS_PROFILE_SORT_CALLS:
+            va = (double)ea->nCalls;
+            vb = (double)eb->nCalls;
+            break;
+
+        case L2DBUS_PROFILE_SORT_SLOW:
+            va = (double)ea->nSlow;
+            vb = (double)eb->nSlow;
+            break;
+
+        default:
+            va = ea->totalMsec;
+            vb = eb->totalMsec;
+            break;
+    }
+
+    return (va < vb) ? 1 : ((va > vb) ? -1 : 0);
+}
+
+
+/**
+ @function getReport
+
+ Returns the handlers that consumed the most main loop time.
+
+ The report is an array of tables (one per handler) sorted in descending
+ order. Each table has the fields:
+
+ <ul>
+ <li>*kind*         - The kind of handler, e.g. "Match" or "Timeout"</li>
+ <li>*handler*      - The source location of the Lua handler function</li>
+ <li>*member*       - The D-Bus member handled (service objects and
+ interfaces only) or **nil**</li>
+ <li>*calls*        - The number of calls</li>
+ <li>*totalMsec*    - The total time spent in the handler</li>
+ <li>*avgMsec*      - The average duration of a call</li>
+ <li>*maxMsec*      - The longest duration of a call</li>
+ <li>*slow*         - The number of slow calls</li>
+ </ul>
+
+ At most 512 distinct handlers are profiled. The number of calls that
+ could not be attributed to a handler is returned as a second value.
+
+ @tparam ?number n The maximum number of handlers to report (default 10).
+ @tparam ?string sortBy Sort by "total" (time, the default), "max", "calls"
+ or "slow".
+ @treturn table The report.
+ @treturn number The number of calls that were not attributed.
+ */
+static int
+l2dbus_profileGetReport
+    (
+    lua_State*  L
+    )
+{
+    static const char* const sortNames[] = { "total", "max", "calls", "slow",
+                                            NULL };
+    l2dbus_Profiler* prof;
+    const l2dbus_ProfileEntry** sorted;
+    const l2dbus_ProfileEntry* entry;
+    lua_Integer maxEntries = luaL_optinteger(L, 1, 10);
+    int sortBy = luaL_checkoption(L, 2, "total", sortNames);
+    int nSorted = 0;
+    int idx;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    luaL_argcheck(L, 0 < maxEntries, 1, "must be positive");
+
+    prof = l2dbus_profileGet(L, L2DBUS_FALSE);
+    if ( NULL == prof )
+    {
+        lua_newtable(L);
+        lua_pushinteger(L, 0);
+        return 2;
+    }
+
+    /* The array is anchored on the stack while it's sorted */
+    sorted = (const l2dbus_ProfileEntry**)lua_newuserdata(L,
+                        (prof->nEntries + 1) * sizeof(*sorted));
+    for ( idx = 0; idx < prof->nEntries; ++idx )
+    {
+        if ( 0U < prof->entries[idx].nCalls )
+        {
+            sorted[nSorted++] = &prof->entries[idx];
+        }
+    }
+    gsProfileSortBy = sortBy;
+    qsort((void*)sorted, (size_t)nSorted, sizeof(*sorted), l2dbus_profileCompare);
+
+    if ( nSorted > maxEntries )
+    {
+        nSorted = (int)maxEntries;
+    }
+
+    lua_createtable(L, nSorted, 0);
+    for ( idx = 0; idx < nSorted; ++idx )
+    {
+        entry = sorted[idx];
+        lua_createtable(L, 0, 8);
+        lua_pushstring(L, entry->kind);
+        lua_setfield(L, -2, "kind");
+        lua_pushstring(L, entry->source);
+        lua_setfield(L, -2, "handler");
+        if ( '\0' != entry->detail[0] )
+        {
+            lua_pushstring(L, entry->detail);
+            lua_setfield(L, -2, "member");
+        }
+        lua_pushnumber(L, (lua_Number)entry->nCalls);
+        lua_setfield(L, -2, "calls");
+        lua_pushnumber(L, entry->totalMsec);
+        lua_setfield(L, -2, "totalMsec");
+        lua_pushnumber(L, entry->totalMsec / (double)entry->nCalls);
+        lua_setfield(L, -2, "avgMsec");
+        lua_pushnumber(L, entry->maxMsec);
+        lua_setfield(L, -2, "maxMsec");
+        lua_pushnumber(L, (lua_Number)entry->nSlow);
+        lua_setfield(L, -2, "slow");
+        lua_rawseti(L, -2, idx + 1);
+    }
+    lua_pushnumber(L, (lua_Number)prof->nUntracked);
+
+    return 2;
+}
+
+
+/**
+ @function reset
+
+ Discards all of the statistics gathered so far.
+ */
+static int
+l2dbus_profileReset
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Profiler* prof;
+    int idx;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    prof = l2dbus_profileGet(L, L2DBUS_FALSE);
+    if ( NULL != prof )
+    {
+        for ( idx = 0; idx < L2DBUS_PROFILE_NUM_BUCKETS; ++idx )
+        {
+            prof->buckets[idx] = -1;
+        }
+        prof->nEntries = 0;
+        prof->nUntracked = 0U;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Creates the Profiler sub-module.
+ *
+ * This function simulates opening the Profiler sub-module.
+ *
+ * @return A table defining the Profiler sub-module.
+ */
+void
+l2dbus_openProfiler
+    (
+    lua_State*  L
+    )
+{
+    lua_newtable(L);
+    lua_pushcfunction(L, l2dbus_profileSetEnable);
+    lua_setfield(L, -2, "setEnable");
+
+    lua_pushcfunction(L, l2dbus_profileIsEnabled);
+    lua_setfield(L, -2, "isEnabled");
+
+    lua_pushcfunction(L, l2dbus_profileSetSlowThreshold);
+    lua_setfield(L, -2, "setSlowThreshold");
+
+    lua_pushcfunction(L, l2dbus_profileGetReport);
+    lua_setfield(L, -2, "getReport");
+
+    lua_pushcfunction(L, l2dbus_profileReset);
+    lua_setfield(L, -2, "reset");
+}
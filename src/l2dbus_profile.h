@@ -0,0 +1,84 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_profile.h
+ * @author         Glenn Schmottlach
+ * @brief          Definitions for the callback profiler.
+ *===========================================================================
+ */
+
+#ifndef L2DBUS_PROFILE_H_
+#define L2DBUS_PROFILE_H_
+
+#include "lua.h"
+#include "l2dbus_types.h"
+
+/* Maximum number of distinct handlers that are profiled */
+#define L2DBUS_PROFILE_MAX_ENTRIES      (512)
+#define L2DBUS_PROFILE_NUM_BUCKETS      (128)
+#define L2DBUS_PROFILE_MAX_LABEL        (64)
+
+/* Accumulated statistics of a single handler */
+typedef struct l2dbus_ProfileEntry
+{
+    /* Index of the next entry in the hash bucket or -1 */
+    int             next;
+    /* The identity of the handler */
+    const void*     func;
+    const char*     kind;
+    unsigned        detailHash;
+    char            source[L2DBUS_PROFILE_MAX_LABEL];
+    char            detail[L2DBUS_PROFILE_MAX_LABEL];
+    /* Statistics */
+    unsigned long   nCalls;
+    unsigned long   nSlow;
+    double          totalMsec;
+    double          maxMsec;
+} l2dbus_ProfileEntry;
+
+typedef struct l2dbus_Profiler
+{
+    l2dbus_Bool         enabled;
+    /* Calls taking at least this long are reported (zero disables) */
+    double              slowMsec;
+    int                 slowFuncRef;
+    /* Calls that could not be attributed because the table is full */
+    unsigned long       nUntracked;
+    int                 buckets[L2DBUS_PROFILE_NUM_BUCKETS];
+    int                 nEntries;
+    l2dbus_ProfileEntry entries[L2DBUS_PROFILE_MAX_ENTRIES];
+} l2dbus_Profiler;
+
+l2dbus_ProfileEntry* l2dbus_profileLookup(lua_State* L, l2dbus_Profiler* prof,
+                                        int funcIdx, const char* kind,
+                                        const char* detail);
+void l2dbus_profileRecord(lua_State* L, l2dbus_Profiler* prof,
+                        l2dbus_ProfileEntry* entry, const char* kind,
+                        double elapsedMsec);
+void l2dbus_openProfiler(lua_State* L);
+
+#endif /* Guard for L2DBUS_PROFILE_H_ */
@@ -0,0 +1,549 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_properties.c
+ * @author         Glenn Schmottlach
+ * @brief          Implementation of a native D-Bus Properties interface.
+ *===========================================================================
+ */
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include "dbus/dbus.h"
+#include "cdbus/cdbus.h"
+#include "l2dbus_compat.h"
+#include "l2dbus_trace.h"
+#include "l2dbus_debug.h"
+#include "l2dbus_types.h"
+#include "l2dbus_properties.h"
+#include "l2dbus_interface.h"
+#include "l2dbus_serviceobject.h"
+#include "l2dbus_callback.h"
+#include "l2dbus_transcode.h"
+#include "l2dbus_core.h"
+#include "l2dbus_object.h"
+#include "lualib.h"
+
+/* Not defined by older versions of libdbus */
+#ifndef DBUS_ERROR_UNKNOWN_PROPERTY
+#define DBUS_ERROR_UNKNOWN_PROPERTY     "org.freedesktop.DBus.Error.UnknownProperty"
+#endif
+#ifndef DBUS_ERROR_PROPERTY_READ_ONLY
+#define DBUS_ERROR_PROPERTY_READ_ONLY   "org.freedesktop.DBus.Error.PropertyReadOnly"
+#endif
+
+
+/**
+ L2DBUS Properties
+
+ This section describes a Lua Properties class.
+
+ The Properties class is an implementation of the
+ <a href="http://dbus.freedesktop.org/doc/dbus-specification.html#standard-interfaces-properties">Properties</a>
+ interface that answers requests from the values stored with
+ @{l2dbus.Interface.setProperty|Interface:setProperty}. Registering it with
+ a service object lets clients **Get**, **GetAll** and **Set** the stored
+ properties of the object's other interfaces without calling into Lua.
+
+ Requests it can't answer (e.g. for an interface without stored values)
+ are left to the handler of the service object.
+
+ @namespace l2dbus.Properties
+ */
+
+
+/**
+ * @brief Sends a reply to a request unless the caller doesn't want one.
+ *
+ * @return DBUS_HANDLER_RESULT_HANDLED or DBUS_HANDLER_RESULT_NEED_MEMORY
+ * if the reply couldn't be allocated.
+ */
+static DBusHandlerResult
+l2dbus_propertiesSend
+    (
+    struct cdbus_Connection*    conn,
+    DBusMessage*                msg,
+    DBusMessage*                reply
+    )
+{
+    if ( NULL == reply )
+    {
+        return DBUS_HANDLER_RESULT_NEED_MEMORY;
+    }
+
+    if ( !dbus_message_get_no_reply(msg) )
+    {
+        dbus_connection_send(cdbus_connectionGetDBus(conn), reply, NULL);
+    }
+    dbus_message_unref(reply);
+
+    return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+
+/**
+ * @brief Answers a Get request from a stored value.
+ */
+static DBusHandlerResult
+l2dbus_propertiesGet
+    (
+    struct cdbus_Connection*    conn,
+    DBusMessage*                msg,
+    l2dbus_Interface*           intfUd,
+    l2dbus_InterfaceProperty*   prop
+    )
+{
+    DBusMessage* reply;
+    DBusMessageIter iter;
+
+    if ( !prop->readable )
+    {
+        reply = dbus_message_new_error(msg, DBUS_ERROR_ACCESS_DENIED,
+                                    "Property is not readable");
+    }
+    else
+    {
+        reply = dbus_message_new_method_return(msg);
+        if ( NULL != reply )
+        {
+            dbus_message_iter_init_append(reply, &iter);
+            if ( !l2dbus_interfaceAppendProperty(intfUd, prop, &iter) )
+            {
+                dbus_message_unref(reply);
+                reply = NULL;
+            }
+        }
+    }
+
+    return l2dbus_propertiesSend(conn, msg, reply);
+}
+
+
+/**
+ * @brief Answers a GetAll request from the stored values.
+ */
+static DBusHandlerResult
+l2dbus_propertiesGetAll
+    (
+    struct cdbus_Connection*    conn,
+    DBusMessage*                msg,
+    l2dbus_Interface*           intfUd
+    )
+{
+    DBusMessage* reply = dbus_message_new_method_return(msg);
+    DBusMessageIter iter;
+    DBusMessageIter dictIt;
+    DBusMessageIter entryIt;
+    l2dbus_InterfaceProperty* prop;
+    l2dbus_Bool isOk = (NULL != reply);
+    unsigned idx;
+
+    if ( isOk )
+    {
+        dbus_message_iter_init_append(reply, &iter);
+        isOk = dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+                    DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+                    DBUS_TYPE_STRING_AS_STRING
+                    DBUS_TYPE_VARIANT_AS_STRING
+                    DBUS_DICT_ENTRY_END_CHAR_AS_STRING, &dictIt);
+    }
+
+    for ( idx = 0; isOk && (idx < intfUd->desc->nProps); ++idx )
+    {
+        prop = &intfUd->desc->props[idx];
+        if ( prop->readable )
+        {
+            isOk = dbus_message_iter_open_container(&dictIt,
+                            DBUS_TYPE_DICT_ENTRY, NULL, &entryIt) &&
+                dbus_message_iter_append_basic(&entryIt, DBUS_TYPE_STRING,
+                                            &prop->name) &&
+                l2dbus_interfaceAppendProperty(intfUd, prop, &entryIt) &&
+                dbus_message_iter_close_container(&dictIt, &entryIt);
+        }
+    }
+
+    if ( isOk )
+    {
+        isOk = dbus_message_iter_close_container(&iter, &dictIt);
+    }
+
+    if ( !isOk && (NULL != reply) )
+    {
+        dbus_message_unref(reply);
+        reply = NULL;
+    }
+
+    return l2dbus_propertiesSend(conn, msg, reply);
+}
+
+
+/**
+ * @brief Decodes the new value of a property and calls the setter hook.
+ *
+ * Called (protected) with the hook, the Interface, the property name and
+ * the Set request (as light userdata) on the stack.
+ */
+static int
+l2dbus_propertiesSetterThunk
+    (
+    lua_State*  L
+    )
+{
+    DBusMessage* msg = (DBusMessage*)lua_touserdata(L, 4);
+    int nArgs;
+
+    lua_settop(L, 3);
+    /* Keep the value, the last of the (interface, name, value) arguments */
+    nArgs = l2dbus_transcodeDbusArgsToLua(L, msg);
+    lua_replace(L, -nArgs - 1);
+    lua_pop(L, nArgs - 1);
+    lua_call(L, 3, 1);
+
+    return 1;
+}
+
+
+/**
+ * @brief Calls the setter hook of an interface with a new value.
+ *
+ * @return True if the hook accepted the value.
+ */
+static l2dbus_Bool
+l2dbus_propertiesCallSetter
+    (
+    lua_State*                  L,
+    l2dbus_Interface*           intfUd,
+    l2dbus_InterfaceProperty*   prop,
+    DBusMessage*                msg
+    )
+{
+    l2dbus_Bool isAccepted = L2DBUS_FALSE;
+    int top = lua_gettop(L);
+
+    lua_pushcfunction(L, l2dbus_propertiesSetterThunk);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, intfUd->setterRef);
+    if ( NULL == l2dbus_callbackPushObject(L, &intfUd->cbCtx, intfUd) )
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_WARN, "Cannot call property setter "
+            "because interface has been GC'ed"));
+    }
+    else
+    {
+        lua_pushstring(L, prop->name);
+        lua_pushlightuserdata(L, msg);
+
+        l2dbus_callbackEnterDbusDispatch(&intfUd->cbCtx);
+        if ( 0 == l2dbus_callbackCallThunk(L, intfUd->cbCtx.modCtx,
+                                    4 /* nArgs */, 1 /* nResults */,
+                                    "PropertySetter", prop->name) )
+        {
+            isAccepted = !(lua_isboolean(L, -1) && !lua_toboolean(L, -1));
+        }
+        l2dbus_callbackLeaveDbusDispatch(&intfUd->cbCtx);
+    }
+    lua_settop(L, top);
+
+    return isAccepted;
+}
+
+
+/**
+ * @brief Answers a Set request by storing the value.
+ */
+static DBusHandlerResult
+l2dbus_propertiesSet
+    (
+    lua_State*                  L,
+    struct cdbus_Connection*    conn,
+    DBusMessage*                msg,
+    l2dbus_Interface*           intfUd,
+    l2dbus_InterfaceProperty*   prop
+    )
+{
+    DBusMessage* reply = NULL;
+    DBusMessageIter iter;
+    DBusMessageIter variantIt;
+    char* sig = NULL;
+
+    /* Skip the interface and property names to reach the value */
+    dbus_message_iter_init(msg, &iter);
+    dbus_message_iter_next(&iter);
+    dbus_message_iter_next(&iter);
+    dbus_message_iter_recurse(&iter, &variantIt);
+    sig = dbus_message_iter_get_signature(&variantIt);
+
+    if ( !prop->writable )
+    {
+        reply = dbus_message_new_error(msg, DBUS_ERROR_PROPERTY_READ_ONLY,
+                                    "Property is read-only");
+    }
+    else if ( (NULL == sig) || (0 != strcmp(sig, prop->sig)) )
+    {
+        reply = dbus_message_new_error(msg, DBUS_ERROR_INVALID_ARGS,
+                                    "Unexpected signature for property");
+    }
+    else if ( (LUA_NOREF != intfUd->setterRef) &&
+        !l2dbus_propertiesCallSetter(L, intfUd, prop, msg) )
+    {
+        reply = dbus_message_new_error(msg, DBUS_ERROR_INVALID_ARGS,
+                                    "Property value rejected");
+    }
+    else if ( l2dbus_interfaceStoreProperty(intfUd, prop, &variantIt) )
+    {
+        reply = dbus_message_new_method_return(msg);
+    }
+    dbus_free(sig);
+
+    return l2dbus_propertiesSend(conn, msg, reply);
+}
+
+
+/**
+ * @brief Answers Properties requests for a service object.
+ *
+ * Requests are only answered for interfaces with stored property
+ * values. A Get or Set for a property without a stored value, or a GetAll
+ * for an interface where not every readable property has one, is left
+ * to the service object's handler.
+ *
+ * @param [in] conn     The CDBUS connection that received the request.
+ * @param [in] obj      The CDBUS service object.
+ * @param [in] msg      The D-Bus request message.
+ * @param [in] userdata The Properties (Interface) userdata.
+ * @return DBUS_HANDLER_RESULT_HANDLED if the request was answered.
+ */
+static DBusHandlerResult
+l2dbus_propertiesHandler
+    (
+        struct cdbus_Connection*    conn,
+        struct cdbus_Object*        obj,
+        DBusMessage*                msg,
+        void*                       userdata
+    )
+{
+    const l2dbus_CallbackCtx* cbCtx = &((l2dbus_Interface*)userdata)->cbCtx;
+    l2dbus_ServiceObject* svcObjUd = (l2dbus_ServiceObject*)cdbus_objectGetData(obj);
+    DBusHandlerResult rc = DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    l2dbus_Interface* intfUd;
+    l2dbus_InterfaceProperty* prop = NULL;
+    const char* intfName = NULL;
+    const char* propName = NULL;
+    const char* member;
+    unsigned idx;
+    int base;
+    lua_State* L;
+
+    if ( (NULL == svcObjUd) ||
+        (DBUS_MESSAGE_TYPE_METHOD_CALL != dbus_message_get_type(msg)) )
+    {
+        return rc;
+    }
+
+    /* Anything but a well-formed Get, Set or GetAll is left to the
+     * service object's handler
+     */
+    member = dbus_message_get_member(msg);
+    if ( (NULL == member) ||
+        !((0 == strcmp(member, "Get") &&
+            dbus_message_has_signature(msg, "ss")) ||
+        (0 == strcmp(member, "Set") &&
+            dbus_message_has_signature(msg, "ssv")) ||
+        (0 == strcmp(member, "GetAll") &&
+            dbus_message_has_signature(msg, "s"))) )
+    {
+        return rc;
+    }
+
+    if ( !dbus_message_get_args(msg, NULL, DBUS_TYPE_STRING, &intfName,
+                                DBUS_TYPE_INVALID) )
+    {
+        return rc;
+    }
+
+    L = l2dbus_callbackBegin(cbCtx, &base);
+    intfUd = l2dbus_serviceObjectFindInterface(L, svcObjUd, intfName);
+
+    if ( (NULL != intfUd) && (0 < intfUd->nPropValues) )
+    {
+        if ( 0 == strcmp(member, "GetAll") )
+        {
+            for ( idx = 0; idx < intfUd->desc->nProps; ++idx )
+            {
+                if ( intfUd->desc->props[idx].readable &&
+                    (NULL == intfUd->values[idx].value) )
+                {
+                    break;
+                }
+            }
+
+            if ( idx == intfUd->desc->nProps )
+            {
+                rc = l2dbus_propertiesGetAll(conn, msg, intfUd);
+            }
+        }
+        else
+        {
+            dbus_message_get_args(msg, NULL, DBUS_TYPE_STRING, &intfName,
+                                DBUS_TYPE_STRING, &propName,
+                                DBUS_TYPE_INVALID);
+            prop = l2dbus_interfaceFindProperty(intfUd, propName);
+            if ( NULL == prop )
+            {
+                rc = l2dbus_propertiesSend(conn, msg,
+                            dbus_message_new_error(msg,
+                                DBUS_ERROR_UNKNOWN_PROPERTY,
+                                "No such property"));
+            }
+            else if ( NULL == L2DBUS_INTERFACE_VALUE(intfUd, prop)->value )
+            {
+                /* Left to the service object's handler */
+            }
+            else if ( 0 == strcmp(member, "Get") )
+            {
+                rc = l2dbus_propertiesGet(conn, msg, intfUd, prop);
+            }
+            else
+            {
+                rc = l2dbus_propertiesSet(L, conn, msg, intfUd, prop);
+            }
+        }
+    }
+
+    l2dbus_callbackEnd(L, base);
+
+    return rc;
+}
+
+
+/**
+ @function new
+
+ Creates a new Properties interface.
+
+ The interface describes the **Get**, **GetAll** and **Set** methods and
+ the **PropertiesChanged** signal of the D-Bus
+ <a href="http://dbus.freedesktop.org/doc/dbus-specification.html#standard-interfaces-properties">Properties</a>
+ interface. Registered with a service object it answers requests for the
+ stored properties of the other interfaces of the object.
+
+ @treturn userdata The userdata object representing the Properties interface.
+ */
+static int
+l2dbus_newProperties
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Interface* intfUd;
+    cdbus_DbusIntrospectArgs getArgs[] = {
+        { "interface", "s", CDBUS_XFER_IN },
+        { "propname", "s", CDBUS_XFER_IN },
+        { "value", "v", CDBUS_XFER_OUT } };
+    cdbus_DbusIntrospectArgs setArgs[] = {
+        { "interface", "s", CDBUS_XFER_IN },
+        { "propname", "s", CDBUS_XFER_IN },
+        { "value", "v", CDBUS_XFER_IN } };
+    cdbus_DbusIntrospectArgs getAllArgs[] = {
+        { "interface", "s", CDBUS_XFER_IN },
+        { "props", "a{sv}", CDBUS_XFER_OUT } };
+    cdbus_DbusIntrospectArgs changedArgs[] = {
+        { "interface", "s", CDBUS_XFER_OUT },
+        { "changedProps", "a{sv}", CDBUS_XFER_OUT },
+        { "invalidatedProps", "as", CDBUS_XFER_OUT } };
+    cdbus_DbusIntrospectItem methods[] = {
+        { "Get", getArgs, 3 },
+        { "Set", setArgs, 3 },
+        { "GetAll", getAllArgs, 2 } };
+    cdbus_DbusIntrospectItem signals[] = {
+        { "PropertiesChanged", changedArgs, 3 } };
+
+    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "Create: properties"));
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    intfUd = (l2dbus_Interface*)l2dbus_objectNew(L, sizeof(*intfUd),
+                                             L2DBUS_INTERFACE_TYPE_ID);
+    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "Properties userdata=%p", intfUd));
+
+    if ( NULL == intfUd )
+    {
+        luaL_error(L, "Failed to create properties userdata!");
+    }
+    else
+    {
+        /* Reset the userdata structure */
+        l2dbus_interfaceInitUd(L, intfUd);
+
+        intfUd->intf = cdbus_interfaceNew(DBUS_INTERFACE_PROPERTIES,
+                                        l2dbus_propertiesHandler, intfUd);
+        if ( (NULL != intfUd->intf) &&
+            (!cdbus_interfaceRegisterMethods(intfUd->intf, methods, 3) ||
+            !cdbus_interfaceRegisterSignals(intfUd->intf, signals, 1)) )
+        {
+            cdbus_interfaceUnref(intfUd->intf);
+            intfUd->intf = NULL;
+        }
+
+        if ( NULL == intfUd->intf )
+        {
+            /* Release any references we may still have */
+            l2dbus_callbackUnref(L, &intfUd->cbCtx);
+            luaL_error(L, "Failed to allocate properties interface");
+        }
+        else
+        {
+            /* Create a (weak) mapping between the interface userdata pointer and
+             * itself.
+             */
+            l2dbus_objectRegistryAdd(L, intfUd, -1);
+        }
+    }
+
+    return 1;
+}
+
+
+/**
+ * @brief Creates the Properties sub-module.
+ *
+ * This function simulates opening the Properties sub-module. The
+ * Properties userdata shares the metatable of the Interface class.
+ *
+ * @return A table defining the Properties sub-module.
+ *
+ */
+void
+l2dbus_openProperties
+    (
+    lua_State*  L
+    )
+{
+    lua_newtable(L);
+    lua_pushcfunction(L, l2dbus_newProperties);
+    lua_setfield(L, -2, "new");
+}
@@ -0,0 +1,1163 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_replycontext.c
+ * @author         Glenn Schmottlach
+ * @brief          Implementation of the context used to reply to a request.
+ *===========================================================================
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "dbus/dbus.h"
+#include "cdbus/cdbus.h"
+#include "l2dbus_compat.h"
+#include "l2dbus_replycontext.h"
+#include "l2dbus_connection.h"
+#include "l2dbus_core.h"
+#include "l2dbus_object.h"
+#include "l2dbus_util.h"
+#include "l2dbus_message.h"
+#include "l2dbus_context.h"
+#include "l2dbus_serviceobject.h"
+#include "l2dbus_dispatcher.h"
+#include "l2dbus_transcode.h"
+#include "l2dbus_dbuscompat.h"
+#include "l2dbus_trace.h"
+#include "l2dbus_debug.h"
+#include "l2dbus_alloc.h"
+#include "lauxlib.h"
+
+/**
+ L2DBUS ReplyContext
+
+ A ReplyContext is handed to the method handlers registered with
+ @{l2dbus.Interface.registerMethods|registerMethods} and to the handlers
+ of the *l2dbus.service* module. It's used to reply to the request either
+ from within the handler or at some later time if a reference to the
+ context is kept.
+
+ Contexts are recycled. Once a request has been replied to and its handler
+ has returned the context is released and its state is handed out again
+ for another request. A released context can't act on the request it
+ was created for nor on any later one: replying to it raises an error
+ and its other methods report that the request has been answered. A
+ context that is replied to after its handler returned isn't released
+ until it's garbage collected.
+
+ A handler that replies later should call @{ReplyContext.defer|defer}
+ before returning. A deferred context is kept alive until it's replied to
+ or until its deadline passes, in which case the caller is sent a
+ *org.freedesktop.DBus.Error.Timeout* error. Deferred replies are counted
+ against the limit of the @{l2dbus.ServiceObject|ServiceObject} answering
+ the request (see
+ @{l2dbus.ServiceObject.setDeferredLimit|setDeferredLimit}).
+
+ @namespace l2dbus.ReplyContext
+ */
+
+
+/**
+ * @brief Copies the reply signature into the context's buffer.
+ *
+ * @param [in] ud       The ReplyContext userdata.
+ * @param [in] outSig   The signature of the reply or NULL if unknown.
+ * @return True if the signature could be stored.
+ */
+static l2dbus_Bool
+l2dbus_replyContextSetOutSig
+    (
+    l2dbus_ReplyContext*    ud,
+    const char*             outSig
+    )
+{
+    size_t len;
+    char* buf;
+
+    ud->hasOutSig = (NULL != outSig);
+    if ( NULL != outSig )
+    {
+        len = strlen(outSig) + 1;
+        if ( len > ud->outSigCap )
+        {
+            buf = (char*)l2dbus_realloc(ud->outSig, len);
+            if ( NULL == buf )
+            {
+                ud->hasOutSig = L2DBUS_FALSE;
+                return L2DBUS_FALSE;
+            }
+            ud->outSig = buf;
+            ud->outSigCap = len;
+        }
+        memcpy(ud->outSig, outSig, len);
+    }
+
+    return L2DBUS_TRUE;
+}
+
+
+/**
+ * @brief Stops tracking a deferred context.
+ *
+ * The deadline is cancelled, the context is removed from the in-flight
+ * list of its service object (giving up the request's admission slot)
+ * and the strong reference to it is dropped.
+ *
+ * @param [in] L        The Lua state.
+ * @param [in] ud       The ReplyContext userdata.
+ */
+static void
+l2dbus_replyContextUndefer
+    (
+    lua_State*              L,
+    l2dbus_ReplyContext*    ud
+    )
+{
+    if ( ud->deferred )
+    {
+        if ( NULL != ud->wheel )
+        {
+            l2dbus_timerDisarm(ud->wheel, &ud->timer);
+            l2dbus_timerWheelUnref(ud->wheel);
+            ud->wheel = NULL;
+        }
+
+        if ( NULL != ud->svcUd )
+        {
+            LIST_REMOVE(ud, deferLink);
+            --ud->svcUd->nDeferred;
+            if ( ud->admitted )
+            {
+                l2dbus_admissionRelease(&ud->svcUd->admission, ud->msg);
+            }
+        }
+        ud->admitted = L2DBUS_FALSE;
+
+        ud->deferred = L2DBUS_FALSE;
+        luaL_unref(L, LUA_REGISTRYINDEX, ud->selfRef);
+        ud->selfRef = LUA_NOREF;
+    }
+}
+
+
+/**
+ * @brief Called when the deadline of a deferred reply passes.
+ *
+ * The caller is sent a timeout error on behalf of the handler.
+ *
+ * @param [in] timer  The expired timer of the context.
+ * @param [in] user   The ReplyContext userdata.
+ */
+static void
+l2dbus_replyContextExpired
+    (
+    l2dbus_Timer*   timer,
+    void*           user
+    )
+{
+    l2dbus_ReplyContext* ud = (l2dbus_ReplyContext*)user;
+    int base;
+    lua_State* L = l2dbus_callbackBegin(&ud->cbCtx, &base);
+
+    (void)timer;
+
+    if ( ud->deferred && !ud->replied && (NULL != ud->msg) )
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_WARN,
+            "Deferred reply (serial #=%u) timed out",
+            dbus_message_get_serial(ud->msg)));
+
+        if ( dbus_message_get_no_reply(ud->msg) )
+        {
+            ud->replied = L2DBUS_TRUE;
+        }
+        else
+        {
+            l2dbus_replyContextSendError(ud, DBUS_ERROR_TIMEOUT,
+                                        "The deferred reply timed out", NULL);
+        }
+        ud->expired = L2DBUS_TRUE;
+
+        if ( NULL != ud->svcUd )
+        {
+            ++ud->svcUd->deferredExpired;
+        }
+    }
+
+    l2dbus_replyContextUndefer(L, ud);
+    l2dbus_callbackEnd(L, base);
+}
+
+
+/**
+ * @brief Returns the state of a ReplyContext object.
+ *
+ * @param [in] L        The Lua state.
+ * @param [in] ctxIdx   Stack index of the ReplyContext userdata.
+ * @return The state of the context or NULL if the context has been
+ * released (its state may since have been handed out again).
+ */
+l2dbus_ReplyContext*
+l2dbus_replyContextGet
+    (
+    lua_State*  L,
+    int         ctxIdx
+    )
+{
+    l2dbus_ReplyContextHandle* handle =
+                (l2dbus_ReplyContextHandle*)lua_touserdata(L, ctxIdx);
+
+    if ( (NULL == handle) || (NULL == handle->ctx) ||
+        (handle->ctx->generation != handle->generation) )
+    {
+        return NULL;
+    }
+
+    return handle->ctx;
+}
+
+
+/*
+ * Frees a context state that's neither pooled nor used by any
+ * ReplyContext object.
+ */
+static void
+l2dbus_replyStateFree
+    (
+    l2dbus_ReplyContext*    ud
+    )
+{
+    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "Free: reply state (%p)", ud));
+
+    if ( NULL != ud->msg )
+    {
+        dbus_message_unref(ud->msg);
+    }
+    l2dbus_free(ud->outSig);
+    l2dbus_free(ud);
+}
+
+
+/*
+ * Drops a ReplyContext object's use of a context state. The state is freed
+ * once no object uses it unless it's waiting in the pool.
+ */
+static void
+l2dbus_replyStateUnref
+    (
+    l2dbus_ReplyContext*    ud
+    )
+{
+    assert( 0U < ud->nHandles );
+    --ud->nHandles;
+    if ( (0U == ud->nHandles) && !ud->pooled )
+    {
+        l2dbus_replyStateFree(ud);
+    }
+}
+
+
+/*
+ * Drops the request of a context state and returns the state to the pool
+ * if it isn't full. Any ReplyContext object still referring to it becomes
+ * invalid.
+ */
+static void
+l2dbus_replyContextRecycle
+    (
+    lua_State*              L,
+    l2dbus_Context*         modCtx,
+    l2dbus_ReplyContext*    ud
+    )
+{
+    if ( NULL != ud->msg )
+    {
+        dbus_message_unref(ud->msg);
+        ud->msg = NULL;
+    }
+    luaL_unref(L, LUA_REGISTRYINDEX, ud->connRef);
+    ud->connRef = LUA_NOREF;
+    ud->connUd = NULL;
+    luaL_unref(L, LUA_REGISTRYINDEX, ud->svcRef);
+    ud->svcRef = LUA_NOREF;
+    ud->svcUd = NULL;
+
+    ++ud->generation;
+    if ( modCtx->replyPoolSize < modCtx->replyPoolMax )
+    {
+        ud->nextIdle = modCtx->replyIdle;
+        modCtx->replyIdle = ud;
+        ud->pooled = L2DBUS_TRUE;
+        ++modCtx->replyPoolSize;
+    }
+}
+
+
+/**
+ * @brief Acquires a (Lua) ReplyContext object for a request.
+ *
+ * A new ReplyContext object is created for every request. Its state is
+ * taken from the pool if an idle one is available. Otherwise a new state
+ * is allocated. A state is kept until neither the pool nor any
+ * ReplyContext object refers to it so an object that outlives its
+ * request can safely detect that it's no longer valid.
+ *
+ * @param [in] L        The Lua state.
+ * @param [in] connIdx  Stack index of the Connection userdata on which the
+ * request was received.
+ * @param [in] svcIdx   Stack index of the ServiceObject userdata answering
+ * the request or zero (0) if unknown. Nil is treated as unknown.
+ * @param [in] msg      The request message.
+ * @param [in] outSig   The signature of the reply or NULL if unknown.
+ * @return The state of the ReplyContext whose userdata is left on the
+ * stack.
+ */
+l2dbus_ReplyContext*
+l2dbus_replyContextAcquire
+    (
+    lua_State*          L,
+    int                 connIdx,
+    int                 svcIdx,
+    struct DBusMessage* msg,
+    const char*         outSig
+    )
+{
+    l2dbus_Context* modCtx = l2dbus_contextGet(L);
+    l2dbus_ReplyContextHandle* handle;
+    l2dbus_ReplyContext* ud;
+
+    connIdx = lua_absindex(L, connIdx);
+    if ( 0 != svcIdx )
+    {
+        svcIdx = lua_absindex(L, svcIdx);
+    }
+
+    handle = (l2dbus_ReplyContextHandle*)l2dbus_objectNew(L, sizeof(*handle),
+                                            L2DBUS_REPLY_CONTEXT_TYPE_ID);
+    if ( NULL == handle )
+    {
+        luaL_error(L, "Failed to create reply context userdata!");
+    }
+
+    if ( NULL != modCtx->replyIdle )
+    {
+        ud = modCtx->replyIdle;
+        modCtx->replyIdle = ud->nextIdle;
+        ud->nextIdle = NULL;
+        ud->pooled = L2DBUS_FALSE;
+        --modCtx->replyPoolSize;
+        ++modCtx->replyCtxReused;
+    }
+    else
+    {
+        ud = (l2dbus_ReplyContext*)l2dbus_calloc(1, sizeof(*ud));
+        if ( NULL == ud )
+        {
+            luaL_error(L, "Failed to create reply context state!");
+        }
+        ud->connRef = LUA_NOREF;
+        ud->svcRef = LUA_NOREF;
+        ud->selfRef = LUA_NOREF;
+        l2dbus_callbackInit(L, &ud->cbCtx);
+        l2dbus_timerInit(&ud->timer, l2dbus_replyContextExpired, ud);
+        ++modCtx->replyCtxCreated;
+    }
+
+    /* From here on the state is returned to the pool with the object */
+    ++ud->nHandles;
+    handle->ctx = ud;
+    handle->generation = ud->generation;
+
+    if ( !l2dbus_replyContextSetOutSig(ud, outSig) )
+    {
+        luaL_error(L, "Failed to allocate reply signature");
+    }
+
+    ud->connUd = (l2dbus_Connection*)lua_touserdata(L, connIdx);
+    lua_pushvalue(L, connIdx);
+    ud->connRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    ud->msg = dbus_message_ref(msg);
+    ud->replied = L2DBUS_FALSE;
+    ud->expired = L2DBUS_FALSE;
+    ud->admitted = L2DBUS_FALSE;
+
+    if ( (0 != svcIdx) && (NULL != lua_touserdata(L, svcIdx)) )
+    {
+        ud->svcUd = (l2dbus_ServiceObject*)lua_touserdata(L, svcIdx);
+        lua_pushvalue(L, svcIdx);
+        ud->svcRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+
+    return ud;
+}
+
+
+/**
+ * @brief Releases a ReplyContext once its handler has returned.
+ *
+ * A context that has been replied to drops its request and connection and
+ * its state is returned to the pool. The ReplyContext object can't be
+ * used any longer. A context that hasn't been replied to is left
+ * untouched so that it can be replied to later.
+ *
+ * @param [in] L        The Lua state.
+ * @param [in] ctxIdx   Stack index of the ReplyContext userdata.
+ * @return True if the context was released.
+ */
+l2dbus_Bool
+l2dbus_replyContextRelease
+    (
+    lua_State*  L,
+    int         ctxIdx
+    )
+{
+    l2dbus_ReplyContext* ud = l2dbus_replyContextGet(L, ctxIdx);
+
+    if ( (NULL == ud) || !ud->replied || ud->deferred || (NULL == ud->msg) )
+    {
+        return L2DBUS_FALSE;
+    }
+
+    l2dbus_replyContextRecycle(L, l2dbus_contextGet(L), ud);
+
+    return L2DBUS_TRUE;
+}
+
+
+/**
+ * @brief Sends an error reply to the request of a reply context.
+ *
+ * @param [in] ud           The ReplyContext userdata.
+ * @param [in] errName      The D-Bus error name.
+ * @param [in] errMsg       An optional error message or NULL.
+ * @param [out] serialNum   The serial number of the error reply (may be
+ * NULL).
+ * @return True if the error reply was queued to be sent.
+ */
+l2dbus_Bool
+l2dbus_replyContextSendError
+    (
+    l2dbus_ReplyContext*    ud,
+    const char*             errName,
+    const char*             errMsg,
+    dbus_uint32_t*          serialNum
+    )
+{
+    DBusMessage* errorMsg;
+    l2dbus_Bool isSent = L2DBUS_FALSE;
+
+    errorMsg = dbus_message_new_error(ud->msg, errName, errMsg);
+    if ( NULL != errorMsg )
+    {
+        isSent = dbus_connection_send(
+                    cdbus_connectionGetDBus(ud->connUd->conn), errorMsg,
+                    serialNum);
+        dbus_message_unref(errorMsg);
+    }
+    ud->replied = L2DBUS_TRUE;
+
+    return isSent;
+}
+
+
+/**
+ @function new
+ @within l2dbus.ReplyContext
+
+ Acquires a ReplyContext for a request.
+
+ This is intended for dispatchers written in Lua. The context should be
+ handed back with @{release} once the handler of the request returns.
+
+ @tparam userdata conn The D-Bus connection on which the request arrived.
+ @tparam userdata msg The request message.
+ @tparam ?string outSig The signature of the reply. If not specified the
+ D-Bus types of the reply are guessed from the Lua types.
+ @tparam ?userdata svcObj The @{l2dbus.ServiceObject|ServiceObject}
+ answering the request. Deferred replies are only counted against the
+ limit of a service object if one is given.
+ @treturn userdata The ReplyContext.
+ */
+static int
+l2dbus_newReplyContext
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Message* msgUd;
+    const char* outSig;
+    int svcIdx = 0;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    luaL_checkudata(L, 1, L2DBUS_CONNECTION_MTBL_NAME);
+    msgUd = (l2dbus_Message*)luaL_checkudata(L, 2, L2DBUS_MESSAGE_MTBL_NAME);
+    outSig = luaL_optstring(L, 3, NULL);
+    if ( !lua_isnoneornil(L, 4) )
+    {
+        luaL_checkudata(L, 4, L2DBUS_SERVICE_OBJECT_MTBL_NAME);
+        svcIdx = 4;
+    }
+
+    if ( (NULL == msgUd->msg) ||
+        (DBUS_MESSAGE_TYPE_METHOD_CALL != dbus_message_get_type(msgUd->msg)) )
+    {
+        luaL_argerror(L, 2, "expected a method call message");
+    }
+
+    if ( (NULL != outSig) && !dbus_signature_validate(outSig, NULL) )
+    {
+        luaL_argerror(L, 3, "invalid D-Bus signature");
+    }
+
+    l2dbus_replyContextAcquire(L, 1, svcIdx, msgUd->msg, outSig);
+
+    return 1;
+}
+
+
+/**
+ @function getPoolStats
+ @within l2dbus.ReplyContext
+
+ Returns the statistics of the ReplyContext pool.
+
+ @treturn table A table with the number of context states *created*, the
+ number of times an idle state was *reused*, the number of states
+ currently *pooled* and the most that are kept (*maxPooled*). States
+ beyond that are freed once no ReplyContext refers to them.
+ */
+static int
+l2dbus_replyContextGetPoolStats
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Context* modCtx;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    modCtx = l2dbus_contextGet(L);
+    lua_createtable(L, 0, 4);
+    lua_pushnumber(L, (lua_Number)modCtx->replyCtxCreated);
+    lua_setfield(L, -2, "created");
+    lua_pushnumber(L, (lua_Number)modCtx->replyCtxReused);
+    lua_setfield(L, -2, "reused");
+    lua_pushinteger(L, modCtx->replyPoolSize);
+    lua_setfield(L, -2, "pooled");
+    lua_pushinteger(L, modCtx->replyPoolMax);
+    lua_setfield(L, -2, "maxPooled");
+
+    return 1;
+}
+
+
+/*
+ * Returns the state of the ReplyContext argument or NULL if the context
+ * has been released.
+ */
+static l2dbus_ReplyContext*
+l2dbus_replyContextCheck
+    (
+    lua_State*  L,
+    int         ctxIdx
+    )
+{
+    luaL_checkudata(L, ctxIdx, L2DBUS_REPLY_CONTEXT_MTBL_NAME);
+
+    return l2dbus_replyContextGet(L, ctxIdx);
+}
+
+
+/**
+ * The L2DBUS ReplyContext class.
+ * @type ReplyContext
+ */
+
+/**
+ @function reply
+ @within ReplyContext
+
+ Sends the reply to the request.
+
+ The arguments are marshalled using the output signature of the method
+ if it's known or otherwise by guessing the D-Bus type of each argument.
+ It's an error to reply to the same request more than once (an
+ @{error} reply counts as a reply). Replying to a deferred request whose
+ deadline has passed is not an error but nothing is sent.
+
+ @tparam userdata ctx The ReplyContext.
+ @tparam any ... The arguments of the reply.
+ @treturn bool Returns **true** if the reply is queued to be sent and
+ **false** otherwise.
+ @treturn number The serial number of the reply or zero (0) if it
+ cannot be queued.
+ */
+static int
+l2dbus_replyContextReply
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_ReplyContext* ud = l2dbus_replyContextCheck(L, 1);
+    int nArgs = lua_gettop(L) - 1;
+    DBusMessage* replyMsg;
+    dbus_uint32_t serialNum = 0;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    if ( NULL == ud )
+    {
+        luaL_error(L, "reply context has been released");
+    }
+
+    if ( ud->expired )
+    {
+        lua_pushboolean(L, L2DBUS_FALSE);
+        lua_pushnumber(L, serialNum);
+        return 2;
+    }
+
+    if ( ud->replied || (NULL == ud->msg) )
+    {
+        luaL_error(L, "request has already been replied to");
+    }
+
+    replyMsg = dbus_message_new_method_return(ud->msg);
+    if ( NULL == replyMsg )
+    {
+        luaL_error(L, "Failed to allocate reply message");
+    }
+
+    /* The wrapper owns the message should marshalling fail */
+    l2dbus_messageWrap(L, replyMsg, L2DBUS_FALSE);
+    if ( ud->hasOutSig )
+    {
+        l2dbus_transcodeLuaArgsToDbusBySignature(L, replyMsg, 2, nArgs,
+                                                ud->outSig);
+    }
+    else
+    {
+        l2dbus_transcodeLuaArgsToDbus(L, replyMsg, 2, nArgs);
+    }
+
+    ud->replied = L2DBUS_TRUE;
+    lua_pushboolean(L, dbus_connection_send(
+                    cdbus_connectionGetDBus(ud->connUd->conn), replyMsg,
+                    &serialNum));
+    lua_pushnumber(L, serialNum);
+    l2dbus_replyContextUndefer(L, ud);
+
+    return 2;
+}
+
+
+/**
+ @function error
+ @within ReplyContext
+
+ Sends an error reply to the request.
+
+ @tparam userdata ctx The ReplyContext.
+ @tparam string errName The D-Bus error name.
+ @tparam ?string errMsg An optional error message.
+ @treturn bool Returns **true** if the error is queued to be sent and
+ **false** otherwise.
+ @treturn number The serial number of the error reply or zero (0) if it
+ cannot be queued.
+ */
+static int
+l2dbus_replyContextError
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_ReplyContext* ud = l2dbus_replyContextCheck(L, 1);
+    const char* errName = luaL_checkstring(L, 2);
+    const char* errMsg = luaL_optstring(L, 3, NULL);
+    dbus_uint32_t serialNum = 0;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    if ( !l2dbus_validateErrorName(errName) )
+    {
+        luaL_argerror(L, 2, "invalid D-Bus error name");
+    }
+
+    if ( NULL == ud )
+    {
+        luaL_error(L, "reply context has been released");
+    }
+
+    if ( ud->expired )
+    {
+        lua_pushboolean(L, L2DBUS_FALSE);
+        lua_pushnumber(L, serialNum);
+        return 2;
+    }
+
+    if ( ud->replied || (NULL == ud->msg) )
+    {
+        luaL_error(L, "request has already been replied to");
+    }
+
+    lua_pushboolean(L, l2dbus_replyContextSendError(ud, errName, errMsg,
+                                                    &serialNum));
+    lua_pushnumber(L, serialNum);
+    l2dbus_replyContextUndefer(L, ud);
+
+    return 2;
+}
+
+
+/**
+ @function getConnection
+ @within ReplyContext
+
+ Returns the connection on which the request was received.
+
+ @tparam userdata ctx The ReplyContext.
+ @treturn userdata The D-Bus connection or **nil** if the context has
+ been released.
+ */
+static int
+l2dbus_replyContextGetConnection
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_ReplyContext* ud = l2dbus_replyContextCheck(L, 1);
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    if ( NULL == ud )
+    {
+        lua_pushnil(L);
+    }
+    else
+    {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, ud->connRef);
+    }
+
+    return 1;
+}
+
+
+/**
+ @function getMessage
+ @within ReplyContext
+
+ Returns the request message.
+
+ @tparam userdata ctx The ReplyContext.
+ @treturn userdata The D-Bus request message or **nil** if the context
+ has been released.
+ */
+static int
+l2dbus_replyContextGetMessage
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_ReplyContext* ud = l2dbus_replyContextCheck(L, 1);
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    if ( (NULL == ud) || (NULL == ud->msg) )
+    {
+        lua_pushnil(L);
+    }
+    else
+    {
+        l2dbus_messageWrap(L, ud->msg, L2DBUS_TRUE);
+    }
+
+    return 1;
+}
+
+
+/**
+ @function needsReply
+ @within ReplyContext
+
+ Returns whether the caller expects a reply.
+
+ @tparam userdata ctx The ReplyContext.
+ @treturn bool Returns **true** if the request expects a reply.
+ */
+static int
+l2dbus_replyContextNeedsReply
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_ReplyContext* ud = l2dbus_replyContextCheck(L, 1);
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    lua_pushboolean(L, (NULL != ud) && (NULL != ud->msg) &&
+                        !dbus_message_get_no_reply(ud->msg));
+
+    return 1;
+}
+
+
+/**
+ @function isReplied
+ @within ReplyContext
+
+ Returns whether the request has been replied to.
+
+ @tparam userdata ctx The ReplyContext.
+ @treturn bool Returns **true** if a reply (or error) has been sent.
+ */
+static int
+l2dbus_replyContextIsReplied
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_ReplyContext* ud = l2dbus_replyContextCheck(L, 1);
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    /* Only contexts that have been replied to are released */
+    lua_pushboolean(L, (NULL == ud) || ud->replied);
+
+    return 1;
+}
+
+
+/**
+ @function defer
+ @within ReplyContext
+
+ Defers the reply until after the handler returns.
+
+ The context is kept alive until it's replied to. If no reply is sent
+ before the deadline the caller is sent a
+ *org.freedesktop.DBus.Error.Timeout* error. Deferring a context again
+ moves its deadline. If the service object answering the request already
+ has as many deferred replies in-flight as its limit allows the caller is
+ sent a *org.freedesktop.DBus.Error.LimitsExceeded* error instead and
+ the request is considered answered. A deferred request counts against
+ the @{l2dbus.ServiceObject.setAdmission|admission limits} of the
+ service object until it's answered.
+
+ @tparam userdata ctx The ReplyContext.
+ @tparam ?number timeout The deadline (in milliseconds) of the reply.
+ Defaults to 25000 msec.
+ @treturn bool Returns **true** if the reply is deferred and **false** if
+ the request was rejected.
+ */
+static int
+l2dbus_replyContextDefer
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_ReplyContext* ud = l2dbus_replyContextCheck(L, 1);
+    lua_Number timeout = luaL_optnumber(L, 2,
+                                    L2DBUS_REPLY_CONTEXT_DEFAULT_TIMEOUT);
+    l2dbus_ServiceObject* svcUd;
+    double now;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    luaL_argcheck(L, timeout > 0, 2, "timeout must be positive");
+
+    if ( NULL == ud )
+    {
+        luaL_error(L, "reply context has been released");
+    }
+
+    svcUd = ud->svcUd;
+    if ( ud->replied || (NULL == ud->msg) )
+    {
+        luaL_error(L, "request has already been replied to");
+    }
+
+    if ( !ud->deferred )
+    {
+        if ( (NULL != svcUd) && (0U < svcUd->maxDeferred) &&
+            (svcUd->nDeferred >= svcUd->maxDeferred) )
+        {
+            ++svcUd->deferredRejected;
+            if ( dbus_message_get_no_reply(ud->msg) )
+            {
+                ud->replied = L2DBUS_TRUE;
+            }
+            else
+            {
+                l2dbus_replyContextSendError(ud, DBUS_ERROR_LIMITS_EXCEEDED,
+                                    "Too many deferred replies in-flight",
+                                    NULL);
+            }
+            lua_pushboolean(L, L2DBUS_FALSE);
+            return 1;
+        }
+
+        /* The timer wheel may outlive the Dispatcher userdata */
+        ud->wheel = ud->connUd->dispUd->timerWheel;
+        l2dbus_timerWheelRef(ud->wheel);
+
+        /* Keep the context alive until it's answered */
+        lua_pushvalue(L, 1);
+        ud->selfRef = luaL_ref(L, LUA_REGISTRYINDEX);
+        ud->deferredAt = l2dbus_getMonotonicTime();
+        ud->deferred = L2DBUS_TRUE;
+
+        if ( NULL != svcUd )
+        {
+            LIST_INSERT_HEAD(&svcUd->deferred, ud, deferLink);
+            ++svcUd->nDeferred;
+            ++svcUd->deferredTotal;
+            /* The request stays in-flight until it's answered */
+            ud->admitted = l2dbus_admissionClaim(&svcUd->admission, ud->msg);
+        }
+    }
+
+    now = l2dbus_getMonotonicTime();
+    l2dbus_timerArm(ud->wheel, &ud->timer, now + (double)timeout);
+    lua_pushboolean(L, L2DBUS_TRUE);
+
+    return 1;
+}
+
+
+/**
+ @function isDeferred
+ @within ReplyContext
+
+ Returns whether the reply is deferred and still awaited.
+
+ @tparam userdata ctx The ReplyContext.
+ @treturn bool Returns **true** if the reply is deferred.
+ @treturn number The time (in milliseconds) the reply has been deferred
+ or zero (0) if it isn't.
+ */
+static int
+l2dbus_replyContextIsDeferred
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_ReplyContext* ud = l2dbus_replyContextCheck(L, 1);
+
+    if ( NULL == ud )
+    {
+        lua_pushboolean(L, L2DBUS_FALSE);
+        lua_pushnumber(L, 0.0);
+    }
+    else
+    {
+        lua_pushboolean(L, ud->deferred);
+        lua_pushnumber(L, ud->deferred ?
+                        (l2dbus_getMonotonicTime() - ud->deferredAt) : 0.0);
+    }
+
+    return 2;
+}
+
+
+/**
+ @function release
+ @within ReplyContext
+
+ Releases the context once the handler of its request has returned.
+
+ A context that has been replied to is recycled and can't be used
+ afterwards. A context that hasn't been replied to (or whose reply is
+ deferred) is left as is so that it can still be replied to later.
+
+ @tparam userdata ctx The ReplyContext.
+ @treturn bool Returns **true** if the context was released and **false**
+ otherwise.
+ */
+static int
+l2dbus_replyContextReleaseMethod
+    (
+    lua_State*  L
+    )
+{
+    luaL_checkudata(L, 1, L2DBUS_REPLY_CONTEXT_MTBL_NAME);
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    lua_pushboolean(L, l2dbus_replyContextRelease(L, 1));
+
+    return 1;
+}
+
+
+/**
+ * @brief Called by Lua VM to GC/reclaim the ReplyContext userdata.
+ *
+ * A context that hasn't been released returns its state to the pool. The
+ * state is freed if this was the last object using it and the pool
+ * doesn't hold it.
+ *
+ * @return nil
+ */
+static int
+l2dbus_replyContextDispose
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_ReplyContextHandle* handle;
+    l2dbus_ReplyContext* ud;
+
+    handle = (l2dbus_ReplyContextHandle*)luaL_checkudata(L, -1,
+                                        L2DBUS_REPLY_CONTEXT_MTBL_NAME);
+    ud = l2dbus_replyContextGet(L, -1);
+
+    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "GC: reply context (userdata=%p)",
+                handle));
+
+    if ( NULL != ud )
+    {
+        /* Only possible when the module is shut down */
+        l2dbus_replyContextUndefer(L, ud);
+
+        if ( !ud->replied && (NULL != ud->msg) &&
+            !dbus_message_get_no_reply(ud->msg) )
+        {
+            L2DBUS_TRACE((L2DBUS_TRC_WARN,
+                "Request (serial #=%u) was never replied to",
+                dbus_message_get_serial(ud->msg)));
+        }
+
+        l2dbus_replyContextRecycle(L, l2dbus_contextGet(L), ud);
+    }
+
+    if ( NULL != handle->ctx )
+    {
+        l2dbus_replyStateUnref(handle->ctx);
+        handle->ctx = NULL;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Empties the pool of idle ReplyContext states.
+ *
+ * Called when the module is finalized. Nothing is pooled afterwards and
+ * states still used by a ReplyContext object are freed along with the
+ * last such object.
+ *
+ * @param [in] modCtx   The module context.
+ */
+void
+l2dbus_replyContextClosePool
+    (
+    l2dbus_Context* modCtx
+    )
+{
+    l2dbus_ReplyContext* ud;
+
+    if ( NULL == modCtx )
+    {
+        return;
+    }
+
+    modCtx->replyPoolMax = 0;
+    while ( NULL != modCtx->replyIdle )
+    {
+        ud = modCtx->replyIdle;
+        modCtx->replyIdle = ud->nextIdle;
+        ud->nextIdle = NULL;
+        ud->pooled = L2DBUS_FALSE;
+        --modCtx->replyPoolSize;
+        if ( 0U == ud->nHandles )
+        {
+            l2dbus_replyStateFree(ud);
+        }
+    }
+}
+
+
+/*
+ * Define the methods of the ReplyContext
+ */
+static const luaL_Reg l2dbus_replyContextMetaTable[] = {
+    {"reply", l2dbus_replyContextReply},
+    {"error", l2dbus_replyContextError},
+    {"getConnection", l2dbus_replyContextGetConnection},
+    {"getMessage", l2dbus_replyContextGetMessage},
+    {"needsReply", l2dbus_replyContextNeedsReply},
+    {"isReplied", l2dbus_replyContextIsReplied},
+    {"defer", l2dbus_replyContextDefer},
+    {"isDeferred", l2dbus_replyContextIsDeferred},
+    {"release", l2dbus_replyContextReleaseMethod},
+    {"__gc", l2dbus_replyContextDispose},
+    {NULL, NULL},
+};
+
+
+/**
+ * @brief "Opens" the ReplyContext sub-module.
+ *
+ * This function creates the metatable entries for the ReplyContext
+ * userdata and initializes the pool of context states. It leaves a
+ * table with the functions of the sub-module on the stack.
+ *
+ * @return None
+ */
+void
+l2dbus_openReplyContext
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Context* modCtx = l2dbus_contextGet(L);
+
+    lua_pop(L, l2dbus_createMetatable(L, L2DBUS_REPLY_CONTEXT_TYPE_ID,
+            l2dbus_replyContextMetaTable));
+
+    modCtx->replyIdle = NULL;
+    modCtx->replyPoolMax = L2DBUS_REPLY_CONTEXT_POOL_SIZE;
+    modCtx->replyPoolSize = 0;
+
+    lua_createtable(L, 0, 2);
+    lua_pushcfunction(L, l2dbus_newReplyContext);
+    lua_setfield(L, -2, "new");
+    lua_pushcfunction(L, l2dbus_replyContextGetPoolStats);
+    lua_setfield(L, -2, "getPoolStats");
+}
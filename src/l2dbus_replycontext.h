@@ -0,0 +1,112 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_replycontext.h
+ * @author         Glenn Schmottlach
+ * @brief          Definition of the context used to reply to a request.
+ *===========================================================================
+ */
+
+#ifndef L2DBUS_REPLYCONTEXT_H_
+#define L2DBUS_REPLYCONTEXT_H_
+
+#include "lua.h"
+#include "dbus/dbus.h"
+#include "queue.h"
+#include "l2dbus_types.h"
+#include "l2dbus_callback.h"
+#include "l2dbus_timerwheel.h"
+
+/* Maximum number of idle context states kept for re-use */
+#define L2DBUS_REPLY_CONTEXT_POOL_SIZE  (64)
+
+/* Deadline (in msec) of a deferred reply when none is given */
+#define L2DBUS_REPLY_CONTEXT_DEFAULT_TIMEOUT    (25000)
+
+/* Forward declarations */
+struct l2dbus_Connection;
+struct l2dbus_Context;
+struct l2dbus_ServiceObject;
+
+/* The (recycled) state of a reply context */
+typedef struct l2dbus_ReplyContext
+{
+    /* The request being replied to (NULL once released) */
+    struct DBusMessage*         msg;
+    int                         connRef;
+    struct l2dbus_Connection*   connUd;
+    /* Signature of the reply (buffer is kept when recycled) */
+    char*                       outSig;
+    size_t                      outSigCap;
+    l2dbus_Bool                 hasOutSig;
+    l2dbus_Bool                 replied;
+    /* The service object answering the request (NULL if unknown) */
+    struct l2dbus_ServiceObject* svcUd;
+    int                         svcRef;
+    /* Deferred reply tracking */
+    l2dbus_CallbackCtx          cbCtx;
+    l2dbus_Bool                 deferred;
+    l2dbus_Bool                 expired;
+    /* Holds the request's in-flight slot of the service object */
+    l2dbus_Bool                 admitted;
+    int                         selfRef;
+    double                      deferredAt;
+    l2dbus_Timer                timer;
+    struct l2dbus_TimerWheel*   wheel;
+    LIST_ENTRY(l2dbus_ReplyContext) deferLink;
+    /* Advanced every time the state is handed out to a request */
+    unsigned long               generation;
+    /* Number of ReplyContext objects referring to the state */
+    unsigned                    nHandles;
+    /* Set while the state is idle in the pool */
+    l2dbus_Bool                 pooled;
+    struct l2dbus_ReplyContext* nextIdle;
+} l2dbus_ReplyContext;
+
+/* The Lua ReplyContext object handed out for a single request. It's only
+ * valid while the generation of its state matches.
+ */
+typedef struct l2dbus_ReplyContextHandle
+{
+    l2dbus_ReplyContext*        ctx;
+    unsigned long               generation;
+} l2dbus_ReplyContextHandle;
+
+l2dbus_ReplyContext* l2dbus_replyContextAcquire(lua_State* L, int connIdx,
+                                    int svcIdx,
+                                    struct DBusMessage* msg,
+                                    const char* outSig);
+l2dbus_Bool l2dbus_replyContextRelease(lua_State* L, int ctxIdx);
+l2dbus_ReplyContext* l2dbus_replyContextGet(lua_State* L, int ctxIdx);
+l2dbus_Bool l2dbus_replyContextSendError(l2dbus_ReplyContext* ud,
+                                    const char* errName,
+                                    const char* errMsg,
+                                    dbus_uint32_t* serialNum);
+void l2dbus_replyContextClosePool(struct l2dbus_Context* modCtx);
+void l2dbus_openReplyContext(lua_State* L);
+
+#endif /* Guard for L2DBUS_REPLYCONTEXT_H_ */
@@ -0,0 +1,1013 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_scheduler.c
+ * @author         Glenn Schmottlach
+ * @brief          Implementation of the coroutine (task) scheduler.
+ *===========================================================================
+ */
+#include <stdlib.h>
+#include <assert.h>
+#include "dbus/dbus.h"
+#include "cdbus/cdbus.h"
+#include "l2dbus_compat.h"
+#include "l2dbus_scheduler.h"
+#include "l2dbus_dispatcher.h"
+#include "l2dbus_pendingcall.h"
+#include "l2dbus_message.h"
+#include "l2dbus_context.h"
+#include "l2dbus_core.h"
+#include "l2dbus_alloc.h"
+#include "l2dbus_util.h"
+#include "l2dbus_trace.h"
+#include "l2dbus_debug.h"
+#include "l2dbus_types.h"
+#include "lauxlib.h"
+
+/**
+ L2DBUS Scheduler
+
+ Tasks are functions run in a coroutine by the Dispatcher. A task can
+ wait for the reply to a method call (see @{l2dbus.PendingCall.await|await}),
+ for several replies at once (see @{awaitAll}) or for some time to pass
+ (see @{sleep}) without blocking the main loop. Thousands of tasks can be
+ waiting at the same time since a waiting task costs no more than its
+ coroutine.
+
+ Tasks that are ready to run are queued and resumed by the Dispatcher on
+ the next iteration of the main loop. The coroutine of a finished task is
+ kept and re-used by the next task spawned. Calling *coroutine.yield*
+ directly from a task simply moves it to the back of the run queue.
+
+ **Note:** Under Lua 5.1 a task cannot wait from within a protected call
+ (*pcall*) or a metamethod since the coroutine cannot yield across them.
+ */
+
+/* Yielded by a task coroutine once its function has returned */
+static const char l2dbus_gTaskDone = 0;
+
+/*
+ * The body run by every task coroutine. Once a function returns the
+ * coroutine yields the "done" marker and waits to be resumed with the
+ * next function (and arguments) to run.
+ */
+static const char l2dbus_gTaskBody[] =
+    "local done, yield = ..., coroutine.yield\n"
+    "local function body(fn, ...)\n"
+    "    fn(...)\n"
+    "    return body(yield(done))\n"
+    "end\n"
+    "return body\n";
+
+
+/*
+ * Arms the (zero length) timeout that runs the ready tasks on the next
+ * iteration of the main loop.
+ */
+static void
+l2dbus_schedulerArm
+    (
+    l2dbus_Scheduler*   sched
+    )
+{
+    cdbus_HResult rc;
+
+    if ( !sched->runArmed )
+    {
+        /* A one-shot timeout may still report that it's enabled after
+         * it has expired so explicitly re-arm it.
+         */
+        cdbus_timeoutEnable(sched->runTimeout, CDBUS_FALSE);
+        rc = cdbus_timeoutEnable(sched->runTimeout, CDBUS_TRUE);
+        if ( CDBUS_FAILED(rc) )
+        {
+            L2DBUS_TRACE((L2DBUS_TRC_ERROR,
+                "Failed to arm task run queue timeout (0x%X)", rc));
+        }
+        else
+        {
+            sched->runArmed = L2DBUS_TRUE;
+        }
+    }
+}
+
+
+/*
+ * Adds a task to the back of the run queue.
+ */
+static void
+l2dbus_schedulerEnqueue
+    (
+    l2dbus_Scheduler*   sched,
+    l2dbus_Task*        task
+    )
+{
+    task->state = L2DBUS_TASK_READY;
+    TAILQ_INSERT_TAIL(&sched->runQueue, task, link);
+    ++sched->nReady;
+    l2dbus_schedulerArm(sched);
+}
+
+
+/*
+ * Returns the task running on the given Lua thread or NULL if the thread
+ * isn't running a task.
+ */
+static l2dbus_Task*
+l2dbus_taskCurrent
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Context* ctx = l2dbus_contextGet(L);
+    l2dbus_Task* task = (NULL != ctx) ? ctx->curTask : NULL;
+
+    if ( (NULL != task) && (L == task->co) && (NULL != task->sched) )
+    {
+        return task;
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Called when a sleeping task is due to run again.
+ */
+static void
+l2dbus_taskTimerExpired
+    (
+    l2dbus_Timer*   timer,
+    void*           user
+    )
+{
+    l2dbus_Task* task = (l2dbus_Task*)user;
+
+    (void)timer;
+
+    if ( (NULL != task->sched) && (L2DBUS_TASK_SLEEPING == task->state) )
+    {
+        l2dbus_schedulerEnqueue(task->sched, task);
+    }
+}
+
+
+/**
+ * @brief Wakes a task awaiting the completion of a pending call.
+ *
+ * Once none of the pending calls awaited by the task remain incomplete
+ * it's queued to be resumed with the replies.
+ *
+ * @param [in] task The awaiting task.
+ */
+void
+l2dbus_taskWake
+    (
+    l2dbus_Task*    task
+    )
+{
+    assert( NULL != task );
+
+    if ( 0 < task->nPending )
+    {
+        --task->nPending;
+    }
+
+    if ( (NULL != task->sched) && (0 == task->nPending) &&
+        (L2DBUS_TASK_WAITING == task->state) )
+    {
+        l2dbus_schedulerEnqueue(task->sched, task);
+    }
+}
+
+
+/*
+ * Forgets the pending calls awaited by a task without taking their replies.
+ */
+static void
+l2dbus_taskReleaseWaits
+    (
+    lua_State*      L,
+    l2dbus_Task*    task
+    )
+{
+    l2dbus_PendingCall* pcUd;
+    int idx;
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, task->waitRef);
+    for ( idx = 1; idx <= task->nAwaited; ++idx )
+    {
+        lua_rawgeti(L, -1, idx);
+        pcUd = (l2dbus_PendingCall*)lua_touserdata(L, -1);
+        if ( (NULL != pcUd) && (task == pcUd->waiter) )
+        {
+            pcUd->waiter = NULL;
+        }
+        lua_pop(L, 1);
+        lua_pushnil(L);
+        lua_rawseti(L, -2, idx);
+    }
+    lua_pop(L, 1);
+
+    task->nAwaited = 0;
+    task->nPending = 0;
+}
+
+
+/*
+ * Pushes the replies of the pending calls awaited by a task (in the order
+ * they were given) onto the stack of L and forgets the pending calls. The
+ * reply of a call that was cancelled is nil.
+ */
+static int
+l2dbus_taskPushReplies
+    (
+    lua_State*      L,
+    l2dbus_Task*    task
+    )
+{
+    l2dbus_PendingCall* pcUd;
+    DBusMessage* msg;
+    int nReplies = task->nAwaited;
+    int tblIdx;
+    int idx;
+
+    if ( !lua_checkstack(L, nReplies + 2) )
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_ERROR,
+            "Cannot pass %d replies to the awaiting task", nReplies));
+        l2dbus_taskReleaseWaits(L, task);
+        return 0;
+    }
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, task->waitRef);
+    tblIdx = lua_gettop(L);
+
+    for ( idx = 1; idx <= nReplies; ++idx )
+    {
+        /* The table anchors the pending call until its entry is cleared */
+        lua_rawgeti(L, tblIdx, idx);
+        pcUd = (l2dbus_PendingCall*)lua_touserdata(L, -1);
+        lua_pop(L, 1);
+
+        msg = NULL;
+        if ( NULL != pcUd )
+        {
+            if ( task == pcUd->waiter )
+            {
+                pcUd->waiter = NULL;
+            }
+
+            if ( dbus_pending_call_get_completed(pcUd->pendingCall) )
+            {
+                msg = dbus_pending_call_steal_reply(pcUd->pendingCall);
+            }
+        }
+
+        if ( NULL != msg )
+        {
+            /* The Lua object now owns the reference */
+            l2dbus_messageWrap(L, msg, L2DBUS_FALSE);
+        }
+        else
+        {
+            lua_pushnil(L);
+        }
+
+        lua_pushnil(L);
+        lua_rawseti(L, tblIdx, idx);
+    }
+
+    lua_remove(L, tblIdx);
+    task->nAwaited = 0;
+    task->nPending = 0;
+
+    return nReplies;
+}
+
+
+/*
+ * Frees a task along with its coroutine.
+ */
+static void
+l2dbus_taskFree
+    (
+    lua_State*      L,
+    l2dbus_Task*    task
+    )
+{
+    l2dbus_Context* ctx;
+
+    if ( NULL != task->sched )
+    {
+        l2dbus_timerDisarm(task->sched->wheel, &task->timer);
+        ctx = task->sched->modCtx;
+        if ( task == ctx->curTask )
+        {
+            ctx->curTask = NULL;
+        }
+    }
+
+    luaL_unref(L, LUA_REGISTRYINDEX, task->coRef);
+    luaL_unref(L, LUA_REGISTRYINDEX, task->waitRef);
+    l2dbus_free(task);
+}
+
+
+/*
+ * Takes an idle task from the pool (or creates a new one) to run a
+ * function. Returns NULL if a task cannot be allocated.
+ */
+static l2dbus_Task*
+l2dbus_schedulerAcquireTask
+    (
+    lua_State*          L,
+    l2dbus_Scheduler*   sched
+    )
+{
+    l2dbus_Task* task = TAILQ_FIRST(&sched->pool);
+
+    if ( NULL != task )
+    {
+        TAILQ_REMOVE(&sched->pool, task, link);
+        --sched->nPooled;
+    }
+    else
+    {
+        task = (l2dbus_Task*)l2dbus_malloc(sizeof(*task));
+        if ( NULL == task )
+        {
+            return NULL;
+        }
+
+        task->sched = sched;
+        task->co = lua_newthread(L);
+        task->coRef = luaL_ref(L, LUA_REGISTRYINDEX);
+        lua_newtable(L);
+        task->waitRef = luaL_ref(L, LUA_REGISTRYINDEX);
+        task->nAwaited = 0;
+        task->nPending = 0;
+        l2dbus_timerInit(&task->timer, l2dbus_taskTimerExpired, task);
+
+        /* A new coroutine starts by calling the body */
+        lua_rawgeti(L, LUA_REGISTRYINDEX, sched->bodyRef);
+        lua_xmove(L, task->co, 1);
+        ++sched->nCreated;
+    }
+
+    task->nArgs = 0;
+    task->state = L2DBUS_TASK_IDLE;
+    LIST_INSERT_HEAD(&sched->tasks, task, live);
+    ++sched->nLive;
+
+    return task;
+}
+
+
+/*
+ * Called once a task has finished running its function. The task (and
+ * its coroutine) is pooled for re-use if possible.
+ */
+static void
+l2dbus_schedulerRetireTask
+    (
+    lua_State*          L,
+    l2dbus_Scheduler*   sched,
+    l2dbus_Task*        task,
+    l2dbus_Bool         reusable
+    )
+{
+    LIST_REMOVE(task, live);
+    --sched->nLive;
+
+    if ( reusable && (sched->nPooled < sched->maxPooled) )
+    {
+        task->state = L2DBUS_TASK_IDLE;
+        TAILQ_INSERT_HEAD(&sched->pool, task, link);
+        ++sched->nPooled;
+    }
+    else
+    {
+        l2dbus_taskFree(L, task);
+    }
+}
+
+
+/*
+ * Resumes a task taken from the run queue until it waits, yields or
+ * finishes.
+ */
+static void
+l2dbus_schedulerResume
+    (
+    lua_State*          L,
+    l2dbus_Scheduler*   sched,
+    l2dbus_Task*        task
+    )
+{
+    l2dbus_Context* ctx = sched->modCtx;
+    l2dbus_Task* prevTask;
+    lua_State* co = task->co;
+    int nArgs = task->nArgs;
+    int nResults = 0;
+    int status;
+
+    if ( 0 < task->nAwaited )
+    {
+        nArgs = l2dbus_taskPushReplies(co, task);
+    }
+    task->nArgs = 0;
+    task->state = L2DBUS_TASK_RUNNING;
+
+    /* A task can resume another from a nested dispatch */
+    prevTask = ctx->curTask;
+    ctx->curTask = task;
+    ++ctx->cbDepth;
+    status = l2dbus_resume(co, L, nArgs, &nResults);
+    --ctx->cbDepth;
+    ctx->curTask = prevTask;
+    ++sched->nResumed;
+
+    if ( LUA_YIELD == status )
+    {
+        if ( (1 == nResults) &&
+            (&l2dbus_gTaskDone == (const char*)lua_touserdata(co, -1)) )
+        {
+            lua_settop(co, 0);
+            ++sched->nCompleted;
+            l2dbus_schedulerRetireTask(L, sched, task, L2DBUS_TRUE);
+        }
+        else
+        {
+            /* Any values yielded directly by the task are dropped */
+            lua_settop(co, 0);
+            if ( L2DBUS_TASK_RUNNING == task->state )
+            {
+                l2dbus_schedulerEnqueue(sched, task);
+            }
+        }
+    }
+    else
+    {
+        /* The coroutine is dead and cannot be re-used */
+        if ( 0 != status )
+        {
+            L2DBUS_TRACE((L2DBUS_TRC_ERROR, "Task error: %s",
+                        lua_isstring(co, -1) ? lua_tostring(co, -1) : ""));
+            ++sched->nFailed;
+        }
+        else
+        {
+            ++sched->nCompleted;
+        }
+        l2dbus_schedulerRetireTask(L, sched, task, L2DBUS_FALSE);
+    }
+}
+
+
+/*
+ * Called on the main loop iteration following the one in which tasks
+ * became ready. Only the tasks queued before this iteration are resumed
+ * so a task that keeps yielding doesn't starve the main loop.
+ */
+static cdbus_Bool
+l2dbus_schedulerRunHandler
+    (
+    cdbus_Timeout*  t,
+    void*           user
+    )
+{
+    l2dbus_Scheduler* sched = (l2dbus_Scheduler*)user;
+    lua_State* L = sched->modCtx->cbThread;
+    l2dbus_Task* task;
+    unsigned count;
+
+    assert( NULL != L );
+
+    sched->runArmed = L2DBUS_FALSE;
+
+    for ( count = sched->nReady;
+        (0U < count) && !TAILQ_EMPTY(&sched->runQueue); --count )
+    {
+        task = TAILQ_FIRST(&sched->runQueue);
+        TAILQ_REMOVE(&sched->runQueue, task, link);
+        --sched->nReady;
+        l2dbus_schedulerResume(L, sched, task);
+    }
+
+    if ( !TAILQ_EMPTY(&sched->runQueue) )
+    {
+        l2dbus_schedulerArm(sched);
+    }
+
+    /* The return value is unused by CDBUS */
+    return CDBUS_TRUE;
+}
+
+
+/**
+ * @brief Initializes the scheduler of a dispatcher.
+ *
+ * @param [in] L        The Lua state.
+ * @param [in] sched    The scheduler to initialize.
+ * @param [in] disp     The CDBUS dispatcher that resumes the tasks.
+ * @param [in] wheel    The timer wheel used by sleeping tasks.
+ * @return L2DBUS_TRUE on success or L2DBUS_FALSE if the scheduler
+ * couldn't be initialized.
+ */
+l2dbus_Bool
+l2dbus_schedulerInit
+    (
+    lua_State*                  L,
+    l2dbus_Scheduler*           sched,
+    struct cdbus_Dispatcher*    disp,
+    struct l2dbus_TimerWheel*   wheel
+    )
+{
+    assert( NULL != sched );
+
+    TAILQ_INIT(&sched->runQueue);
+    TAILQ_INIT(&sched->pool);
+    LIST_INIT(&sched->tasks);
+    sched->nReady = 0U;
+    sched->nPooled = 0U;
+    sched->maxPooled = L2DBUS_SCHEDULER_POOL_SIZE;
+    sched->nLive = 0U;
+    sched->runArmed = L2DBUS_FALSE;
+    sched->wheel = NULL;
+    sched->modCtx = l2dbus_contextGet(L);
+    sched->bodyRef = LUA_NOREF;
+    sched->nSpawned = 0U;
+    sched->nCreated = 0U;
+    sched->nCompleted = 0U;
+    sched->nFailed = 0U;
+    sched->nResumed = 0U;
+
+    sched->runTimeout = cdbus_timeoutNew(disp, 0, CDBUS_FALSE,
+                                    l2dbus_schedulerRunHandler, sched);
+    if ( NULL == sched->runTimeout )
+    {
+        return L2DBUS_FALSE;
+    }
+
+    if ( 0 != luaL_loadbuffer(L, l2dbus_gTaskBody,
+                            sizeof(l2dbus_gTaskBody) - 1, "=l2dbus.task") )
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_ERROR, "Failed to load task body: %s",
+                    lua_tostring(L, -1)));
+        lua_pop(L, 1);
+        cdbus_timeoutUnref(sched->runTimeout);
+        sched->runTimeout = NULL;
+        return L2DBUS_FALSE;
+    }
+    lua_pushlightuserdata(L, (void*)&l2dbus_gTaskDone);
+    lua_call(L, 1, 1);
+    sched->bodyRef = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    l2dbus_timerWheelRef(wheel);
+    sched->wheel = wheel;
+
+    return L2DBUS_TRUE;
+}
+
+
+/**
+ * @brief Destroys the scheduler of a dispatcher.
+ *
+ * Tasks that haven't finished are dropped without being resumed.
+ *
+ * @param [in] L        The Lua state.
+ * @param [in] sched    The scheduler to destroy.
+ */
+void
+l2dbus_schedulerDestroy
+    (
+    lua_State*          L,
+    l2dbus_Scheduler*   sched
+    )
+{
+    l2dbus_Task* task;
+
+    /* Nothing to do if it was never initialized */
+    if ( NULL == sched->runTimeout )
+    {
+        return;
+    }
+
+    cdbus_timeoutEnable(sched->runTimeout, CDBUS_FALSE);
+    cdbus_timeoutUnref(sched->runTimeout);
+    sched->runTimeout = NULL;
+
+    while ( NULL != (task = LIST_FIRST(&sched->tasks)) )
+    {
+        LIST_REMOVE(task, live);
+        l2dbus_taskReleaseWaits(L, task);
+        l2dbus_taskFree(L, task);
+    }
+    TAILQ_INIT(&sched->runQueue);
+    sched->nReady = 0U;
+    sched->nLive = 0U;
+
+    while ( NULL != (task = TAILQ_FIRST(&sched->pool)) )
+    {
+        TAILQ_REMOVE(&sched->pool, task, link);
+        l2dbus_taskFree(L, task);
+    }
+    sched->nPooled = 0U;
+
+    luaL_unref(L, LUA_REGISTRYINDEX, sched->bodyRef);
+    sched->bodyRef = LUA_NOREF;
+
+    l2dbus_timerWheelUnref(sched->wheel);
+    sched->wheel = NULL;
+}
+
+
+/**
+ * @brief Sets the maximum number of finished tasks kept for re-use.
+ *
+ * @param [in] L        The Lua state.
+ * @param [in] sched    The scheduler.
+ * @param [in] size     The maximum number of pooled tasks.
+ */
+void
+l2dbus_schedulerSetPoolSize
+    (
+    lua_State*          L,
+    l2dbus_Scheduler*   sched,
+    unsigned            size
+    )
+{
+    l2dbus_Task* task;
+
+    sched->maxPooled = size;
+    while ( sched->nPooled > size )
+    {
+        task = TAILQ_FIRST(&sched->pool);
+        TAILQ_REMOVE(&sched->pool, task, link);
+        --sched->nPooled;
+        l2dbus_taskFree(L, task);
+    }
+}
+
+
+/**
+ * @brief Pushes a table of the scheduler's statistics.
+ *
+ * @param [in] L        The Lua state.
+ * @param [in] sched    The scheduler.
+ */
+void
+l2dbus_schedulerPushStats
+    (
+    lua_State*              L,
+    const l2dbus_Scheduler* sched
+    )
+{
+    lua_createtable(L, 0, 9);
+    lua_pushinteger(L, (lua_Integer)sched->nLive);
+    lua_setfield(L, -2, "live");
+    lua_pushinteger(L, (lua_Integer)sched->nReady);
+    lua_setfield(L, -2, "ready");
+    lua_pushinteger(L, (lua_Integer)sched->nPooled);
+    lua_setfield(L, -2, "pooled");
+    lua_pushinteger(L, (lua_Integer)sched->maxPooled);
+    lua_setfield(L, -2, "maxPooled");
+    lua_pushnumber(L, (lua_Number)sched->nSpawned);
+    lua_setfield(L, -2, "spawned");
+    lua_pushnumber(L, (lua_Number)sched->nCreated);
+    lua_setfield(L, -2, "created");
+    lua_pushnumber(L, (lua_Number)sched->nCompleted);
+    lua_setfield(L, -2, "completed");
+    lua_pushnumber(L, (lua_Number)sched->nFailed);
+    lua_setfield(L, -2, "failed");
+    lua_pushnumber(L, (lua_Number)sched->nResumed);
+    lua_setfield(L, -2, "resumed");
+}
+
+
+/**
+ * @brief Awaits the replies of pending calls.
+ *
+ * Called from a task the task is suspended until every pending call has
+ * completed and then resumed with the replies. Called from anywhere else
+ * each pending call is blocked on in turn.
+ *
+ * @param [in] L        The Lua thread.
+ * @param [in] firstIdx The stack index of the first pending call.
+ * @param [in] count    The number of (consecutive) pending calls.
+ * @return The number of replies pushed or the result of lua_yield().
+ */
+int
+l2dbus_taskAwait
+    (
+    lua_State*  L,
+    int         firstIdx,
+    int         count
+    )
+{
+    l2dbus_PendingCall* pcUd;
+    l2dbus_Task* task;
+    DBusMessage* msg;
+    int tblIdx;
+    int idx;
+
+    for ( idx = firstIdx; idx < firstIdx + count; ++idx )
+    {
+        pcUd = (l2dbus_PendingCall*)luaL_checkudata(L, idx,
+                                            L2DBUS_PENDING_CALL_MTBL_NAME);
+        if ( NULL != pcUd->waiter )
+        {
+            luaL_argerror(L, idx, "pending call is already awaited");
+        }
+    }
+
+    task = l2dbus_taskCurrent(L);
+    if ( NULL == task )
+    {
+        /* Not a task so there is nothing to yield to */
+        luaL_checkstack(L, count, "too many pending calls");
+        for ( idx = firstIdx; idx < firstIdx + count; ++idx )
+        {
+            pcUd = (l2dbus_PendingCall*)lua_touserdata(L, idx);
+            dbus_pending_call_block(pcUd->pendingCall);
+            msg = dbus_pending_call_get_completed(pcUd->pendingCall) ?
+                    dbus_pending_call_steal_reply(pcUd->pendingCall) : NULL;
+            if ( NULL != msg )
+            {
+                l2dbus_messageWrap(L, msg, L2DBUS_FALSE);
+            }
+            else
+            {
+                lua_pushnil(L);
+            }
+        }
+        return count;
+    }
+
+    luaL_checkstack(L, count + 2, "too many pending calls");
+    lua_rawgeti(L, LUA_REGISTRYINDEX, task->waitRef);
+    tblIdx = lua_gettop(L);
+    task->nAwaited = 0;
+    task->nPending = 0;
+
+    for ( idx = 0; idx < count; ++idx )
+    {
+        pcUd = (l2dbus_PendingCall*)lua_touserdata(L, firstIdx + idx);
+        lua_pushvalue(L, firstIdx + idx);
+        lua_rawseti(L, tblIdx, idx + 1);
+        ++task->nAwaited;
+
+        if ( !dbus_pending_call_get_completed(pcUd->pendingCall) &&
+            (task != pcUd->waiter) )
+        {
+            if ( l2dbus_pendingCallSetWaiter(pcUd, task) )
+            {
+                ++task->nPending;
+            }
+            else
+            {
+                dbus_pending_call_block(pcUd->pendingCall);
+            }
+        }
+    }
+    lua_pop(L, 1);
+
+    if ( 0 == task->nPending )
+    {
+        return l2dbus_taskPushReplies(L, task);
+    }
+
+    task->state = L2DBUS_TASK_WAITING;
+    return lua_yield(L, 0);
+}
+
+
+/**
+ @function spawn
+
+ Spawns a new task.
+
+ The function is run in a coroutine by the Dispatcher starting on the next
+ iteration of the main loop. Any error raised by the function is traced and
+ ends the task. The Dispatcher can be omitted when called from a task, in
+ which case the new task is run by the same Dispatcher.
+
+ @tparam ?userdata disp The Dispatcher that runs the task.
+ @tparam func fn The function to run.
+ @tparam ?any ... Arguments passed to the function.
+ */
+static int
+l2dbus_schedulerSpawn
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Dispatcher* dispUd;
+    l2dbus_Scheduler* sched = NULL;
+    l2dbus_Context* ctx;
+    l2dbus_Task* task;
+    int fnIdx = 1;
+    int nArgs;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    dispUd = (l2dbus_Dispatcher*)l2dbus_isUserData(L, 1,
+                                                L2DBUS_DISPATCHER_MTBL_NAME);
+    if ( NULL != dispUd )
+    {
+        sched = &dispUd->sched;
+        fnIdx = 2;
+    }
+    else
+    {
+        ctx = l2dbus_contextGet(L);
+        if ( NULL != ctx->curTask )
+        {
+            sched = ctx->curTask->sched;
+        }
+    }
+
+    if ( (NULL == sched) || (NULL == sched->runTimeout) )
+    {
+        return luaL_error(L, "a Dispatcher is required to spawn a task");
+    }
+    luaL_checktype(L, fnIdx, LUA_TFUNCTION);
+
+    /* The function and its arguments */
+    nArgs = lua_gettop(L) - fnIdx + 1;
+
+    task = l2dbus_schedulerAcquireTask(L, sched);
+    if ( NULL == task )
+    {
+        return luaL_error(L, "Failed to allocate task!");
+    }
+
+    if ( !lua_checkstack(task->co, nArgs + 1) )
+    {
+        l2dbus_schedulerRetireTask(L, sched, task, L2DBUS_TRUE);
+        return luaL_error(L, "too many task arguments");
+    }
+
+    lua_xmove(L, task->co, nArgs);
+    task->nArgs = nArgs;
+    ++sched->nSpawned;
+    l2dbus_schedulerEnqueue(sched, task);
+
+    return 0;
+}
+
+
+/**
+ @function sleep
+
+ Suspends the calling task for a period of time.
+
+ The Dispatcher goes on processing other events while the task sleeps.
+ A period of zero lets every other ready task run before the task is
+ resumed. This function can only be called from a task.
+
+ @tparam number msec The period (in milliseconds) to sleep.
+ */
+static int
+l2dbus_schedulerSleep
+    (
+    lua_State*  L
+    )
+{
+    lua_Number msec;
+    l2dbus_Task* task;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    msec = luaL_checknumber(L, 1);
+    task = l2dbus_taskCurrent(L);
+    if ( NULL == task )
+    {
+        return luaL_error(L, "sleep can only be called from a task");
+    }
+
+    if ( 0 > msec )
+    {
+        msec = 0;
+    }
+
+    task->state = L2DBUS_TASK_SLEEPING;
+    l2dbus_timerArm(task->sched->wheel, &task->timer,
+                    l2dbus_getMonotonicTime() + (double)msec);
+
+    return lua_yield(L, 0);
+}
+
+
+/**
+ @function awaitAll
+
+ Waits for the replies of several pending calls.
+
+ Like @{l2dbus.PendingCall.await|await} but the calling task is only
+ resumed once every pending call has completed. The pending calls can also
+ be given as a single array.
+
+ @tparam userdata|table pending A PendingCall object or an array of them.
+ @tparam ?userdata ... More PendingCall objects.
+ @treturn userdata|nil... The reply message of each pending call in the order
+ they were given.
+ */
+static int
+l2dbus_schedulerAwaitAll
+    (
+    lua_State*  L
+    )
+{
+    int count;
+    int idx;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    if ( (1 == lua_gettop(L)) && lua_istable(L, 1) )
+    {
+        count = (int)lua_rawlen(L, 1);
+        luaL_checkstack(L, count, "too many pending calls");
+        for ( idx = 1; idx <= count; ++idx )
+        {
+            lua_rawgeti(L, 1, idx);
+        }
+        return l2dbus_taskAwait(L, 2, count);
+    }
+
+    return l2dbus_taskAwait(L, 1, lua_gettop(L));
+}
+
+
+/**
+ @function inTask
+
+ Determines whether the caller is running in a task.
+
+ @treturn bool Returns **true** if called from a task (and so can
+ @{sleep} or await replies without blocking) and **false** otherwise.
+ */
+static int
+l2dbus_schedulerInTask
+    (
+    lua_State*  L
+    )
+{
+    lua_pushboolean(L, NULL != l2dbus_taskCurrent(L));
+    return 1;
+}
+
+
+static const luaL_Reg l2dbus_schedulerFuncs[] = {
+    {"spawn", l2dbus_schedulerSpawn},
+    {"sleep", l2dbus_schedulerSleep},
+    {"awaitAll", l2dbus_schedulerAwaitAll},
+    {"inTask", l2dbus_schedulerInTask},
+    {NULL, NULL},
+};
+
+
+/**
+ @brief Adds the scheduler functions to the module.
+
+ The functions are added to the (module) table at the top of the stack.
+
+ @return nil
+ */
+void
+l2dbus_openScheduler
+    (
+    lua_State*  L
+    )
+{
+    luaL_setfuncs(L, l2dbus_schedulerFuncs, 0);
+}
+
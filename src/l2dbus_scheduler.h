@@ -0,0 +1,129 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_scheduler.h
+ * @author         Glenn Schmottlach
+ * @brief          Definitions of the coroutine (task) scheduler.
+ *===========================================================================
+ */
+
+#ifndef L2DBUS_SCHEDULER_H_
+#define L2DBUS_SCHEDULER_H_
+#include "lua.h"
+#include "queue.h"
+#include "l2dbus_types.h"
+#include "l2dbus_timerwheel.h"
+
+/* Forward declarations */
+struct cdbus_Dispatcher;
+struct cdbus_Timeout;
+struct l2dbus_Context;
+struct l2dbus_Scheduler;
+
+/* Default number of finished tasks kept for re-use */
+#define L2DBUS_SCHEDULER_POOL_SIZE      (64)
+
+typedef enum
+{
+    /* Pooled waiting to run a new function */
+    L2DBUS_TASK_IDLE = 0,
+    /* In the run queue */
+    L2DBUS_TASK_READY,
+    L2DBUS_TASK_RUNNING,
+    /* Awaiting the completion of one or more pending calls */
+    L2DBUS_TASK_WAITING,
+    L2DBUS_TASK_SLEEPING
+} l2dbus_TaskState;
+
+typedef struct l2dbus_Task
+{
+    /* Link in the run queue or the pool of idle tasks */
+    TAILQ_ENTRY(l2dbus_Task)    link;
+    /* Link in the list of tasks running a function */
+    LIST_ENTRY(l2dbus_Task)     live;
+    /* NULL once the scheduler has been destroyed */
+    struct l2dbus_Scheduler*    sched;
+    /* The coroutine (re-used by successive functions) */
+    lua_State*                  co;
+    int                         coRef;
+    /* Table of the awaited pending calls (re-used by every wait) */
+    int                         waitRef;
+    int                         nAwaited;
+    /* Number of awaited pending calls that haven't completed */
+    int                         nPending;
+    /* Number of values on the coroutine's stack to resume it with */
+    int                         nArgs;
+    l2dbus_TaskState            state;
+    /* Used to sleep */
+    l2dbus_Timer                timer;
+} l2dbus_Task;
+
+TAILQ_HEAD(l2dbus_TaskQueue, l2dbus_Task);
+LIST_HEAD(l2dbus_TaskList, l2dbus_Task);
+
+typedef struct l2dbus_Scheduler
+{
+    /* Tasks ready to be resumed on the next loop iteration */
+    struct l2dbus_TaskQueue     runQueue;
+    unsigned                    nReady;
+    /* Finished tasks whose coroutine can be re-used */
+    struct l2dbus_TaskQueue     pool;
+    unsigned                    nPooled;
+    unsigned                    maxPooled;
+    /* All tasks that are running a function */
+    struct l2dbus_TaskList      tasks;
+    unsigned                    nLive;
+
+    struct cdbus_Timeout*       runTimeout;
+    l2dbus_Bool                 runArmed;
+    struct l2dbus_TimerWheel*   wheel;
+    struct l2dbus_Context*      modCtx;
+    /* The Lua function every coroutine runs */
+    int                         bodyRef;
+
+    /* Statistics */
+    unsigned long               nSpawned;
+    unsigned long               nCreated;
+    unsigned long               nCompleted;
+    unsigned long               nFailed;
+    unsigned long               nResumed;
+} l2dbus_Scheduler;
+
+l2dbus_Bool l2dbus_schedulerInit(lua_State* L, l2dbus_Scheduler* sched,
+                                struct cdbus_Dispatcher* disp,
+                                struct l2dbus_TimerWheel* wheel);
+void l2dbus_schedulerDestroy(lua_State* L, l2dbus_Scheduler* sched);
+void l2dbus_schedulerSetPoolSize(lua_State* L, l2dbus_Scheduler* sched,
+                                unsigned size);
+void l2dbus_schedulerPushStats(lua_State* L, const l2dbus_Scheduler* sched);
+
+void l2dbus_taskWake(l2dbus_Task* task);
+int l2dbus_taskAwait(lua_State* L, int firstIdx, int count);
+
+void l2dbus_openScheduler(lua_State* L);
+
+#endif /* Guard for L2DBUS_SCHEDULER_H_ */
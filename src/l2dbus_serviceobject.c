@@ -39,8 +39,12 @@
 #include "cdbus/cdbus.h"
 #include "l2dbus_compat.h"
 #include "l2dbus_serviceobject.h"
+#include "l2dbus_replycontext.h"
 #include "l2dbus_interface.h"
 #include "l2dbus_connection.h"
+#include "l2dbus_objectmanager.h"
+#include "l2dbus_context.h"
+#include "l2dbus_dispatcher.h"
 #include "l2dbus_core.h"
 #include "l2dbus_object.h"
 #include "l2dbus_util.h"
@@ -86,12 +90,535 @@
  */
 
 
+/**
+ @brief Calls the Lua handler of the service object.
+
+ The service object userdata is expected at index **svcObjIdx** and
+ the Lua connection userdata at index **connIdx**.
+
+ @param [in] L          The Lua state used to make the call.
+ @param [in] ud         The Lua ServiceObject userdata.
+ @param [in] svcObjIdx  Stack index of the ServiceObject userdata.
+ @param [in] connIdx    Stack index of the Connection userdata.
+ @param [in] msg        The D-Bus request message (e.g. method call).
+
+ @return The DBusHandlerResult value returned by the Lua handler.
+ */
+static DBusHandlerResult
+l2dbus_serviceObjectInvoke
+    (
+    lua_State*              L,
+    l2dbus_ServiceObject*   ud,
+    int                     svcObjIdx,
+    int                     connIdx,
+    DBusMessage*            msg
+    )
+{
+    DBusHandlerResult rc = DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+    svcObjIdx = lua_absindex(L, svcObjIdx);
+    connIdx = lua_absindex(L, connIdx);
+
+    /* Push the service object userdata */
+    lua_pushvalue(L, svcObjIdx);
+    /* Push the associated Lua connection userdata wrapper on the stack */
+    lua_pushvalue(L, connIdx);
+    /* Push a Lua wrapper around the message */
+    l2dbus_messageWrap(L, msg, L2DBUS_TRUE);
+
+    if ( 0 == l2dbus_callbackInvokeDetail(L, &ud->cbCtx, 3 /* nArgs */,
+                                    1 /* nResults */, "Service object",
+                                    dbus_message_get_member(msg)) )
+    {
+        if ( lua_isnumber(L, -1) )
+        {
+            rc = lua_tointeger(L, -1);
+            switch ( rc )
+            {
+                case DBUS_HANDLER_RESULT_HANDLED:
+                case DBUS_HANDLER_RESULT_NOT_YET_HANDLED:
+                case DBUS_HANDLER_RESULT_NEED_MEMORY:
+                    /* These are understood */
+                    break;
+
+                default:
+                    L2DBUS_TRACE((L2DBUS_TRC_ERROR,
+                        "Unknown service object callback return code (%d)", rc));
+                    rc = DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+                    break;
+            }
+        }
+    }
+
+    return rc;
+}
+
+
+/**
+ @brief Calls the handler of the service object if the request is admitted.
+
+ A request over the admission limits of the object is answered with an
+ error and reported as handled without calling the handler.
+
+ @param [in] L      The Lua state used to make the call.
+ @param [in] ud     The Lua ServiceObject userdata (on the stack at -2).
+ @param [in] connUd The Lua Connection userdata (on the stack at -1).
+ @param [in] msg    The D-Bus request message.
+
+ @return A suitable DBusHandlerResult value.
+ */
+static DBusHandlerResult
+l2dbus_serviceObjectAdmitAndInvoke
+    (
+    lua_State*              L,
+    l2dbus_ServiceObject*   ud,
+    l2dbus_Connection*      connUd,
+    DBusMessage*            msg
+    )
+{
+    DBusHandlerResult rc;
+
+    if ( !l2dbus_admissionEnter(&ud->admission,
+                                cdbus_connectionGetDBus(connUd->conn),
+                                msg, 0.0) )
+    {
+        return DBUS_HANDLER_RESULT_HANDLED;
+    }
+
+    rc = l2dbus_serviceObjectInvoke(L, ud, -2, -1, msg);
+    l2dbus_admissionExit(&ud->admission, msg);
+
+    return rc;
+}
+
+
+/**
+ @brief Holds a deferred request until the object's handler returns.
+
+ The Dispatcher releases the references of an item once it has been
+ delivered so the held copy takes its own references.
+
+ @param [in] L      The Lua state.
+ @param [in] ud     The Lua ServiceObject userdata.
+ @param [in] item   The deferred dispatch item.
+
+ @return True if the request is held or false if memory could not be
+ allocated.
+ */
+l2dbus_Bool
+l2dbus_serviceObjectHoldItem
+    (
+    lua_State*              L,
+    l2dbus_ServiceObject*   ud,
+    l2dbus_DispatchItem*    item
+    )
+{
+    l2dbus_DispatchItem* held;
+    unsigned capacity;
+
+    if ( ud->nHeld == ud->heldCapacity )
+    {
+        capacity = (0U == ud->heldCapacity) ? 4U : 2U * ud->heldCapacity;
+        held = (l2dbus_DispatchItem*)l2dbus_realloc(ud->held,
+                                                capacity * sizeof(*held));
+        if ( NULL == held )
+        {
+            return L2DBUS_FALSE;
+        }
+        ud->held = held;
+        ud->heldCapacity = capacity;
+    }
+
+    held = &ud->held[ud->nHeld++];
+    *held = *item;
+    lua_rawgeti(L, LUA_REGISTRYINDEX, item->targetRef);
+    held->targetRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, item->connRef);
+    held->connRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    held->msg = dbus_message_ref(item->msg);
+
+    return L2DBUS_TRUE;
+}
+
+
+/**
+ @brief Releases the resources held by a held request.
+
+ @param [in] L      The Lua state.
+ @param [in] item   The held dispatch item.
+ */
+static void
+l2dbus_serviceObjectFreeItem
+    (
+    lua_State*              L,
+    l2dbus_DispatchItem*    item
+    )
+{
+    luaL_unref(L, LUA_REGISTRYINDEX, item->targetRef);
+    luaL_unref(L, LUA_REGISTRYINDEX, item->connRef);
+    if ( NULL != item->msg )
+    {
+        dbus_message_unref(item->msg);
+    }
+}
+
+
+/**
+ @brief Delivers a request that was deferred by the Dispatcher.
+
+ Since the request was reported as handled when it was deferred, an
+ error reply is sent here on behalf of the Lua handler if it turns out
+ the request was not handled after all. Requests arriving while the
+ object's handler waits in a nested call are held (if so configured)
+ until the handler returns. Requests over the admission limits of the
+ object (including the time spent queued) are rejected without
+ calling the handler.
+
+ @param [in] L      The Lua state used to make the call.
+ @param [in] item   The deferred dispatch item.
+ */
+static void
+l2dbus_serviceObjectDispatchDeferred
+    (
+    lua_State*              L,
+    l2dbus_DispatchItem*    item
+    )
+{
+    DBusHandlerResult rc;
+    DBusMessage* errMsg;
+    l2dbus_Connection* connUd;
+    l2dbus_ServiceObject* ud = (l2dbus_ServiceObject*)item->target;
+    l2dbus_ServiceObject* prevActive;
+
+    if ( (0U < ud->holdCount) && l2dbus_serviceObjectHoldItem(L, ud, item) )
+    {
+        return;
+    }
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, item->targetRef);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, item->connRef);
+    connUd = (l2dbus_Connection*)lua_touserdata(L, -1);
+
+    /* Requests that waited too long are turned away without a call */
+    if ( !l2dbus_admissionEnter(&ud->admission,
+                                cdbus_connectionGetDBus(connUd->conn),
+                                item->msg, item->queuedAt) )
+    {
+        return;
+    }
+
+    /* Lets a nested call made by the handler find the object */
+    prevActive = connUd->dispUd->activeObject;
+    connUd->dispUd->activeObject = ud;
+    rc = l2dbus_serviceObjectInvoke(L, ud, -2, -1, item->msg);
+    connUd->dispUd->activeObject = prevActive;
+    l2dbus_admissionExit(&ud->admission, item->msg);
+
+    if ( (DBUS_HANDLER_RESULT_HANDLED != rc) &&
+        (DBUS_MESSAGE_TYPE_METHOD_CALL == dbus_message_get_type(item->msg)) &&
+        !dbus_message_get_no_reply(item->msg) )
+    {
+        errMsg = dbus_message_new_error(item->msg, DBUS_ERROR_UNKNOWN_METHOD,
+                                        "Method not handled by object");
+        if ( NULL != errMsg )
+        {
+            dbus_connection_send(cdbus_connectionGetDBus(connUd->conn),
+                                errMsg, NULL);
+            dbus_message_unref(errMsg);
+        }
+    }
+}
+
+
+/**
+ @brief Holds back requests to the service object.
+
+ Called before a handler of the object waits in a nested call. Requests
+ delivered in the meantime are held until a matching call to
+ l2dbus_serviceObjectReleaseRequests().
+
+ @param [in] ud     The Lua ServiceObject userdata.
+ */
+void
+l2dbus_serviceObjectHoldRequests
+    (
+    l2dbus_ServiceObject*   ud
+    )
+{
+    ++ud->holdCount;
+}
+
+
+/**
+ @brief Releases the requests held back for the service object.
+
+ Once the last hold is released the requests are handed back to the
+ Dispatcher (in the order they arrived) for delivery. If that fails
+ they are delivered immediately.
+
+ @param [in] L      The Lua state.
+ @param [in] ud     The Lua ServiceObject userdata.
+ @param [in] dispUd The Dispatcher delivering the requests.
+ */
+void
+l2dbus_serviceObjectReleaseRequests
+    (
+    lua_State*              L,
+    l2dbus_ServiceObject*   ud,
+    l2dbus_Dispatcher*      dispUd
+    )
+{
+    l2dbus_DispatchItem* held = ud->held;
+    unsigned nHeld = ud->nHeld;
+    unsigned idx;
+    int top;
+
+    assert( 0U < ud->holdCount );
+    if ( 0U < --ud->holdCount )
+    {
+        return;
+    }
+
+    /* A request delivered directly may lead to requests being held all
+     * over again so detach the ones released here.
+     */
+    ud->held = NULL;
+    ud->nHeld = 0U;
+    ud->heldCapacity = 0U;
+    for ( idx = 0U; idx < nHeld; ++idx )
+    {
+        if ( !l2dbus_dispatcherDefer(dispUd, &held[idx]) )
+        {
+            top = lua_gettop(L);
+            held[idx].func(L, &held[idx]);
+            lua_settop(L, top);
+            l2dbus_serviceObjectFreeItem(L, &held[idx]);
+        }
+    }
+    l2dbus_free(held);
+}
+
+
+/**
+ * @brief Finds an interface of a service object by name.
+ *
+ * @param [in] L        The Lua state.
+ * @param [in] ud       The Lua ServiceObject userdata.
+ * @param [in] name     The name of the interface.
+ * @return The Interface userdata or NULL if the object doesn't have it.
+ */
+l2dbus_Interface*
+l2dbus_serviceObjectFindInterface
+    (
+    lua_State*              L,
+    l2dbus_ServiceObject*   ud,
+    const char*             name
+    )
+{
+    l2dbus_RefItem* item;
+    l2dbus_Interface* intfUd;
+
+    if ( NULL == name )
+    {
+        return NULL;
+    }
+
+    for ( item = LIST_FIRST(&ud->interfaces.list);
+        item != LIST_END(&ud->interfaces.list);
+        item = LIST_NEXT(item, link) )
+    {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, item->refIdx);
+        intfUd = (l2dbus_Interface*)lua_touserdata(L, -1);
+        lua_pop(L, 1);
+        if ( (NULL != intfUd) &&
+            (0 == strcmp(name, cdbus_interfaceGetName(intfUd->intf))) )
+        {
+            return intfUd;
+        }
+    }
+
+    return NULL;
+}
+
+
+/**
+ @brief Determines the dispatch priority class of a request.
+
+ A priority assigned to the interface named by the request takes
+ precedence over one assigned to the service object. Otherwise the
+ priority is derived from the type of the message.
+
+ @param [in] L      The Lua state.
+ @param [in] ud     The Lua ServiceObject userdata.
+ @param [in] dispUd The Dispatcher delivering the request.
+ @param [in] msg    The D-Bus request message (e.g. method call).
+
+ @return The priority class of the request.
+ */
+int
+l2dbus_serviceObjectPriority
+    (
+    lua_State*              L,
+    l2dbus_ServiceObject*   ud,
+    l2dbus_Dispatcher*      dispUd,
+    DBusMessage*            msg
+    )
+{
+    int priority = ud->priority;
+    l2dbus_Interface* intfUd;
+
+    intfUd = l2dbus_serviceObjectFindInterface(L, ud,
+                                            dbus_message_get_interface(msg));
+    if ( (NULL != intfUd) &&
+        (L2DBUS_DISPATCH_PRIORITY_DEFAULT != intfUd->priority) )
+    {
+        priority = intfUd->priority;
+    }
+
+    return l2dbus_dispatcherResolvePriority(dispUd, priority, msg);
+}
+
+
+/**
+ * @brief Releases the cached introspection data of a service object.
+ */
+static void
+l2dbus_serviceObjectFlushIntrospection
+    (
+    l2dbus_ServiceObject*   ud
+    )
+{
+    unsigned idx;
+
+    for ( idx = 0; idx < L2DBUS_INTROSPECT_CACHE_SIZE; ++idx )
+    {
+        l2dbus_free(ud->introspectCache[idx].path);
+        l2dbus_free(ud->introspectCache[idx].xml);
+        memset(&ud->introspectCache[idx], 0, sizeof(ud->introspectCache[idx]));
+    }
+    ud->introspectNext = 0U;
+}
+
+
+/**
+ * @brief Returns the introspection XML of a service object.
+ *
+ * The XML is generated by CDBUS only when nothing is cached for the
+ * connection and path or the cached copy is stale. The copy is stale once
+ * the object, one of its interfaces, or the set of objects registered with
+ * any connection (the child nodes) has changed since it was generated.
+ *
+ * @param [in]  L       Lua state.
+ * @param [in]  ud      The ServiceObject userdata.
+ * @param [in]  conn    The connection the object is registered with.
+ * @param [in]  path    The object path being introspected.
+ * @param [out] len     The length of the XML (may be NULL).
+ * @return The XML (owned by the object) or NULL if it is unavailable.
+ */
+const char*
+l2dbus_serviceObjectIntrospectCached
+    (
+    lua_State*                  L,
+    l2dbus_ServiceObject*       ud,
+    struct cdbus_Connection*    conn,
+    const char*                 path,
+    size_t*                     len
+    )
+{
+    l2dbus_Context* ctx = ud->cbCtx.modCtx;
+    l2dbus_IntrospectCacheEntry* entry = NULL;
+    unsigned long stamp = ud->introspectStamp;
+    l2dbus_RefItem* item;
+    l2dbus_Interface* intfUd;
+    cdbus_StringBuffer* buf;
+    unsigned idx;
+
+    if ( ctx->introspectTreeStamp > stamp )
+    {
+        stamp = ctx->introspectTreeStamp;
+    }
+
+    for ( item = LIST_FIRST(&ud->interfaces.list);
+        item != LIST_END(&ud->interfaces.list);
+        item = LIST_NEXT(item, link) )
+    {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, item->refIdx);
+        intfUd = (l2dbus_Interface*)lua_touserdata(L, -1);
+        lua_pop(L, 1);
+        if ( (NULL != intfUd) && (intfUd->introspectStamp > stamp) )
+        {
+            stamp = intfUd->introspectStamp;
+        }
+    }
+
+    for ( idx = 0; idx < L2DBUS_INTROSPECT_CACHE_SIZE; ++idx )
+    {
+        if ( (conn == ud->introspectCache[idx].conn) &&
+            (NULL != ud->introspectCache[idx].path) &&
+            (0 == strcmp(path, ud->introspectCache[idx].path)) )
+        {
+            entry = &ud->introspectCache[idx];
+            break;
+        }
+    }
+
+    if ( (NULL != entry) && (NULL != entry->xml) && (entry->stamp >= stamp) )
+    {
+        ++ud->introspectHits;
+    }
+    else
+    {
+        ++ud->introspectMisses;
+
+        /* Replace the oldest entry if the path isn't cached */
+        if ( NULL == entry )
+        {
+            entry = &ud->introspectCache[ud->introspectNext];
+            ud->introspectNext = (ud->introspectNext + 1U) %
+                                L2DBUS_INTROSPECT_CACHE_SIZE;
+            l2dbus_free(entry->path);
+            entry->path = l2dbus_strDup(path);
+            entry->conn = conn;
+        }
+        l2dbus_free(entry->xml);
+        entry->xml = NULL;
+        entry->len = 0;
+        entry->stamp = ctx->introspectStamp;
+
+        buf = cdbus_objectIntrospect(ud->obj, conn, path);
+        if ( NULL != buf )
+        {
+            if ( (NULL != entry->path) && !cdbus_stringBufferIsEmpty(buf) )
+            {
+                entry->len = cdbus_stringBufferLength(buf);
+                entry->xml = (char*)l2dbus_malloc(entry->len + 1);
+                if ( NULL != entry->xml )
+                {
+                    memcpy(entry->xml, cdbus_stringBufferRaw(buf), entry->len + 1);
+                }
+            }
+            cdbus_stringBufferUnref(buf);
+        }
+    }
+
+    if ( (NULL != len) && (NULL != entry->xml) )
+    {
+        *len = entry->len;
+    }
+
+    return entry->xml;
+}
+
+
 /**
  @brief Handles and processes requests to the service object.
 
  This function will try to deliver a callback to a Lua handler function
  when invoked. The handler itself will determine whether or not it
- can handle the request.
+ can handle the request. If the dispatch budget of the Dispatcher has
+ been exhausted the request is queued and delivered on a subsequent
+ main loop iteration. Requests over the admission limits of the object
+ are rejected before they reach the handler.
 
  @param [in] obj      The CDBUS service object.
  @param [in] conn     The CDBUS connection associated with this object.
@@ -110,13 +637,22 @@ l2dbus_serviceObjectHandler
         DBusMessage*                msg
     )
 {
-    lua_State* L = l2dbus_callbackGetThread();
-    const char* errMsg = "";
+    /* The service object userdata was registered as the CDBUS object's
+     * user data. The callback thread is resolved from the context of the
+     * Lua state that owns it.
+     */
+    l2dbus_ServiceObject* svcObjUd = (l2dbus_ServiceObject*)cdbus_objectGetData(obj);
+    int base;
+    lua_State* L = l2dbus_callbackBegin(&svcObjUd->cbCtx, &base);
     DBusHandlerResult rc = DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
     l2dbus_ServiceObject* ud;
+    l2dbus_Connection* connUd;
+    l2dbus_DispatchItem item;
+    int priority = L2DBUS_DISPATCH_PRIORITY_NORMAL;
 
     /* Leaves the userdata sitting on the top of the stack */
-    ud = l2dbus_objectRegistryGet(L, obj);
+    ud = l2dbus_callbackPushObject(L, &svcObjUd->cbCtx, obj);
+    l2dbus_callbackEnterDbusDispatch(&svcObjUd->cbCtx);
 
     /* Nil or the ServiceObject userdata is sitting at the top of the
      * stack at this point.
@@ -134,59 +670,56 @@ l2dbus_serviceObjectHandler
     /* Else if a default callback function was provided then ... */
     else if ( LUA_NOREF != ud->cbCtx.funcRef )
     {
-        /* Push function and user value on the stack and execute the callback */
-        lua_rawgeti(L, LUA_REGISTRYINDEX, ud->cbCtx.funcRef);
-        /* Push the service object userdata */
-        lua_pushvalue(L, -2 /* Service object ud */);
         /* Push the associated Lua connection userdata wrapper on the stack */
-        l2dbus_objectRegistryGet(L, conn);
-        if ( lua_isnil(L, -1) )
+        connUd = (l2dbus_Connection*)l2dbus_callbackPushObject(L,
+                                                    &ud->cbCtx, conn);
+        if ( NULL == connUd )
         {
             L2DBUS_TRACE((L2DBUS_TRC_WARN,
                         "Cannot call object handler because connection has been GC'ed"));
         }
         else
         {
-            /* Push a Lua wrapper around the message */
-            l2dbus_messageWrap(L, msg, L2DBUS_TRUE);
-
-            /* Push the user provided value on the stack */
-            lua_rawgeti(L, LUA_REGISTRYINDEX, ud->cbCtx.userRef);
+            /* Only resolve the priority if delivery might be deferred */
+            if ( l2dbus_dispatcherIsThrottling(connUd->dispUd) )
+            {
+                priority = l2dbus_serviceObjectPriority(L, ud, connUd->dispUd, msg);
+            }
 
-            if ( 0 != lua_pcall(L, 4 /* nArgs */, 1 /* nResults */, 0) )
+            if ( l2dbus_dispatcherAdmit(connUd->dispUd, priority) )
             {
-                if ( lua_isstring(L, -1) )
-                {
-                    errMsg = lua_tostring(L, -1);
-                }
-                L2DBUS_TRACE((L2DBUS_TRC_ERROR, "Service object callback error: %s", errMsg));
+                rc = l2dbus_serviceObjectAdmitAndInvoke(L, ud, connUd, msg);
             }
             else
             {
-                if ( lua_isnumber(L, -1) )
+                item.func = l2dbus_serviceObjectDispatchDeferred;
+                item.priority = priority;
+                item.target = ud;
+                lua_pushvalue(L, -2 /* Service object ud */);
+                item.targetRef = luaL_ref(L, LUA_REGISTRYINDEX);
+                lua_pushvalue(L, -1 /* Connection ud */);
+                item.connRef = luaL_ref(L, LUA_REGISTRYINDEX);
+                item.msg = dbus_message_ref(msg);
+                item.queuedAt = 0.0;
+
+                if ( l2dbus_dispatcherDefer(connUd->dispUd, &item) )
                 {
-                    rc = lua_tointeger(L, -1);
-                    switch ( rc )
-                    {
-                        case DBUS_HANDLER_RESULT_HANDLED:
-                        case DBUS_HANDLER_RESULT_NOT_YET_HANDLED:
-                        case DBUS_HANDLER_RESULT_NEED_MEMORY:
-                            /* These are understood */
-                            break;
-
-                        default:
-                            L2DBUS_TRACE((L2DBUS_TRC_ERROR,
-                                "Unknown service object callback return code (%d)", rc));
-                            rc = DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
-                            break;
-                    }
+                    rc = DBUS_HANDLER_RESULT_HANDLED;
+                }
+                else
+                {
+                    luaL_unref(L, LUA_REGISTRYINDEX, item.targetRef);
+                    luaL_unref(L, LUA_REGISTRYINDEX, item.connRef);
+                    dbus_message_unref(item.msg);
+                    rc = l2dbus_serviceObjectAdmitAndInvoke(L, ud, connUd, msg);
                 }
             }
         }
     }
 
     /* Clean up the thread stack */
-    lua_settop(L, 0);
+    l2dbus_callbackLeaveDbusDispatch(&svcObjUd->cbCtx);
+    l2dbus_callbackEnd(L, base);
 
     /* The return value is unused by CDBUS */
     return rc;
@@ -209,6 +742,7 @@ l2dbus_serviceObjectFreeObject
     l2dbus_Interface* intfUd = (l2dbus_Interface*)item;
     l2dbus_ServiceObject* svcObjUd = (l2dbus_ServiceObject*)userdata;
 
+    --intfUd->nObjects;
     if ( !cdbus_objectRemoveInterface(svcObjUd->obj, cdbus_interfaceGetName(intfUd->intf)) )
     {
         L2DBUS_TRACE((L2DBUS_TRC_WARN,
@@ -304,8 +838,11 @@ l2dbus_newServiceObject
     else
     {
         /* Reset the userdata structure */
-        l2dbus_callbackInit(&svcObjUd->cbCtx);
+        l2dbus_callbackInit(L, &svcObjUd->cbCtx);
         l2dbus_refListInit(&svcObjUd->interfaces);
+        svcObjUd->priority = L2DBUS_DISPATCH_PRIORITY_DEFAULT;
+        LIST_INIT(&svcObjUd->deferred);
+        l2dbus_admissionInit(&svcObjUd->admission);
 
         l2dbus_callbackRef(L, funcIdx, userIdx, &svcObjUd->cbCtx);
         svcObjUd->obj = cdbus_objectNew(path, l2dbus_serviceObjectHandler, svcObjUd);
@@ -347,13 +884,39 @@ l2dbus_serviceObjectDispose
 {
     l2dbus_ServiceObject* ud = (l2dbus_ServiceObject*)luaL_checkudata(L, -1,
                                         L2DBUS_SERVICE_OBJECT_MTBL_NAME);
+    l2dbus_ReplyContext* ctx;
 
     L2DBUS_TRACE((L2DBUS_TRC_TRACE, "GC: service object (userdata=%p)", ud));
 
     l2dbus_refListFree(&ud->interfaces, L, l2dbus_serviceObjectFreeObject, ud);
 
+    /* Requests that were never released are dropped */
+    while ( 0U < ud->nHeld )
+    {
+        l2dbus_serviceObjectFreeItem(L, &ud->held[--ud->nHeld]);
+    }
+    l2dbus_free(ud->held);
+    ud->held = NULL;
+    ud->heldCapacity = 0U;
+    l2dbus_serviceObjectFlushIntrospection(ud);
+
+    /* Deferred replies anchor the object so any left over belong to a
+     * module being shut down.
+     */
+    while ( !LIST_EMPTY(&ud->deferred) )
+    {
+        ctx = LIST_FIRST(&ud->deferred);
+        LIST_REMOVE(ctx, deferLink);
+        ctx->svcUd = NULL;
+    }
+    ud->nDeferred = 0U;
+    l2dbus_admissionFree(&ud->admission);
+
     if ( ud->obj != NULL )
     {
+        /* The object may still be registered with a connection */
+        l2dbus_objectIndexDropObject(ud);
+
         /* Remove the weak association from CDBUS object to the Lua
          * userdata object wrapper.
          */
@@ -473,6 +1036,68 @@ l2dbus_serviceObjectGetData
 }
 
 
+/**
+ @function setPriority
+ @within ServiceObject
+
+ Sets the dispatch priority class of requests to the service object.
+
+ The priority class determines the order in which messages are delivered
+ when the Dispatcher has deferred their delivery because its dispatch
+ @{l2dbus.Dispatcher.setBudget|budget} was exhausted. By default the
+ priority class is derived from the @{l2dbus.Dispatcher.setTypePriority|type}
+ of the message.
+
+ @tparam userdata object The ServiceObject.
+ @tparam ?number priority The priority class (e.g.
+ @{l2dbus.Dispatcher.PRIORITY_HIGH|PRIORITY_HIGH}) or **nil** for the
+ @{l2dbus.Dispatcher.PRIORITY_DEFAULT|default}.
+ */
+static int
+l2dbus_serviceObjectSetPriority
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_ServiceObject* ud = (l2dbus_ServiceObject*)luaL_checkudata(L, 1,
+                                        L2DBUS_SERVICE_OBJECT_MTBL_NAME);
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    ud->priority = l2dbus_checkDispatchPriority(L, 2);
+
+    return 0;
+}
+
+
+/**
+ @function priority
+ @within ServiceObject
+
+ Gets the dispatch priority class of requests to the service object.
+
+ @tparam userdata object The ServiceObject.
+ @treturn number The priority class.
+ */
+static int
+l2dbus_serviceObjectGetPriority
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_ServiceObject* ud = (l2dbus_ServiceObject*)luaL_checkudata(L, 1,
+                                        L2DBUS_SERVICE_OBJECT_MTBL_NAME);
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    lua_pushinteger(L, ud->priority);
+
+    return 1;
+}
+
+
 /**
  @function addInterface
  @within ServiceObject
@@ -481,7 +1106,9 @@ l2dbus_serviceObjectGetData
 
  A service object can implement more than one interface but the interface
  names must be unique (e.g. no two interfaces with the same name). This
- method will fail if you try to add the same interface twice.
+ method will fail if you try to add the same interface twice. It also
+ fails if the interface @{l2dbus.Interface.setPropertyBatching|batches}
+ its property changes and has already been added to another object.
 
  @tparam userdata object The userdata representing the ServiceObject.
  @tparam userdata interface The @{l2dbus.Interface|interface} to add to
@@ -505,7 +1132,14 @@ l2dbus_serviceObjectAddInterface
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    if ( cdbus_objectAddInterface(objUd->obj, ifUd->intf) )
+    /* Batched changes are announced from a single object path */
+    if ( (NULL != ifUd->batch.connUd) && (0U < ifUd->nObjects) )
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_WARN, "Interface '%s' batches its property "
+                    "changes and cannot be shared by several objects",
+                    cdbus_interfaceGetName(ifUd->intf)));
+    }
+    else if ( cdbus_objectAddInterface(objUd->obj, ifUd->intf) )
     {
         /* Add a strong reference to the Lua userdata wrapping
          *  the D-Bus interface
@@ -518,6 +1152,13 @@ l2dbus_serviceObjectAddInterface
         else
         {
             isAdded = L2DBUS_TRUE;
+            ++ifUd->nObjects;
+            objUd->introspectStamp = ++objUd->cbCtx.modCtx->introspectStamp;
+            if ( ifUd->isObjectManager )
+            {
+                ++objUd->nManagers;
+            }
+            l2dbus_objectManagerInterfaceChanged(L, objUd, ifUd, L2DBUS_TRUE);
         }
     }
 
@@ -575,6 +1216,13 @@ l2dbus_serviceObjectRemoveInterface
          * object.
          */
         removed = L2DBUS_TRUE;
+        --intfUd->nObjects;
+        objUd->introspectStamp = ++objUd->cbCtx.modCtx->introspectStamp;
+        if ( intfUd->isObjectManager )
+        {
+            --objUd->nManagers;
+        }
+        l2dbus_objectManagerInterfaceChanged(L, objUd, intfUd, L2DBUS_FALSE);
 
         /* Make best effort to remove the strong reference to the interface */
 
@@ -605,7 +1253,9 @@ l2dbus_serviceObjectRemoveInterface
 
  This method generates the D-Bus introspection XML data for a service object
  and returns it as a string. Each interface associated with this object
- will be introspected as well.
+ will be introspected as well. The XML is cached per connection and path
+ and only regenerated after the object, its interfaces, or the objects
+ registered with a connection have changed.
 
  @tparam userdata object The userdata representing the ServiceObject.
  @tparam userdata conn The userdata representing the Connection.
@@ -623,24 +1273,289 @@ l2dbus_serviceObjectIntrospect
     l2dbus_Connection* connUd = (l2dbus_Connection*)luaL_checkudata(L, 2,
                                         L2DBUS_CONNECTION_MTBL_NAME);
     const char* path;
-    cdbus_StringBuffer* buf;
+    const char* xml;
+    size_t len = 0;
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
     path = luaL_checkstring(L, 3);
 
-    buf = cdbus_objectIntrospect(objUd->obj, connUd->conn, path);
-    if ( cdbus_stringBufferIsEmpty(buf) )
+    xml = l2dbus_serviceObjectIntrospectCached(L, objUd, connUd->conn, path, &len);
+    if ( NULL == xml )
     {
         lua_pushnil(L);
     }
     else
     {
-        lua_pushstring(L, cdbus_stringBufferRaw(buf));
-        cdbus_stringBufferUnref(buf);
+        lua_pushlstring(L, xml, len);
+    }
+
+    return 1;
+}
+
+
+/**
+ @function getIntrospectStats
+ @within ServiceObject
+
+ Returns statistics about the cached introspection data of the object.
+
+ @tparam userdata object The userdata representing the ServiceObject.
+ @treturn table A table with the fields *hits* (requests answered from the
+ cache) and *misses* (requests for which the XML was regenerated).
+ */
+static int
+l2dbus_serviceObjectGetIntrospectStats
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_ServiceObject* objUd = (l2dbus_ServiceObject*)luaL_checkudata(L, 1,
+                                        L2DBUS_SERVICE_OBJECT_MTBL_NAME);
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    lua_createtable(L, 0, 2);
+    lua_pushnumber(L, (lua_Number)objUd->introspectHits);
+    lua_setfield(L, -2, "hits");
+    lua_pushnumber(L, (lua_Number)objUd->introspectMisses);
+    lua_setfield(L, -2, "misses");
+
+    return 1;
+}
+
+
+/**
+ @function setDeferredLimit
+ @within ServiceObject
+
+ Sets the maximum number of deferred replies that may be in-flight.
+
+ Once the limit is reached requests whose handlers try to
+ @{l2dbus.ReplyContext.defer|defer} their reply are answered with a
+ *org.freedesktop.DBus.Error.LimitsExceeded* error.
+
+ @tparam userdata object The userdata representing the ServiceObject.
+ @tparam number limit The maximum number of in-flight deferred replies.
+ Zero (0) means there is no limit (the default).
+ */
+static int
+l2dbus_serviceObjectSetDeferredLimit
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_ServiceObject* objUd = (l2dbus_ServiceObject*)luaL_checkudata(L, 1,
+                                        L2DBUS_SERVICE_OBJECT_MTBL_NAME);
+    lua_Integer limit = luaL_checkinteger(L, 2);
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    luaL_argcheck(L, limit >= 0, 2, "limit must not be negative");
+    objUd->maxDeferred = (unsigned)limit;
+
+    return 0;
+}
+
+
+/**
+ @function getDeferredStats
+ @within ServiceObject
+
+ Returns statistics about the deferred replies of the object.
+
+ @tparam userdata object The userdata representing the ServiceObject.
+ @treturn table A table with the fields *inFlight* (replies currently
+ deferred), *limit* (see @{setDeferredLimit}), *deferred* (total replies
+ deferred), *expired* (replies whose deadline passed), *rejected*
+ (deferrals refused because of the limit) and *oldest* (the time in
+ milliseconds the oldest in-flight reply has been deferred).
+ */
+static int
+l2dbus_serviceObjectGetDeferredStats
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_ServiceObject* objUd = (l2dbus_ServiceObject*)luaL_checkudata(L, 1,
+                                        L2DBUS_SERVICE_OBJECT_MTBL_NAME);
+    l2dbus_ReplyContext* ctx;
+    double oldest = 0.0;
+    double now;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    /* The list is ordered newest first */
+    now = l2dbus_getMonotonicTime();
+    LIST_FOREACH(ctx, &objUd->deferred, deferLink)
+    {
+        oldest = now - ctx->deferredAt;
+    }
+
+    lua_createtable(L, 0, 6);
+    lua_pushinteger(L, (lua_Integer)objUd->nDeferred);
+    lua_setfield(L, -2, "inFlight");
+    lua_pushinteger(L, (lua_Integer)objUd->maxDeferred);
+    lua_setfield(L, -2, "limit");
+    lua_pushnumber(L, (lua_Number)objUd->deferredTotal);
+    lua_setfield(L, -2, "deferred");
+    lua_pushnumber(L, (lua_Number)objUd->deferredExpired);
+    lua_setfield(L, -2, "expired");
+    lua_pushnumber(L, (lua_Number)objUd->deferredRejected);
+    lua_setfield(L, -2, "rejected");
+    lua_pushnumber(L, oldest);
+    lua_setfield(L, -2, "oldest");
+
+    return 1;
+}
+
+
+/**
+ @function setAdmission
+ @within ServiceObject
+
+ Sets the admission limits of requests to the object.
+
+ The limits apply to method calls delivered to the handler of the object
+ and to the handlers of its @{l2dbus.Interface|interfaces}. A request
+ over any limit is answered with an error right away without calling a
+ Lua handler. A request is in-flight while its handler runs (e.g. waits
+ in a nested call) and, if its reply is
+ @{l2dbus.ReplyContext.defer|deferred}, until it's answered.
+
+ The options table may contain the following fields. A field that is
+ missing (or zero) removes the corresponding limit:
+ <ul>
+ <li>*maxQueueAge* - The maximum time (in milliseconds) a request may
+ wait in the queue of the @{l2dbus.Dispatcher|Dispatcher} (see
+ @{l2dbus.Dispatcher.setBudget|setBudget}) or be held back during a
+ nested call. Older requests are rejected when their turn comes. This
+ limit only applies to requests for the handler of the object itself:
+ the method handlers of its interfaces are called without a queue age
+ and are never rejected by it.</li>
+ <li>*maxPerSender* - The maximum number of requests in-flight from a
+ single sender (unique bus name).</li>
+ <li>*maxConcurrent* - The maximum number of requests in-flight
+ overall.</li>
+ <li>*errorName* - The name of the error sent to rejected callers.
+ Defaults to *org.freedesktop.DBus.Error.LimitsExceeded*.</li>
+ </ul>
+
+ @tparam userdata object The userdata representing the ServiceObject.
+ @tparam ?table options The admission limits or **nil** to remove them
+ all.
+ */
+static int
+l2dbus_serviceObjectSetAdmission
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_ServiceObject* objUd = (l2dbus_ServiceObject*)luaL_checkudata(L, 1,
+                                        L2DBUS_SERVICE_OBJECT_MTBL_NAME);
+    lua_Number maxQueueAge = 0.0;
+    lua_Number maxPerSender = 0.0;
+    lua_Number maxConcurrent = 0.0;
+    const char* errorName = NULL;
+    char* name = NULL;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    if ( !lua_isnoneornil(L, 2) )
+    {
+        luaL_checktype(L, 2, LUA_TTABLE);
+
+        lua_getfield(L, 2, "maxQueueAge");
+        maxQueueAge = luaL_optnumber(L, -1, 0.0);
+        lua_getfield(L, 2, "maxPerSender");
+        maxPerSender = luaL_optnumber(L, -1, 0.0);
+        lua_getfield(L, 2, "maxConcurrent");
+        maxConcurrent = luaL_optnumber(L, -1, 0.0);
+        lua_getfield(L, 2, "errorName");
+        errorName = luaL_optstring(L, -1, NULL);
+
+        luaL_argcheck(L, (maxQueueAge >= 0.0) && (maxPerSender >= 0.0) &&
+                    (maxConcurrent >= 0.0), 2, "limits must not be negative");
+        if ( (NULL != errorName) && !l2dbus_validateErrorName(errorName) )
+        {
+            luaL_argerror(L, 2, "invalid D-Bus error name");
+        }
     }
 
+    if ( NULL != errorName )
+    {
+        name = l2dbus_strDup(errorName);
+        if ( NULL == name )
+        {
+            luaL_error(L, "Failed to allocate error name");
+        }
+    }
+
+    objUd->admission.maxQueueAge = (double)maxQueueAge;
+    objUd->admission.maxPerSender = (unsigned)maxPerSender;
+    objUd->admission.maxConcurrent = (unsigned)maxConcurrent;
+    l2dbus_free(objUd->admission.errorName);
+    objUd->admission.errorName = name;
+
+    return 0;
+}
+
+
+/**
+ @function getAdmissionStats
+ @within ServiceObject
+
+ Returns statistics about the admission control of the object.
+
+ @tparam userdata object The userdata representing the ServiceObject.
+ @treturn table A table with the limits *maxQueueAge*, *maxPerSender* and
+ *maxConcurrent* (see @{setAdmission}), the fields *inFlight* (requests
+ currently in-flight), *senders* (senders with requests in-flight),
+ *admitted* (requests admitted while limits were set), *rejected* (total
+ requests rejected) and the number of requests rejected because of each
+ limit: *rejectedAge*, *rejectedSender* and *rejectedConcurrent*.
+ */
+static int
+l2dbus_serviceObjectGetAdmissionStats
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_ServiceObject* objUd = (l2dbus_ServiceObject*)luaL_checkudata(L, 1,
+                                        L2DBUS_SERVICE_OBJECT_MTBL_NAME);
+    l2dbus_Admission* adm = &objUd->admission;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    lua_createtable(L, 0, 10);
+    lua_pushnumber(L, (lua_Number)adm->maxQueueAge);
+    lua_setfield(L, -2, "maxQueueAge");
+    lua_pushinteger(L, (lua_Integer)adm->maxPerSender);
+    lua_setfield(L, -2, "maxPerSender");
+    lua_pushinteger(L, (lua_Integer)adm->maxConcurrent);
+    lua_setfield(L, -2, "maxConcurrent");
+    lua_pushinteger(L, (lua_Integer)adm->nInFlight);
+    lua_setfield(L, -2, "inFlight");
+    lua_pushinteger(L, (lua_Integer)adm->nSenders);
+    lua_setfield(L, -2, "senders");
+    lua_pushnumber(L, (lua_Number)adm->admitted);
+    lua_setfield(L, -2, "admitted");
+    lua_pushnumber(L, (lua_Number)(adm->rejectedAge + adm->rejectedSender +
+                                    adm->rejectedConcurrent));
+    lua_setfield(L, -2, "rejected");
+    lua_pushnumber(L, (lua_Number)adm->rejectedAge);
+    lua_setfield(L, -2, "rejectedAge");
+    lua_pushnumber(L, (lua_Number)adm->rejectedSender);
+    lua_setfield(L, -2, "rejectedSender");
+    lua_pushnumber(L, (lua_Number)adm->rejectedConcurrent);
+    lua_setfield(L, -2, "rejectedConcurrent");
+
     return 1;
 }
 
@@ -652,9 +1567,16 @@ static const luaL_Reg l2dbus_serviceObjectMetaTable[] = {
     {"path", l2dbus_serviceObjectGetPath},
     {"setData", l2dbus_serviceObjectSetData},
     {"data", l2dbus_serviceObjectGetData},
+    {"setPriority", l2dbus_serviceObjectSetPriority},
+    {"priority", l2dbus_serviceObjectGetPriority},
     {"addInterface", l2dbus_serviceObjectAddInterface},
     {"removeInterface", l2dbus_serviceObjectRemoveInterface},
     {"introspect", l2dbus_serviceObjectIntrospect},
+    {"getIntrospectStats", l2dbus_serviceObjectGetIntrospectStats},
+    {"setDeferredLimit", l2dbus_serviceObjectSetDeferredLimit},
+    {"getDeferredStats", l2dbus_serviceObjectGetDeferredStats},
+    {"setAdmission", l2dbus_serviceObjectSetAdmission},
+    {"getAdmissionStats", l2dbus_serviceObjectGetAdmissionStats},
     {"__gc", l2dbus_serviceObjectDispose},
     {NULL, NULL},
 };
@@ -35,20 +35,88 @@
 #define L2DBUS_SERVICEOBJECT_H_
 
 #include "lua.h"
+#include "queue.h"
 #include "l2dbus_callback.h"
 #include "l2dbus_reflist.h"
+#include "l2dbus_admission.h"
+
+/* Number of paths (per connection) with cached introspection data */
+#define L2DBUS_INTROSPECT_CACHE_SIZE    (4)
 
 /* Forward declarations */
 struct cdbus_Object;
+struct cdbus_Connection;
 struct l2dbus_Interface;
+struct l2dbus_Dispatcher;
+struct l2dbus_DispatchItem;
+struct l2dbus_ReplyContext;
+struct l2dbus_Connection;
+struct DBusMessage;
+
+typedef struct l2dbus_IntrospectCacheEntry
+{
+    const struct cdbus_Connection*      conn;
+    char*                               path;
+    char*                               xml;
+    size_t                              len;
+    /* Value of the introspection stamp when the XML was generated */
+    unsigned long                       stamp;
+} l2dbus_IntrospectCacheEntry;
 
 typedef struct l2dbus_ServiceObject
 {
     struct cdbus_Object*                obj;
     l2dbus_CallbackCtx                  cbCtx;
     l2dbus_RefList                      interfaces;
+    int                                 priority;
+    /* Requests held back while a handler waits in a nested call */
+    unsigned                            holdCount;
+    struct l2dbus_DispatchItem*         held;
+    unsigned                            nHeld;
+    unsigned                            heldCapacity;
+    /* Cached introspection XML */
+    unsigned long                       introspectStamp;
+    l2dbus_IntrospectCacheEntry         introspectCache[L2DBUS_INTROSPECT_CACHE_SIZE];
+    unsigned                            introspectNext;
+    unsigned long                       introspectHits;
+    unsigned long                       introspectMisses;
+    /* Deferred replies still in-flight (newest first) */
+    LIST_HEAD(l2dbus_DeferredHead,
+              l2dbus_ReplyContext)      deferred;
+    unsigned                            nDeferred;
+    /* Maximum in-flight deferred replies (zero means unlimited) */
+    unsigned                            maxDeferred;
+    unsigned long                       deferredTotal;
+    unsigned long                       deferredExpired;
+    unsigned long                       deferredRejected;
+    /* Connections the object is registered with (see ObjectManager) */
+    struct l2dbus_Connection**          regConns;
+    unsigned                            nRegConns;
+    unsigned                            maxRegConns;
+    /* Number of ObjectManager interfaces of the object */
+    unsigned                            nManagers;
+    /* Admission control of requests to the object and its interfaces */
+    l2dbus_Admission                    admission;
 } l2dbus_ServiceObject;
 
+struct l2dbus_Interface* l2dbus_serviceObjectFindInterface(lua_State* L,
+                                        l2dbus_ServiceObject* ud,
+                                        const char* name);
+int l2dbus_serviceObjectPriority(lua_State* L, l2dbus_ServiceObject* ud,
+                                struct l2dbus_Dispatcher* dispUd,
+                                struct DBusMessage* msg);
+void l2dbus_serviceObjectHoldRequests(l2dbus_ServiceObject* ud);
+l2dbus_Bool l2dbus_serviceObjectHoldItem(lua_State* L,
+                                        l2dbus_ServiceObject* ud,
+                                        struct l2dbus_DispatchItem* item);
+void l2dbus_serviceObjectReleaseRequests(lua_State* L,
+                                        l2dbus_ServiceObject* ud,
+                                        struct l2dbus_Dispatcher* dispUd);
+const char* l2dbus_serviceObjectIntrospectCached(lua_State* L,
+                                        l2dbus_ServiceObject* ud,
+                                        struct cdbus_Connection* conn,
+                                        const char* path,
+                                        size_t* len);
 void l2dbus_openServiceObject(lua_State* L);
 
 #endif /* Guard for L2DBUS_SERVICEOBJECT_H_ */
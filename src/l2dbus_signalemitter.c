@@ -0,0 +1,523 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_signalemitter.c
+ * @author         Glenn Schmottlach
+ * @brief          Implementation of a pre-compiled D-Bus signal emitter.
+ *===========================================================================
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "dbus/dbus.h"
+#include "cdbus/cdbus.h"
+#include "l2dbus_compat.h"
+#include "l2dbus_signalemitter.h"
+#include "l2dbus_connection.h"
+#include "l2dbus_core.h"
+#include "l2dbus_object.h"
+#include "l2dbus_util.h"
+#include "l2dbus_transcode.h"
+#include "l2dbus_dbuscompat.h"
+#include "l2dbus_trace.h"
+#include "l2dbus_debug.h"
+#include "l2dbus_alloc.h"
+#include "lauxlib.h"
+
+/**
+ L2DBUS SignalEmitter
+
+ A SignalEmitter sends one particular D-Bus signal on a set of
+ connections. The object path, interface, member and signature of the
+ signal are validated once when the emitter is created. Emitting the
+ signal then only copies the prepared header, marshals the arguments
+ and queues the message on each of the emitter's connections.
+
+ The emitter keeps a *strong* reference to each of its connections.
+
+ @namespace l2dbus.SignalEmitter
+ */
+
+
+/**
+ * @brief Counts the complete types of a (valid) D-Bus signature.
+ *
+ * @param [in] signature    The D-Bus signature.
+ * @return The number of arguments described by the signature.
+ */
+static int
+l2dbus_signalEmitterCountArgs
+    (
+    const char* signature
+    )
+{
+    DBusSignatureIter sigIt;
+    int nArgs = 0;
+
+    if ( '\0' != *signature )
+    {
+        dbus_signature_iter_init(&sigIt, signature);
+        do
+        {
+            ++nArgs;
+        }
+        while ( dbus_signature_iter_next(&sigIt) );
+    }
+
+    return nArgs;
+}
+
+
+/**
+ * @brief Finds the slot of a connection in the emitter's list.
+ *
+ * @param [in] ud       The SignalEmitter userdata.
+ * @param [in] connUd   The Connection userdata.
+ * @return The slot of the connection or -1 if it's not in the list.
+ */
+static int
+l2dbus_signalEmitterFindConn
+    (
+    l2dbus_SignalEmitter*   ud,
+    l2dbus_Connection*      connUd
+    )
+{
+    unsigned idx;
+
+    for ( idx = 0; idx < ud->nConns; ++idx )
+    {
+        if ( ud->conns[idx].connUd == connUd )
+        {
+            return (int)idx;
+        }
+    }
+
+    return -1;
+}
+
+
+/**
+ @function new
+ @within l2dbus.SignalEmitter
+
+ Creates a new SignalEmitter.
+
+ @tparam string objPath The object path emitting the signal.
+ @tparam string intfName The interface name of the signal.
+ @tparam string signalName The name of the signal.
+ @tparam ?string signature The D-Bus signature of the signal's arguments.
+ Defaults to the empty signature (no arguments).
+ @treturn userdata The SignalEmitter userdata.
+ */
+static int
+l2dbus_newSignalEmitter
+    (
+    lua_State*  L
+    )
+{
+    const char* objPath = luaL_checkstring(L, 1);
+    const char* intfName = luaL_checkstring(L, 2);
+    const char* signalName = luaL_checkstring(L, 3);
+    const char* signature = luaL_optstring(L, 4, "");
+    l2dbus_SignalEmitter* ud;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    if ( !l2dbus_validatePath(objPath) )
+    {
+        luaL_argerror(L, 1, "invalid D-Bus object path");
+    }
+
+    if ( !l2dbus_validateInterface(intfName) )
+    {
+        luaL_argerror(L, 2, "invalid D-Bus interface name");
+    }
+
+    if ( !l2dbus_validateMember(signalName) )
+    {
+        luaL_argerror(L, 3, "invalid D-Bus signal name");
+    }
+
+    if ( !dbus_signature_validate(signature, NULL) )
+    {
+        luaL_argerror(L, 4, "invalid D-Bus signature");
+    }
+
+    ud = (l2dbus_SignalEmitter*)l2dbus_objectNew(L, sizeof(*ud),
+                                            L2DBUS_SIGNAL_EMITTER_TYPE_ID);
+    if ( NULL == ud )
+    {
+        luaL_error(L, "Failed to create signal emitter userdata!");
+    }
+
+    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "Create: signal emitter (userdata=%p)",
+                ud));
+
+    ud->header = dbus_message_new_signal(objPath, intfName, signalName);
+    ud->signature = l2dbus_strDup(signature);
+    if ( (NULL == ud->header) || (NULL == ud->signature) )
+    {
+        luaL_error(L, "Failed to allocate signal header");
+    }
+    ud->nArgs = l2dbus_signalEmitterCountArgs(signature);
+
+    return 1;
+}
+
+
+/**
+ * The L2DBUS SignalEmitter class.
+ * @type SignalEmitter
+ */
+
+/**
+ @function emit
+ @within SignalEmitter
+
+ Emits the signal on each connection of the emitter.
+
+ The emitter can also be called directly as a function, e.g.
+ *emitter(...)*. The number of arguments must match the signature of the
+ signal.
+
+ @tparam userdata emitter The SignalEmitter.
+ @tparam any ... The arguments of the signal.
+ @treturn bool Returns **true** if the signal is queued to be sent on every
+ connection and **false** otherwise (or if the emitter has no connections).
+ @treturn number The serial number of the last signal queued or zero (0)
+ if it cannot be queued.
+ */
+static int
+l2dbus_signalEmitterEmit
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_SignalEmitter* ud = (l2dbus_SignalEmitter*)luaL_checkudata(L, 1,
+                                        L2DBUS_SIGNAL_EMITTER_MTBL_NAME);
+    int nArgs = lua_gettop(L) - 1;
+    DBusMessage* msg;
+    DBusMessage* sendMsg;
+    dbus_uint32_t serialNum = 0;
+    l2dbus_Bool isSent;
+    unsigned idx;
+
+    if ( nArgs != ud->nArgs )
+    {
+        luaL_error(L, "signal expects %d argument(s) but %d given",
+                    ud->nArgs, nArgs);
+    }
+
+    /* A message left behind by a failed emit is released here */
+    if ( NULL != ud->scratch )
+    {
+        dbus_message_unref(ud->scratch);
+        ud->scratch = NULL;
+    }
+
+    if ( 0U == ud->nConns )
+    {
+        lua_pushboolean(L, L2DBUS_FALSE);
+        lua_pushnumber(L, serialNum);
+        return 2;
+    }
+
+    msg = dbus_message_copy(ud->header);
+    if ( NULL == msg )
+    {
+        luaL_error(L, "Failed to allocate signal message");
+    }
+
+    ud->scratch = msg;
+    if ( nArgs > 0 )
+    {
+        l2dbus_transcodeLuaArgsToDbusBySignature(L, msg, 2, nArgs,
+                                                ud->signature);
+    }
+    ud->scratch = NULL;
+
+    /* A sent message is locked so every connection but the last
+     * is given a copy of it.
+     */
+    isSent = L2DBUS_TRUE;
+    for ( idx = 0; idx < ud->nConns; ++idx )
+    {
+        sendMsg = (idx + 1 < ud->nConns) ? dbus_message_copy(msg) : msg;
+        if ( (NULL == sendMsg) || !dbus_connection_send(
+                        cdbus_connectionGetDBus(ud->conns[idx].connUd->conn),
+                        sendMsg, &serialNum) )
+        {
+            isSent = L2DBUS_FALSE;
+        }
+
+        if ( (NULL != sendMsg) && (sendMsg != msg) )
+        {
+            dbus_message_unref(sendMsg);
+        }
+    }
+    dbus_message_unref(msg);
+    ++ud->nEmitted;
+
+    lua_pushboolean(L, isSent);
+    lua_pushnumber(L, serialNum);
+
+    return 2;
+}
+
+
+/**
+ @function addConnection
+ @within SignalEmitter
+
+ Adds a connection on which the signal is emitted.
+
+ Adding a connection the emitter already has is not an error.
+
+ @tparam userdata emitter The SignalEmitter.
+ @tparam userdata conn The D-Bus connection.
+ */
+static int
+l2dbus_signalEmitterAddConnection
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_SignalEmitter* ud = (l2dbus_SignalEmitter*)luaL_checkudata(L, 1,
+                                        L2DBUS_SIGNAL_EMITTER_MTBL_NAME);
+    l2dbus_Connection* connUd = (l2dbus_Connection*)luaL_checkudata(L, 2,
+                                        L2DBUS_CONNECTION_MTBL_NAME);
+    l2dbus_EmitterConn* conns;
+    unsigned maxConns;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    if ( 0 > l2dbus_signalEmitterFindConn(ud, connUd) )
+    {
+        if ( ud->nConns == ud->maxConns )
+        {
+            maxConns = (0U == ud->maxConns) ? 2U : (2U * ud->maxConns);
+            conns = (l2dbus_EmitterConn*)l2dbus_realloc(ud->conns,
+                                            maxConns * sizeof(*conns));
+            if ( NULL == conns )
+            {
+                luaL_error(L, "Failed to grow the connection list");
+            }
+            ud->conns = conns;
+            ud->maxConns = maxConns;
+        }
+
+        lua_pushvalue(L, 2);
+        ud->conns[ud->nConns].connRef = luaL_ref(L, LUA_REGISTRYINDEX);
+        ud->conns[ud->nConns].connUd = connUd;
+        ++ud->nConns;
+    }
+
+    return 0;
+}
+
+
+/**
+ @function removeConnection
+ @within SignalEmitter
+
+ Removes a connection from the emitter.
+
+ @tparam userdata emitter The SignalEmitter.
+ @tparam userdata conn The D-Bus connection.
+ @treturn bool Returns **true** if the connection was removed and **false**
+ if the emitter didn't have it.
+ */
+static int
+l2dbus_signalEmitterRemoveConnection
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_SignalEmitter* ud = (l2dbus_SignalEmitter*)luaL_checkudata(L, 1,
+                                        L2DBUS_SIGNAL_EMITTER_MTBL_NAME);
+    l2dbus_Connection* connUd = (l2dbus_Connection*)luaL_checkudata(L, 2,
+                                        L2DBUS_CONNECTION_MTBL_NAME);
+    int slot;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    slot = l2dbus_signalEmitterFindConn(ud, connUd);
+    if ( 0 <= slot )
+    {
+        luaL_unref(L, LUA_REGISTRYINDEX, ud->conns[slot].connRef);
+        --ud->nConns;
+        /* Keep the remaining connections in the order they were added */
+        memmove(&ud->conns[slot], &ud->conns[slot + 1],
+                (ud->nConns - (unsigned)slot) * sizeof(ud->conns[0]));
+    }
+
+    lua_pushboolean(L, 0 <= slot);
+
+    return 1;
+}
+
+
+/**
+ @function clearConnections
+ @within SignalEmitter
+
+ Removes all the connections from the emitter.
+
+ @tparam userdata emitter The SignalEmitter.
+ */
+static int
+l2dbus_signalEmitterClearConnections
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_SignalEmitter* ud = (l2dbus_SignalEmitter*)luaL_checkudata(L, 1,
+                                        L2DBUS_SIGNAL_EMITTER_MTBL_NAME);
+    unsigned idx;
+
+    for ( idx = 0; idx < ud->nConns; ++idx )
+    {
+        luaL_unref(L, LUA_REGISTRYINDEX, ud->conns[idx].connRef);
+    }
+    ud->nConns = 0;
+
+    return 0;
+}
+
+
+/**
+ @function getStats
+ @within SignalEmitter
+
+ Returns the statistics of the emitter.
+
+ @tparam userdata emitter The SignalEmitter.
+ @treturn table A table with the number of signals *emitted* and the
+ number of *connections* of the emitter.
+ */
+static int
+l2dbus_signalEmitterGetStats
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_SignalEmitter* ud = (l2dbus_SignalEmitter*)luaL_checkudata(L, 1,
+                                        L2DBUS_SIGNAL_EMITTER_MTBL_NAME);
+
+    lua_createtable(L, 0, 2);
+    lua_pushnumber(L, (lua_Number)ud->nEmitted);
+    lua_setfield(L, -2, "emitted");
+    lua_pushinteger(L, (lua_Integer)ud->nConns);
+    lua_setfield(L, -2, "connections");
+
+    return 1;
+}
+
+
+/**
+ * @brief Called by Lua VM to GC/reclaim the SignalEmitter userdata.
+ *
+ * @return nil
+ */
+static int
+l2dbus_signalEmitterDispose
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_SignalEmitter* ud = (l2dbus_SignalEmitter*)luaL_checkudata(L, -1,
+                                        L2DBUS_SIGNAL_EMITTER_MTBL_NAME);
+    unsigned idx;
+
+    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "GC: signal emitter (userdata=%p)", ud));
+
+    for ( idx = 0; idx < ud->nConns; ++idx )
+    {
+        luaL_unref(L, LUA_REGISTRYINDEX, ud->conns[idx].connRef);
+    }
+    l2dbus_free(ud->conns);
+    ud->conns = NULL;
+    ud->nConns = 0;
+    ud->maxConns = 0;
+
+    if ( NULL != ud->scratch )
+    {
+        dbus_message_unref(ud->scratch);
+        ud->scratch = NULL;
+    }
+
+    if ( NULL != ud->header )
+    {
+        dbus_message_unref(ud->header);
+        ud->header = NULL;
+    }
+
+    l2dbus_free(ud->signature);
+    ud->signature = NULL;
+
+    return 0;
+}
+
+
+/*
+ * Define the methods of the SignalEmitter
+ */
+static const luaL_Reg l2dbus_signalEmitterMetaTable[] = {
+    {"emit", l2dbus_signalEmitterEmit},
+    {"addConnection", l2dbus_signalEmitterAddConnection},
+    {"removeConnection", l2dbus_signalEmitterRemoveConnection},
+    {"clearConnections", l2dbus_signalEmitterClearConnections},
+    {"getStats", l2dbus_signalEmitterGetStats},
+    {"__call", l2dbus_signalEmitterEmit},
+    {"__gc", l2dbus_signalEmitterDispose},
+    {NULL, NULL},
+};
+
+
+/**
+ * @brief "Opens" the SignalEmitter sub-module.
+ *
+ * This function creates a metatable entry for the SignalEmitter userdata
+ * and leaves a table with the constructor on the stack.
+ *
+ * @return None
+ */
+void
+l2dbus_openSignalEmitter
+    (
+    lua_State*  L
+    )
+{
+    lua_pop(L, l2dbus_createMetatable(L, L2DBUS_SIGNAL_EMITTER_TYPE_ID,
+            l2dbus_signalEmitterMetaTable));
+    lua_createtable(L, 0, 1);
+    lua_pushcfunction(L, l2dbus_newSignalEmitter);
+    lua_setfield(L, -2, "new");
+}
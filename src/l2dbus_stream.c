@@ -0,0 +1,1439 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_stream.c
+ * @author         Glenn Schmottlach
+ * @brief          Implementation of a buffered stream object.
+ *===========================================================================
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include "cdbus/cdbus.h"
+#include "l2dbus_compat.h"
+#include "l2dbus_stream.h"
+#include "l2dbus_dispatcher.h"
+#include "l2dbus_core.h"
+#include "l2dbus_object.h"
+#include "l2dbus_alloc.h"
+#include "l2dbus_util.h"
+#include "l2dbus_trace.h"
+#include "l2dbus_debug.h"
+#include "l2dbus_types.h"
+#include "lualib.h"
+
+/* Default size of the receive buffer */
+#define L2DBUS_STREAM_BUFFER_SIZE       (64U * 1024U)
+
+/* Default write queue watermarks */
+#define L2DBUS_STREAM_HIGH_WATER        (64U * 1024U)
+#define L2DBUS_STREAM_LOW_WATER         (16U * 1024U)
+
+/* Maximum number of queued chunks written by a single system call */
+#define L2DBUS_STREAM_MAX_IOV           (64)
+
+/**
+ L2DBUS Stream
+
+ This section describes a L2DBUS Stream class which performs buffered,
+ non-blocking I/O on a file descriptor (a socket, pipe, serial port, etc...)
+ driven by the @{l2dbus.Dispatcher|Dispatcher} main loop.
+
+ Received data is read into a buffer and split into frames in C. Depending
+ on the @{setFraming|framing} a frame is whatever data is available
+ (@{FRAME_RAW}), a line terminated by a delimiter (@{FRAME_LINE}), or a
+ message preceded by its big-endian length (@{FRAME_LENGTH}). Only complete
+ frames are delivered to Lua.
+
+ Data written to a Stream is queued and written when the descriptor becomes
+ writable so that multiple writes made during a main loop iteration are
+ coalesced into a single system call. Once the amount of queued data exceeds
+ the @{setWatermarks|high watermark} @{write} returns **false** and the
+ handler receives a @{EVENT_DRAIN} event after the queue has drained below
+ the low watermark.
+
+ A Stream takes ownership of its descriptor and puts it in non-blocking
+ mode. The descriptor is closed when the Stream is @{close|closed} or
+ garbage collected. While a Stream is open a *strong* reference is kept to
+ it so that it's not eligible for garbage collection.
+
+ @namespace l2dbus.Stream
+ */
+
+
+/*
+ * Returns the offset of the first occurrence of a character in the
+ * receive buffer at or after the given offset.
+ */
+static l2dbus_Bool
+l2dbus_streamBufferFind
+    (
+    const l2dbus_StreamBuffer*  buf,
+    char                        ch,
+    size_t                      from,
+    size_t*                     offset
+    )
+{
+    size_t first = buf->capacity - buf->head;
+    const char* p;
+
+    if ( first > buf->count )
+    {
+        first = buf->count;
+    }
+
+    if ( from < first )
+    {
+        p = memchr(buf->data + buf->head + from, ch, first - from);
+        if ( NULL != p )
+        {
+            *offset = (size_t)(p - (buf->data + buf->head));
+            return L2DBUS_TRUE;
+        }
+        from = first;
+    }
+
+    if ( from < buf->count )
+    {
+        p = memchr(buf->data + (from - first), ch, buf->count - from);
+        if ( NULL != p )
+        {
+            *offset = first + (size_t)(p - buf->data);
+            return L2DBUS_TRUE;
+        }
+    }
+
+    return L2DBUS_FALSE;
+}
+
+
+/*
+ * Returns the byte at the given offset of the receive buffer.
+ */
+static unsigned char
+l2dbus_streamBufferPeek
+    (
+    const l2dbus_StreamBuffer*  buf,
+    size_t                      offset
+    )
+{
+    return (unsigned char)buf->data[(buf->head + offset) % buf->capacity];
+}
+
+
+/*
+ * Pushes a string holding the given bytes of the receive buffer.
+ */
+static void
+l2dbus_streamBufferPush
+    (
+    lua_State*                  L,
+    const l2dbus_StreamBuffer*  buf,
+    size_t                      offset,
+    size_t                      len
+    )
+{
+    size_t start = (buf->head + offset) % buf->capacity;
+    size_t first = buf->capacity - start;
+
+    if ( len <= first )
+    {
+        lua_pushlstring(L, buf->data + start, len);
+    }
+    else
+    {
+        /* The frame wraps around the end of the buffer */
+        lua_pushlstring(L, buf->data + start, first);
+        lua_pushlstring(L, buf->data, len - first);
+        lua_concat(L, 2);
+    }
+}
+
+
+/*
+ * Discards bytes from the front of the receive buffer.
+ */
+static void
+l2dbus_streamBufferConsume
+    (
+    l2dbus_StreamBuffer*    buf,
+    size_t                  len
+    )
+{
+    assert( len <= buf->count );
+
+    buf->count -= len;
+    buf->head = (0U == buf->count) ? 0U : (buf->head + len) % buf->capacity;
+}
+
+
+/*
+ * Reads as much as is available (and fits) into the receive buffer.
+ * Returns zero on success, one if the end of the stream was reached,
+ * or -1 on error (with errno set).
+ */
+static int
+l2dbus_streamFill
+    (
+    l2dbus_Stream*  ud
+    )
+{
+    l2dbus_StreamBuffer* buf = &ud->rdBuf;
+    struct iovec iov[2];
+    int nIov;
+    size_t tail;
+    size_t avail;
+    ssize_t n;
+
+    while ( buf->count < buf->capacity )
+    {
+        tail = (buf->head + buf->count) % buf->capacity;
+        avail = buf->capacity - buf->count;
+
+        iov[0].iov_base = buf->data + tail;
+        nIov = 1;
+        if ( tail + avail <= buf->capacity )
+        {
+            iov[0].iov_len = avail;
+        }
+        else
+        {
+            iov[0].iov_len = buf->capacity - tail;
+            iov[1].iov_base = buf->data;
+            iov[1].iov_len = avail - iov[0].iov_len;
+            nIov = 2;
+        }
+
+        n = readv(ud->fd, iov, nIov);
+        if ( 0 < n )
+        {
+            buf->count += (size_t)n;
+
+            /* A short read means the descriptor has been drained */
+            if ( (size_t)n < avail )
+            {
+                break;
+            }
+        }
+        else if ( 0 == n )
+        {
+            return 1;
+        }
+        else if ( EINTR != errno )
+        {
+            if ( (EAGAIN == errno) || (EWOULDBLOCK == errno) )
+            {
+                break;
+            }
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/*
+ * Determines whether a complete frame is available in the receive buffer.
+ * On return *skip is the length of the frame header, *len the length of
+ * the frame payload, and *consumed the number of bytes making up the frame.
+ * Returns -1 if a frame can never fit into the receive buffer.
+ */
+static int
+l2dbus_streamNextFrame
+    (
+    l2dbus_Stream*  ud,
+    size_t*         skip,
+    size_t*         len,
+    size_t*         consumed
+    )
+{
+    l2dbus_StreamBuffer* buf = &ud->rdBuf;
+    size_t offset;
+    unsigned idx;
+
+    *skip = 0U;
+
+    if ( 0U == buf->count )
+    {
+        return 0;
+    }
+
+    switch ( ud->framing )
+    {
+        case L2DBUS_STREAM_FRAME_LINE:
+            if ( l2dbus_streamBufferFind(buf, ud->delimiter, ud->rdScanned,
+                                        &offset) )
+            {
+                *len = offset;
+                *consumed = offset + 1U;
+                ud->rdScanned = 0U;
+                return 1;
+            }
+            ud->rdScanned = buf->count;
+            return (buf->count == buf->capacity) ? -1 : 0;
+
+        case L2DBUS_STREAM_FRAME_LENGTH:
+            if ( buf->count < ud->prefixSize )
+            {
+                return 0;
+            }
+            *len = 0U;
+            for ( idx = 0U; idx < ud->prefixSize; ++idx )
+            {
+                *len = (*len << 8) | l2dbus_streamBufferPeek(buf, idx);
+            }
+            if ( ud->prefixSize + *len > buf->capacity )
+            {
+                return -1;
+            }
+            if ( buf->count < ud->prefixSize + *len )
+            {
+                return 0;
+            }
+            *skip = ud->prefixSize;
+            *consumed = ud->prefixSize + *len;
+            return 1;
+
+        default:
+            *len = buf->count;
+            *consumed = buf->count;
+            return 1;
+    }
+}
+
+
+/*
+ * Calls the stream handler. The Stream userdata is at the (absolute)
+ * index udIdx and the (optional) event data at dataIdx.
+ */
+static void
+l2dbus_streamNotify
+    (
+    lua_State*      L,
+    l2dbus_Stream*  ud,
+    int             udIdx,
+    int             event,
+    int             dataIdx
+    )
+{
+    int top = lua_gettop(L);
+
+    lua_pushvalue(L, udIdx);
+    lua_pushinteger(L, event);
+    if ( 0 != dataIdx )
+    {
+        lua_pushvalue(L, dataIdx);
+    }
+    else
+    {
+        lua_pushnil(L);
+    }
+    l2dbus_callbackInvoke(L, &ud->cbCtx, 3 /* nArgs */, 0, "Stream");
+
+    lua_settop(L, top);
+}
+
+
+/*
+ * Watches the events the stream is currently interested in.
+ */
+static void
+l2dbus_streamUpdateWatch
+    (
+    l2dbus_Stream*  ud
+    )
+{
+    unsigned flags = 0U;
+
+    if ( NULL == ud->watch )
+    {
+        return;
+    }
+
+    if ( !ud->rdPaused && !ud->eof )
+    {
+        flags |= DBUS_WATCH_READABLE;
+    }
+
+    if ( 0U < ud->chunkCount )
+    {
+        flags |= DBUS_WATCH_WRITABLE;
+    }
+
+    if ( flags != ud->watchFlags )
+    {
+        if ( 0U == flags )
+        {
+            cdbus_watchEnable(ud->watch, CDBUS_FALSE);
+        }
+        else
+        {
+            cdbus_watchSetFlags(ud->watch, flags);
+            cdbus_watchEnable(ud->watch, CDBUS_TRUE);
+        }
+        ud->watchFlags = flags;
+    }
+}
+
+
+/*
+ * Closes the stream: the descriptor is closed, all buffered data is
+ * discarded, and the stream is no longer anchored.
+ */
+static void
+l2dbus_streamRelease
+    (
+    lua_State*      L,
+    l2dbus_Stream*  ud
+    )
+{
+    if ( NULL != ud->watch )
+    {
+        cdbus_watchEnable(ud->watch, CDBUS_FALSE);
+        cdbus_watchUnref(ud->watch);
+        ud->watch = NULL;
+        ud->watchFlags = 0U;
+    }
+
+    if ( 0 <= ud->fd )
+    {
+        close(ud->fd);
+        ud->fd = -1;
+    }
+
+    while ( 0U < ud->chunkCount )
+    {
+        luaL_unref(L, LUA_REGISTRYINDEX, ud->chunks[ud->chunkHead].ref);
+        ud->chunkHead = (ud->chunkHead + 1U) % ud->chunkCapacity;
+        --ud->chunkCount;
+    }
+    l2dbus_free(ud->chunks);
+    ud->chunks = NULL;
+    ud->chunkCapacity = 0U;
+    ud->chunkHead = 0U;
+    ud->wrOffset = 0U;
+    ud->wrQueued = 0U;
+
+    l2dbus_free(ud->rdBuf.data);
+    ud->rdBuf.data = NULL;
+    ud->rdBuf.count = 0U;
+    ud->rdBuf.head = 0U;
+
+    luaL_unref(L, LUA_REGISTRYINDEX, ud->streamUdRef);
+    ud->streamUdRef = LUA_NOREF;
+}
+
+
+/*
+ * Reports an error to the handler and closes the stream.
+ */
+static void
+l2dbus_streamFail
+    (
+    lua_State*      L,
+    l2dbus_Stream*  ud,
+    int             udIdx,
+    const char*     errMsg
+    )
+{
+    L2DBUS_TRACE((L2DBUS_TRC_WARN, "Stream (fd=%d) error: %s", ud->fd, errMsg));
+
+    lua_pushstring(L, errMsg);
+    l2dbus_streamNotify(L, ud, udIdx, L2DBUS_STREAM_EVENT_ERROR,
+                        lua_gettop(L));
+    lua_pop(L, 1);
+    l2dbus_streamRelease(L, ud);
+}
+
+
+/*
+ * Writes as much of the queued data as possible.
+ */
+static void
+l2dbus_streamFlush
+    (
+    lua_State*      L,
+    l2dbus_Stream*  ud,
+    int             udIdx
+    )
+{
+    struct iovec iov[L2DBUS_STREAM_MAX_IOV];
+    l2dbus_StreamChunk* chunk;
+    unsigned idx;
+    int nIov;
+    size_t total;
+    size_t rem;
+    ssize_t written;
+    ssize_t n;
+
+    while ( 0U < ud->chunkCount )
+    {
+        total = 0U;
+        for ( nIov = 0; (nIov < L2DBUS_STREAM_MAX_IOV) &&
+                ((unsigned)nIov < ud->chunkCount); ++nIov )
+        {
+            idx = (ud->chunkHead + (unsigned)nIov) % ud->chunkCapacity;
+            chunk = &ud->chunks[idx];
+            iov[nIov].iov_base = (void*)(chunk->data);
+            iov[nIov].iov_len = chunk->len;
+            if ( 0 == nIov )
+            {
+                iov[nIov].iov_base = (char*)iov[nIov].iov_base + ud->wrOffset;
+                iov[nIov].iov_len -= ud->wrOffset;
+            }
+            total += iov[nIov].iov_len;
+        }
+
+        n = writev(ud->fd, iov, nIov);
+        if ( 0 > n )
+        {
+            if ( EINTR == errno )
+            {
+                continue;
+            }
+            if ( (EAGAIN != errno) && (EWOULDBLOCK != errno) )
+            {
+                l2dbus_streamFail(L, ud, udIdx, strerror(errno));
+                return;
+            }
+            break;
+        }
+
+        written = n;
+        ud->wrQueued -= (size_t)n;
+        while ( 0 < n )
+        {
+            chunk = &ud->chunks[ud->chunkHead];
+            rem = chunk->len - ud->wrOffset;
+            if ( (size_t)n < rem )
+            {
+                ud->wrOffset += (size_t)n;
+                break;
+            }
+
+            n -= (ssize_t)rem;
+            luaL_unref(L, LUA_REGISTRYINDEX, chunk->ref);
+            ud->chunkHead = (ud->chunkHead + 1U) % ud->chunkCapacity;
+            --ud->chunkCount;
+            ud->wrOffset = 0U;
+        }
+
+        /* A short write means the descriptor can't take any more */
+        if ( (size_t)written < total )
+        {
+            break;
+        }
+    }
+
+    if ( ud->wrBlocked && (ud->wrQueued <= ud->lowWater) )
+    {
+        ud->wrBlocked = L2DBUS_FALSE;
+        l2dbus_streamNotify(L, ud, udIdx, L2DBUS_STREAM_EVENT_DRAIN, 0);
+    }
+}
+
+
+/*
+ * Reads from the descriptor and delivers any complete frames.
+ */
+static void
+l2dbus_streamReceive
+    (
+    lua_State*      L,
+    l2dbus_Stream*  ud,
+    int             udIdx
+    )
+{
+    size_t skip;
+    size_t len;
+    size_t consumed;
+    int rc = 0;
+    int status;
+
+    status = l2dbus_streamFill(ud);
+    if ( 0 > status )
+    {
+        l2dbus_streamFail(L, ud, udIdx, strerror(errno));
+        return;
+    }
+
+    /* The handler may close the stream or change the framing */
+    while ( (NULL != ud->watch) &&
+        (0 < (rc = l2dbus_streamNextFrame(ud, &skip, &len, &consumed))) )
+    {
+        l2dbus_streamBufferPush(L, &ud->rdBuf, skip, len);
+        l2dbus_streamBufferConsume(&ud->rdBuf, consumed);
+        l2dbus_streamNotify(L, ud, udIdx, L2DBUS_STREAM_EVENT_DATA,
+                            lua_gettop(L));
+        lua_pop(L, 1);
+    }
+
+    if ( NULL == ud->watch )
+    {
+        return;
+    }
+
+    if ( 0 > rc )
+    {
+        l2dbus_streamFail(L, ud, udIdx, "frame exceeds the receive buffer");
+    }
+    else if ( 0 < status )
+    {
+        ud->eof = L2DBUS_TRUE;
+
+        /* An unterminated last line is still delivered */
+        if ( (L2DBUS_STREAM_FRAME_LINE == ud->framing) &&
+            (0U < ud->rdBuf.count) )
+        {
+            len = ud->rdBuf.count;
+            l2dbus_streamBufferPush(L, &ud->rdBuf, 0U, len);
+            l2dbus_streamBufferConsume(&ud->rdBuf, len);
+            ud->rdScanned = 0U;
+            l2dbus_streamNotify(L, ud, udIdx, L2DBUS_STREAM_EVENT_DATA,
+                                lua_gettop(L));
+            lua_pop(L, 1);
+        }
+
+        if ( NULL != ud->watch )
+        {
+            l2dbus_streamNotify(L, ud, udIdx, L2DBUS_STREAM_EVENT_EOF, 0);
+        }
+    }
+}
+
+
+/**
+ * @brief Processes descriptor events from the underlying CDBUS watch.
+ *
+ * @param [in] w            CDBUS Watch instance.
+ * @param [in] rcvEvents    The bitmask of signaled events.
+ * @param [in] user         The Stream userdata.
+ * @return A boolean value that is ignored by CDBUS.
+ */
+static cdbus_Bool
+l2dbus_streamHandler
+    (
+    cdbus_Watch*    w,
+    cdbus_UInt32    rcvEvents,
+    void*           user
+    )
+{
+    /* The callback thread is resolved from the context of the Lua state
+     * that owns the stream.
+     */
+    const l2dbus_CallbackCtx* cbCtx = &((l2dbus_Stream*)user)->cbCtx;
+    int base;
+    lua_State* L = l2dbus_callbackBegin(cbCtx, &base);
+    l2dbus_Stream* ud = l2dbus_callbackPushObject(L, cbCtx, user);
+    int udIdx = lua_gettop(L);
+
+    assert( NULL != w );
+    assert( NULL != L );
+
+    /* If the stream userdata has been GC'ed then ... */
+    if ( NULL == ud )
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_WARN,
+            "Cannot call handler because the stream has been GC'ed"));
+    }
+    else
+    {
+        if ( 0U != (rcvEvents & DBUS_WATCH_WRITABLE) )
+        {
+            l2dbus_streamFlush(L, ud, udIdx);
+        }
+
+        if ( (NULL != ud->watch) && !ud->rdPaused && !ud->eof &&
+            (0U != (rcvEvents & (DBUS_WATCH_READABLE | DBUS_WATCH_HANGUP |
+                                DBUS_WATCH_ERROR))) )
+        {
+            l2dbus_streamReceive(L, ud, udIdx);
+        }
+
+        l2dbus_streamUpdateWatch(ud);
+    }
+
+    /* Clean up the thread stack */
+    l2dbus_callbackEnd(L, base);
+
+    /* The return value is unused by CDBUS */
+    return CDBUS_TRUE;
+}
+
+
+/**
+ @function new
+
+ Creates a new Stream.
+
+ Creates a new Stream that immediately starts reading from the provided
+ file descriptor. The Stream handler has a signature of the form:
+
+    function onStream(stream, event, data, userToken)
+
+ Where:
+
+ <ul>
+ <li>*stream*       - The L2DBUS Stream instance</li>
+ <li>*event*        - One of @{EVENT_DATA}, @{EVENT_DRAIN}, @{EVENT_EOF},
+ or @{EVENT_ERROR}</li>
+ <li>*data*         - The received frame for @{EVENT_DATA}, an error message
+ for @{EVENT_ERROR}, and **nil** otherwise</li>
+ <li>*userToken*    - A value specified by the client when the stream is created.</li>
+ </ul>
+
+ After an @{EVENT_ERROR} the Stream is closed. After an @{EVENT_EOF}
+ nothing more is read but queued data is still written. The
+ application should @{close} the Stream when it's done with it.
+
+ @tparam userdata dispatcher The @{l2dbus.Dispatcher|dispatcher} with which
+ to associate the Stream.
+ @tparam number|userdata fd The file descriptor to stream. This can be either
+ a Lua file (whose descriptor is duplicated) or a raw file descriptor. The
+ Stream owns the descriptor which is closed along with the Stream or if
+ the Stream cannot be created.
+ @tparam func handler The stream handler.
+ @tparam ?any userToken User data that will be passed to the Stream
+ handler when it's called. Can be any Lua value.
+ @treturn userdata The userdata object representing the Stream.
+ */
+int
+l2dbus_newStream
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Stream* streamUd;
+    l2dbus_Dispatcher* dispUd;
+    int nArgs;
+    int fd = -1;
+    int flags;
+    int errNum;
+    FILE* fp;
+    int userIdx = L2DBUS_CALLBACK_NOREF_NEEDED;
+
+    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "Create: stream"));
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    /* See how many arguments were passed in */
+    nArgs = lua_gettop(L);
+
+    if ( nArgs < 3 )
+    {
+        luaL_error(L, "Insufficient number of parameters");
+    }
+
+    dispUd = (l2dbus_Dispatcher*)luaL_checkudata(L, 1,
+                                L2DBUS_DISPATCHER_MTBL_NAME);
+
+    /* Check for a handler function */
+    luaL_checktype(L, 3, LUA_TFUNCTION);
+
+    /* See if an optional user value is provided */
+    if ( nArgs >= 4 )
+    {
+        userIdx = 4;
+    }
+
+    /* Parse the file/descriptor */
+    if ( (LUA_TUSERDATA == lua_type(L, 2)) &&
+        luaL_checkudata(L, 2, LUA_FILEHANDLE) )
+    {
+        fp = *(FILE**)luaL_checkudata(L, 2, LUA_FILEHANDLE);
+        fd = dup(fileno(fp));
+        if ( 0 > fd )
+        {
+            luaL_error(L, "Failed to duplicate the file descriptor: %s",
+                        strerror(errno));
+        }
+    }
+    else if ( LUA_TNUMBER == lua_type(L, 2) )
+    {
+        fd = lua_tointeger(L, 2);
+    }
+    else
+    {
+        luaL_error(L, "bad argument #2 - expected file object or stream descriptor");
+    }
+
+    /* From here on the descriptor belongs to the stream and must be
+     * closed if the stream can't be created.
+     */
+    flags = fcntl(fd, F_GETFL, 0);
+    if ( (0 > flags) || (0 > fcntl(fd, F_SETFL, flags | O_NONBLOCK)) )
+    {
+        errNum = errno;
+        close(fd);
+        luaL_error(L, "Cannot make the descriptor non-blocking: %s",
+                    strerror(errNum));
+    }
+
+    streamUd = (l2dbus_Stream*)l2dbus_objectNew(L, sizeof(*streamUd),
+                                                L2DBUS_STREAM_TYPE_ID);
+    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "Stream userdata=%p", streamUd));
+
+    if ( NULL == streamUd )
+    {
+        close(fd);
+        luaL_error(L, "Failed to create stream userdata!");
+    }
+    else
+    {
+        /* Reset the userdata structure */
+        l2dbus_callbackInit(L, &streamUd->cbCtx);
+        streamUd->fd = fd;
+        streamUd->dispUdRef = LUA_NOREF;
+        streamUd->streamUdRef = LUA_NOREF;
+        streamUd->framing = L2DBUS_STREAM_FRAME_RAW;
+        streamUd->prefixSize = 4U;
+        streamUd->delimiter = '\n';
+        streamUd->highWater = L2DBUS_STREAM_HIGH_WATER;
+        streamUd->lowWater = L2DBUS_STREAM_LOW_WATER;
+
+        streamUd->rdBuf.capacity = L2DBUS_STREAM_BUFFER_SIZE;
+        streamUd->rdBuf.data = (char*)l2dbus_malloc(streamUd->rdBuf.capacity);
+        if ( NULL == streamUd->rdBuf.data )
+        {
+            l2dbus_streamRelease(L, streamUd);
+            luaL_error(L, "Failed to allocate Stream buffer");
+        }
+
+        l2dbus_callbackRef(L, 3 /* func */, userIdx, &streamUd->cbCtx);
+        streamUd->watch = cdbus_watchNew(dispUd->disp, fd, DBUS_WATCH_READABLE,
+                                        l2dbus_streamHandler, streamUd);
+        if ( NULL == streamUd->watch )
+        {
+            l2dbus_streamRelease(L, streamUd);
+            luaL_error(L, "Failed to allocate Stream watch");
+        }
+
+        /* Add a reference to the Dispatcher userdata */
+        lua_pushvalue(L, 1 /* dispUd */);
+        streamUd->dispUdRef = luaL_ref(L, LUA_REGISTRYINDEX);
+
+        /* Create a weak reference to the Stream user data */
+        l2dbus_objectRegistryAdd(L, streamUd, -1);
+
+        /* An open stream is anchored until it's closed */
+        lua_pushvalue(L, -1);
+        streamUd->streamUdRef = luaL_ref(L, LUA_REGISTRYINDEX);
+        l2dbus_streamUpdateWatch(streamUd);
+    }
+
+    return 1;
+}
+
+
+/**
+ * @brief Called by Lua VM to GC/reclaim the Stream userdata.
+ *
+ * This method is called by the Lua VM to reclaim the Stream userdata.
+ *
+ * @return nil
+ *
+ */
+static int
+l2dbus_streamDispose
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Stream* ud = (l2dbus_Stream*)luaL_checkudata(L, -1,
+                                        L2DBUS_STREAM_MTBL_NAME);
+
+    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "GC: stream (userdata=%p)", ud));
+
+    l2dbus_streamRelease(L, ud);
+
+    /* Drop the weak reference to the userdata */
+    l2dbus_objectRegistryRemove(L, ud);
+
+    /* We no longer need to anchor the dispatcher */
+    luaL_unref(L, LUA_REGISTRYINDEX, ud->dispUdRef);
+
+    /* Unreference the function/data associated with a callback */
+    l2dbus_callbackUnref(L, &ud->cbCtx);
+
+    return 0;
+}
+
+
+/*
+ * Returns the Stream at the first argument and raises an error if it's closed.
+ */
+static l2dbus_Stream*
+l2dbus_streamCheckOpen
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Stream* ud = (l2dbus_Stream*)luaL_checkudata(L, 1,
+                                        L2DBUS_STREAM_MTBL_NAME);
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    if ( NULL == ud->watch )
+    {
+        luaL_error(L, "Stream is closed");
+    }
+
+    return ud;
+}
+
+
+/**
+ * The L2DBUS Stream class.
+ * @type Stream
+ */
+
+/**
+ @function write
+ @within Stream
+
+ Queues data to be written to the stream.
+
+ The data is written once the descriptor becomes writable. Data queued
+ during the same main loop iteration is written with a single system call.
+
+ @tparam userdata stream The stream to write to.
+ @tparam string data The data to write.
+ @treturn bool Returns **true** if more data can be written or **false**
+ if the amount of queued data has reached the high watermark. In the
+ latter case the handler will receive @{EVENT_DRAIN} once the queue has
+ drained below the low watermark.
+ */
+static int
+l2dbus_streamWrite
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Stream* ud = l2dbus_streamCheckOpen(L);
+    l2dbus_StreamChunk* chunks;
+    l2dbus_StreamChunk* chunk;
+    unsigned capacity;
+    unsigned idx;
+    size_t len;
+    const char* data = luaL_checklstring(L, 2, &len);
+
+    if ( 0U < len )
+    {
+        /* Grow the chunk ring as necessary (unwrapping it) */
+        if ( ud->chunkCount == ud->chunkCapacity )
+        {
+            capacity = (0U == ud->chunkCapacity) ? 16U : ud->chunkCapacity * 2U;
+            chunks = (l2dbus_StreamChunk*)l2dbus_malloc(
+                                            capacity * sizeof(*chunks));
+            if ( NULL == chunks )
+            {
+                luaL_error(L, "Failed to grow the Stream write queue");
+            }
+            for ( idx = 0U; idx < ud->chunkCount; ++idx )
+            {
+                chunks[idx] = ud->chunks[(ud->chunkHead + idx) %
+                                            ud->chunkCapacity];
+            }
+            l2dbus_free(ud->chunks);
+            ud->chunks = chunks;
+            ud->chunkCapacity = capacity;
+            ud->chunkHead = 0U;
+        }
+
+        chunk = &ud->chunks[(ud->chunkHead + ud->chunkCount) %
+                            ud->chunkCapacity];
+        /* The reference keeps the string (and its data) alive */
+        lua_pushvalue(L, 2);
+        chunk->ref = luaL_ref(L, LUA_REGISTRYINDEX);
+        chunk->data = data;
+        chunk->len = len;
+        ++ud->chunkCount;
+        ud->wrQueued += len;
+
+        l2dbus_streamUpdateWatch(ud);
+
+        if ( ud->wrQueued >= ud->highWater )
+        {
+            ud->wrBlocked = L2DBUS_TRUE;
+        }
+    }
+
+    lua_pushboolean(L, !ud->wrBlocked);
+    return 1;
+}
+
+
+/**
+ @function close
+ @within Stream
+
+ Closes the stream and its descriptor.
+
+ Any data that is still queued for writing is discarded. Closing a stream
+ that's already closed has no effect.
+
+ @tparam userdata stream The stream to close.
+ */
+static int
+l2dbus_streamClose
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Stream* ud = (l2dbus_Stream*)luaL_checkudata(L, 1,
+                                        L2DBUS_STREAM_MTBL_NAME);
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    l2dbus_streamRelease(L, ud);
+
+    return 0;
+}
+
+
+/**
+ @function isOpen
+ @within Stream
+
+ Returns whether the stream is open.
+
+ @tparam userdata stream The stream.
+ @treturn bool Returns **true** if the stream is open.
+ */
+static int
+l2dbus_streamIsOpen
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Stream* ud = (l2dbus_Stream*)luaL_checkudata(L, 1,
+                                        L2DBUS_STREAM_MTBL_NAME);
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    lua_pushboolean(L, NULL != ud->watch);
+    return 1;
+}
+
+
+/**
+ @function setReadEnable
+ @within Stream
+
+ Pauses or resumes reading from the stream.
+
+ While reading is paused no data is read from the descriptor which, for
+ sockets and pipes, eventually applies backpressure to the sender. Frames
+ that have already been received are still delivered.
+
+ @tparam userdata stream The stream.
+ @tparam bool option Set to **true** to read from the stream or **false**
+ to pause reading.
+ */
+static int
+l2dbus_streamSetReadEnable
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Stream* ud = l2dbus_streamCheckOpen(L);
+
+    luaL_checktype(L, 2, LUA_TBOOLEAN);
+    ud->rdPaused = !lua_toboolean(L, 2);
+    l2dbus_streamUpdateWatch(ud);
+
+    return 0;
+}
+
+
+/**
+ @function setFraming
+ @within Stream
+
+ Sets how received data is split into frames.
+
+ With @{FRAME_RAW} (the default) all the data that has been received is
+ delivered as a single frame. With @{FRAME_LINE} each frame is a line
+ terminated by a delimiter which is not included in the frame. With
+ @{FRAME_LENGTH} each frame is preceded by its length as a big-endian
+ unsigned integer which is not included in the frame. A frame must fit
+ into the receive buffer.
+
+ @tparam userdata stream The stream.
+ @tparam number framing One of @{FRAME_RAW}, @{FRAME_LINE}, or
+ @{FRAME_LENGTH}.
+ @tparam ?string|number option For @{FRAME_LINE} the (single character)
+ delimiter which defaults to a newline. For @{FRAME_LENGTH} the size (1, 2,
+ or 4 bytes) of the length prefix which defaults to 4.
+ */
+static int
+l2dbus_streamSetFraming
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Stream* ud = (l2dbus_Stream*)luaL_checkudata(L, 1,
+                                        L2DBUS_STREAM_MTBL_NAME);
+    lua_Integer framing = luaL_checkinteger(L, 2);
+    lua_Integer prefixSize;
+    const char* delimiter;
+    size_t len;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    switch ( framing )
+    {
+        case L2DBUS_STREAM_FRAME_RAW:
+            break;
+
+        case L2DBUS_STREAM_FRAME_LINE:
+            delimiter = luaL_optlstring(L, 3, "\n", &len);
+            luaL_argcheck(L, 1U == len, 3, "delimiter must be one character");
+            ud->delimiter = delimiter[0];
+            break;
+
+        case L2DBUS_STREAM_FRAME_LENGTH:
+            prefixSize = luaL_optinteger(L, 3, 4);
+            luaL_argcheck(L, (1 == prefixSize) || (2 == prefixSize) ||
+                        (4 == prefixSize), 3, "prefix size must be 1, 2, or 4");
+            ud->prefixSize = (unsigned)prefixSize;
+            break;
+
+        default:
+            luaL_argerror(L, 2, "invalid framing");
+            break;
+    }
+
+    ud->framing = (int)framing;
+    ud->rdScanned = 0U;
+
+    return 0;
+}
+
+
+/**
+ @function setWatermarks
+ @within Stream
+
+ Sets the write queue watermarks.
+
+ @tparam userdata stream The stream.
+ @tparam number high Once this many bytes are queued @{write} returns
+ **false**.
+ @tparam number low The number of queued bytes below which a blocked
+ writer is notified with @{EVENT_DRAIN}.
+ */
+static int
+l2dbus_streamSetWatermarks
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Stream* ud = (l2dbus_Stream*)luaL_checkudata(L, 1,
+                                        L2DBUS_STREAM_MTBL_NAME);
+    lua_Integer high = luaL_checkinteger(L, 2);
+    lua_Integer low = luaL_checkinteger(L, 3);
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    luaL_argcheck(L, high > 0, 2, "high watermark must be positive");
+    luaL_argcheck(L, (low >= 0) && (low < high), 3,
+                "low watermark must be below the high watermark");
+
+    ud->highWater = (size_t)high;
+    ud->lowWater = (size_t)low;
+
+    return 0;
+}
+
+
+/**
+ @function setReadBufferSize
+ @within Stream
+
+ Sets the size of the receive buffer.
+
+ The receive buffer limits the size of a frame and the amount of data
+ read from the descriptor at once. It defaults to 64 KiB.
+
+ @tparam userdata stream The stream.
+ @tparam number size The size (in bytes) of the receive buffer. It cannot
+ be smaller than the data currently buffered.
+ */
+static int
+l2dbus_streamSetReadBufferSize
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Stream* ud = l2dbus_streamCheckOpen(L);
+    lua_Integer size = luaL_checkinteger(L, 2);
+    l2dbus_StreamBuffer* buf = &ud->rdBuf;
+    char* data;
+    size_t first;
+
+    luaL_argcheck(L, (size > 0) && ((size_t)size >= buf->count), 2,
+                "size must be positive and fit the buffered data");
+
+    data = (char*)l2dbus_malloc((size_t)size);
+    if ( NULL == data )
+    {
+        luaL_error(L, "Failed to allocate Stream buffer");
+    }
+
+    /* Unwrap the buffered data */
+    first = buf->capacity - buf->head;
+    if ( first > buf->count )
+    {
+        first = buf->count;
+    }
+    memcpy(data, buf->data + buf->head, first);
+    memcpy(data + first, buf->data, buf->count - first);
+
+    l2dbus_free(buf->data);
+    buf->data = data;
+    buf->capacity = (size_t)size;
+    buf->head = 0U;
+
+    return 0;
+}
+
+
+/**
+ @function getWriteQueueSize
+ @within Stream
+
+ Returns the number of bytes queued for writing.
+
+ @tparam userdata stream The stream.
+ @treturn number The number of bytes waiting to be written.
+ */
+static int
+l2dbus_streamGetWriteQueueSize
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Stream* ud = (l2dbus_Stream*)luaL_checkudata(L, 1,
+                                        L2DBUS_STREAM_MTBL_NAME);
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    lua_pushinteger(L, (lua_Integer)ud->wrQueued);
+    return 1;
+}
+
+
+/**
+ @function getDescriptor
+ @within Stream
+
+ Returns the underlying file descriptor of the stream.
+
+ @tparam userdata stream The stream.
+ @treturn number The file descriptor or -1 if the stream is closed.
+ */
+static int
+l2dbus_streamGetDescriptor
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Stream* ud = (l2dbus_Stream*)luaL_checkudata(L, 1,
+                                        L2DBUS_STREAM_MTBL_NAME);
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    lua_pushinteger(L, ud->fd);
+    return 1;
+}
+
+
+/**
+ @function data
+ @within Stream
+
+ Returns the user specified data associated with the stream.
+
+ @tparam userdata stream The stream to get the user data.
+ @treturn any Returns the user data associated with the stream.
+ */
+static int
+l2dbus_streamData
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Stream* ud = (l2dbus_Stream*)luaL_checkudata(L, 1,
+                                        L2DBUS_STREAM_MTBL_NAME);
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ud->cbCtx.userRef);
+    return 1;
+}
+
+
+/**
+ @function setData
+ @within Stream
+
+ Sets the user specific data passed to the stream handler.
+
+ @tparam userdata stream The stream to set the user data.
+ @tparam any userToken The user specific data to associate with the stream.
+ */
+static int
+l2dbus_streamSetData
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Stream* ud = (l2dbus_Stream*)luaL_checkudata(L, 1,
+                                        L2DBUS_STREAM_MTBL_NAME);
+    /* Any value is acceptable - but it should be specified */
+    luaL_checkany(L, 2);
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    /* Unreference the previous value */
+    luaL_unref(L, LUA_REGISTRYINDEX, ud->cbCtx.userRef);
+
+    /* On the top of the stack should be the client's user data value.
+     * We'll keep a reference to that for safe-keeping.
+     */
+    ud->cbCtx.userRef = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    return 0;
+}
+
+
+/*
+ * Define the methods of the Stream class
+ */
+static const luaL_Reg l2dbus_streamMetaTable[] = {
+    {"write", l2dbus_streamWrite},
+    {"close", l2dbus_streamClose},
+    {"isOpen", l2dbus_streamIsOpen},
+    {"setReadEnable", l2dbus_streamSetReadEnable},
+    {"setFraming", l2dbus_streamSetFraming},
+    {"setWatermarks", l2dbus_streamSetWatermarks},
+    {"setReadBufferSize", l2dbus_streamSetReadBufferSize},
+    {"getWriteQueueSize", l2dbus_streamGetWriteQueueSize},
+    {"getDescriptor", l2dbus_streamGetDescriptor},
+    {"data", l2dbus_streamData},
+    {"setData", l2dbus_streamSetData},
+    {"__gc", l2dbus_streamDispose},
+    {NULL, NULL},
+};
+
+
+/**
+ * @brief Creates the Stream sub-module.
+ *
+ * This function creates a metatable entry for the Stream userdata
+ * and simulates opening the Stream sub-module.
+ *
+ * @return A table defining the Stream sub-module.
+ */
+void
+l2dbus_openStream
+    (
+    lua_State*  L
+    )
+{
+    lua_pop(L, l2dbus_createMetatable(L, L2DBUS_STREAM_TYPE_ID,
+            l2dbus_streamMetaTable));
+    lua_newtable(L);
+    lua_pushcfunction(L, l2dbus_newStream);
+    lua_setfield(L, -2, "new");
+
+/**
+ @constant FRAME_RAW
+ Received data is delivered as it arrives.
+ */
+    lua_pushinteger(L, L2DBUS_STREAM_FRAME_RAW);
+    lua_setfield(L, -2, "FRAME_RAW");
+
+/**
+ @constant FRAME_LINE
+ Received data is delivered one (delimited) line at a time.
+ */
+    lua_pushinteger(L, L2DBUS_STREAM_FRAME_LINE);
+    lua_setfield(L, -2, "FRAME_LINE");
+
+/**
+ @constant FRAME_LENGTH
+ Received data is delivered one length-prefixed frame at a time.
+ */
+    lua_pushinteger(L, L2DBUS_STREAM_FRAME_LENGTH);
+    lua_setfield(L, -2, "FRAME_LENGTH");
+
+/**
+ @constant EVENT_DATA
+ A frame has been received.
+ */
+    lua_pushinteger(L, L2DBUS_STREAM_EVENT_DATA);
+    lua_setfield(L, -2, "EVENT_DATA");
+
+/**
+ @constant EVENT_DRAIN
+ The write queue has drained below the low watermark.
+ */
+    lua_pushinteger(L, L2DBUS_STREAM_EVENT_DRAIN);
+    lua_setfield(L, -2, "EVENT_DRAIN");
+
+/**
+ @constant EVENT_EOF
+ The end of the stream has been reached.
+ */
+    lua_pushinteger(L, L2DBUS_STREAM_EVENT_EOF);
+    lua_setfield(L, -2, "EVENT_EOF");
+
+/**
+ @constant EVENT_ERROR
+ An I/O error occurred and the stream has been closed.
+ */
+    lua_pushinteger(L, L2DBUS_STREAM_EVENT_ERROR);
+    lua_setfield(L, -2, "EVENT_ERROR");
+}
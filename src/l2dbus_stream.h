@@ -0,0 +1,115 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_stream.h
+ * @author         Glenn Schmottlach
+ * @brief          Definition of a buffered stream object.
+ *===========================================================================
+ */
+
+#ifndef L2DBUS_STREAM_H_
+#define L2DBUS_STREAM_H_
+
+#include <stddef.h>
+#include "lua.h"
+#include "l2dbus_types.h"
+#include "l2dbus_callback.h"
+
+/* Forward declarations */
+struct cdbus_Watch;
+
+/* How received data is split into frames */
+typedef enum
+{
+    L2DBUS_STREAM_FRAME_RAW = 0,
+    L2DBUS_STREAM_FRAME_LINE,
+    L2DBUS_STREAM_FRAME_LENGTH
+} l2dbus_StreamFraming;
+
+/* Events delivered to the stream handler */
+typedef enum
+{
+    L2DBUS_STREAM_EVENT_DATA = 0,
+    L2DBUS_STREAM_EVENT_DRAIN,
+    L2DBUS_STREAM_EVENT_EOF,
+    L2DBUS_STREAM_EVENT_ERROR
+} l2dbus_StreamEvent;
+
+/* Ring buffer of received bytes */
+typedef struct l2dbus_StreamBuffer
+{
+    char*   data;
+    size_t  capacity;
+    size_t  head;
+    size_t  count;
+} l2dbus_StreamBuffer;
+
+/* A (Lua) string queued for writing */
+typedef struct l2dbus_StreamChunk
+{
+    const char* data;
+    size_t      len;
+    int         ref;
+} l2dbus_StreamChunk;
+
+typedef struct l2dbus_Stream
+{
+    struct cdbus_Watch*     watch;
+    /* The events currently watched (zero if the watch is disabled) */
+    unsigned                watchFlags;
+    int                     fd;
+    int                     dispUdRef;
+    int                     streamUdRef;
+    l2dbus_CallbackCtx      cbCtx;
+
+    /* Inbound data */
+    l2dbus_StreamBuffer     rdBuf;
+    /* Bytes already searched for the line delimiter */
+    size_t                  rdScanned;
+    int                     framing;
+    unsigned                prefixSize;
+    char                    delimiter;
+    l2dbus_Bool             rdPaused;
+    l2dbus_Bool             eof;
+
+    /* Outbound data (ring of queued chunks) */
+    l2dbus_StreamChunk*     chunks;
+    unsigned                chunkHead;
+    unsigned                chunkCount;
+    unsigned                chunkCapacity;
+    /* Bytes of the first chunk already written */
+    size_t                  wrOffset;
+    size_t                  wrQueued;
+    size_t                  highWater;
+    size_t                  lowWater;
+    l2dbus_Bool             wrBlocked;
+} l2dbus_Stream;
+
+int l2dbus_newStream(lua_State* L);
+void l2dbus_openStream(lua_State* L);
+
+#endif /* Guard for L2DBUS_STREAM_H_ */
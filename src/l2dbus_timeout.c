@@ -32,9 +32,9 @@
  */
 #include <stdlib.h>
 #include <assert.h>
-#include "cdbus/cdbus.h"
 #include "l2dbus_compat.h"
 #include "l2dbus_timeout.h"
+#include "l2dbus_timerwheel.h"
 #include "l2dbus_dispatcher.h"
 #include "l2dbus_core.h"
 #include "l2dbus_object.h"
@@ -60,12 +60,18 @@
  execution or the L2DBUS dispatch loop will block as well. Every effort should
  be made to exit the timeout handler quickly.
 
+ All the Timeouts of a Dispatcher share a single main loop timer. Arming and
+ disarming a Timeout is a constant time operation and Timeouts that expire
+ together are handled in a single batch. The granularity of the Timeouts can
+ be coarsened with @{l2dbus.Dispatcher.setTimerResolution|setTimerResolution}
+ in order to reduce the number of main loop wakeups.
+
 
  While a Timeout is enabled a *strong* reference will be kept to it regardless
  of whether is referenced by the client code. This means that it is **not**
  eligible for garbage collection (GC) by the Lua VM. The strong reference
- will be maintained until the first timeout occurs. At the point, if the timeout
- remains enabled and is **not** configured to *repeat* then the strong
+ will be maintained until the first timeout occurs. At that point, if the
+ timeout is **not** configured to *repeat* then it's disabled and the strong
  reference will be dropped. If the timeout is enabled and repeatable then
  the strong reference is always maintained. This behavior facilitates the
  creation of non-referenced timeouts that will continue to trigger as long
@@ -78,33 +84,51 @@
  */
 
 
+/*
+ * Arms the timer of an enabled timeout for the next period.
+ */
+static void
+l2dbus_timeoutArm
+    (
+    l2dbus_Timeout* ud,
+    double          start
+    )
+{
+    l2dbus_timerArm(ud->wheel, &ud->timer, start + (double)ud->interval);
+}
+
+
 /**
  * @brief Handles and processes timeout callbacks.
  *
  * This function will try to deliver a callback to a Lua timeout handler
  * when invoked.
  *
- * @param [in] t      The CDBUS timeout instance.
- * @param [in] user   Opaque data provided by the client when the handler
- * was registered.
- * @return A boolean value that is currently unused by CDBUS.
+ * @param [in] timer  The expired timer of the timeout.
+ * @param [in] user   Opaque data provided by the client when the timer
+ * was initialized.
  */
-static cdbus_Bool
+static void
 l2dbus_timeoutHandler
     (
-    cdbus_Timeout*  t,
+    l2dbus_Timer*   timer,
     void*           user
     )
 {
-    lua_State* L = l2dbus_callbackGetThread();
-    const char* errMsg = "";
-    l2dbus_Timeout* ud = l2dbus_objectRegistryGet(L, user);
+    /* The callback thread is resolved from the context of the Lua state
+     * that owns the timeout.
+     */
+    const l2dbus_CallbackCtx* cbCtx = &((l2dbus_Timeout*)user)->cbCtx;
+    int base;
+    lua_State* L = l2dbus_callbackBegin(cbCtx, &base);
+    l2dbus_Timeout* ud = l2dbus_callbackPushObject(L, cbCtx, user);
+    double now;
 
     /* Nil or the Timeout userdata is sitting at the top of the
      * stack at this point.
      */
 
-    assert( NULL != t );
+    assert( NULL != timer );
     assert( NULL != L );
 
     /* If the timeout userdata has been GC'ed then ... */
@@ -115,42 +139,43 @@ l2dbus_timeoutHandler
     }
     else
     {
-        /* Push function and user value on the stack and execute the callback */
-        lua_rawgeti(L, LUA_REGISTRYINDEX, ud->cbCtx.funcRef);
-        lua_pushvalue(L, -2 /* Timeout ud */);
-        lua_rawgeti(L, LUA_REGISTRYINDEX, ud->cbCtx.userRef);
-
-        if ( 0 != lua_pcall(L, 2 /* nArgs */, 0, 0) )
+        /*
+         * A repeating timeout is re-armed before calling the handler so the
+         * handler is free to disable it. The next period is measured from
+         * the deadline of this one to avoid drifting unless we've fallen
+         * more than a period behind.
+         */
+        if ( ud->repeat )
         {
-            if ( lua_isstring(L, -1) )
+            now = l2dbus_getMonotonicTime();
+            if ( (timer->deadline + (double)ud->interval) > now )
             {
-                errMsg = lua_tostring(L, -1);
+                l2dbus_timeoutArm(ud, timer->deadline);
+            }
+            else
+            {
+                l2dbus_timeoutArm(ud, now);
             }
-            L2DBUS_TRACE((L2DBUS_TRC_ERROR, "Timeout callback error: %s",
-                          errMsg));
         }
-
-        /*
-         * If we're in the scenario where the timeout is enabled but it's not
-         * configured to repeat then we need to un-reference it or it could
-         * never be garbage collected.
-         */
-        if ( cdbus_timeoutIsEnabled(ud->timeout) &&
-            !cdbus_timeoutGetRepeat(ud->timeout) )
+        else
         {
-            /* Remove the reference since the timeout is now eligible to
-             * be garbage collected.
+            /*
+             * A one-shot timeout is now disabled so we need to un-reference
+             * it or it could never be garbage collected. The userdata remains
+             * anchored on the stack while the handler runs.
              */
+            ud->enabled = L2DBUS_FALSE;
             luaL_unref(L, LUA_REGISTRYINDEX, ud->timeoutUdRef);
             ud->timeoutUdRef = LUA_NOREF;
         }
+
+        /* Push the Timeout ud and execute the callback */
+        lua_pushvalue(L, -1);
+        l2dbus_callbackInvoke(L, &ud->cbCtx, 1 /* nArgs */, 0, "Timeout");
     }
 
     /* Clean up the thread stack */
-    lua_settop(L, 0);
-
-    /* The return value is unused by CDBUS */
-    return CDBUS_TRUE;
+    l2dbus_callbackEnd(L, base);
 }
 
 
@@ -218,6 +243,7 @@ l2dbus_newTimeout
     dispUd = (l2dbus_Dispatcher*)luaL_checkudata(L, 1,
                                     L2DBUS_DISPATCHER_MTBL_NAME);
     msecInterval = luaL_checkint(L, 2);
+    luaL_argcheck(L, msecInterval >= 0, 2, "interval cannot be negative");
     luaL_checktype(L, 3, LUA_TBOOLEAN);
     repeat = lua_toboolean(L, 3);
     luaL_checktype(L, 4, LUA_TFUNCTION);
@@ -239,29 +265,28 @@ l2dbus_newTimeout
     else
     {
         /* Reset the userdata structure */
-        l2dbus_callbackInit(&timeoutUd->cbCtx);
+        l2dbus_callbackInit(L, &timeoutUd->cbCtx);
         timeoutUd->dispUdRef = LUA_NOREF;
         timeoutUd->timeoutUdRef = LUA_NOREF;
 
         l2dbus_callbackRef(L, 4 /* func */, userIdx, &timeoutUd->cbCtx);
-        timeoutUd->timeout = cdbus_timeoutNew(dispUd->disp, msecInterval, repeat,
-                                    l2dbus_timeoutHandler, timeoutUd);
+        l2dbus_timerInit(&timeoutUd->timer, l2dbus_timeoutHandler, timeoutUd);
+        timeoutUd->interval = msecInterval;
+        timeoutUd->repeat = repeat;
+        timeoutUd->enabled = L2DBUS_FALSE;
 
-        if ( NULL == timeoutUd->timeout )
-        {
-            /* Release any references we may still have */
-            l2dbus_callbackUnref(L, &timeoutUd->cbCtx);
-            luaL_error(L, "Failed to allocate Timeout");
-        }
-        else
-        {
-            /* Add a reference to the Dispatcher userdata */
-            lua_pushvalue(L, 1 /* dispUd */);
-            timeoutUd->dispUdRef = luaL_ref(L, LUA_REGISTRYINDEX);
+        /* The timer wheel may outlive the Dispatcher userdata when both
+         * are collected together.
+         */
+        timeoutUd->wheel = dispUd->timerWheel;
+        l2dbus_timerWheelRef(timeoutUd->wheel);
 
-            /* Create a weak reference to the Timeout user data */
-            l2dbus_objectRegistryAdd(L, timeoutUd, -1);
-        }
+        /* Add a reference to the Dispatcher userdata */
+        lua_pushvalue(L, 1 /* dispUd */);
+        timeoutUd->dispUdRef = luaL_ref(L, LUA_REGISTRYINDEX);
+
+        /* Create a weak reference to the Timeout user data */
+        l2dbus_objectRegistryAdd(L, timeoutUd, -1);
     }
 
     return 1;
@@ -287,10 +312,11 @@ l2dbus_timeoutDispose
 
     L2DBUS_TRACE((L2DBUS_TRC_TRACE, "GC: timeout (userdata=%p)", ud));
 
-    if ( ud->timeout != NULL )
+    if ( NULL != ud->wheel )
     {
-        cdbus_timeoutEnable(ud->timeout, CDBUS_FALSE);
-        cdbus_timeoutUnref(ud->timeout);
+        l2dbus_timerDisarm(ud->wheel, &ud->timer);
+        l2dbus_timerWheelUnref(ud->wheel);
+        ud->wheel = NULL;
     }
 
     /* Drop the weak reference to the userdata */
@@ -333,7 +359,7 @@ l2dbus_timeoutIsEnabled
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    lua_pushboolean(L, cdbus_timeoutIsEnabled(ud->timeout));
+    lua_pushboolean(L, ud->enabled);
     return 1;
 }
 
@@ -350,6 +376,8 @@ l2dbus_timeoutIsEnabled
  enabled and set to *repeat*. By default a newly created timeout is *disabled*
  and must explicitly be enabled in order to activate it.
 
+ Enabling a timeout (re)starts its countdown.
+
  @tparam userdata timeout The timeout to set.
  @tparam bool option Set to **true** to enable the timeout or **false** to
  disable it.
@@ -360,7 +388,6 @@ l2dbus_timeoutSetEnable
     lua_State*  L
     )
 {
-    cdbus_HResult rc;
     int enable;
 
     l2dbus_Timeout* ud = (l2dbus_Timeout*)luaL_checkudata(L, 1,
@@ -371,10 +398,14 @@ l2dbus_timeoutSetEnable
     l2dbus_checkModuleInitialized(L);
 
     enable = lua_toboolean(L, 2);
-    rc = cdbus_timeoutEnable(ud->timeout, enable);
-    if ( CDBUS_FAILED(rc) )
+    ud->enabled = enable ? L2DBUS_TRUE : L2DBUS_FALSE;
+    if ( enable )
+    {
+        l2dbus_timeoutArm(ud, l2dbus_getMonotonicTime());
+    }
+    else
     {
-        l2dbus_cdbusError(L, rc, "Cannot enable/disable timer");
+        l2dbus_timerDisarm(ud->wheel, &ud->timer);
     }
 
     /*
@@ -386,8 +417,11 @@ l2dbus_timeoutSetEnable
      */
     if ( enable )
     {
-        lua_pushvalue(L, 1 /* timeoutUd */);
-        ud->timeoutUdRef = luaL_ref(L, LUA_REGISTRYINDEX);
+        if ( LUA_NOREF == ud->timeoutUdRef )
+        {
+            lua_pushvalue(L, 1 /* timeoutUd */);
+            ud->timeoutUdRef = luaL_ref(L, LUA_REGISTRYINDEX);
+        }
     }
     else
     {
@@ -421,7 +455,7 @@ l2dbus_timeoutInterval
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    lua_pushinteger(L, cdbus_timeoutInterval(ud->timeout));
+    lua_pushinteger(L, ud->interval);
     return 1;
 }
 
@@ -433,7 +467,8 @@ l2dbus_timeoutInterval
  Sets the timeout interval.
 
  The timeout interval must be a positive number and specifies the number
- of milliseconds before the timeout expires.
+ of milliseconds before the timeout expires. The countdown of an enabled
+ timeout is restarted with the new interval.
 
  @tparam userdata timeout The timeout to set the interval.
  @tparam number interval The interval of the timeout (in milliseconds).
@@ -444,20 +479,20 @@ l2dbus_timeoutSetInterval
     lua_State*  L
     )
 {
-    cdbus_HResult rc;
-    cdbus_Int32 interval;
+    int interval;
 
     l2dbus_Timeout* ud = (l2dbus_Timeout*)luaL_checkudata(L, 1,
                                                     L2DBUS_TIMEOUT_MTBL_NAME);
     interval = luaL_checkint(L, 2);
+    luaL_argcheck(L, interval >= 0, 2, "interval cannot be negative");
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    rc = cdbus_timeoutSetInterval(ud->timeout, interval);
-    if ( CDBUS_FAILED(rc) )
+    ud->interval = interval;
+    if ( ud->enabled )
     {
-        l2dbus_cdbusError(L, rc, "Cannot set the timeout interval");
+        l2dbus_timeoutArm(ud, l2dbus_getMonotonicTime());
     }
 
     return 0;
@@ -486,7 +521,7 @@ l2dbus_timeoutRepeat
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    lua_pushboolean(L, cdbus_timeoutGetRepeat(ud->timeout));
+    lua_pushboolean(L, ud->repeat);
     return 1;
 }
 
@@ -517,7 +552,7 @@ l2dbus_timeoutSetRepeat
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    cdbus_timeoutSetRepeat(ud->timeout,  lua_toboolean(L, 2));
+    ud->repeat = lua_toboolean(L, 2) ? L2DBUS_TRUE : L2DBUS_FALSE;
 
     return 0;
 }
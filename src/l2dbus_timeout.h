@@ -35,17 +35,20 @@
 #define L2DBUS_TIMEOUT_H_
 
 #include "lua.h"
+#include "l2dbus_types.h"
 #include "l2dbus_callback.h"
-
-/* Forward declarations */
-struct cdbus_Timeout;
+#include "l2dbus_timerwheel.h"
 
 typedef struct l2dbus_Timeout
 {
-    struct cdbus_Timeout*   timeout;
-    int                     dispUdRef;
-    int                     timeoutUdRef;
-    l2dbus_CallbackCtx      cbCtx;
+    l2dbus_Timer                timer;
+    struct l2dbus_TimerWheel*   wheel;
+    int                         interval;
+    l2dbus_Bool                 enabled;
+    l2dbus_Bool                 repeat;
+    int                         dispUdRef;
+    int                         timeoutUdRef;
+    l2dbus_CallbackCtx          cbCtx;
 } l2dbus_Timeout;
 
 int l2dbus_newTimeout(lua_State* L);
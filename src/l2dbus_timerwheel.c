@@ -0,0 +1,781 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_timerwheel.c
+ * @author         Glenn Schmottlach
+ * @brief          Implementation of a hierarchical timer wheel.
+ *===========================================================================
+ */
+
+/*
+ * Timers are kept in a hierarchy of wheels each having 64 slots. A timer
+ * is placed on the level corresponding to the most significant group of
+ * bits in which its expiration (in ticks) differs from the current tick
+ * and it's moved (cascaded) down to a lower level as time advances. Timers
+ * further away than the span of the top level sit on an overflow list
+ * that's revisited each time the top level wraps. Every level carries a
+ * bitmap of its occupied slots so the next tick requiring attention can
+ * be found without visiting empty slots.
+ *
+ * All the timers of a wheel share a single main loop timeout that is only
+ * re-armed when the earliest tick of interest changes.
+ */
+#include <stdlib.h>
+#include <assert.h>
+#include "cdbus/cdbus.h"
+#include "l2dbus_timerwheel.h"
+#include "l2dbus_alloc.h"
+#include "l2dbus_util.h"
+#include "l2dbus_trace.h"
+
+#define L2DBUS_TIMER_WHEEL_BITS     (6U)
+#define L2DBUS_TIMER_WHEEL_SLOTS    (1U << L2DBUS_TIMER_WHEEL_BITS)
+#define L2DBUS_TIMER_WHEEL_MASK     ((uint64_t)(L2DBUS_TIMER_WHEEL_SLOTS - 1U))
+#define L2DBUS_TIMER_WHEEL_LEVELS   (4U)
+#define L2DBUS_TIMER_WHEEL_SPAN     (L2DBUS_TIMER_WHEEL_BITS * \
+                                    L2DBUS_TIMER_WHEEL_LEVELS)
+
+/* Fraction of a tick ignored when determining the current tick */
+#define L2DBUS_TIMER_WHEEL_EPSILON  (1.0e-6)
+
+/* The main loop timeout is not armed */
+#define L2DBUS_TIMER_WHEEL_NO_TICK  (UINT64_MAX)
+
+typedef struct l2dbus_TimerWheel
+{
+    unsigned                refCount;
+    struct cdbus_Timeout*   driver;
+    /* The tick the driver timeout is armed for */
+    uint64_t                armedTick;
+    /* Every timer expiring at or before this tick has been collected */
+    uint64_t                now;
+    /* Monotonic time (in msec) of tick zero */
+    double                  origin;
+    /* Length of a tick (in msec) */
+    double                  resolution;
+    /* Expirations are rounded up to a multiple of this many ticks */
+    uint64_t                slackTicks;
+    /* Number of armed timers */
+    unsigned                count;
+    l2dbus_Bool             advancing;
+    uint64_t                occupied[L2DBUS_TIMER_WHEEL_LEVELS];
+    struct l2dbus_TimerList slots[L2DBUS_TIMER_WHEEL_LEVELS]
+                                [L2DBUS_TIMER_WHEEL_SLOTS];
+    struct l2dbus_TimerList overflow;
+    struct l2dbus_TimerList expired;
+} l2dbus_TimerWheel;
+
+
+/*
+ * Returns the index of the least significant bit set. The bitmap
+ * must not be zero.
+ */
+static unsigned
+l2dbus_timerWheelFirstBit
+    (
+    uint64_t    bits
+    )
+{
+#if defined(__GNUC__)
+    return (unsigned)__builtin_ctzll(bits);
+#else
+    unsigned idx = 0U;
+
+    assert( 0U != bits );
+    while ( 0U == (bits & 1U) )
+    {
+        bits >>= 1;
+        ++idx;
+    }
+    return idx;
+#endif
+}
+
+
+/*
+ * Converts a deadline (in msec) into the (future) tick at which
+ * the timer expires.
+ */
+static uint64_t
+l2dbus_timerWheelDeadlineTick
+    (
+    const l2dbus_TimerWheel*    wheel,
+    double                      deadline
+    )
+{
+    double ticks = (deadline - wheel->origin) / wheel->resolution;
+    uint64_t expiry;
+
+    /* A timer never expires early or during the current tick */
+    if ( ticks <= (double)wheel->now )
+    {
+        expiry = wheel->now + 1U;
+    }
+    else
+    {
+        expiry = (uint64_t)ticks;
+        if ( (double)expiry < ticks )
+        {
+            ++expiry;
+        }
+    }
+
+    /* Coalesce neighbouring expirations */
+    if ( 1U < wheel->slackTicks )
+    {
+        expiry = ((expiry + wheel->slackTicks - 1U) / wheel->slackTicks) *
+                    wheel->slackTicks;
+    }
+
+    return expiry;
+}
+
+
+/*
+ * Places an armed timer on the list corresponding to its expiration.
+ */
+static void
+l2dbus_timerWheelPlace
+    (
+    l2dbus_TimerWheel*  wheel,
+    l2dbus_Timer*       timer
+    )
+{
+    uint64_t diff;
+    unsigned level;
+    unsigned slot;
+
+    if ( timer->expiry <= wheel->now )
+    {
+        timer->list = &wheel->expired;
+    }
+    else
+    {
+        diff = timer->expiry ^ wheel->now;
+        if ( 0U != (diff >> L2DBUS_TIMER_WHEEL_SPAN) )
+        {
+            timer->list = &wheel->overflow;
+        }
+        else
+        {
+            level = 0U;
+            while ( 0U != (diff >> ((level + 1U) * L2DBUS_TIMER_WHEEL_BITS)) )
+            {
+                ++level;
+            }
+            slot = (unsigned)((timer->expiry >>
+                        (level * L2DBUS_TIMER_WHEEL_BITS)) &
+                        L2DBUS_TIMER_WHEEL_MASK);
+            wheel->occupied[level] |= (uint64_t)1U << slot;
+            timer->list = &wheel->slots[level][slot];
+        }
+    }
+
+    TAILQ_INSERT_TAIL(timer->list, timer, link);
+}
+
+
+/*
+ * Re-places every timer of a list relative to the current tick.
+ */
+static void
+l2dbus_timerWheelCascade
+    (
+    l2dbus_TimerWheel*          wheel,
+    struct l2dbus_TimerList*    list
+    )
+{
+    struct l2dbus_TimerList pending;
+    l2dbus_Timer* timer;
+
+    /* Timers on the overflow list may land back on it */
+    TAILQ_INIT(&pending);
+    while ( !TAILQ_EMPTY(list) )
+    {
+        timer = TAILQ_FIRST(list);
+        TAILQ_REMOVE(list, timer, link);
+        TAILQ_INSERT_TAIL(&pending, timer, link);
+    }
+
+    while ( !TAILQ_EMPTY(&pending) )
+    {
+        timer = TAILQ_FIRST(&pending);
+        TAILQ_REMOVE(&pending, timer, link);
+        l2dbus_timerWheelPlace(wheel, timer);
+    }
+}
+
+
+/*
+ * Returns the next tick at which a timer expires or must be cascaded
+ * to a lower level.
+ */
+static uint64_t
+l2dbus_timerWheelNextTick
+    (
+    const l2dbus_TimerWheel*    wheel
+    )
+{
+    uint64_t next = L2DBUS_TIMER_WHEEL_NO_TICK;
+    uint64_t tick;
+    unsigned shift;
+    unsigned level;
+
+    for ( level = 0U; level < L2DBUS_TIMER_WHEEL_LEVELS; ++level )
+    {
+        if ( 0U != wheel->occupied[level] )
+        {
+            /* Every occupied slot lies ahead in the current rotation */
+            shift = level * L2DBUS_TIMER_WHEEL_BITS;
+            tick = (wheel->now >> (shift + L2DBUS_TIMER_WHEEL_BITS)) <<
+                    (shift + L2DBUS_TIMER_WHEEL_BITS);
+            tick |= (uint64_t)l2dbus_timerWheelFirstBit(
+                                wheel->occupied[level]) << shift;
+            if ( tick < next )
+            {
+                next = tick;
+            }
+        }
+    }
+
+    if ( !TAILQ_EMPTY(&wheel->overflow) )
+    {
+        tick = ((wheel->now >> L2DBUS_TIMER_WHEEL_SPAN) + 1U) <<
+                L2DBUS_TIMER_WHEEL_SPAN;
+        if ( tick < next )
+        {
+            next = tick;
+        }
+    }
+
+    return next;
+}
+
+
+/*
+ * Moves the wheel to the given tick which must be the next tick
+ * returned by l2dbus_timerWheelNextTick(). Timers expiring at this
+ * tick are moved to the expired list.
+ */
+static void
+l2dbus_timerWheelTurn
+    (
+    l2dbus_TimerWheel*  wheel,
+    uint64_t            tick
+    )
+{
+    unsigned level;
+    unsigned shift;
+    unsigned slot;
+
+    wheel->now = tick;
+
+    if ( 0U == (tick & ((((uint64_t)1U) << L2DBUS_TIMER_WHEEL_SPAN) - 1U)) )
+    {
+        l2dbus_timerWheelCascade(wheel, &wheel->overflow);
+    }
+
+    /* Higher levels are cascaded first so their timers can land on the
+     * slots of the lower levels that are cascaded next.
+     */
+    for ( level = L2DBUS_TIMER_WHEEL_LEVELS; level-- > 0U; )
+    {
+        shift = level * L2DBUS_TIMER_WHEEL_BITS;
+        if ( 0U != (tick & ((((uint64_t)1U) << shift) - 1U)) )
+        {
+            continue;
+        }
+
+        slot = (unsigned)((tick >> shift) & L2DBUS_TIMER_WHEEL_MASK);
+        if ( 0U != (wheel->occupied[level] & ((uint64_t)1U << slot)) )
+        {
+            wheel->occupied[level] &= ~((uint64_t)1U << slot);
+            l2dbus_timerWheelCascade(wheel, &wheel->slots[level][slot]);
+        }
+    }
+}
+
+
+/*
+ * Arms (or disarms) the main loop timeout for the next tick of interest.
+ */
+static void
+l2dbus_timerWheelSchedule
+    (
+    l2dbus_TimerWheel*  wheel
+    )
+{
+    uint64_t next = L2DBUS_TIMER_WHEEL_NO_TICK;
+    double msec;
+    cdbus_Int32 interval;
+    cdbus_HResult rc;
+
+    if ( 0U < wheel->count )
+    {
+        next = l2dbus_timerWheelNextTick(wheel);
+    }
+
+    if ( next == wheel->armedTick )
+    {
+        return;
+    }
+
+    cdbus_timeoutEnable(wheel->driver, CDBUS_FALSE);
+    wheel->armedTick = next;
+
+    if ( L2DBUS_TIMER_WHEEL_NO_TICK != next )
+    {
+        msec = wheel->origin + ((double)next * wheel->resolution) -
+                l2dbus_getMonotonicTime();
+        interval = 0;
+        if ( 0.0 < msec )
+        {
+            interval = (cdbus_Int32)msec;
+            if ( (double)interval < msec )
+            {
+                ++interval;
+            }
+        }
+
+        cdbus_timeoutSetInterval(wheel->driver, interval);
+        rc = cdbus_timeoutEnable(wheel->driver, CDBUS_TRUE);
+        if ( CDBUS_FAILED(rc) )
+        {
+            L2DBUS_TRACE((L2DBUS_TRC_ERROR,
+                "Failed to arm timer wheel timeout (0x%X)", rc));
+            wheel->armedTick = L2DBUS_TIMER_WHEEL_NO_TICK;
+        }
+    }
+}
+
+
+/*
+ * Called by the main loop when the next tick of interest has (probably)
+ * arrived. Every timer that has expired since is called in order of
+ * expiration.
+ */
+static cdbus_Bool
+l2dbus_timerWheelHandler
+    (
+    cdbus_Timeout*  t,
+    void*           user
+    )
+{
+    l2dbus_TimerWheel* wheel = (l2dbus_TimerWheel*)user;
+    l2dbus_Timer* timer;
+    double ticks;
+    uint64_t target = 0U;
+    uint64_t next;
+
+    assert( NULL != wheel );
+
+    /* The driver is a one-shot timeout */
+    wheel->armedTick = L2DBUS_TIMER_WHEEL_NO_TICK;
+
+    /* Timers may dispose of the (last reference to the) wheel */
+    l2dbus_timerWheelRef(wheel);
+    wheel->advancing = L2DBUS_TRUE;
+
+    /* Tolerate rounding errors so waking up exactly on a tick boundary
+     * doesn't appear to be just short of it.
+     */
+    ticks = ((l2dbus_getMonotonicTime() - wheel->origin) / wheel->resolution) +
+            L2DBUS_TIMER_WHEEL_EPSILON;
+    if ( 0.0 < ticks )
+    {
+        target = (uint64_t)ticks;
+    }
+
+    /* Skip directly between the ticks that have work to do */
+    while ( 0U < wheel->count )
+    {
+        next = l2dbus_timerWheelNextTick(wheel);
+        if ( next > target )
+        {
+            break;
+        }
+        l2dbus_timerWheelTurn(wheel, next);
+    }
+
+    if ( target > wheel->now )
+    {
+        wheel->now = target;
+    }
+
+    /* Timers (re)armed by these callbacks expire after the current tick */
+    while ( !TAILQ_EMPTY(&wheel->expired) )
+    {
+        timer = TAILQ_FIRST(&wheel->expired);
+        TAILQ_REMOVE(&wheel->expired, timer, link);
+        timer->list = NULL;
+        --wheel->count;
+        timer->func(timer, timer->user);
+    }
+
+    wheel->advancing = L2DBUS_FALSE;
+    l2dbus_timerWheelSchedule(wheel);
+    l2dbus_timerWheelUnref(wheel);
+
+    /* The return value is unused by CDBUS */
+    return CDBUS_TRUE;
+}
+
+
+/**
+ * @brief Creates a new timer wheel.
+ *
+ * @param [in] disp The CDBUS dispatcher whose main loop drives the wheel.
+ * @return The timer wheel (with a reference count of one) or NULL on
+ * failure.
+ */
+l2dbus_TimerWheel*
+l2dbus_timerWheelNew
+    (
+    struct cdbus_Dispatcher*    disp
+    )
+{
+    l2dbus_TimerWheel* wheel;
+    unsigned level;
+    unsigned slot;
+
+    wheel = (l2dbus_TimerWheel*)l2dbus_calloc(1, sizeof(*wheel));
+    if ( NULL != wheel )
+    {
+        wheel->driver = cdbus_timeoutNew(disp, 0, CDBUS_FALSE,
+                                        l2dbus_timerWheelHandler, wheel);
+        if ( NULL == wheel->driver )
+        {
+            l2dbus_free(wheel);
+            wheel = NULL;
+        }
+        else
+        {
+            wheel->refCount = 1U;
+            wheel->armedTick = L2DBUS_TIMER_WHEEL_NO_TICK;
+            wheel->origin = l2dbus_getMonotonicTime();
+            wheel->resolution = L2DBUS_TIMER_WHEEL_RESOLUTION;
+            wheel->slackTicks = 1U;
+            for ( level = 0U; level < L2DBUS_TIMER_WHEEL_LEVELS; ++level )
+            {
+                for ( slot = 0U; slot < L2DBUS_TIMER_WHEEL_SLOTS; ++slot )
+                {
+                    TAILQ_INIT(&wheel->slots[level][slot]);
+                }
+            }
+            TAILQ_INIT(&wheel->overflow);
+            TAILQ_INIT(&wheel->expired);
+        }
+    }
+
+    return wheel;
+}
+
+
+/**
+ * @brief Adds a reference to the timer wheel.
+ *
+ * @param [in] wheel The timer wheel.
+ */
+void
+l2dbus_timerWheelRef
+    (
+    l2dbus_TimerWheel*  wheel
+    )
+{
+    if ( NULL != wheel )
+    {
+        ++wheel->refCount;
+    }
+}
+
+
+/**
+ * @brief Drops a reference to the timer wheel.
+ *
+ * The wheel is freed when the last reference is dropped. By then
+ * every timer must have been disarmed.
+ *
+ * @param [in] wheel The timer wheel.
+ */
+void
+l2dbus_timerWheelUnref
+    (
+    l2dbus_TimerWheel*  wheel
+    )
+{
+    if ( NULL != wheel )
+    {
+        assert( 0U < wheel->refCount );
+        if ( 0U == --wheel->refCount )
+        {
+            assert( 0U == wheel->count );
+            cdbus_timeoutEnable(wheel->driver, CDBUS_FALSE);
+            cdbus_timeoutUnref(wheel->driver);
+            l2dbus_free(wheel);
+        }
+    }
+}
+
+
+/**
+ * @brief Sets the tick length and coalescing slack of the timer wheel.
+ *
+ * Armed timers are re-placed on the wheel according to their deadlines.
+ *
+ * @param [in] wheel      The timer wheel.
+ * @param [in] resolution The length of a tick (in msec).
+ * @param [in] slack      The time (in msec) by which an expiration may be
+ *                        postponed so it coincides with other expirations.
+ */
+void
+l2dbus_timerWheelSetResolution
+    (
+    l2dbus_TimerWheel*  wheel,
+    double              resolution,
+    double              slack
+    )
+{
+    struct l2dbus_TimerList pending;
+    l2dbus_Timer* timer;
+    unsigned level;
+    unsigned slot;
+
+    assert( NULL != wheel );
+    assert( 0.0 < resolution );
+
+    /* Gather every timer not already expired */
+    TAILQ_INIT(&pending);
+    for ( level = 0U; level < L2DBUS_TIMER_WHEEL_LEVELS; ++level )
+    {
+        while ( 0U != wheel->occupied[level] )
+        {
+            slot = l2dbus_timerWheelFirstBit(wheel->occupied[level]);
+            wheel->occupied[level] &= ~((uint64_t)1U << slot);
+            while ( !TAILQ_EMPTY(&wheel->slots[level][slot]) )
+            {
+                timer = TAILQ_FIRST(&wheel->slots[level][slot]);
+                TAILQ_REMOVE(&wheel->slots[level][slot], timer, link);
+                TAILQ_INSERT_TAIL(&pending, timer, link);
+            }
+        }
+    }
+    while ( !TAILQ_EMPTY(&wheel->overflow) )
+    {
+        timer = TAILQ_FIRST(&wheel->overflow);
+        TAILQ_REMOVE(&wheel->overflow, timer, link);
+        TAILQ_INSERT_TAIL(&pending, timer, link);
+    }
+
+    wheel->origin = l2dbus_getMonotonicTime();
+    wheel->now = 0U;
+    wheel->resolution = resolution;
+    wheel->slackTicks = (uint64_t)(slack / resolution);
+    if ( 0U == wheel->slackTicks )
+    {
+        wheel->slackTicks = 1U;
+    }
+
+    while ( !TAILQ_EMPTY(&pending) )
+    {
+        timer = TAILQ_FIRST(&pending);
+        TAILQ_REMOVE(&pending, timer, link);
+        timer->expiry = l2dbus_timerWheelDeadlineTick(wheel, timer->deadline);
+        l2dbus_timerWheelPlace(wheel, timer);
+    }
+
+    /* The ticks have a new meaning so the driver must be re-armed */
+    wheel->armedTick = L2DBUS_TIMER_WHEEL_NO_TICK;
+    cdbus_timeoutEnable(wheel->driver, CDBUS_FALSE);
+    if ( !wheel->advancing )
+    {
+        l2dbus_timerWheelSchedule(wheel);
+    }
+}
+
+
+/**
+ * @brief Returns the tick length and coalescing slack of the timer wheel.
+ *
+ * @param [in]  wheel      The timer wheel.
+ * @param [out] resolution The length of a tick (in msec).
+ * @param [out] slack      The coalescing slack (in msec).
+ */
+void
+l2dbus_timerWheelGetResolution
+    (
+    const l2dbus_TimerWheel*    wheel,
+    double*                     resolution,
+    double*                     slack
+    )
+{
+    assert( NULL != wheel );
+
+    *resolution = wheel->resolution;
+    *slack = 1U < wheel->slackTicks ?
+                (double)wheel->slackTicks * wheel->resolution : 0.0;
+}
+
+
+/**
+ * @brief Returns the number of timers armed on the wheel.
+ *
+ * @param [in] wheel The timer wheel.
+ * @return The number of armed timers.
+ */
+unsigned
+l2dbus_timerWheelCount
+    (
+    const l2dbus_TimerWheel*    wheel
+    )
+{
+    return (NULL != wheel) ? wheel->count : 0U;
+}
+
+
+/**
+ * @brief Initializes a (disarmed) timer.
+ *
+ * @param [in] timer The timer to initialize.
+ * @param [in] func  The function called when the timer expires.
+ * @param [in] user  Opaque data passed to the function.
+ */
+void
+l2dbus_timerInit
+    (
+    l2dbus_Timer*       timer,
+    l2dbus_TimerFunc    func,
+    void*               user
+    )
+{
+    assert( NULL != timer );
+
+    timer->list = NULL;
+    timer->expiry = 0U;
+    timer->deadline = 0.0;
+    timer->func = func;
+    timer->user = user;
+}
+
+
+/**
+ * @brief Arms (or re-arms) a timer.
+ *
+ * @param [in] wheel    The timer wheel.
+ * @param [in] timer    The timer to arm.
+ * @param [in] deadline The time (in msec on the monotonic clock returned
+ *                      by l2dbus_getMonotonicTime()) at which the timer
+ *                      expires.
+ */
+void
+l2dbus_timerArm
+    (
+    l2dbus_TimerWheel*  wheel,
+    l2dbus_Timer*       timer,
+    double              deadline
+    )
+{
+    assert( NULL != wheel );
+    assert( NULL != timer );
+
+    l2dbus_timerDisarm(wheel, timer);
+
+    timer->deadline = deadline;
+    timer->expiry = l2dbus_timerWheelDeadlineTick(wheel, deadline);
+    l2dbus_timerWheelPlace(wheel, timer);
+    ++wheel->count;
+
+    /* Only an earlier tick of interest requires re-arming the driver */
+    if ( !wheel->advancing &&
+        ((L2DBUS_TIMER_WHEEL_NO_TICK == wheel->armedTick) ||
+        (l2dbus_timerWheelNextTick(wheel) < wheel->armedTick)) )
+    {
+        l2dbus_timerWheelSchedule(wheel);
+    }
+}
+
+
+/**
+ * @brief Disarms a timer.
+ *
+ * Disarming a timer that isn't armed has no effect.
+ *
+ * @param [in] wheel The timer wheel.
+ * @param [in] timer The timer to disarm.
+ */
+void
+l2dbus_timerDisarm
+    (
+    l2dbus_TimerWheel*  wheel,
+    l2dbus_Timer*       timer
+    )
+{
+    unsigned idx;
+
+    assert( NULL != wheel );
+    assert( NULL != timer );
+
+    if ( NULL != timer->list )
+    {
+        TAILQ_REMOVE(timer->list, timer, link);
+
+        /* Keep the occupancy bitmap of a wheel slot up-to-date */
+        if ( TAILQ_EMPTY(timer->list) &&
+            (timer->list >= &wheel->slots[0][0]) &&
+            (timer->list <= &wheel->slots[L2DBUS_TIMER_WHEEL_LEVELS - 1U]
+                                        [L2DBUS_TIMER_WHEEL_SLOTS - 1U]) )
+        {
+            idx = (unsigned)(timer->list - &wheel->slots[0][0]);
+            wheel->occupied[idx / L2DBUS_TIMER_WHEEL_SLOTS] &=
+                ~((uint64_t)1U << (idx % L2DBUS_TIMER_WHEEL_SLOTS));
+        }
+
+        timer->list = NULL;
+        --wheel->count;
+
+        /* An idle wheel doesn't need to wake up the main loop */
+        if ( (0U == wheel->count) && !wheel->advancing )
+        {
+            l2dbus_timerWheelSchedule(wheel);
+        }
+    }
+}
+
+
+/**
+ * @brief Tests whether a timer is armed.
+ *
+ * @param [in] timer The timer.
+ * @return L2DBUS_TRUE if the timer is armed.
+ */
+l2dbus_Bool
+l2dbus_timerIsArmed
+    (
+    const l2dbus_Timer* timer
+    )
+{
+    return (NULL != timer->list) ? L2DBUS_TRUE : L2DBUS_FALSE;
+}
@@ -0,0 +1,85 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_timerwheel.h
+ * @author         Glenn Schmottlach
+ * @brief          Definition of a hierarchical timer wheel.
+ *===========================================================================
+ */
+
+#ifndef L2DBUS_TIMERWHEEL_H_
+#define L2DBUS_TIMERWHEEL_H_
+#include <stdint.h>
+#include "queue.h"
+#include "l2dbus_types.h"
+
+/* Forward declarations */
+struct cdbus_Dispatcher;
+struct l2dbus_Timer;
+struct l2dbus_TimerWheel;
+
+/* Default resolution (in milliseconds) of a timer wheel tick */
+#define L2DBUS_TIMER_WHEEL_RESOLUTION   (1.0)
+
+/*
+ * Function called when a timer expires. The timer is no longer armed
+ * when it's called and may be re-armed (or disposed) by the function.
+ */
+typedef void (*l2dbus_TimerFunc)(struct l2dbus_Timer* timer, void* user);
+
+TAILQ_HEAD(l2dbus_TimerList, l2dbus_Timer);
+
+typedef struct l2dbus_Timer
+{
+    TAILQ_ENTRY(l2dbus_Timer)   link;
+    /* The list (wheel slot) holding the timer or NULL if not armed */
+    struct l2dbus_TimerList*    list;
+    /* Expiration in wheel ticks */
+    uint64_t                    expiry;
+    /* Expiration in milliseconds (monotonic clock) */
+    double                      deadline;
+    l2dbus_TimerFunc            func;
+    void*                       user;
+} l2dbus_Timer;
+
+struct l2dbus_TimerWheel* l2dbus_timerWheelNew(struct cdbus_Dispatcher* disp);
+void l2dbus_timerWheelRef(struct l2dbus_TimerWheel* wheel);
+void l2dbus_timerWheelUnref(struct l2dbus_TimerWheel* wheel);
+void l2dbus_timerWheelSetResolution(struct l2dbus_TimerWheel* wheel,
+                                    double resolution, double slack);
+void l2dbus_timerWheelGetResolution(const struct l2dbus_TimerWheel* wheel,
+                                    double* resolution, double* slack);
+unsigned l2dbus_timerWheelCount(const struct l2dbus_TimerWheel* wheel);
+
+void l2dbus_timerInit(l2dbus_Timer* timer, l2dbus_TimerFunc func, void* user);
+void l2dbus_timerArm(struct l2dbus_TimerWheel* wheel, l2dbus_Timer* timer,
+                    double deadline);
+void l2dbus_timerDisarm(struct l2dbus_TimerWheel* wheel, l2dbus_Timer* timer);
+l2dbus_Bool l2dbus_timerIsArmed(const l2dbus_Timer* timer);
+
+
+#endif /* Guard for L2DBUS_TIMERWHEEL_H_ */
@@ -36,6 +36,7 @@
 #include <stdlib.h>
 #include <dbus/dbus.h>
 #include "l2dbus_trace.h"
+#include "l2dbus_defs.h"
 #include "lauxlib.h"
 
 /**
@@ -60,7 +61,13 @@
  */
 
 
-static volatile unsigned gsTraceMask = L2DBUS_TRC_ALL;
+/*
+ * Trace calls are made from places where no Lua state is available so
+ * the mask cannot live in the per Lua state module context. Instead it is
+ * kept per OS thread so that Lua states hosted on different threads can
+ * trace independently of each other.
+ */
+static L2DBUS_THREAD_LOCAL unsigned gsTraceMask = L2DBUS_TRC_ALL;
 
 
 /**
@@ -202,6 +209,10 @@ l2dbus_traceGetMask()
 
      l2dbus.Trace.setFlags(l2dbus.Trace.WARN, l2dbus.Trace.ERROR)
 
+ The L2DBUS trace flags apply to the calling OS thread so Lua states hosted
+ on different threads can be traced independently. The flags handed to
+ the underlying CDBUS library remain process-wide.
+
  @tparam ... args A list of parameters to turn *on*.
  */
 static int
@@ -26,6 +26,7 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
+#include <unistd.h>
 #include <math.h>
 #include <limits.h>
 #include <float.h>
@@ -3513,6 +3514,87 @@ l2dbus_transcodeDbusArgsToLua
 }
 
 
+/**
+ * @brief Copies the D-Bus argument at an iterator to another message.
+ *
+ * The argument (including the contents of any container) is copied
+ * without converting it to Lua. The source iterator isn't advanced.
+ *
+ * @param [in] srcIt    The iterator positioned on the argument to copy.
+ * @param [in] dstIt    The append iterator of the destination.
+ * @return True if the argument was copied or false if out of memory.
+ */
+l2dbus_Bool
+l2dbus_transcodeCopyArg
+    (
+    DBusMessageIter*    srcIt,
+    DBusMessageIter*    dstIt
+    )
+{
+    union
+    {
+        dbus_uint64_t   u64;
+        double          dbl;
+        const char*     str;
+        int             fd;
+    } value;
+    DBusMessageIter srcSubIt;
+    DBusMessageIter dstSubIt;
+    char* sig = NULL;
+    const char* containedSig = NULL;
+    int argType = dbus_message_iter_get_arg_type(srcIt);
+    l2dbus_Bool isCopied = L2DBUS_FALSE;
+
+    if ( dbus_type_is_basic(argType) )
+    {
+        dbus_message_iter_get_basic(srcIt, &value);
+        isCopied = dbus_message_iter_append_basic(dstIt, argType, &value);
+        if ( DBUS_TYPE_UNIX_FD == argType )
+        {
+            /* Both calls duplicate the descriptor */
+            close(value.fd);
+        }
+    }
+    else if ( dbus_type_is_container(argType) )
+    {
+        dbus_message_iter_recurse(srcIt, &srcSubIt);
+        if ( DBUS_TYPE_ARRAY == argType )
+        {
+            /* Skip the 'a' to get the element signature */
+            sig = dbus_message_iter_get_signature(srcIt);
+            containedSig = (NULL != sig) ? sig + 1 : NULL;
+        }
+        else if ( DBUS_TYPE_VARIANT == argType )
+        {
+            sig = dbus_message_iter_get_signature(&srcSubIt);
+            containedSig = sig;
+        }
+
+        if ( (((DBUS_TYPE_ARRAY != argType) && (DBUS_TYPE_VARIANT != argType)) ||
+            (NULL != containedSig)) &&
+            dbus_message_iter_open_container(dstIt, argType, containedSig,
+                                            &dstSubIt) )
+        {
+            isCopied = L2DBUS_TRUE;
+            while ( isCopied &&
+                (DBUS_TYPE_INVALID != dbus_message_iter_get_arg_type(&srcSubIt)) )
+            {
+                isCopied = l2dbus_transcodeCopyArg(&srcSubIt, &dstSubIt);
+                dbus_message_iter_next(&srcSubIt);
+            }
+
+            if ( !dbus_message_iter_close_container(dstIt, &dstSubIt) )
+            {
+                isCopied = L2DBUS_FALSE;
+            }
+        }
+        dbus_free(sig);
+    }
+
+    return isCopied;
+}
+
+
 /**
  * @brief Creates a metatable for a D-Bus type wrapper class.
  */
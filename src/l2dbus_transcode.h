@@ -27,6 +27,8 @@
 #ifndef L2DBUS_TRANSCODE_H_
 #define L2DBUS_TRANSCODE_H_
 #include "lua.h"
+#include "dbus/dbus.h"
+#include "l2dbus_types.h"
 
 
 typedef struct l2dbus_DbusValue
@@ -40,6 +42,7 @@ void l2dbus_transcodeLuaArgsToDbusBySignature(lua_State* L, DBusMessage* msg, in
 void l2dbus_transcodeLuaArgsToDbus(lua_State* L, DBusMessage* msg, int argIdx, int nArgs);
 int l2dbus_transcodeDbusArgsToLuaArray(lua_State* L, DBusMessage* msg);
 int l2dbus_transcodeDbusArgsToLua(lua_State* L, DBusMessage* msg);
+l2dbus_Bool l2dbus_transcodeCopyArg(DBusMessageIter* srcIt, DBusMessageIter* dstIt);
 int l2dbus_openTranscode(lua_State* L);
 
 #endif /* Guard for L2DBUS_TRANSCODE_H_ */
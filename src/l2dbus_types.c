@@ -39,8 +39,13 @@ const char L2DBUS_MESSAGE_MTBL_NAME[] = L2DBUS_MAKE_METANAME("message");
 const char L2DBUS_PENDING_CALL_MTBL_NAME[] = L2DBUS_MAKE_METANAME("pending_call");
 const char L2DBUS_SERVICE_OBJECT_MTBL_NAME[] = L2DBUS_MAKE_METANAME("service_object");
 const char L2DBUS_INTERFACE_MTBL_NAME[] = L2DBUS_MAKE_METANAME("interface");
+const char L2DBUS_INTERFACE_DESCRIPTOR_MTBL_NAME[] = L2DBUS_MAKE_METANAME("interface_descriptor");
 const char L2DBUS_INT64_MTBL_NAME[] = L2DBUS_MAKE_METANAME("int64");
 const char L2DBUS_UINT64_MTBL_NAME[] = L2DBUS_MAKE_METANAME("uint64");
+const char L2DBUS_STREAM_MTBL_NAME[] = L2DBUS_MAKE_METANAME("stream");
+const char L2DBUS_REPLY_CONTEXT_MTBL_NAME[] = L2DBUS_MAKE_METANAME("reply_context");
+const char L2DBUS_SIGNAL_EMITTER_MTBL_NAME[] = L2DBUS_MAKE_METANAME("signal_emitter");
+const char L2DBUS_GC_SENTINEL_MTBL_NAME[] = L2DBUS_MAKE_METANAME("gcsentinel");
 
 const char L2DBUS_DBUS_START_MTBL_NAME[] = "";
 const char L2DBUS_DBUS_INVALID_MTBL_NAME[] = L2DBUS_MAKE_METANAME("dbus.invalid");
@@ -56,8 +56,13 @@ X(L2DBUS_MESSAGE_TYPE_ID, L2DBUS_MESSAGE_MTBL_NAME) \
 X(L2DBUS_PENDING_CALL_TYPE_ID, L2DBUS_PENDING_CALL_MTBL_NAME) \
 X(L2DBUS_SERVICE_OBJECT_TYPE_ID, L2DBUS_SERVICE_OBJECT_MTBL_NAME) \
 X(L2DBUS_INTERFACE_TYPE_ID, L2DBUS_INTERFACE_MTBL_NAME) \
+X(L2DBUS_INTERFACE_DESCRIPTOR_TYPE_ID, L2DBUS_INTERFACE_DESCRIPTOR_MTBL_NAME) \
 X(L2DBUS_INT64_TYPE_ID, L2DBUS_INT64_MTBL_NAME) \
 X(L2DBUS_UINT64_TYPE_ID, L2DBUS_UINT64_MTBL_NAME) \
+X(L2DBUS_STREAM_TYPE_ID, L2DBUS_STREAM_MTBL_NAME) \
+X(L2DBUS_REPLY_CONTEXT_TYPE_ID, L2DBUS_REPLY_CONTEXT_MTBL_NAME) \
+X(L2DBUS_SIGNAL_EMITTER_TYPE_ID, L2DBUS_SIGNAL_EMITTER_MTBL_NAME) \
+X(L2DBUS_GC_SENTINEL_TYPE_ID, L2DBUS_GC_SENTINEL_MTBL_NAME) \
 \
 X(L2DBUS_START_DBUS_TYPE_ID, L2DBUS_DBUS_START_MTBL_NAME) \
 X(L2DBUS_DBUS_INVALID_TYPE_ID, L2DBUS_DBUS_INVALID_MTBL_NAME) \
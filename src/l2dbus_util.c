@@ -31,6 +31,7 @@
  *===========================================================================
  */
 #include <stdlib.h>
+#include <time.h>
 #include "l2dbus_util.h"
 #include "lauxlib.h"
 #include "l2dbus_debug.h"
@@ -256,3 +257,53 @@ l2dbus_checkString
     return lua_tostring(L, nArg);
 }
 
+
+/**
+ * @brief Returns the current value of the monotonic clock.
+ *
+ * The returned time is unaffected by changes to the system (wall) clock
+ * and is suitable for measuring elapsed time.
+ *
+ * @return The time in milliseconds (with sub-millisecond precision).
+ */
+double
+l2dbus_getMonotonicTime
+    (
+    void
+    )
+{
+    struct timespec ts;
+
+    if ( 0 != clock_gettime(CLOCK_MONOTONIC, &ts) )
+    {
+        return 0.0;
+    }
+
+    return ((double)ts.tv_sec * 1000.0) + ((double)ts.tv_nsec / 1000000.0);
+}
+
+
+/**
+ * @brief Hashes a string (FNV-1a).
+ *
+ * @param [in] str  The string to hash or NULL.
+ * @return The hash of the string (NULL hashes like an empty string).
+ */
+unsigned
+l2dbus_hashString
+    (
+    const char* str
+    )
+{
+    unsigned hash = 2166136261U;
+
+    if ( NULL != str )
+    {
+        while ( '\0' != *str )
+        {
+            hash = (hash ^ (unsigned char)*str++) * 16777619U;
+        }
+    }
+
+    return hash;
+}
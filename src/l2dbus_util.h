@@ -46,5 +46,7 @@ const char* l2dbus_getTypeName(lua_State* L, int idx);
 void l2dbus_getGlobalField(lua_State* L, const char* name);
 l2dbus_Bool l2dbus_isString(lua_State* L, int nArg);
 const char* l2dbus_checkString(lua_State* L, int nArg);
+double l2dbus_getMonotonicTime(void);
+unsigned l2dbus_hashString(const char* str);
 
 #endif /* Guard for L2DBUS_UTIL_H_ */
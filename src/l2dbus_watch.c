@@ -67,6 +67,12 @@
  creation of non-referenced watches that will continue to trigger as long
  as they remain enabled.
 
+ By default a new @{EventTable} is created for every event delivered to a
+ Watch handler. Applications monitoring many descriptors can avoid this
+ garbage by switching a Watch to @{MODE_MASK} (the handler receives the
+ raw event bitmask) or @{MODE_BATCH} (every Watch signaled during a main
+ loop iteration is delivered to a single @{setBatchHandler|batch handler}).
+
  @namespace l2dbus.Watch
  */
 
@@ -206,6 +212,234 @@ l2dbus_watchParseEvents
 }
 
 
+/*
+ * Called once the watches signaled during a loop iteration have been
+ * collected to deliver them to the batch handler.
+ */
+static cdbus_Bool
+l2dbus_watchBatchHandler
+    (
+    cdbus_Timeout*  t,
+    void*           user
+    )
+{
+    l2dbus_Dispatcher* dispUd = (l2dbus_Dispatcher*)user;
+    int base;
+    lua_State* L = l2dbus_callbackBegin(&dispUd->cbCtx, &base);
+    unsigned count = dispUd->watchBatchCount;
+    unsigned nReady = 0U;
+    unsigned idx;
+    l2dbus_Watch* ud;
+
+    assert( NULL != L );
+
+    /* Watches signaled from here on start a new batch */
+    dispUd->watchBatchCount = 0U;
+    ++dispUd->watchBatchSeq;
+
+    if ( (0U < count) && (LUA_NOREF != dispUd->watchBatchCtx.funcRef) )
+    {
+        /* The arrays are handed over to the handler. A watch signaled
+         * while it runs (e.g. in a nested call) is collected in new
+         * arrays so the ones being delivered aren't disturbed.
+         */
+        lua_rawgeti(L, LUA_REGISTRYINDEX, dispUd->watchBatchWatchesRef);
+        lua_rawgeti(L, LUA_REGISTRYINDEX, dispUd->watchBatchMasksRef);
+        luaL_unref(L, LUA_REGISTRYINDEX, dispUd->watchBatchWatchesRef);
+        dispUd->watchBatchWatchesRef = LUA_NOREF;
+        luaL_unref(L, LUA_REGISTRYINDEX, dispUd->watchBatchMasksRef);
+        dispUd->watchBatchMasksRef = LUA_NOREF;
+
+        /* Watches disabled since they were signaled are dropped and the
+         * remaining ones moved down to keep the arrays dense.
+         */
+        for ( idx = 1U; idx <= count; ++idx )
+        {
+            lua_rawgeti(L, base + 1, idx);
+            ud = (l2dbus_Watch*)lua_touserdata(L, -1);
+            if ( !cdbus_watchIsEnabled(ud->watch) )
+            {
+                lua_pop(L, 1);
+                continue;
+            }
+
+            if ( ++nReady < idx )
+            {
+                lua_rawseti(L, base + 1, nReady);
+                lua_rawgeti(L, base + 2, idx);
+                lua_rawseti(L, base + 2, nReady);
+            }
+            else
+            {
+                lua_pop(L, 1);
+            }
+        }
+        for ( idx = nReady + 1U; idx <= count; ++idx )
+        {
+            lua_pushnil(L);
+            lua_rawseti(L, base + 1, idx);
+        }
+
+        if ( 0U < nReady )
+        {
+            lua_pushvalue(L, base + 1);
+            lua_pushvalue(L, base + 2);
+            lua_pushinteger(L, nReady);
+            l2dbus_callbackInvoke(L, &dispUd->watchBatchCtx, 3 /* nArgs */,
+                                0, "Watch batch");
+            lua_settop(L, base + 2);
+        }
+
+        /* Reuse the arrays unless the handler was removed or a new batch
+         * was started in the meantime. The watches they anchor are
+         * released either way.
+         */
+        for ( idx = 1U; idx <= count; ++idx )
+        {
+            lua_pushnil(L);
+            lua_rawseti(L, base + 1, idx);
+        }
+        if ( (LUA_NOREF != dispUd->watchBatchCtx.funcRef) &&
+            (LUA_NOREF == dispUd->watchBatchWatchesRef) )
+        {
+            lua_pushvalue(L, base + 1);
+            dispUd->watchBatchWatchesRef = luaL_ref(L, LUA_REGISTRYINDEX);
+            lua_pushvalue(L, base + 2);
+            dispUd->watchBatchMasksRef = luaL_ref(L, LUA_REGISTRYINDEX);
+        }
+    }
+
+    /* Clean up the thread stack */
+    l2dbus_callbackEnd(L, base);
+
+    /* The return value is unused by CDBUS */
+    return CDBUS_TRUE;
+}
+
+
+/*
+ * Adds the watch userdata on the top of the stack and its signaled
+ * events to the batch. A watch signaled more than once before the batch
+ * is delivered appears once with the events combined.
+ */
+static void
+l2dbus_watchBatchAdd
+    (
+    lua_State*          L,
+    l2dbus_Watch*       ud,
+    cdbus_UInt32        events
+    )
+{
+    l2dbus_Dispatcher* dispUd = ud->dispUd;
+    cdbus_HResult rc;
+
+    if ( LUA_NOREF == dispUd->watchBatchWatchesRef )
+    {
+        lua_newtable(L);
+        dispUd->watchBatchWatchesRef = luaL_ref(L, LUA_REGISTRYINDEX);
+        lua_newtable(L);
+        dispUd->watchBatchMasksRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, dispUd->watchBatchMasksRef);
+    if ( (ud->batchSeq == dispUd->watchBatchSeq) && (0U != ud->batchIdx) )
+    {
+        lua_rawgeti(L, -1, ud->batchIdx);
+        events |= (cdbus_UInt32)lua_tointeger(L, -1);
+        lua_pop(L, 1);
+        lua_pushinteger(L, events);
+        lua_rawseti(L, -2, ud->batchIdx);
+        lua_pop(L, 1);
+        return;
+    }
+
+    ud->batchIdx = ++dispUd->watchBatchCount;
+    ud->batchSeq = dispUd->watchBatchSeq;
+    lua_pushinteger(L, events);
+    lua_rawseti(L, -2, ud->batchIdx);
+    lua_pop(L, 1);
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, dispUd->watchBatchWatchesRef);
+    lua_pushvalue(L, -2 /* Watch ud */);
+    lua_rawseti(L, -2, ud->batchIdx);
+    lua_pop(L, 1);
+
+    /* The first watch of a batch arms its delivery */
+    if ( 1U == dispUd->watchBatchCount )
+    {
+        /* A one-shot timeout may still report that it's enabled after
+         * it has expired so explicitly re-arm it.
+         */
+        cdbus_timeoutEnable(dispUd->watchBatchTimeout, CDBUS_FALSE);
+        rc = cdbus_timeoutEnable(dispUd->watchBatchTimeout, CDBUS_TRUE);
+        if ( CDBUS_FAILED(rc) )
+        {
+            L2DBUS_TRACE((L2DBUS_TRC_ERROR,
+                "Failed to arm watch batch timeout (0x%X)", rc));
+        }
+    }
+}
+
+
+/**
+ * @brief Initializes the watch batch of a dispatcher.
+ *
+ * @param [in] L      Lua state.
+ * @param [in] dispUd The Dispatcher userdata.
+ */
+void
+l2dbus_watchBatchInit
+    (
+    lua_State*          L,
+    l2dbus_Dispatcher*  dispUd
+    )
+{
+    assert( NULL != dispUd );
+
+    l2dbus_callbackInit(L, &dispUd->watchBatchCtx);
+    dispUd->watchBatchWatchesRef = LUA_NOREF;
+    dispUd->watchBatchMasksRef = LUA_NOREF;
+    dispUd->watchBatchCount = 0U;
+    dispUd->watchBatchSeq = 0UL;
+    dispUd->watchBatchTimeout = NULL;
+}
+
+
+/**
+ * @brief Releases the watch batch of a dispatcher.
+ *
+ * Watches that are still waiting to be delivered are dropped.
+ *
+ * @param [in] L      Lua state.
+ * @param [in] dispUd The Dispatcher userdata.
+ */
+void
+l2dbus_watchBatchFree
+    (
+    lua_State*          L,
+    l2dbus_Dispatcher*  dispUd
+    )
+{
+    assert( NULL != dispUd );
+
+    if ( NULL != dispUd->watchBatchTimeout )
+    {
+        cdbus_timeoutEnable(dispUd->watchBatchTimeout, CDBUS_FALSE);
+        cdbus_timeoutUnref(dispUd->watchBatchTimeout);
+        dispUd->watchBatchTimeout = NULL;
+    }
+
+    luaL_unref(L, LUA_REGISTRYINDEX, dispUd->watchBatchWatchesRef);
+    dispUd->watchBatchWatchesRef = LUA_NOREF;
+    luaL_unref(L, LUA_REGISTRYINDEX, dispUd->watchBatchMasksRef);
+    dispUd->watchBatchMasksRef = LUA_NOREF;
+    dispUd->watchBatchCount = 0U;
+    ++dispUd->watchBatchSeq;
+
+    l2dbus_callbackUnref(L, &dispUd->watchBatchCtx);
+}
+
+
 /**
  * @brief Processes watch events from the underlying CDBUS callback.
  *
@@ -225,9 +459,13 @@ l2dbus_watchHandler
     void*           user
     )
 {
-    lua_State* L = l2dbus_callbackGetThread();
-    const char* errMsg = "";
-    l2dbus_Watch* ud = l2dbus_objectRegistryGet(L, user);
+    /* The callback thread is resolved from the context of the Lua state
+     * that owns the watch.
+     */
+    const l2dbus_CallbackCtx* cbCtx = &((l2dbus_Watch*)user)->cbCtx;
+    int base;
+    lua_State* L = l2dbus_callbackBegin(cbCtx, &base);
+    l2dbus_Watch* ud = l2dbus_callbackPushObject(L, cbCtx, user);
 
     /* Nil or the Watch userdata is sitting at the top of the
      * stack at this point.
@@ -242,26 +480,28 @@ l2dbus_watchHandler
         L2DBUS_TRACE((L2DBUS_TRC_WARN,
             "Cannot call handler because the watch has been GC'ed"));
     }
+    else if ( (L2DBUS_WATCH_MODE_BATCH == ud->mode) &&
+            (LUA_NOREF != ud->dispUd->watchBatchCtx.funcRef) )
+    {
+        l2dbus_watchBatchAdd(L, ud, rcvEvents);
+    }
     else
     {
-        /* Push function and user value on the stack and execute the callback */
-        lua_rawgeti(L, LUA_REGISTRYINDEX, ud->cbCtx.funcRef);
-        lua_pushvalue(L, -2 /* Watch ud */);
-        l2dbus_watchMakeEvTable(L, rcvEvents);
-        lua_rawgeti(L, LUA_REGISTRYINDEX, ud->cbCtx.userRef);
-
-        if ( 0 != lua_pcall(L, 3 /* nArgs */, 0, 0) )
+        /* Push the Watch ud and events and execute the callback */
+        lua_pushvalue(L, -1);
+        if ( L2DBUS_WATCH_MODE_TABLE == ud->mode )
         {
-            if ( lua_isstring(L, -1) )
-            {
-                errMsg = lua_tostring(L, -1);
-            }
-            L2DBUS_TRACE((L2DBUS_TRC_ERROR, "Watch callback error: %s", errMsg));
+            l2dbus_watchMakeEvTable(L, rcvEvents);
         }
+        else
+        {
+            lua_pushinteger(L, rcvEvents);
+        }
+        l2dbus_callbackInvoke(L, &ud->cbCtx, 2 /* nArgs */, 0, "Watch");
     }
 
     /* Clean up the thread stack */
-    lua_settop(L, 0);
+    l2dbus_callbackEnd(L, base);
 
     /* The return value is unused by CDBUS */
     return CDBUS_TRUE;
@@ -286,7 +526,8 @@ l2dbus_watchHandler
 
  <ul>
  <li>*watch*        - The L2DBUS Watch instance</li>
- <li>*evTable*      - An table of signaled events. See @{EventTable}.</li>
+ <li>*evTable*      - An table of signaled events. See @{EventTable}. In
+ @{MODE_MASK} this is the bitmask of signaled events instead.</li>
  <li>*userToken*    - A value specified by the client when the watch is created.</li>
  </ul>
 
@@ -380,9 +621,11 @@ l2dbus_newWatch
     else
     {
         /* Reset the userdata structure */
-        l2dbus_callbackInit(&watchUd->cbCtx);
+        l2dbus_callbackInit(L, &watchUd->cbCtx);
+        watchUd->dispUd = dispUd;
         watchUd->dispUdRef = LUA_NOREF;
         watchUd->watchUdRef = LUA_NOREF;
+        watchUd->mode = L2DBUS_WATCH_MODE_TABLE;
 
         l2dbus_callbackRef(L, 4 /* func */, userIdx, &watchUd->cbCtx);
         watchUd->watch = cdbus_watchNew(dispUd->disp, fd, events,
@@ -410,6 +653,93 @@ l2dbus_newWatch
 
 
 
+/**
+ @function setBatchHandler
+
+ Sets the handler receiving the batched Watches of a dispatcher.
+
+ Watches in @{MODE_BATCH} that are signaled during a main loop iteration
+ are collected and delivered together in a single call once the
+ iteration's events have been dispatched. A Watch signaled several
+ times before delivery appears once with its events combined. With the
+ epoll main loop the batch is delivered at the end of the same
+ iteration. The libev and GLib loops deliver it at the start of the
+ next (non-blocking) iteration. The handler has a signature of the form:
+
+    function onWatches(watches, evMasks, count, userToken)
+
+ Where:
+
+ <ul>
+ <li>*watches*      - An array of the signaled Watch instances</li>
+ <li>*evMasks*      - An array (parallel to *watches*) of the bitmasks of
+ signaled events</li>
+ <li>*count*        - The number of signaled watches</li>
+ <li>*userToken*    - A value specified by the client when the handler is set.</li>
+ </ul>
+
+ The two arrays are reused for subsequent batches so only the first
+ *count* entries are valid and the arrays should not be retained by the
+ handler. A Watch that is disabled after it was signaled but before the
+ batch is delivered is left out of the batch.
+
+ @tparam userdata dispatcher The @{l2dbus.Dispatcher|dispatcher} whose
+ Watches are batched.
+ @tparam ?func handler The batch handler or **nil** to remove it. Any
+ Watches waiting to be delivered are dropped when the handler is removed.
+ @tparam ?any userToken User data that will be passed to the batch
+ handler when it's called. Can be any Lua value.
+ */
+static int
+l2dbus_watchSetBatchHandler
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Dispatcher* dispUd;
+    int userIdx = L2DBUS_CALLBACK_NOREF_NEEDED;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    dispUd = (l2dbus_Dispatcher*)luaL_checkudata(L, 1,
+                                L2DBUS_DISPATCHER_MTBL_NAME);
+
+    if ( lua_isnoneornil(L, 2) )
+    {
+        l2dbus_watchBatchFree(L, dispUd);
+        return 0;
+    }
+
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+    if ( lua_gettop(L) >= 3 )
+    {
+        userIdx = 3;
+    }
+
+    if ( NULL == dispUd->watchBatchTimeout )
+    {
+        dispUd->watchBatchTimeout = cdbus_timeoutNew(dispUd->disp, 0,
+                                    CDBUS_FALSE, l2dbus_watchBatchHandler,
+                                    dispUd);
+        if ( NULL == dispUd->watchBatchTimeout )
+        {
+            luaL_error(L, "Failed to allocate Watch batch timeout");
+        }
+
+        lua_newtable(L);
+        dispUd->watchBatchWatchesRef = luaL_ref(L, LUA_REGISTRYINDEX);
+        lua_newtable(L);
+        dispUd->watchBatchMasksRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+
+    l2dbus_callbackUnref(L, &dispUd->watchBatchCtx);
+    l2dbus_callbackRef(L, 2 /* func */, userIdx, &dispUd->watchBatchCtx);
+
+    return 0;
+}
+
+
 /**
  * @brief Called by Lua VM to GC/reclaim the Watch userdata.
  *
@@ -626,6 +956,74 @@ l2dbus_watchSetEnable
 }
 
 
+/**
+ @function setMode
+ @within Watch
+
+ Sets how signaled events are delivered.
+
+ In @{MODE_TABLE} (the default) the handler receives an @{EventTable}.
+ In @{MODE_MASK} it receives the bitmask of signaled events as a number
+ which avoids creating a table for every event. In @{MODE_BATCH} the
+ Watch is delivered along with all the other (batched) Watches signaled
+ during the same main loop iteration to the
+ @{setBatchHandler|batch handler} of the dispatcher once the iteration's
+ events have been dispatched. If the dispatcher has no batch handler the
+ Watch handler is called as in @{MODE_MASK}.
+
+ @tparam userdata watch The watch to configure.
+ @tparam number mode One of @{MODE_TABLE}, @{MODE_MASK}, or @{MODE_BATCH}.
+ */
+static int
+l2dbus_watchSetMode
+    (
+    lua_State*  L
+    )
+{
+    lua_Integer mode;
+    l2dbus_Watch* ud = (l2dbus_Watch*)luaL_checkudata(L, 1,
+                                                L2DBUS_WATCH_MTBL_NAME);
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    mode = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, (L2DBUS_WATCH_MODE_TABLE <= mode) &&
+                    (L2DBUS_WATCH_MODE_BATCH >= mode), 2,
+                    "invalid watch mode");
+
+    ud->mode = (int)mode;
+
+    return 0;
+}
+
+
+/**
+ @function mode
+ @within Watch
+
+ Returns how signaled events are delivered.
+
+ @tparam userdata watch The watch.
+ @treturn number One of @{MODE_TABLE}, @{MODE_MASK}, or @{MODE_BATCH}.
+ */
+static int
+l2dbus_watchMode
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Watch* ud = (l2dbus_Watch*)luaL_checkudata(L, 1,
+                                                L2DBUS_WATCH_MTBL_NAME);
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    lua_pushinteger(L, ud->mode);
+    return 1;
+}
+
+
 /**
  @function data
  @within Watch
@@ -698,6 +1096,8 @@ static const luaL_Reg l2dbus_watchMetaTable[] = {
     {"setEvents", l2dbus_watchSetEvents},
     {"data", l2dbus_watchData},
     {"setData", l2dbus_watchSetData},
+    {"setMode", l2dbus_watchSetMode},
+    {"mode", l2dbus_watchMode},
     {"__gc", l2dbus_watchDispose},
     {NULL, NULL},
 };
@@ -722,6 +1122,8 @@ l2dbus_openWatch
     lua_newtable(L);
     lua_pushcfunction(L, l2dbus_newWatch);
     lua_setfield(L, -2, "new");
+    lua_pushcfunction(L, l2dbus_watchSetBatchHandler);
+    lua_setfield(L, -2, "setBatchHandler");
 
 /**
  @constant READ
@@ -754,6 +1156,28 @@ l2dbus_openWatch
     lua_pushstring(L, "HANGUP");
     lua_pushinteger(L, DBUS_WATCH_HANGUP);
     lua_rawset(L, -3);
+
+/**
+ @constant MODE_TABLE
+ Signaled events are delivered to the Watch handler as an @{EventTable}.
+ */
+    lua_pushinteger(L, L2DBUS_WATCH_MODE_TABLE);
+    lua_setfield(L, -2, "MODE_TABLE");
+
+/**
+ @constant MODE_MASK
+ Signaled events are delivered to the Watch handler as a bitmask.
+ */
+    lua_pushinteger(L, L2DBUS_WATCH_MODE_MASK);
+    lua_setfield(L, -2, "MODE_MASK");
+
+/**
+ @constant MODE_BATCH
+ Signaled Watches are delivered together to the batch handler of the
+ dispatcher.
+ */
+    lua_pushinteger(L, L2DBUS_WATCH_MODE_BATCH);
+    lua_setfield(L, -2, "MODE_BATCH");
 }
 
 
@@ -39,16 +39,35 @@
 
 /* Forward declarations */
 struct cdbus_Watch;
+struct l2dbus_Dispatcher;
+
+/* How signaled events are delivered to Lua */
+typedef enum
+{
+    L2DBUS_WATCH_MODE_TABLE = 0,
+    L2DBUS_WATCH_MODE_MASK,
+    L2DBUS_WATCH_MODE_BATCH
+} l2dbus_WatchMode;
 
 typedef struct l2dbus_Watch
 {
-    struct cdbus_Watch* watch;
-    int                 dispUdRef;
-    int                 watchUdRef;
-    l2dbus_CallbackCtx  cbCtx;
+    struct cdbus_Watch*         watch;
+    /* Anchored by the dispatcher reference */
+    struct l2dbus_Dispatcher*   dispUd;
+    int                         dispUdRef;
+    int                         watchUdRef;
+    /* One of l2dbus_WatchMode */
+    int                         mode;
+    l2dbus_CallbackCtx          cbCtx;
+    /* Position in the pending batch (valid if batchSeq is current) */
+    unsigned                    batchIdx;
+    unsigned long               batchSeq;
 } l2dbus_Watch;
 
 int l2dbus_newWatch(lua_State* L);
 void l2dbus_openWatch(lua_State* L);
 
+void l2dbus_watchBatchInit(lua_State* L, struct l2dbus_Dispatcher* dispUd);
+void l2dbus_watchBatchFree(lua_State* L, struct l2dbus_Dispatcher* dispUd);
+
 #endif /* Guard for L2DBUS_WATCH_H_ */
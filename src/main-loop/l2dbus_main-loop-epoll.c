@@ -0,0 +1,1517 @@
+/*===========================================================================
+ *
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_main-loop-epoll.c
+ * @author         Glenn Schmottlach
+ * @brief          The epoll based main-loop module for L2DBUS.
+ *===========================================================================
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include "lua.h"
+#include "lauxlib.h"
+#include "dbus/dbus.h"
+#include "l2dbus_main-loop.h"
+#include "cdbus/cdbus.h"
+#include "l2dbus_compat.h"
+#include "l2dbus_types.h"
+#include "l2dbus_util.h"
+#include "l2dbus_alloc.h"
+#include "l2dbus_module.h"
+#include "queue.h"
+
+
+/**
+The L2DBUS epoll main loop implementation.
+
+This module provides a main loop built directly on the Linux epoll,
+timerfd, and eventfd interfaces. It has no dependencies beyond the C
+library and is intended for applications that don't already use libev or
+Glib and want the lowest possible dispatch overhead.
+
+ @module l2dbus-epoll
+ */
+
+#define L2DBUS_MAIN_LOOP_EPOLL_MAJOR_VER       (1)
+#define L2DBUS_MAIN_LOOP_EPOLL_MINOR_VER       (0)
+#define L2DBUS_MAIN_LOOP_EPOLL_RELEASE_VER     (0)
+#define L2DBUS_MAIN_LOOP_EPOLL_COPYRIGHT       "(c) Copyright 2013 XS-Embedded LLC"
+#define L2DBUS_MAIN_LOOP_EPOLL_AUTHOR          "Glenn Schmottlach"
+
+/* Default (and maximum) number of events harvested by one epoll_wait() */
+#define L2DBUS_EPOLL_DEFAULT_MAX_EVENTS        (256)
+#define L2DBUS_EPOLL_LIMIT_MAX_EVENTS          (4096)
+/* Number of events harvested by a pass nested within event dispatch */
+#define L2DBUS_EPOLL_NESTED_MAX_EVENTS         (32)
+
+#define L2DBUS_EPOLL_FAILURE(code) \
+    CDBUS_MAKE_HRESULT(CDBUS_SEV_FAILURE, CDBUS_FAC_CDBUS, (code))
+
+struct l2dbus_EpollLoop;
+
+/*
+ * A watch on a file descriptor. libdbus may create separate read and write
+ * watches for the same descriptor so watches are grouped by descriptor.
+ */
+typedef struct l2dbus_EpollWatch
+{
+    struct l2dbus_EpollLoop*        loop;
+    int                             fd;
+    cdbus_UInt32                    flags;
+    l2dbus_Bool                     enabled;
+    l2dbus_Bool                     destroyed;
+    cdbus_MainLoopWatchCbFunc       cbFunc;
+    void*                           data;
+    LIST_ENTRY(l2dbus_EpollWatch)   link;
+} l2dbus_EpollWatch;
+
+typedef struct l2dbus_EpollDescriptor
+{
+    /* The events currently registered with epoll (zero if not registered) */
+    cdbus_UInt32                    events;
+    LIST_HEAD(l2dbus_EpollWatchHead,
+                l2dbus_EpollWatch)  watches;
+} l2dbus_EpollDescriptor;
+
+typedef struct l2dbus_EpollTimer
+{
+    struct l2dbus_EpollLoop*        loop;
+    cdbus_Int32                     interval;
+    l2dbus_Bool                     repeat;
+    l2dbus_Bool                     enabled;
+    /* Absolute expiry time (msec) on the monotonic clock */
+    double                          expiry;
+    /* Position in the timer heap or -1 if not scheduled */
+    int                             heapIdx;
+    cdbus_MainLoopTimerCbFunc       cbFunc;
+    void*                           data;
+} l2dbus_EpollTimer;
+
+typedef struct l2dbus_EpollWakeup
+{
+    struct l2dbus_EpollLoop*        loop;
+    volatile int                    pending;
+    l2dbus_Bool                     destroyed;
+    cdbus_MainLoopWakeupCbFunc      cbFunc;
+    void*                           data;
+    LIST_ENTRY(l2dbus_EpollWakeup)  link;
+} l2dbus_EpollWakeup;
+
+typedef struct l2dbus_EpollLoop
+{
+    /* Must always be declared first */
+    cdbus_MainLoop                  base;
+    int                             refCnt;
+    int                             epollFd;
+    int                             timerFd;
+    int                             wakeupFd;
+    volatile int                    quit;
+    l2dbus_Bool                     edgeTriggered;
+    /* Depth of the (nested) passes currently dispatching events */
+    int                             dispatching;
+    /* Depth of the (nested) calls to iterate the loop */
+    int                             running;
+
+    /* Watches indexed by descriptor */
+    l2dbus_EpollDescriptor**        descs;
+    int                             nDescs;
+    /* Watches destroyed while dispatching events */
+    LIST_HEAD(l2dbus_EpollZombieHead,
+                l2dbus_EpollWatch)  zombies;
+
+    /* Min-heap of scheduled timers ordered by expiry */
+    l2dbus_EpollTimer**             timers;
+    int                             nTimers;
+    int                             timerCapacity;
+    /* The expiry currently programmed into the timerfd (zero if none) */
+    double                          armedExpiry;
+
+    LIST_HEAD(l2dbus_EpollWakeupHead,
+                l2dbus_EpollWakeup) wakeups;
+
+    struct epoll_event*             events;
+    int                             maxEvents;
+} l2dbus_EpollLoop;
+
+/*
+ * Extension of the base l2dbus_MainLoopUserData type
+ */
+typedef struct l2dbus_MainLoopEpollUserData
+{
+    /* Must always be declared first */
+    struct cdbus_MainLoop* loop;
+} l2dbus_MainLoopEpollUserData;
+
+
+/*
+ * Descriptor watches
+ */
+
+static l2dbus_EpollDescriptor*
+l2dbus_epollGetDescriptor
+    (
+    l2dbus_EpollLoop*   loop,
+    int                 fd
+    )
+{
+    l2dbus_EpollDescriptor** descs;
+    int nDescs;
+
+    if ( fd >= loop->nDescs )
+    {
+        nDescs = (0 == loop->nDescs) ? 64 : loop->nDescs;
+        while ( nDescs <= fd )
+        {
+            nDescs *= 2;
+        }
+        descs = (l2dbus_EpollDescriptor**)l2dbus_realloc(loop->descs,
+                                                nDescs * sizeof(*descs));
+        if ( NULL == descs )
+        {
+            return NULL;
+        }
+        memset(&descs[loop->nDescs], 0,
+                (nDescs - loop->nDescs) * sizeof(*descs));
+        loop->descs = descs;
+        loop->nDescs = nDescs;
+    }
+
+    if ( NULL == loop->descs[fd] )
+    {
+        loop->descs[fd] = (l2dbus_EpollDescriptor*)l2dbus_calloc(1,
+                                            sizeof(*loop->descs[fd]));
+        if ( NULL != loop->descs[fd] )
+        {
+            LIST_INIT(&loop->descs[fd]->watches);
+        }
+    }
+
+    return loop->descs[fd];
+}
+
+
+/*
+ * Brings the epoll registration of a descriptor in line with the
+ * union of its enabled watches.
+ */
+static cdbus_HResult
+l2dbus_epollUpdateDescriptor
+    (
+    l2dbus_EpollLoop*   loop,
+    int                 fd
+    )
+{
+    l2dbus_EpollDescriptor* desc = loop->descs[fd];
+    l2dbus_EpollWatch* watch;
+    struct epoll_event ev;
+    cdbus_UInt32 events = 0U;
+    int op;
+
+    LIST_FOREACH(watch, &desc->watches, link)
+    {
+        if ( watch->enabled && !watch->destroyed )
+        {
+            if ( watch->flags & DBUS_WATCH_READABLE )
+            {
+                events |= EPOLLIN;
+            }
+            if ( watch->flags & DBUS_WATCH_WRITABLE )
+            {
+                events |= EPOLLOUT;
+            }
+        }
+    }
+
+    if ( events == desc->events )
+    {
+        return CDBUS_RESULT_SUCCESS;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.data.fd = fd;
+    ev.events = events;
+    if ( loop->edgeTriggered )
+    {
+        ev.events |= EPOLLET;
+    }
+
+    if ( 0U == events )
+    {
+        op = EPOLL_CTL_DEL;
+    }
+    else if ( 0U == desc->events )
+    {
+        op = EPOLL_CTL_ADD;
+    }
+    else
+    {
+        op = EPOLL_CTL_MOD;
+    }
+
+    if ( (0 != epoll_ctl(loop->epollFd, op, fd, &ev)) &&
+        /* The descriptor may already have been closed */
+        !((EPOLL_CTL_DEL == op) && ((EBADF == errno) || (ENOENT == errno))) )
+    {
+        return L2DBUS_EPOLL_FAILURE(CDBUS_EC_INTERNAL);
+    }
+
+    desc->events = events;
+
+    return CDBUS_RESULT_SUCCESS;
+}
+
+
+static cdbus_MainLoopWatch*
+l2dbus_epollWatchNew
+    (
+    cdbus_MainLoop*             base,
+    cdbus_Descriptor            fd,
+    cdbus_UInt32                flags,
+    cdbus_MainLoopWatchCbFunc   cbFunc,
+    void*                       data
+    )
+{
+    l2dbus_EpollLoop* loop = (l2dbus_EpollLoop*)base;
+    l2dbus_EpollDescriptor* desc;
+    l2dbus_EpollWatch* watch = NULL;
+
+    if ( (0 <= fd) && (NULL != cbFunc) )
+    {
+        desc = l2dbus_epollGetDescriptor(loop, fd);
+        if ( NULL != desc )
+        {
+            watch = (l2dbus_EpollWatch*)l2dbus_calloc(1, sizeof(*watch));
+            if ( NULL != watch )
+            {
+                watch->loop = loop;
+                watch->fd = fd;
+                watch->flags = flags;
+                watch->cbFunc = cbFunc;
+                watch->data = data;
+                LIST_INSERT_HEAD(&desc->watches, watch, link);
+            }
+        }
+    }
+
+    return (cdbus_MainLoopWatch*)watch;
+}
+
+
+static void
+l2dbus_epollWatchDestroy
+    (
+    cdbus_MainLoop*         base,
+    cdbus_MainLoopWatch*    w
+    )
+{
+    l2dbus_EpollLoop* loop = (l2dbus_EpollLoop*)base;
+    l2dbus_EpollWatch* watch = (l2dbus_EpollWatch*)w;
+
+    if ( (NULL != watch) && !watch->destroyed )
+    {
+        watch->destroyed = L2DBUS_TRUE;
+        l2dbus_epollUpdateDescriptor(loop, watch->fd);
+        LIST_REMOVE(watch, link);
+
+        /* The watch may be referenced by the event being dispatched */
+        if ( loop->dispatching )
+        {
+            LIST_INSERT_HEAD(&loop->zombies, watch, link);
+        }
+        else
+        {
+            l2dbus_free(watch);
+        }
+    }
+}
+
+
+static cdbus_Bool
+l2dbus_epollWatchIsEnabled
+    (
+    cdbus_MainLoop*         base,
+    cdbus_MainLoopWatch*    w
+    )
+{
+    l2dbus_EpollWatch* watch = (l2dbus_EpollWatch*)w;
+
+    return (NULL != watch) && watch->enabled ? CDBUS_TRUE : CDBUS_FALSE;
+}
+
+
+static cdbus_HResult
+l2dbus_epollWatchEnable
+    (
+    cdbus_MainLoop*         base,
+    cdbus_MainLoopWatch*    w,
+    cdbus_Bool              option
+    )
+{
+    l2dbus_EpollWatch* watch = (l2dbus_EpollWatch*)w;
+
+    if ( NULL == watch )
+    {
+        return L2DBUS_EPOLL_FAILURE(CDBUS_EC_INVALID_PARAMETER);
+    }
+
+    watch->enabled = option ? L2DBUS_TRUE : L2DBUS_FALSE;
+
+    return l2dbus_epollUpdateDescriptor((l2dbus_EpollLoop*)base, watch->fd);
+}
+
+
+static cdbus_UInt32
+l2dbus_epollWatchGetFlags
+    (
+    cdbus_MainLoop*         base,
+    cdbus_MainLoopWatch*    w
+    )
+{
+    l2dbus_EpollWatch* watch = (l2dbus_EpollWatch*)w;
+
+    return (NULL != watch) ? watch->flags : 0U;
+}
+
+
+static cdbus_HResult
+l2dbus_epollWatchSetFlags
+    (
+    cdbus_MainLoop*         base,
+    cdbus_MainLoopWatch*    w,
+    cdbus_UInt32            flags
+    )
+{
+    l2dbus_EpollWatch* watch = (l2dbus_EpollWatch*)w;
+
+    if ( NULL == watch )
+    {
+        return L2DBUS_EPOLL_FAILURE(CDBUS_EC_INVALID_PARAMETER);
+    }
+
+    watch->flags = flags;
+
+    return l2dbus_epollUpdateDescriptor((l2dbus_EpollLoop*)base, watch->fd);
+}
+
+
+/*
+ * Timers
+ */
+
+static void
+l2dbus_epollHeapSwap
+    (
+    l2dbus_EpollLoop*   loop,
+    int                 i,
+    int                 j
+    )
+{
+    l2dbus_EpollTimer* t = loop->timers[i];
+
+    loop->timers[i] = loop->timers[j];
+    loop->timers[j] = t;
+    loop->timers[i]->heapIdx = i;
+    loop->timers[j]->heapIdx = j;
+}
+
+
+static void
+l2dbus_epollHeapUp
+    (
+    l2dbus_EpollLoop*   loop,
+    int                 idx
+    )
+{
+    int parent;
+
+    while ( 0 < idx )
+    {
+        parent = (idx - 1) / 2;
+        if ( loop->timers[parent]->expiry <= loop->timers[idx]->expiry )
+        {
+            break;
+        }
+        l2dbus_epollHeapSwap(loop, parent, idx);
+        idx = parent;
+    }
+}
+
+
+static void
+l2dbus_epollHeapDown
+    (
+    l2dbus_EpollLoop*   loop,
+    int                 idx
+    )
+{
+    int child;
+
+    for ( ;; )
+    {
+        child = (2 * idx) + 1;
+        if ( child >= loop->nTimers )
+        {
+            break;
+        }
+        if ( ((child + 1) < loop->nTimers) &&
+            (loop->timers[child + 1]->expiry < loop->timers[child]->expiry) )
+        {
+            ++child;
+        }
+        if ( loop->timers[idx]->expiry <= loop->timers[child]->expiry )
+        {
+            break;
+        }
+        l2dbus_epollHeapSwap(loop, idx, child);
+        idx = child;
+    }
+}
+
+
+static l2dbus_Bool
+l2dbus_epollTimerSchedule
+    (
+    l2dbus_EpollTimer*  timer,
+    double              expiry
+    )
+{
+    l2dbus_EpollLoop* loop = timer->loop;
+    l2dbus_EpollTimer** timers;
+    int capacity;
+
+    timer->expiry = expiry;
+
+    if ( 0 <= timer->heapIdx )
+    {
+        /* Already scheduled so just restore the heap order */
+        l2dbus_epollHeapUp(loop, timer->heapIdx);
+        l2dbus_epollHeapDown(loop, timer->heapIdx);
+        return L2DBUS_TRUE;
+    }
+
+    if ( loop->nTimers == loop->timerCapacity )
+    {
+        capacity = (0 == loop->timerCapacity) ? 16 : (2 * loop->timerCapacity);
+        timers = (l2dbus_EpollTimer**)l2dbus_realloc(loop->timers,
+                                            capacity * sizeof(*timers));
+        if ( NULL == timers )
+        {
+            return L2DBUS_FALSE;
+        }
+        loop->timers = timers;
+        loop->timerCapacity = capacity;
+    }
+
+    timer->heapIdx = loop->nTimers++;
+    loop->timers[timer->heapIdx] = timer;
+    l2dbus_epollHeapUp(loop, timer->heapIdx);
+
+    return L2DBUS_TRUE;
+}
+
+
+static void
+l2dbus_epollTimerUnschedule
+    (
+    l2dbus_EpollTimer*  timer
+    )
+{
+    l2dbus_EpollLoop* loop = timer->loop;
+    int idx = timer->heapIdx;
+
+    if ( 0 <= idx )
+    {
+        --loop->nTimers;
+        if ( idx != loop->nTimers )
+        {
+            l2dbus_epollHeapSwap(loop, idx, loop->nTimers);
+            l2dbus_epollHeapUp(loop, idx);
+            l2dbus_epollHeapDown(loop, idx);
+        }
+        timer->heapIdx = -1;
+    }
+}
+
+
+static cdbus_MainLoopTimer*
+l2dbus_epollTimerNew
+    (
+    cdbus_MainLoop*             base,
+    cdbus_Int32                 msecInterval,
+    cdbus_Bool                  repeat,
+    cdbus_MainLoopTimerCbFunc   cbFunc,
+    void*                       data
+    )
+{
+    l2dbus_EpollTimer* timer = NULL;
+
+    if ( NULL != cbFunc )
+    {
+        timer = (l2dbus_EpollTimer*)l2dbus_calloc(1, sizeof(*timer));
+        if ( NULL != timer )
+        {
+            timer->loop = (l2dbus_EpollLoop*)base;
+            timer->interval = (0 > msecInterval) ? 0 : msecInterval;
+            timer->repeat = repeat ? L2DBUS_TRUE : L2DBUS_FALSE;
+            timer->heapIdx = -1;
+            timer->cbFunc = cbFunc;
+            timer->data = data;
+        }
+    }
+
+    return (cdbus_MainLoopTimer*)timer;
+}
+
+
+static void
+l2dbus_epollTimerDestroy
+    (
+    cdbus_MainLoop*         base,
+    cdbus_MainLoopTimer*    t
+    )
+{
+    l2dbus_EpollTimer* timer = (l2dbus_EpollTimer*)t;
+
+    if ( NULL != timer )
+    {
+        l2dbus_epollTimerUnschedule(timer);
+        l2dbus_free(timer);
+    }
+}
+
+
+static cdbus_Bool
+l2dbus_epollTimerIsEnabled
+    (
+    cdbus_MainLoop*         base,
+    cdbus_MainLoopTimer*    t
+    )
+{
+    l2dbus_EpollTimer* timer = (l2dbus_EpollTimer*)t;
+
+    return (NULL != timer) && timer->enabled ? CDBUS_TRUE : CDBUS_FALSE;
+}
+
+
+static cdbus_HResult
+l2dbus_epollTimerEnable
+    (
+    cdbus_MainLoop*         base,
+    cdbus_MainLoopTimer*    t,
+    cdbus_Bool              option
+    )
+{
+    l2dbus_EpollTimer* timer = (l2dbus_EpollTimer*)t;
+
+    if ( NULL == timer )
+    {
+        return L2DBUS_EPOLL_FAILURE(CDBUS_EC_INVALID_PARAMETER);
+    }
+
+    if ( option )
+    {
+        if ( !l2dbus_epollTimerSchedule(timer,
+                l2dbus_getMonotonicTime() + timer->interval) )
+        {
+            return L2DBUS_EPOLL_FAILURE(CDBUS_EC_ALLOC_FAILURE);
+        }
+        timer->enabled = L2DBUS_TRUE;
+    }
+    else
+    {
+        l2dbus_epollTimerUnschedule(timer);
+        timer->enabled = L2DBUS_FALSE;
+    }
+
+    return CDBUS_RESULT_SUCCESS;
+}
+
+
+static cdbus_Int32
+l2dbus_epollTimerGetInterval
+    (
+    cdbus_MainLoop*         base,
+    cdbus_MainLoopTimer*    t
+    )
+{
+    l2dbus_EpollTimer* timer = (l2dbus_EpollTimer*)t;
+
+    return (NULL != timer) ? timer->interval : -1;
+}
+
+
+static cdbus_HResult
+l2dbus_epollTimerSetInterval
+    (
+    cdbus_MainLoop*         base,
+    cdbus_MainLoopTimer*    t,
+    cdbus_Int32             msecInterval
+    )
+{
+    l2dbus_EpollTimer* timer = (l2dbus_EpollTimer*)t;
+
+    if ( (NULL == timer) || (0 > msecInterval) )
+    {
+        return L2DBUS_EPOLL_FAILURE(CDBUS_EC_INVALID_PARAMETER);
+    }
+
+    timer->interval = msecInterval;
+
+    /* Restart an enabled timer with the new interval */
+    if ( timer->enabled )
+    {
+        return l2dbus_epollTimerEnable(base, t, CDBUS_TRUE);
+    }
+
+    return CDBUS_RESULT_SUCCESS;
+}
+
+
+static cdbus_Bool
+l2dbus_epollTimerGetRepeat
+    (
+    cdbus_MainLoop*         base,
+    cdbus_MainLoopTimer*    t
+    )
+{
+    l2dbus_EpollTimer* timer = (l2dbus_EpollTimer*)t;
+
+    return (NULL != timer) && timer->repeat ? CDBUS_TRUE : CDBUS_FALSE;
+}
+
+
+static cdbus_HResult
+l2dbus_epollTimerSetRepeat
+    (
+    cdbus_MainLoop*         base,
+    cdbus_MainLoopTimer*    t,
+    cdbus_Bool              repeat
+    )
+{
+    l2dbus_EpollTimer* timer = (l2dbus_EpollTimer*)t;
+
+    if ( NULL == timer )
+    {
+        return L2DBUS_EPOLL_FAILURE(CDBUS_EC_INVALID_PARAMETER);
+    }
+
+    timer->repeat = repeat ? L2DBUS_TRUE : L2DBUS_FALSE;
+
+    return CDBUS_RESULT_SUCCESS;
+}
+
+
+/*
+ * Programs the timerfd with the expiry of the earliest timer. The timerfd
+ * is only touched when the earliest expiry changes.
+ */
+static void
+l2dbus_epollArmTimerFd
+    (
+    l2dbus_EpollLoop*   loop
+    )
+{
+    struct itimerspec spec;
+    double expiry = (0 < loop->nTimers) ? loop->timers[0]->expiry : 0.0;
+
+    if ( expiry != loop->armedExpiry )
+    {
+        memset(&spec, 0, sizeof(spec));
+        if ( 0.0 < expiry )
+        {
+            spec.it_value.tv_sec = (time_t)(expiry / 1000.0);
+            spec.it_value.tv_nsec = (long)((expiry -
+                    ((double)spec.it_value.tv_sec * 1000.0)) * 1000000.0);
+            /* An all zero value would disarm the timer */
+            if ( (0 == spec.it_value.tv_sec) && (0 == spec.it_value.tv_nsec) )
+            {
+                spec.it_value.tv_nsec = 1;
+            }
+        }
+        timerfd_settime(loop->timerFd, TFD_TIMER_ABSTIME, &spec, NULL);
+        loop->armedExpiry = expiry;
+    }
+}
+
+
+static void
+l2dbus_epollDispatchTimers
+    (
+    l2dbus_EpollLoop*   loop
+    )
+{
+    l2dbus_EpollTimer* timer;
+    double now = l2dbus_getMonotonicTime();
+    int budget = loop->nTimers;
+
+    /* The budget prevents a zero interval repeating timer from
+     * starving everything else.
+     */
+    while ( (0 < loop->nTimers) && (0 < budget--) &&
+            (loop->timers[0]->expiry <= now) )
+    {
+        timer = loop->timers[0];
+        if ( timer->repeat )
+        {
+            /* Don't try to catch up on missed expirations */
+            timer->expiry += timer->interval;
+            if ( timer->expiry <= now )
+            {
+                timer->expiry = now + timer->interval;
+            }
+            l2dbus_epollHeapDown(loop, 0);
+        }
+        else
+        {
+            l2dbus_epollTimerUnschedule(timer);
+            timer->enabled = L2DBUS_FALSE;
+        }
+
+        /* The timer may be destroyed by the callback */
+        timer->cbFunc((cdbus_MainLoopTimer*)timer, timer->data);
+    }
+}
+
+
+/*
+ * Wakeups
+ */
+
+static cdbus_MainLoopWakeup*
+l2dbus_epollWakeupNew
+    (
+    cdbus_MainLoop*             base,
+    cdbus_MainLoopWakeupCbFunc  cbFunc,
+    void*                       data
+    )
+{
+    l2dbus_EpollLoop* loop = (l2dbus_EpollLoop*)base;
+    l2dbus_EpollWakeup* wakeup = NULL;
+
+    if ( NULL != cbFunc )
+    {
+        wakeup = (l2dbus_EpollWakeup*)l2dbus_calloc(1, sizeof(*wakeup));
+        if ( NULL != wakeup )
+        {
+            wakeup->loop = loop;
+            wakeup->cbFunc = cbFunc;
+            wakeup->data = data;
+            LIST_INSERT_HEAD(&loop->wakeups, wakeup, link);
+        }
+    }
+
+    return (cdbus_MainLoopWakeup*)wakeup;
+}
+
+
+static void
+l2dbus_epollWakeupDestroy
+    (
+    cdbus_MainLoop*         base,
+    cdbus_MainLoopWakeup*   w
+    )
+{
+    l2dbus_EpollLoop* loop = (l2dbus_EpollLoop*)base;
+    l2dbus_EpollWakeup* wakeup = (l2dbus_EpollWakeup*)w;
+
+    if ( NULL != wakeup )
+    {
+        if ( loop->dispatching )
+        {
+            /* Reaped once the wakeups have been dispatched */
+            wakeup->destroyed = L2DBUS_TRUE;
+        }
+        else
+        {
+            LIST_REMOVE(wakeup, link);
+            l2dbus_free(wakeup);
+        }
+    }
+}
+
+
+static void
+l2dbus_epollSignalFd
+    (
+    l2dbus_EpollLoop*   loop
+    )
+{
+    eventfd_t one = 1;
+    ssize_t n;
+
+    do
+    {
+        n = write(loop->wakeupFd, &one, sizeof(one));
+    }
+    while ( (0 > n) && (EINTR == errno) );
+}
+
+
+/* May be called from any thread */
+static void
+l2dbus_epollWakeupSignal
+    (
+    cdbus_MainLoop*         base,
+    cdbus_MainLoopWakeup*   w
+    )
+{
+    l2dbus_EpollWakeup* wakeup = (l2dbus_EpollWakeup*)w;
+
+    if ( NULL != wakeup )
+    {
+        wakeup->pending = 1;
+        l2dbus_epollSignalFd((l2dbus_EpollLoop*)base);
+    }
+}
+
+
+static void
+l2dbus_epollDispatchWakeups
+    (
+    l2dbus_EpollLoop*   loop
+    )
+{
+    l2dbus_EpollWakeup* wakeup;
+    l2dbus_EpollWakeup* next;
+    eventfd_t value;
+
+    /* Clear the (non-blocking) eventfd */
+    (void)eventfd_read(loop->wakeupFd, &value);
+
+    LIST_FOREACH(wakeup, &loop->wakeups, link)
+    {
+        if ( wakeup->pending && !wakeup->destroyed )
+        {
+            wakeup->pending = 0;
+            wakeup->cbFunc((cdbus_MainLoopWakeup*)wakeup, wakeup->data);
+        }
+    }
+
+    for ( wakeup = LIST_FIRST(&loop->wakeups); NULL != wakeup; wakeup = next )
+    {
+        next = LIST_NEXT(wakeup, link);
+        if ( wakeup->destroyed && (1 == loop->dispatching) )
+        {
+            LIST_REMOVE(wakeup, link);
+            l2dbus_free(wakeup);
+        }
+    }
+}
+
+
+/*
+ * The loop itself
+ */
+
+static void
+l2dbus_epollDispatchDescriptor
+    (
+    l2dbus_EpollLoop*   loop,
+    int                 fd,
+    cdbus_UInt32        events
+    )
+{
+    l2dbus_EpollDescriptor* desc;
+    l2dbus_EpollWatch* watch;
+    l2dbus_EpollWatch* next;
+    cdbus_UInt32 flags = 0U;
+
+    if ( (fd >= loop->nDescs) || (NULL == loop->descs[fd]) )
+    {
+        return;
+    }
+    desc = loop->descs[fd];
+
+    if ( events & EPOLLIN )
+    {
+        flags |= DBUS_WATCH_READABLE;
+    }
+    if ( events & EPOLLOUT )
+    {
+        flags |= DBUS_WATCH_WRITABLE;
+    }
+    if ( events & EPOLLERR )
+    {
+        flags |= DBUS_WATCH_ERROR;
+    }
+    if ( events & EPOLLHUP )
+    {
+        flags |= DBUS_WATCH_HANGUP;
+    }
+
+    /* Watches destroyed by a callback are parked on the zombie list
+     * until dispatching is finished so the next pointer stays valid.
+     */
+    for ( watch = LIST_FIRST(&desc->watches); NULL != watch; watch = next )
+    {
+        next = LIST_NEXT(watch, link);
+        if ( watch->enabled && !watch->destroyed &&
+            (0U != (flags & (watch->flags | DBUS_WATCH_ERROR | DBUS_WATCH_HANGUP))) )
+        {
+            watch->cbFunc((cdbus_MainLoopWatch*)watch,
+                        flags & (watch->flags | DBUS_WATCH_ERROR | DBUS_WATCH_HANGUP),
+                        watch->data);
+        }
+        if ( (NULL != next) && next->destroyed )
+        {
+            /* The next watch has moved to the zombie list so stop here.
+             * Anything left over is reported again on the next pass.
+             */
+            break;
+        }
+    }
+}
+
+
+static void
+l2dbus_epollReapZombies
+    (
+    l2dbus_EpollLoop*   loop
+    )
+{
+    l2dbus_EpollWatch* watch;
+
+    while ( NULL != (watch = LIST_FIRST(&loop->zombies)) )
+    {
+        LIST_REMOVE(watch, link);
+        l2dbus_free(watch);
+    }
+}
+
+
+/*
+ * Performs a single pass of the loop: wait (up to the next timer expiry
+ * if blocking) and dispatch every harvested event. A handler may run a
+ * nested pass (e.g. for a synchronous call) in which case events are
+ * harvested into a local buffer so the outer pass isn't disturbed.
+ */
+static void
+l2dbus_epollRunOnce
+    (
+    l2dbus_EpollLoop*   loop,
+    l2dbus_Bool         block
+    )
+{
+    int nEvents;
+    int idx;
+    int fd;
+    int timeout = block ? -1 : 0;
+    l2dbus_Bool timersDue = L2DBUS_FALSE;
+    uint64_t expirations;
+    struct epoll_event nested[L2DBUS_EPOLL_NESTED_MAX_EVENTS];
+    struct epoll_event* events = loop->events;
+    int maxEvents = loop->maxEvents;
+
+    if ( 0 < loop->dispatching )
+    {
+        events = nested;
+        maxEvents = L2DBUS_EPOLL_NESTED_MAX_EVENTS;
+    }
+
+    if ( 0 < loop->nTimers )
+    {
+        if ( loop->timers[0]->expiry <= l2dbus_getMonotonicTime() )
+        {
+            /* Don't wait on anything if a timer is already due */
+            timeout = 0;
+            timersDue = L2DBUS_TRUE;
+        }
+    }
+    if ( !timersDue )
+    {
+        l2dbus_epollArmTimerFd(loop);
+    }
+
+    nEvents = epoll_wait(loop->epollFd, events, maxEvents, timeout);
+    if ( 0 > nEvents )
+    {
+        /* Most likely EINTR */
+        return;
+    }
+
+    ++loop->dispatching;
+    for ( idx = 0; idx < nEvents; ++idx )
+    {
+        fd = events[idx].data.fd;
+        if ( fd == loop->timerFd )
+        {
+            (void)read(loop->timerFd, &expirations, sizeof(expirations));
+            loop->armedExpiry = 0.0;
+            timersDue = L2DBUS_TRUE;
+        }
+        else if ( fd == loop->wakeupFd )
+        {
+            l2dbus_epollDispatchWakeups(loop);
+        }
+        else
+        {
+            l2dbus_epollDispatchDescriptor(loop, fd, events[idx].events);
+        }
+    }
+    if ( 0 == --loop->dispatching )
+    {
+        l2dbus_epollReapZombies(loop);
+    }
+
+    /* A (zero interval) timer armed by a handler during this pass is
+     * run at the end of it rather than on the next pass.
+     */
+    if ( !timersDue && (0 < loop->nTimers) &&
+        (loop->timers[0]->expiry <= l2dbus_getMonotonicTime()) )
+    {
+        timersDue = L2DBUS_TRUE;
+    }
+
+    if ( timersDue )
+    {
+        l2dbus_epollDispatchTimers(loop);
+    }
+}
+
+
+static void
+l2dbus_epollLoopIterate
+    (
+    cdbus_MainLoop*     base,
+    cdbus_RunOption     option
+    )
+{
+    l2dbus_EpollLoop* loop = (l2dbus_EpollLoop*)base;
+
+    /* A nested pass mustn't forget a request to quit the outer one */
+    if ( 0 == loop->running )
+    {
+        loop->quit = 0;
+    }
+    ++loop->running;
+
+    switch ( option )
+    {
+        case CDBUS_RUN_NO_WAIT:
+            l2dbus_epollRunOnce(loop, L2DBUS_FALSE);
+            break;
+
+        case CDBUS_RUN_ONCE:
+            l2dbus_epollRunOnce(loop, L2DBUS_TRUE);
+            break;
+
+        case CDBUS_RUN_WAIT:
+        default:
+            while ( !loop->quit )
+            {
+                l2dbus_epollRunOnce(loop, L2DBUS_TRUE);
+            }
+            break;
+    }
+
+    --loop->running;
+}
+
+
+/* May be called from any thread */
+static void
+l2dbus_epollLoopQuit
+    (
+    cdbus_MainLoop* base
+    )
+{
+    l2dbus_EpollLoop* loop = (l2dbus_EpollLoop*)base;
+
+    loop->quit = 1;
+    l2dbus_epollSignalFd(loop);
+}
+
+
+static cdbus_MainLoop*
+l2dbus_epollLoopRef
+    (
+    cdbus_MainLoop* base
+    )
+{
+    l2dbus_EpollLoop* loop = (l2dbus_EpollLoop*)base;
+
+    if ( NULL != loop )
+    {
+        ++loop->refCnt;
+    }
+
+    return base;
+}
+
+
+static void
+l2dbus_epollLoopUnref
+    (
+    cdbus_MainLoop* base
+    )
+{
+    l2dbus_EpollLoop* loop = (l2dbus_EpollLoop*)base;
+    l2dbus_EpollWatch* watch;
+    l2dbus_EpollWakeup* wakeup;
+    int idx;
+
+    if ( (NULL == loop) || (0 < --loop->refCnt) )
+    {
+        return;
+    }
+
+    /* Free anything that wasn't explicitly destroyed */
+    for ( idx = 0; idx < loop->nDescs; ++idx )
+    {
+        if ( NULL != loop->descs[idx] )
+        {
+            while ( NULL != (watch = LIST_FIRST(&loop->descs[idx]->watches)) )
+            {
+                LIST_REMOVE(watch, link);
+                l2dbus_free(watch);
+            }
+            l2dbus_free(loop->descs[idx]);
+        }
+    }
+    l2dbus_epollReapZombies(loop);
+    for ( idx = 0; idx < loop->nTimers; ++idx )
+    {
+        l2dbus_free(loop->timers[idx]);
+    }
+    while ( NULL != (wakeup = LIST_FIRST(&loop->wakeups)) )
+    {
+        LIST_REMOVE(wakeup, link);
+        l2dbus_free(wakeup);
+    }
+
+    if ( 0 <= loop->wakeupFd )
+    {
+        close(loop->wakeupFd);
+    }
+    if ( 0 <= loop->timerFd )
+    {
+        close(loop->timerFd);
+    }
+    if ( 0 <= loop->epollFd )
+    {
+        close(loop->epollFd);
+    }
+    l2dbus_free(loop->descs);
+    l2dbus_free(loop->timers);
+    l2dbus_free(loop->events);
+    l2dbus_free(loop);
+}
+
+
+static l2dbus_EpollLoop*
+l2dbus_epollLoopNew
+    (
+    l2dbus_Bool edgeTriggered,
+    int         maxEvents
+    )
+{
+    struct epoll_event ev;
+    l2dbus_EpollLoop* loop = (l2dbus_EpollLoop*)l2dbus_calloc(1, sizeof(*loop));
+
+    if ( NULL == loop )
+    {
+        return NULL;
+    }
+
+    loop->refCnt = 1;
+    loop->edgeTriggered = edgeTriggered;
+    loop->maxEvents = maxEvents;
+    LIST_INIT(&loop->zombies);
+    LIST_INIT(&loop->wakeups);
+
+    loop->base.loopRef = l2dbus_epollLoopRef;
+    loop->base.loopUnref = l2dbus_epollLoopUnref;
+    loop->base.loopIterate = l2dbus_epollLoopIterate;
+    loop->base.loopQuit = l2dbus_epollLoopQuit;
+    loop->base.loopPre = NULL;
+    loop->base.loopPost = NULL;
+    loop->base.watchNew = l2dbus_epollWatchNew;
+    loop->base.watchDestroy = l2dbus_epollWatchDestroy;
+    loop->base.watchIsEnabled = l2dbus_epollWatchIsEnabled;
+    loop->base.watchEnable = l2dbus_epollWatchEnable;
+    loop->base.watchGetFlags = l2dbus_epollWatchGetFlags;
+    loop->base.watchSetFlags = l2dbus_epollWatchSetFlags;
+    loop->base.timerNew = l2dbus_epollTimerNew;
+    loop->base.timerDestroy = l2dbus_epollTimerDestroy;
+    loop->base.timerIsEnabled = l2dbus_epollTimerIsEnabled;
+    loop->base.timerEnable = l2dbus_epollTimerEnable;
+    loop->base.timerGetInterval = l2dbus_epollTimerGetInterval;
+    loop->base.timerSetInterval = l2dbus_epollTimerSetInterval;
+    loop->base.timerGetRepeat = l2dbus_epollTimerGetRepeat;
+    loop->base.timerSetRepeat = l2dbus_epollTimerSetRepeat;
+    loop->base.wakeupNew = l2dbus_epollWakeupNew;
+    loop->base.wakeupDestroy = l2dbus_epollWakeupDestroy;
+    loop->base.wakeupSignal = l2dbus_epollWakeupSignal;
+
+    loop->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    loop->timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    loop->wakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    loop->events = (struct epoll_event*)l2dbus_malloc(
+                                    maxEvents * sizeof(*loop->events));
+
+    if ( (0 > loop->epollFd) || (0 > loop->timerFd) ||
+        (0 > loop->wakeupFd) || (NULL == loop->events) )
+    {
+        l2dbus_epollLoopUnref(&loop->base);
+        return NULL;
+    }
+
+    /* The internal descriptors are always level-triggered */
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = loop->timerFd;
+    if ( 0 == epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, loop->timerFd, &ev) )
+    {
+        ev.data.fd = loop->wakeupFd;
+        if ( 0 == epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, loop->wakeupFd, &ev) )
+        {
+            return loop;
+        }
+    }
+
+    l2dbus_epollLoopUnref(&loop->base);
+    return NULL;
+}
+
+
+/**
+ Epoll main loop module version table.
+
+ A table containing version information for the epoll-based main loop module.
+
+ @table mainLoopEpollVersionInfo
+ @field mainLoopEpollMajor The epoll main loop major version.
+ @field mainLoopEpollMinor The epoll main loop minor version.
+ @field mainLoopEpollRelease The epoll main loop release version.
+ @field copyright The L2DBUS epoll main loop module copyright information.
+ @field author The L2DBUS epoll main loop author information.
+ */
+
+/**
+ @function getVersion
+
+ Returns version information about the L2DBUS epoll module.
+
+ This function returns a table containing useful version
+ information related to the module itself.
+
+ @treturn table @{mainLoopEpollVersionInfo}
+*/
+static int
+l2dbus_mainLoopGetVersion
+    (
+    lua_State*  L
+    )
+{
+    lua_newtable(L);
+    lua_pushinteger(L, L2DBUS_MAIN_LOOP_EPOLL_MAJOR_VER);
+    lua_setfield(L, -2, "mainLoopEpollMajor");
+    lua_pushinteger(L, L2DBUS_MAIN_LOOP_EPOLL_MINOR_VER);
+    lua_setfield(L, -2, "mainLoopEpollMinor");
+    lua_pushinteger(L, L2DBUS_MAIN_LOOP_EPOLL_RELEASE_VER);
+    lua_setfield(L, -2, "mainLoopEpollRelease");
+
+    lua_pushliteral(L, L2DBUS_MAIN_LOOP_EPOLL_COPYRIGHT);
+    lua_setfield(L, -2, "copyright");
+    lua_pushliteral(L, L2DBUS_MAIN_LOOP_EPOLL_AUTHOR);
+    lua_setfield(L, -2, "author");
+
+    return 1;
+}
+
+
+/**
+ * @brief Called by Lua VM to GC/reclaim the Main Loop userdata.
+ *
+ * This method is called by the Lua VM to reclaim the Main Loop
+ * userdata.
+ *
+ * @return nil
+ *
+ */
+static int
+l2dbus_mainLoopDispose
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_MainLoopEpollUserData* ud = (l2dbus_MainLoopEpollUserData*)
+        luaL_checkudata(L, -1, L2DBUS_MAIN_LOOP_MTBL_NAME);
+
+    /* Dispatchers hold their own reference to the loop */
+    if ( NULL != ud->loop )
+    {
+        l2dbus_epollLoopUnref(ud->loop);
+        ud->loop = NULL;
+    }
+
+    return 0;
+}
+
+
+/**
+ @function MainLoop.new
+
+ Creates a new L2DBUS epoll-based main loop.
+
+ Constructs a new main loop built directly on the Linux epoll, timerfd,
+ and eventfd interfaces. Each pass of the loop harvests up to *maxEvents*
+ ready descriptors with a single system call and dispatches all of them
+ before waiting again. Timers are kept in a heap and share a single
+ timerfd that is only re-programmed when the earliest expiry changes.
+
+ The optional table of options may contain the following fields:
+
+ <ul>
+ <li>maxEvents - The maximum number of events harvested per pass of the
+ loop (default 256).</li>
+ <li>edgeTriggered - If **true** the D-Bus watches are registered as
+ edge-triggered (default **false**). This saves a system call per event
+ but is only safe if every watch handler drains its descriptor. Since
+ libdbus may stop reading before a socket is drained this should only be
+ enabled for applications that don't rely on the default D-Bus
+ transports.</li>
+ </ul>
+
+ @tparam ?table options Optional loop options.
+ @treturn userdata MainLoop userdata object
+ */
+static int
+l2dbus_mainLoopNew
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_MainLoopEpollUserData* loopUd;
+    l2dbus_Bool edgeTriggered = L2DBUS_FALSE;
+    lua_Integer maxEvents = L2DBUS_EPOLL_DEFAULT_MAX_EVENTS;
+    int optType = lua_type(L, 1);
+
+    if ( LUA_TTABLE == optType )
+    {
+        lua_getfield(L, 1, "edgeTriggered");
+        edgeTriggered = lua_toboolean(L, -1) ? L2DBUS_TRUE : L2DBUS_FALSE;
+        lua_pop(L, 1);
+
+        lua_getfield(L, 1, "maxEvents");
+        if ( !lua_isnil(L, -1) )
+        {
+            maxEvents = luaL_checkinteger(L, -1);
+            luaL_argcheck(L, (0 < maxEvents) &&
+                        (L2DBUS_EPOLL_LIMIT_MAX_EVENTS >= maxEvents), 1,
+                        "maxEvents out of range");
+        }
+        lua_pop(L, 1);
+    }
+    else if ( (LUA_TNONE != optType) && (LUA_TNIL != optType) )
+    {
+        luaL_argcheck(L, 0, 1, "expected an options table");
+    }
+
+    loopUd = (l2dbus_MainLoopEpollUserData*)lua_newuserdata(L, sizeof(*loopUd));
+    if ( NULL == loopUd )
+    {
+        luaL_error(L, "Failed to create main loop userdata!");
+    }
+    else
+    {
+        loopUd->loop = NULL;
+
+        /* Assign the main loop meta-table */
+        luaL_getmetatable(L, L2DBUS_MAIN_LOOP_MTBL_NAME);
+        lua_setmetatable(L, -2);
+
+        loopUd->loop = (cdbus_MainLoop*)l2dbus_epollLoopNew(edgeTriggered,
+                                                        (int)maxEvents);
+        if ( NULL == loopUd->loop )
+        {
+            luaL_error(L, "Failed to allocate epoll main loop!");
+        }
+    }
+
+    return 1;
+}
+
+
+/* Meta-table for epoll Main Loop type */
+static const luaL_Reg l2dbus_mainLoopEpollMetaTable[] =
+{
+    {"__gc", l2dbus_mainLoopDispose},
+    {NULL, NULL},
+};
+
+
+/* Module top-level functions */
+static const luaL_Reg l2dbus_mainLoopModuleTable[] =
+{
+    {"getVersion", l2dbus_mainLoopGetVersion},
+    {NULL, NULL},
+};
+
+
+/* Main loop top-level functions */
+static const luaL_Reg l2dbus_mainLoopLoopTable[] =
+{
+    {"new", l2dbus_mainLoopNew},
+    {NULL, NULL},
+};
+
+
+int
+luaopen_l2dbus_epoll
+    (
+    lua_State* L
+    )
+{
+    luaL_checkversion(L);
+
+    /* Create a Main Loop meta-table and pop off the meta-table */
+    lua_pop(L, l2dbus_createMetatable(L, L2DBUS_MAIN_LOOP_TYPE_ID,
+        l2dbus_mainLoopEpollMetaTable));
+
+    luaL_newlib(L, l2dbus_mainLoopModuleTable);
+    luaL_newlib(L, l2dbus_mainLoopLoopTable);
+
+    /* Assign main loop table to the top-level module table */
+    lua_setfield(L, -2, "MainLoop");
+
+    /*
+     * ** KLUDGE **
+     * Keep the module loaded until the program exits so that finalizers
+     * run by older Lua versions never call into an unloaded library (see
+     * the libev main loop module for the details).
+     */
+    l2dbus_moduleRef(L, "l2dbus_epoll");
+
+    return 1;
+}
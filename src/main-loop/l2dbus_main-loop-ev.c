@@ -61,6 +61,21 @@ This module provides the main-loop abstraction around the libev library.
 const char* const L2DBUS_LOOP_MT = "ev{loop}";
 #define L2DBUS_LIBEV_UNINITIALIZED_DEFAULT_LOOP ((struct ev_loop*)1)
 
+/* The registry key used to anchor the module context */
+#define L2DBUS_MAIN_LOOP_EV_CONTEXT_KEY     "l2dbus.ev.context"
+
+/*
+ * Module state kept per Lua state. It's anchored in the registry of
+ * the Lua state so that independent Lua states don't share it.
+ */
+typedef struct l2dbus_MainLoopEvContext
+{
+    /* The Lua thread used to run all libev callbacks */
+    lua_State*  thread;
+    int         threadRef;
+
+} l2dbus_MainLoopEvContext;
+
 /*
  * Extension of the base l2dbus_MainLoopUserData type
  */
@@ -79,12 +94,26 @@ typedef struct l2dbus_MainLoopEvUserData
     /* Old libev loop user data */
     void* oldLoopUserData;
 
+    /* The module context of the Lua state owning the loop */
+    l2dbus_MainLoopEvContext* evCtx;
+
 } l2dbus_MainLoopEvUserData;
 
 
-/* The Lua thread used to run all libev callbacks */
-static lua_State*  gLuaLibevThread = NULL;
-static int gLuaLibevThreadRef = LUA_NOREF;
+static l2dbus_MainLoopEvContext*
+l2dbus_mainLoopGetContext
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_MainLoopEvContext* evCtx;
+
+    lua_getfield(L, LUA_REGISTRYINDEX, L2DBUS_MAIN_LOOP_EV_CONTEXT_KEY);
+    evCtx = (l2dbus_MainLoopEvContext*)lua_touserdata(L, -1);
+    lua_pop(L, 1);
+
+    return evCtx;
+}
 
 
 static void
@@ -93,10 +122,20 @@ l2dbus_mainLoopThreadInit
     lua_State*   L
     )
 {
-    if ( NULL == gLuaLibevThread )
+    l2dbus_MainLoopEvContext* evCtx = l2dbus_mainLoopGetContext(L);
+
+    if ( NULL == evCtx )
+    {
+        evCtx = (l2dbus_MainLoopEvContext*)lua_newuserdata(L, sizeof(*evCtx));
+        evCtx->thread = NULL;
+        evCtx->threadRef = LUA_NOREF;
+        lua_setfield(L, LUA_REGISTRYINDEX, L2DBUS_MAIN_LOOP_EV_CONTEXT_KEY);
+    }
+
+    if ( NULL == evCtx->thread )
     {
-        gLuaLibevThread = lua_newthread(L);
-        gLuaLibevThreadRef = luaL_ref(L, LUA_REGISTRYINDEX);
+        evCtx->thread = lua_newthread(L);
+        evCtx->threadRef = luaL_ref(L, LUA_REGISTRYINDEX);
     }
 }
 
@@ -124,9 +163,14 @@ l2dbus_mainLoopThreadFree
     lua_State*  L
     )
 {
-    luaL_unref(L, LUA_REGISTRYINDEX, gLuaLibevThreadRef);
-    gLuaLibevThread = NULL;
-    gLuaLibevThreadRef = LUA_NOREF;
+    l2dbus_MainLoopEvContext* evCtx = l2dbus_mainLoopGetContext(L);
+
+    if ( NULL != evCtx )
+    {
+        luaL_unref(L, LUA_REGISTRYINDEX, evCtx->threadRef);
+        evCtx->thread = NULL;
+        evCtx->threadRef = LUA_NOREF;
+    }
 
     return 0;
 }
@@ -256,16 +300,19 @@ l2dbus_mainLoopPreLoop
     cdbus_MainLoopEv* mainLoopEv = (cdbus_MainLoopEv*)loop;
     l2dbus_MainLoopEvUserData* loopUd;
 
-    if ( (NULL != mainLoopEv) && (NULL != gLuaLibevThread) )
+    if ( NULL != mainLoopEv )
     {
         loopUd = mainLoopEv->userData;
+        if ( NULL != loopUd->evCtx->thread )
+        {
 #if EV_MULTIPLICITY
-        loopUd->oldLoopUserData = ev_userdata(mainLoopEv->loop);
-        ev_set_userdata(mainLoopEv->loop, gLuaLibevThread);
+            loopUd->oldLoopUserData = ev_userdata(mainLoopEv->loop);
+            ev_set_userdata(mainLoopEv->loop, loopUd->evCtx->thread);
 #else
-        loopUd->oldLoopUserData = ev_userdata();
-        ev_set_userdata(gLuaLibevThread);
+            loopUd->oldLoopUserData = ev_userdata();
+            ev_set_userdata(loopUd->evCtx->thread);
 #endif
+        }
 
     }
 }
@@ -280,14 +327,17 @@ l2dbus_mainLoopPostLoop
     cdbus_MainLoopEv* mainLoopEv = (cdbus_MainLoopEv*)loop;
     l2dbus_MainLoopEvUserData* loopUd;
 
-    if ( (NULL != mainLoopEv) && (NULL != gLuaLibevThread) )
+    if ( NULL != mainLoopEv )
     {
         loopUd = mainLoopEv->userData;
+        if ( NULL != loopUd->evCtx->thread )
+        {
 #if EV_MULTIPLICITY
-        ev_set_userdata(mainLoopEv->loop, loopUd->oldLoopUserData);
+            ev_set_userdata(mainLoopEv->loop, loopUd->oldLoopUserData);
 #else
-        ev_set_userdata(loopUd->oldLoopUserData);
+            ev_set_userdata(loopUd->oldLoopUserData);
 #endif
+        }
 
     }
 }
@@ -340,13 +390,14 @@ l2dbus_mainLoopNew
 {
     struct ev_loop* evLoop = NULL;
     l2dbus_MainLoopEvUserData* loopUd;
+    l2dbus_MainLoopEvContext* evCtx = l2dbus_mainLoopGetContext(L);
 
     /* Check to see if a Lua libev loop userdata was passed
      * in for use as the main loop.
      */
     int loopType = lua_type(L, 1);
 
-    if ( NULL == gLuaLibevThread )
+    if ( (NULL == evCtx) || (NULL == evCtx->thread) )
     {
         luaL_error(L, "Module failed to initialized or was shut down");
     }
@@ -385,6 +436,7 @@ l2dbus_mainLoopNew
     {
         loopUd->loopRef = LUA_NOREF;
         loopUd->oldLoopUserData = NULL;
+        loopUd->evCtx = evCtx;
 
         /* Assign the main loop meta-table */
         luaL_getmetatable(L, L2DBUS_MAIN_LOOP_MTBL_NAME);
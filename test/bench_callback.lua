@@ -0,0 +1,107 @@
+#!/usr/bin/env lua
+------------------------------------------------------------------------------
+-- l2dbus callback overhead benchmark
+--
+-- Measures the cost of delivering a callback from C to a Lua handler.
+-- A pipe is kept readable so its Watch handler is called on every main
+-- loop iteration. The time per callback is compared against calling the
+-- same handler directly from Lua so the difference approximates the cost
+-- of a main loop iteration plus the per-callback overhead of the binding.
+--
+-- Options:
+--  --loop=[ev|epoll|glib]  -- The main loop back-end (default ev)
+--  --count=[n]             -- Number of callbacks measured (default 200000)
+------------------------------------------------------------------------------
+
+local l2dbus = require("l2dbus")
+local posix = require("posix")
+
+local function now()
+    local sec, nsec = posix.clock_gettime("monotonic")
+    return sec * 1000.0 + nsec / 1000000.0
+end
+
+local function parseArgs()
+    local opts = { loop = "ev", count = 200000 }
+    for _, a in ipairs(arg) do
+        local key, value = a:match("^%-%-(%w+)=(.+)$")
+        if key == "loop" then
+            opts.loop = value
+        elseif key == "count" then
+            opts.count = tonumber(value)
+        else
+            io.stderr:write("Unknown option: " .. a .. "\n")
+            os.exit(1)
+        end
+    end
+    return opts
+end
+
+local function newMainLoop(name)
+    if name == "epoll" then
+        return require("l2dbus_epoll").MainLoop.new()
+    elseif name == "glib" then
+        return require("l2dbus_glib").MainLoop.new()
+    else
+        return require("l2dbus_ev").MainLoop.new()
+    end
+end
+
+-- Calls a Watch handler 'count' times (the pipe is never drained)
+local function benchWatch(disp, count, mode)
+    local rd, wr = posix.pipe()
+    local remaining = count
+    local watch = l2dbus.Watch.new(disp, rd, l2dbus.Watch.READ,
+        function(w, ev, user)
+            remaining = remaining - 1
+            if remaining == 0 then
+                disp:stop()
+            end
+        end, "token")
+    watch:setMode(mode)
+    posix.write(wr, "x")
+    watch:setEnable(true)
+
+    local start = now()
+    disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+    local elapsed = now() - start
+
+    watch:setEnable(false)
+    posix.close(rd)
+    posix.close(wr)
+    return elapsed
+end
+
+-- The same number of calls made directly from Lua
+local function benchLua(count)
+    local remaining = count
+    local handler = function(w, ev, user)
+        remaining = remaining - 1
+    end
+    local start = now()
+    for i = 1, count do
+        handler(nil, 1, "token")
+    end
+    return now() - start
+end
+
+local function report(name, count, elapsed)
+    print(string.format("%-24s %d calls in %.1f msec (%.3f usec/call)",
+        name, count, elapsed, elapsed * 1000.0 / count))
+end
+
+local function main()
+    local opts = parseArgs()
+    local disp = l2dbus.Dispatcher.new(newMainLoop(opts.loop))
+
+    print(string.format("Main loop: %s", opts.loop))
+    report("Lua -> Lua", opts.count, benchLua(opts.count))
+    report("C -> Lua (mask)", opts.count,
+        benchWatch(disp, opts.count, l2dbus.Watch.MODE_MASK))
+    report("C -> Lua (table)", opts.count,
+        benchWatch(disp, opts.count, l2dbus.Watch.MODE_TABLE))
+end
+
+main()
+collectgarbage("collect")
+l2dbus.shutdown()
@@ -0,0 +1,155 @@
+#!/usr/bin/env lua
+------------------------------------------------------------------------------
+-- l2dbus main loop benchmark
+--
+-- Compares the wakeup latency and per-event overhead of the main loop
+-- back-ends. Run it once per back-end and compare the results, e.g.
+--
+--      lua ./bench_mainloop.lua --loop=ev
+--      lua ./bench_mainloop.lua --loop=epoll
+--
+-- Options:
+--  --loop=[ev|epoll|glib]  -- The main loop back-end (default ev)
+--  --mode=[table|mask|batch] -- How watch events are delivered (default table)
+--  --count=[n]             -- Number of events per test (default 100000)
+--  --timers=[n]            -- Number of timer wakeups measured (default 1000)
+------------------------------------------------------------------------------
+
+local l2dbus = require("l2dbus")
+local posix = require("posix")
+
+local function now()
+    local sec, nsec = posix.clock_gettime("monotonic")
+    return sec * 1000.0 + nsec / 1000000.0
+end
+
+local function parseArgs()
+    local opts = { loop = "ev", mode = "table", count = 100000, timers = 1000 }
+    for _, a in ipairs(arg) do
+        local key, value = a:match("^%-%-(%w+)=(.+)$")
+        if key == "loop" or key == "mode" then
+            opts[key] = value
+        elseif key == "count" or key == "timers" then
+            opts[key] = tonumber(value)
+        else
+            io.stderr:write("Unknown option: " .. a .. "\n")
+            os.exit(1)
+        end
+    end
+    return opts
+end
+
+local function newMainLoop(name)
+    if name == "epoll" then
+        return require("l2dbus_epoll").MainLoop.new()
+    elseif name == "glib" then
+        return require("l2dbus_glib").MainLoop.new()
+    else
+        return require("l2dbus_ev").MainLoop.new()
+    end
+end
+
+-- Percentile of a sorted array
+local function pct(sorted, p)
+    local idx = math.max(1, math.ceil(#sorted * p / 100))
+    return sorted[idx]
+end
+
+-- Measures the time from a descriptor becoming readable until the
+-- watch handler runs and the cost of each round trip through the loop.
+local function benchWatch(disp, count, mode)
+    local rd, wr = posix.pipe()
+    local remaining = count
+    local sentAt = 0
+    local latencies = {}
+
+    local function onReadable()
+        posix.read(rd, 1)
+        latencies[#latencies + 1] = now() - sentAt
+        remaining = remaining - 1
+        if remaining == 0 then
+            disp:stop()
+        else
+            sentAt = now()
+            posix.write(wr, "x")
+        end
+    end
+
+    local watch = l2dbus.Watch.new(disp, rd, l2dbus.Watch.READ,
+        function(w, ev) onReadable() end)
+    if mode == "mask" then
+        watch:setMode(l2dbus.Watch.MODE_MASK)
+    elseif mode == "batch" then
+        watch:setMode(l2dbus.Watch.MODE_BATCH)
+        l2dbus.Watch.setBatchHandler(disp,
+            function(watches, evMasks, n)
+                for i = 1, n do onReadable() end
+            end)
+    end
+    watch:setEnable(true)
+
+    local start = now()
+    sentAt = now()
+    posix.write(wr, "x")
+    disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+    local elapsed = now() - start
+
+    watch:setEnable(false)
+    l2dbus.Watch.setBatchHandler(disp, nil)
+    posix.close(rd)
+    posix.close(wr)
+
+    table.sort(latencies)
+    return elapsed, latencies
+end
+
+-- Measures how late a one-shot 1 msec timer fires.
+local function benchTimer(disp, count)
+    local remaining = count
+    local armedAt = 0
+    local lateness = {}
+    local timeout
+
+    timeout = l2dbus.Timeout.new(disp, 1, false,
+        function(t)
+            lateness[#lateness + 1] = now() - armedAt - 1.0
+            remaining = remaining - 1
+            if remaining == 0 then
+                disp:stop()
+            else
+                armedAt = now()
+                t:setEnable(false)
+                t:setEnable(true)
+            end
+        end)
+
+    armedAt = now()
+    timeout:setEnable(true)
+    disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+    timeout:setEnable(false)
+
+    table.sort(lateness)
+    return lateness
+end
+
+local function main()
+    local opts = parseArgs()
+    local disp = l2dbus.Dispatcher.new(newMainLoop(opts.loop))
+
+    print(string.format("Main loop: %s (watch mode %s)", opts.loop, opts.mode))
+
+    local elapsed, lat = benchWatch(disp, opts.count, opts.mode)
+    print(string.format("Watch: %d events in %.1f msec (%.2f usec/event)",
+        opts.count, elapsed, elapsed * 1000.0 / opts.count))
+    print(string.format("  wakeup latency usec: p50=%.2f p99=%.2f max=%.2f",
+        pct(lat, 50) * 1000.0, pct(lat, 99) * 1000.0, lat[#lat] * 1000.0))
+
+    local late = benchTimer(disp, opts.timers)
+    print(string.format("Timer: %d x 1 msec one-shot", opts.timers))
+    print(string.format("  lateness usec: p50=%.2f p99=%.2f max=%.2f",
+        pct(late, 50) * 1000.0, pct(late, 99) * 1000.0, late[#late] * 1000.0))
+end
+
+main()
+collectgarbage("collect")
+l2dbus.shutdown()
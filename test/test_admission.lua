@@ -0,0 +1,136 @@
+#!/usr/bin/env lua
+
+local l2dbus = require("l2dbus")
+local testUtils = require("utils.l2dbusUtils")
+
+local TEST_BUS_NAME = "org.l2dbus.test.Admission"
+local TEST_OBJECT = "/org/l2dbus/test/Admission"
+local TEST_SLOW_OBJECT = "/org/l2dbus/test/Admission/Slow"
+local TEST_INTERFACE = "org.l2dbus.test.Admission"
+local TEST_ERROR = "org.l2dbus.test.Error.Busy"
+local N_SLOW_CALLS = 5
+
+local function newCall(path, member)
+    return testUtils.newCall(TEST_BUS_NAME, path, TEST_INTERFACE, member)
+end
+
+local function main()
+    local disp, conn = testUtils.openService(TEST_BUS_NAME)
+    local clientA = testUtils.openSession(disp)
+    local clientB = testUtils.openSession(disp)
+
+    -- Deferred replies keep their requests in-flight
+    local desc = l2dbus.InterfaceDescriptor.new(TEST_INTERFACE, {
+        methods = {
+            { name = "Wait", args = { { name = "reply", sig = "s", dir = "out" } } },
+        },
+    })
+    local intf = l2dbus.Interface.new(desc)
+    local waiting = {}
+    intf:setMethodHandler("Wait", function(ctx)
+        assert(ctx:defer())
+        waiting[#waiting + 1] = ctx
+    end)
+    local obj = l2dbus.ServiceObject.new(TEST_OBJECT,
+        function() return l2dbus.Dbus.HANDLER_RESULT_NOT_YET_HANDLED end)
+    assert(obj:addInterface(intf))
+    assert(conn:registerServiceObject(obj))
+
+    assert(not pcall(obj.setAdmission, obj, {maxConcurrent = -1}))
+    assert(not pcall(obj.setAdmission, obj, {errorName = "not an error"}))
+    obj:setAdmission({maxPerSender = 2, maxConcurrent = 3})
+
+    -- Three admitted and two rejected whatever the order of arrival
+    local rejected = 0
+    local replied = 0
+    local function onReply(p)
+        local reply = p:stealReply()
+        if reply:getType() == l2dbus.Message.ERROR then
+            assert(reply:getErrorName() == l2dbus.Dbus.ERROR_LIMITS_EXCEEDED)
+            rejected = rejected + 1
+        else
+            assert(reply:getArgs() == "done")
+            replied = replied + 1
+        end
+
+        if (rejected == 2) and (replied == 0) and (#waiting == 3) then
+            local stats = obj:getAdmissionStats()
+            assert(stats.inFlight == 3)
+            assert(stats.rejected == 2)
+            assert(stats.rejectedSender + stats.rejectedConcurrent == 2)
+            for _, ctx in ipairs(waiting) do
+                ctx:reply("done")
+            end
+        elseif replied == 3 then
+            disp:stop()
+        end
+    end
+
+    for _, c in ipairs({clientA, clientA, clientA, clientB, clientB}) do
+        local _, pending = c:sendWithReply(newCall(TEST_OBJECT, "Wait"))
+        pending:setNotify(onReply)
+    end
+    disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+
+    local stats = obj:getAdmissionStats()
+    assert(stats.inFlight == 0)
+    assert(stats.senders == 0)
+    assert(stats.admitted == 3)
+    print(string.format("admitted=%d rejectedSender=%d rejectedConcurrent=%d",
+        stats.admitted, stats.rejectedSender, stats.rejectedConcurrent))
+
+    -- Requests queued behind slow handlers for too long are shed
+    local slowObj = l2dbus.ServiceObject.new(TEST_SLOW_OBJECT,
+        function(svcObj, c, req)
+            local start = os.clock()
+            while (os.clock() - start) < 0.03 do end
+            c:send(l2dbus.Message.newMethodReturn(req))
+            return l2dbus.Dbus.HANDLER_RESULT_HANDLED
+        end)
+    assert(conn:registerServiceObject(slowObj))
+    slowObj:setAdmission({maxQueueAge = 10, errorName = TEST_ERROR})
+
+    -- Every call is already waiting when the loop runs so at most one is
+    -- delivered per iteration and the rest outlive the queue age
+    local handled = 0
+    local shed = 0
+    for i = 1, N_SLOW_CALLS do
+        local _, pending = clientA:sendWithReply(newCall(TEST_SLOW_OBJECT, "Slow"))
+        pending:setNotify(function(p)
+            local reply = p:stealReply()
+            if reply:getType() == l2dbus.Message.ERROR then
+                assert(reply:getErrorName() == TEST_ERROR)
+                shed = shed + 1
+            else
+                handled = handled + 1
+            end
+            if handled + shed == N_SLOW_CALLS then
+                disp:stop()
+            end
+        end)
+    end
+    clientA:flush()
+    disp:setBudget(1)
+    disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+    disp:setBudget(0)
+
+    stats = slowObj:getAdmissionStats()
+    print(string.format("handled=%d shed=%d", handled, shed))
+    assert(handled > 0)
+    assert(shed > 0)
+    assert(stats.rejectedAge > 0)
+    assert(stats.rejectedAge == shed)
+    assert(stats.inFlight == 0)
+
+    -- Passing nil removes every limit
+    slowObj:setAdmission(nil)
+    stats = slowObj:getAdmissionStats()
+    assert(stats.maxQueueAge == 0 and stats.maxPerSender == 0 and
+            stats.maxConcurrent == 0)
+
+    print("All admission tests passed")
+end
+
+main()
+collectgarbage("collect")
+l2dbus.shutdown()
@@ -0,0 +1,91 @@
+#!/usr/bin/env lua
+
+local l2dbus = require("l2dbus")
+local testUtils = require("utils.l2dbusUtils")
+
+local TEST_BUS_NAME = "org.l2dbus.test.Call"
+local TEST_OBJECT = "/org/l2dbus/test/Call"
+local TEST_INTERFACE = "org.l2dbus.test.Call"
+
+local function newCall(member)
+    return testUtils.newCall(TEST_BUS_NAME, TEST_OBJECT, TEST_INTERFACE, member)
+end
+
+local function main()
+    local disp, conn = testUtils.openService(TEST_BUS_NAME)
+
+    -- Timer ticks observed while a nested call was waiting
+    local ticks = 0
+    local ticksDuringCall = 0
+    local ticker = l2dbus.Timeout.new(disp, 5, true, function() ticks = ticks + 1 end)
+    ticker:setEnable(true)
+
+    local depthSeen = 0
+    -- Sends the inner reply (anchored here to outlive the handler)
+    local delayed
+    local obj = l2dbus.ServiceObject.new(TEST_OBJECT,
+        function(svcObj, c, req)
+            local member = req:getMember()
+            local reply = l2dbus.Message.newMethodReturn(req)
+            if member == "Outer" then
+                -- The inner request is serviced by this same connection
+                -- while the outer one waits for it.
+                local before = ticks
+                local inner, errName = c:call(newCall("Inner"))
+                assert(inner, errName)
+                ticksDuringCall = ticks - before
+                reply:addArgs(inner:getArgs())
+            elseif member == "Inner" then
+                depthSeen = select(3, disp:getCallNesting())
+                -- Reply late enough for the ticker to come due while the
+                -- outer request waits
+                reply:addArgs("inner")
+                delayed = l2dbus.Timeout.new(disp, 30, false, function()
+                    c:send(reply)
+                end)
+                delayed:setEnable(true)
+                return l2dbus.Dbus.HANDLER_RESULT_HANDLED
+            else
+                return l2dbus.Dbus.HANDLER_RESULT_NOT_YET_HANDLED
+            end
+            c:send(reply)
+            return l2dbus.Dbus.HANDLER_RESULT_HANDLED
+        end)
+    assert(conn:registerServiceObject(obj))
+
+    disp:setCallNesting(2)
+    assert(select(1, disp:getCallNesting()) == 2)
+
+    -- A second connection acts as the client
+    local client = testUtils.openSession(disp)
+    local _, pending = client:sendWithReply(newCall("Outer"))
+    pending:setNotify(function(p)
+        local reply = p:stealReply()
+        assert(reply:getType() == l2dbus.Message.METHOD_RETURN)
+        assert(reply:getArgs() == "inner")
+        disp:stop()
+    end)
+
+    disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+    ticker:setEnable(false)
+
+    assert(depthSeen == 1)
+    assert(select(3, disp:getCallNesting()) == 0)
+    print(string.format("ticks during nested call=%d", ticksDuringCall))
+    assert(ticksDuringCall > 0)
+
+    -- Without nesting a call made outside of any handler still works
+    disp:setCallNesting(0)
+    local reply = conn:call(l2dbus.Message.newMethodCall({
+                                    destination = l2dbus.Dbus.SERVICE_DBUS,
+                                    path        = l2dbus.Dbus.PATH_DBUS,
+                                    interface   = l2dbus.Dbus.INTERFACE_DBUS,
+                                    method      = "GetId"}))
+    assert(type(reply:getArgs()) == "string")
+
+    print("All nested call tests passed")
+end
+
+main()
+collectgarbage("collect")
+l2dbus.shutdown()
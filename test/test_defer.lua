@@ -0,0 +1,53 @@
+#!/usr/bin/env lua
+
+local l2dbus = require("l2dbus")
+
+local function main()
+    local mainLoop
+    if (arg[1] == "--glib") or (arg[1] == "-g") then
+        mainLoop = require("l2dbus_glib").MainLoop.new()
+    else
+        mainLoop = require("l2dbus_ev").MainLoop.new()
+    end
+    local disp = l2dbus.Dispatcher.new(mainLoop)
+    assert(nil ~= disp)
+
+    local order = {}
+    local function record(...)
+        order[#order + 1] = table.concat({...}, ",")
+    end
+
+    disp:defer(record, "a", 1)
+    disp:defer(record, "b")
+    -- Coalesced: only the last arguments are used but the first position is kept
+    disp:deferKeyed("emit", record, "c", 1)
+    disp:defer(record, "d")
+    disp:deferKeyed("emit", record, "c", 2)
+
+    -- Idle functions run once nothing else is pending
+    local function onIdle()
+        record("idle")
+        disp:stop()
+    end
+    disp:idle(onIdle)
+    disp:idle(onIdle)
+
+    -- A function deferred from a deferred function runs on a later iteration
+    disp:defer(function()
+        record("e")
+        disp:defer(record, "f")
+    end)
+
+    local pending, idle = disp:getDeferred()
+    assert(pending == 5 and idle == 1)
+
+    disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+
+    print(table.concat(order, " "))
+    assert(table.concat(order, " ") == "a,1 b c,2 d e f idle")
+    print("All defer tests passed")
+end
+
+main()
+collectgarbage("collect")
+l2dbus.shutdown()
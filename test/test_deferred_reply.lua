@@ -0,0 +1,123 @@
+#!/usr/bin/env lua
+
+local l2dbus = require("l2dbus")
+local testUtils = require("utils.l2dbusUtils")
+local service = require("l2dbus.service")
+
+local TEST_BUS_NAME = "org.l2dbus.test.Deferred"
+local TEST_OBJECT = "/org/l2dbus/test/Deferred"
+local TEST_INTERFACE = "org.l2dbus.test.Deferred"
+
+local TEST_METADATA = {
+    methods = {
+        {
+            name = "Later",
+            args = {
+                {sig = "i", name = "delay", dir = "in"},
+                {sig = "i", name = "result", dir = "out"}
+            }
+        },
+        {
+            name = "Never",
+            args = {}
+        }
+    }
+}
+
+local function newCall(method, ...)
+    return testUtils.newCall(TEST_BUS_NAME, TEST_OBJECT, TEST_INTERFACE, method,
+                            select("#", ...) > 0 and "i" or nil, ...)
+end
+
+local function main()
+    local disp, conn = testUtils.openService(TEST_BUS_NAME)
+
+    local svc = service.new(TEST_OBJECT, false)
+    assert(svc:addInterface(TEST_INTERFACE, TEST_METADATA))
+    svc:setDeferredLimit(3)
+
+    -- Replies after the given delay from a one-shot timeout. The timeouts
+    -- are anchored here so they can't be collected before they fire.
+    local timers = {}
+    svc:registerMethodHandler(TEST_INTERFACE, "Later", function(ctx, delay)
+        assert(ctx:defer(1000))
+        local t
+        t = l2dbus.Timeout.new(disp, delay, false, function()
+            assert(ctx:isDeferred())
+            ctx:reply(delay)
+            assert(not ctx:isDeferred())
+            timers[t] = nil
+        end)
+        timers[t] = true
+        t:setEnable(true)
+    end)
+    -- Never replies so the deadline is reached
+    local expiredCtx = {}
+    svc:registerMethodHandler(TEST_INTERFACE, "Never", function(ctx)
+        if ctx:defer(50) then
+            expiredCtx[#expiredCtx + 1] = ctx
+        end
+    end)
+    assert(svc:attach(conn))
+
+    local client = testUtils.openSession(disp)
+    local results = {}
+    local nPending = 0
+    local function call(method, ...)
+        local _, pending = client:sendWithReply(newCall(method, ...))
+        nPending = nPending + 1
+        pending:setNotify(function(p)
+            local reply = p:stealReply()
+            local key
+            if reply:getType() == l2dbus.Message.ERROR then
+                key = reply:getErrorName()
+            else
+                key = "reply"
+            end
+            results[key] = (results[key] or 0) + 1
+            nPending = nPending - 1
+            if nPending == 0 then
+                disp:stop()
+            end
+        end)
+    end
+
+    call("Later", 30)
+    call("Never")
+    call("Never")
+    -- Over the limit of three in-flight deferred replies
+    call("Never")
+
+    local inFlight = 0
+    local probe = l2dbus.Timeout.new(disp, 20, false, function()
+        local stats = svc:getDeferredStats()
+        inFlight = stats.inFlight
+        assert(stats.oldest > 0)
+    end)
+    probe:setEnable(true)
+    disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+
+    assert(inFlight == 3)
+    assert(results["reply"] == 1)
+    assert(results[l2dbus.Dbus.ERROR_TIMEOUT] == 2)
+    assert(results[l2dbus.Dbus.ERROR_LIMITS_EXCEEDED] == 1)
+
+    -- Replying once the deadline has passed sends nothing
+    assert(#expiredCtx == 2)
+    assert(not expiredCtx[1]:reply())
+    assert(not expiredCtx[1]:isDeferred())
+
+    local stats = svc:getDeferredStats()
+    print(string.format("deferred=%d expired=%d rejected=%d",
+        stats.deferred, stats.expired, stats.rejected))
+    assert(stats.inFlight == 0)
+    assert(stats.deferred == 3)
+    assert(stats.expired == 2)
+    assert(stats.rejected == 1)
+
+    print("All deferred reply tests passed")
+end
+
+main()
+collectgarbage("collect")
+l2dbus.shutdown()
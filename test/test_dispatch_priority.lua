@@ -0,0 +1,133 @@
+#!/usr/bin/env lua
+
+local l2dbus = require("l2dbus")
+local posix = require("posix")
+local testUtils = require("utils.l2dbusUtils")
+
+local TEST_BUS_NAME = "org.l2dbus.test.DispatchPriority"
+local TEST_PATH = "/org/l2dbus/test/"
+
+local HIGH = l2dbus.Dispatcher.PRIORITY_HIGH
+local NORMAL = l2dbus.Dispatcher.PRIORITY_NORMAL
+local LOW = l2dbus.Dispatcher.PRIORITY_LOW
+
+local function busyWait(msec)
+    local function now()
+        local sec, nsec = posix.clock_gettime("monotonic")
+        return sec * 1000.0 + nsec / 1000000.0
+    end
+    local deadline = now() + msec
+    while now() < deadline do end
+end
+
+local function main()
+    local disp, conn = testUtils.openService(TEST_BUS_NAME)
+    local client = testUtils.openSession(disp)
+
+    -- One object per priority class records the order of delivery
+    local order = {}
+    local expected = 0
+    local objects = {}
+    for _, class in ipairs({{"High", HIGH}, {"Normal", NORMAL}, {"Low", LOW}}) do
+        local name, prio = class[1], class[2]
+        local obj = l2dbus.ServiceObject.new(TEST_PATH .. name,
+            function(svcObj, c, req)
+                order[#order + 1] = name .. req:getArgs()
+                if #order == expected then
+                    disp:stop()
+                end
+                return l2dbus.Dbus.HANDLER_RESULT_HANDLED
+            end)
+        obj:setPriority(prio)
+        assert(obj:priority() == prio)
+        assert(conn:registerServiceObject(obj))
+        objects[#objects + 1] = obj
+    end
+
+    -- Sends the requests in one burst so they are all received before
+    -- the service dispatches them
+    local function burst(requests)
+        order = {}
+        expected = #requests
+        for _, req in ipairs(requests) do
+            local msg = testUtils.newCall(TEST_BUS_NAME, TEST_PATH .. req[1],
+                                        nil, "Ping", "i", req[2])
+            msg:setNoReply(true)
+            assert(client:send(msg))
+        end
+        client:flush()
+        busyWait(50)
+        disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+    end
+
+    -- A saturated budget delivers the queued requests by priority class
+    -- and in the order they were received within a class
+    disp:setBudget(1)
+    disp:setStarvationLimit(0)
+    local requests = {}
+    for _, name in ipairs({"Low", "Normal", "High"}) do
+        for idx = 1, 3 do
+            requests[#requests + 1] = {name, idx}
+        end
+    end
+    burst(requests)
+    -- The first request is delivered before the budget is used up
+    local strict = {"Low1", "High1", "High2", "High3", "Normal1", "Normal2",
+                    "Normal3", "Low2", "Low3"}
+    assert(#order == #strict)
+    for idx = 1, #strict do
+        assert(order[idx] == strict[idx],
+            string.format("#%d: %s ~= %s", idx, tostring(order[idx]),
+                        strict[idx]))
+    end
+
+    local stats = disp:getStats()
+    assert(stats.backlog == 0)
+    assert(stats.high.delivered == 3 and stats.high.depth == 0)
+    assert(stats.normal.delivered == 3)
+    assert(stats.low.delivered == 2)
+
+    -- Aging delivers low priority requests under sustained high priority load
+    local LIMIT = 2
+    local N_HIGH = 12
+    disp:setStarvationLimit(LIMIT)
+    requests = {{"High", 0}, {"Low", 1}, {"Low", 2}, {"Low", 3}}
+    for idx = 1, N_HIGH do
+        requests[#requests + 1] = {"High", idx}
+    end
+    burst(requests)
+    assert(#order == #requests)
+
+    assert(order[1] == "High0")
+    local lows = 0
+    local passedOver = 0
+    local lastHigh
+    for idx = 2, #order do
+        if order[idx]:find("^Low") then
+            lows = lows + 1
+            assert(order[idx] == "Low" .. lows)
+            passedOver = 0
+        else
+            lastHigh = idx
+            if lows < 3 then
+                passedOver = passedOver + 1
+                assert(passedOver <= LIMIT,
+                    "low priority request passed over too often")
+            end
+        end
+    end
+    assert(lows == 3)
+    assert(lastHigh == #order)
+
+    disp:setBudget(0)
+    disp:setStarvationLimit(8)
+    for _, obj in ipairs(objects) do
+        conn:unregisterServiceObject(obj)
+    end
+
+    print("All dispatch priority tests passed")
+end
+
+main()
+collectgarbage("collect")
+l2dbus.shutdown()
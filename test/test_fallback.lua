@@ -0,0 +1,137 @@
+#!/usr/bin/env lua
+
+local l2dbus = require("l2dbus")
+local testUtils = require("utils.l2dbusUtils")
+
+local TEST_BUS_NAME = "org.l2dbus.test.Fallback"
+local TEST_PARENT = "/org/l2dbus/test"
+local TEST_TREE = TEST_PARENT .. "/Tree"
+local TEST_INTERFACE = "org.l2dbus.test.Node"
+
+local function newCall(path, interface, method)
+    return testUtils.newCall(TEST_BUS_NAME, path, interface, method)
+end
+
+local function main()
+    local disp, conn = testUtils.openService(TEST_BUS_NAME)
+
+    -- The parent of the tree lists it once it's registered
+    local parent = l2dbus.ServiceObject.new(TEST_PARENT,
+        function() return l2dbus.Dbus.HANDLER_RESULT_NOT_YET_HANDLED end)
+    assert(parent:addInterface(l2dbus.Introspection.new()))
+    assert(conn:registerServiceObject(parent))
+    assert(not parent:introspect(conn, TEST_PARENT):find('name="Tree"', 1, true))
+
+    -- One handler serves every node of the tree
+    local handled = 0
+    local introspected = {}
+    local hnd = conn:registerFallback(TEST_TREE,
+        function(c, req, relPath, token)
+            assert(c == conn)
+            assert(token == "token")
+            if req:getMember() ~= "Where" then
+                return l2dbus.Dbus.HANDLER_RESULT_NOT_YET_HANDLED
+            end
+            handled = handled + 1
+            local reply = l2dbus.Message.newMethodReturn(req)
+            reply:addArgs(relPath)
+            c:send(reply)
+            return l2dbus.Dbus.HANDLER_RESULT_HANDLED
+        end,
+        function(c, relPath, token)
+            assert(token == "token")
+            introspected[#introspected + 1] = relPath
+            return string.format('<node name="%s"><interface name="%s"/></node>',
+                                relPath, TEST_INTERFACE)
+        end,
+        "token")
+    assert(nil ~= hnd)
+    assert(parent:introspect(conn, TEST_PARENT):find('name="Tree"', 1, true))
+
+    -- A registered object still gets its own messages
+    local special = l2dbus.ServiceObject.new(TEST_TREE .. "/special",
+        function(svcObj, c, req)
+            local reply = l2dbus.Message.newMethodReturn(req)
+            reply:addArgs("special")
+            c:send(reply)
+            return l2dbus.Dbus.HANDLER_RESULT_HANDLED
+        end)
+    assert(conn:registerServiceObject(special))
+
+    local client = testUtils.openSession(disp)
+    local results = {}
+    local pending = 0
+    local function request(key, path, interface, method)
+        pending = pending + 1
+        local _, p = client:sendWithReply(newCall(path, interface, method))
+        p:setNotify(function(pc)
+            local reply = pc:stealReply()
+            if reply:getType() == l2dbus.Message.METHOD_RETURN then
+                results[key] = reply:getArgs()
+            end
+            pending = pending - 1
+            if pending == 0 then
+                disp:stop()
+            end
+        end)
+    end
+
+    request("root", TEST_TREE, TEST_INTERFACE, "Where")
+    request("deep", TEST_TREE .. "/dev1/track2", TEST_INTERFACE, "Where")
+    request("special", TEST_TREE .. "/special", TEST_INTERFACE, "Where")
+    request("xml", TEST_TREE .. "/dev5", l2dbus.Dbus.INTERFACE_INTROSPECTABLE,
+            "Introspect")
+    request("sibling", TEST_TREE .. "Sibling", TEST_INTERFACE, "Where")
+    disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+
+    assert(results.root == "")
+    assert(results.deep == "dev1/track2")
+    assert(results.special == "special")
+    assert(results.xml:find('name="dev5"', 1, true))
+    assert(#introspected == 1 and introspected[1] == "dev5")
+    -- A path that only shares a prefix isn't part of the tree
+    assert(results.sibling == nil)
+    assert(handled == 2)
+
+    -- Subtree messages over the dispatch budget are queued, not dropped
+    local errors = 0
+    disp:setBudget(1)
+    for i = 1, 4 do
+        request("queued" .. i, TEST_TREE .. "/dev" .. i, TEST_INTERFACE, "Where")
+    end
+    pending = pending + 1
+    local _, p = client:sendWithReply(newCall(TEST_TREE .. "/dev1",
+                                            TEST_INTERFACE, "Unknown"))
+    p:setNotify(function(pc)
+        local reply = pc:stealReply()
+        assert(reply:getType() == l2dbus.Message.ERROR)
+        assert(reply:getErrorName() == l2dbus.Dbus.ERROR_UNKNOWN_METHOD)
+        errors = errors + 1
+        pending = pending - 1
+        if pending == 0 then
+            disp:stop()
+        end
+    end)
+    disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+    disp:setBudget(0)
+
+    for i = 1, 4 do
+        assert(results["queued" .. i] == "dev" .. i)
+    end
+    assert(errors == 1)
+    assert(handled == 6)
+
+    -- The path can't be taken twice
+    assert(not pcall(conn.registerFallback, conn, TEST_TREE, function() end))
+    assert(not pcall(conn.registerFallback, conn, "not/a/path", function() end))
+
+    assert(conn:unregisterFallback(hnd))
+    assert(not conn:unregisterFallback(hnd))
+    assert(not parent:introspect(conn, TEST_PARENT):find('name="Tree"', 1, true))
+
+    print("All fallback tests passed")
+end
+
+main()
+collectgarbage("collect")
+l2dbus.shutdown()
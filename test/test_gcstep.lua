@@ -0,0 +1,48 @@
+#!/usr/bin/env lua
+
+local l2dbus = require("l2dbus")
+
+local function main()
+    local mainLoop
+    if (arg[1] == "--glib") or (arg[1] == "-g") then
+        mainLoop = require("l2dbus_glib").MainLoop.new()
+    else
+        mainLoop = require("l2dbus_ev").MainLoop.new()
+    end
+    local disp = l2dbus.Dispatcher.new(mainLoop)
+
+    -- Only collect garbage in 64 KB steps, at most 2 msec per idle period
+    disp:setGcStepping(64, 2, true)
+
+    -- Generate garbage in short bursts leaving the loop idle in between
+    local ticks = 0
+    local t = l2dbus.Timeout.new(disp, 20, true, function(t)
+        ticks = ticks + 1
+        local garbage = {}
+        for i = 1, 20000 do
+            garbage[i] = { i, tostring(i) }
+        end
+        if ticks == 100 then
+            disp:stop()
+        end
+    end)
+    t:setEnable(true)
+    disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+    t:setEnable(false)
+
+    local stats = disp:getGcStats()
+    for k, v in pairs(stats) do
+        print(k, v)
+    end
+    assert(stats.steps > 0)
+    assert(stats.idleCycles > 0)
+    -- The regular collector is stopped so no cycle can complete in a handler
+    assert(stats.callbackCycles == 0)
+
+    disp:setGcStepping(nil)
+    print("All GC stepping tests passed")
+end
+
+main()
+collectgarbage("collect")
+l2dbus.shutdown()
@@ -0,0 +1,153 @@
+#!/usr/bin/env lua
+
+local l2dbus = require("l2dbus")
+local testUtils = require("utils.l2dbusUtils")
+local service = require("l2dbus.service")
+
+local TEST_BUS_NAME = "org.l2dbus.test.Descriptor"
+local TEST_ROOT = "/org/l2dbus/test/Descriptor"
+local TEST_INTERFACE = "org.l2dbus.test.Shared"
+local TEST_XML_INTERFACE = "org.l2dbus.test.SharedXml"
+local N_OBJECTS = 100
+
+local TEST_DESCRIPTION = {
+    methods = {
+        { name = "Echo",
+          args = { { name = "text", sig = "s", dir = "in" },
+                   { name = "reply", sig = "s", dir = "out" } } },
+    },
+    signals = {
+        { name = "Changed", args = { { name = "level", sig = "i" } } },
+    },
+    properties = {
+        { name = "Level", sig = "i", access = "rw" },
+    },
+}
+
+local TEST_XML = [[
+<node>
+  <interface name="org.l2dbus.test.SharedXml">
+    <method name="Ping">
+      <arg name="reply" type="s" direction="out"/>
+    </method>
+  </interface>
+</node>
+]]
+
+local function main()
+    local disp, conn = testUtils.openService(TEST_BUS_NAME)
+    local client = testUtils.openSession(disp)
+
+    -- The description is parsed once and interned by name
+    assert(l2dbus.InterfaceDescriptor.lookup(TEST_INTERFACE) == nil)
+    local desc = l2dbus.InterfaceDescriptor.intern(TEST_INTERFACE, TEST_DESCRIPTION)
+    assert(desc:name() == TEST_INTERFACE)
+    assert(l2dbus.InterfaceDescriptor.intern(TEST_INTERFACE, {}) == desc)
+    assert(l2dbus.InterfaceDescriptor.lookup(TEST_INTERFACE) == desc)
+    assert(not pcall(l2dbus.InterfaceDescriptor.new, TEST_INTERFACE,
+                    {methods = {{name = "Bad", args = {{sig = "!"}}}}}))
+
+    -- Every object has its own interface sharing the descriptor
+    local objects = {}
+    for i = 1, N_OBJECTS do
+        local path = TEST_ROOT .. "/obj" .. i
+        local intf = l2dbus.Interface.new(desc)
+        assert(intf:name() == TEST_INTERFACE)
+        assert(intf:descriptor() == desc)
+        intf:setMethodHandler("Echo", function(ctx, text)
+            ctx:reply(text .. ":" .. path)
+        end)
+        intf:setProperty("Level", i)
+        local obj = l2dbus.ServiceObject.new(path,
+            function() return l2dbus.Dbus.HANDLER_RESULT_NOT_YET_HANDLED end)
+        assert(obj:addInterface(intf))
+        assert(obj:addInterface(l2dbus.Introspection.new()))
+        assert(conn:registerServiceObject(obj))
+        objects[i] = { obj = obj, intf = intf }
+    end
+
+    local stats = desc:getStats()
+    assert(stats.users == N_OBJECTS)
+    assert(stats.methods == 1 and stats.signals == 1 and stats.properties == 1)
+
+    -- The shared members can't be changed through one of the interfaces
+    local intf = objects[1].intf
+    assert(not pcall(intf.registerMethods, intf, {{name = "Other"}}))
+    assert(not pcall(intf.clearProperties, intf))
+    assert(not pcall(intf.setMethodHandler, intf, "Unknown", function() end))
+
+    -- Property values and handlers are per interface
+    assert(objects[1].intf:getProperty("Level") == 1)
+    assert(objects[N_OBJECTS].intf:getProperty("Level") == N_OBJECTS)
+
+    local replies = 0
+    local introspected = false
+    local function checkDone()
+        if (replies == N_OBJECTS) and introspected then
+            disp:stop()
+        end
+    end
+
+    for i = 1, N_OBJECTS do
+        local path = TEST_ROOT .. "/obj" .. i
+        local call = testUtils.newCall(TEST_BUS_NAME, path, TEST_INTERFACE,
+                                        "Echo", "s", "hello")
+        local _, pending = client:sendWithReply(call)
+        pending:setNotify(function(p)
+            local reply = p:stealReply()
+            assert(reply:getType() == l2dbus.Message.METHOD_RETURN)
+            assert(reply:getArgs() == "hello:" .. path)
+            replies = replies + 1
+            checkDone()
+        end)
+    end
+
+    local _, pending = client:sendWithReply(testUtils.newCall(TEST_BUS_NAME,
+                                    TEST_ROOT .. "/obj2",
+                                    l2dbus.Dbus.INTERFACE_INTROSPECTABLE,
+                                    "Introspect"))
+    pending:setNotify(function(p)
+        local xml = p:stealReply():getArgs()
+        assert(xml:find(TEST_INTERFACE, 1, true))
+        assert(xml:find('name="Echo"', 1, true))
+        assert(xml:find('name="Changed"', 1, true))
+        assert(xml:find('name="Level"', 1, true))
+        introspected = true
+        checkDone()
+    end)
+
+    disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+    assert(replies == N_OBJECTS)
+
+    -- Services adding an interface from the same XML share its descriptor
+    local svc1 = service.new(TEST_ROOT .. "/svc1", true)
+    local svc2 = service.new(TEST_ROOT .. "/svc2", true)
+    assert(svc1:addInterface(TEST_XML_INTERFACE, TEST_XML))
+    assert(svc2:addInterface(TEST_XML_INTERFACE, TEST_XML))
+    local shared = svc1.interfaces[TEST_XML_INTERFACE].intfInst:descriptor()
+    assert(shared ~= nil)
+    assert(svc2.interfaces[TEST_XML_INTERFACE].intfInst:descriptor() == shared)
+    assert(shared:getStats().users == 2)
+
+    -- Handlers stay with each service
+    svc1:registerMethodHandler(TEST_XML_INTERFACE, "Ping",
+        function(ctx) ctx:reply("svc1") end)
+    assert(svc2.interfaces[TEST_XML_INTERFACE].handlers.Ping == nil)
+
+    -- An interned descriptor goes away with its last user
+    for i = 1, N_OBJECTS do
+        conn:unregisterServiceObject(objects[i].obj)
+    end
+    objects = nil
+    intf = nil
+    desc = nil
+    collectgarbage("collect")
+    collectgarbage("collect")
+    assert(l2dbus.InterfaceDescriptor.lookup(TEST_INTERFACE) == nil)
+
+    print("All interface descriptor tests passed")
+end
+
+main()
+collectgarbage("collect")
+l2dbus.shutdown()
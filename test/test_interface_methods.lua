@@ -0,0 +1,134 @@
+#!/usr/bin/env lua
+
+local l2dbus = require("l2dbus")
+local testUtils = require("utils.l2dbusUtils")
+
+local TEST_BUS_NAME = "org.l2dbus.test.Methods"
+local TEST_OBJECT = "/org/l2dbus/test/Methods"
+local TEST_INTERFACE = "org.l2dbus.test.Methods"
+
+local function newCall(member, sig, ...)
+    return testUtils.newCall(TEST_BUS_NAME, TEST_OBJECT, TEST_INTERFACE,
+                            member, sig, ...)
+end
+
+local function main()
+    local disp, conn = testUtils.openService(TEST_BUS_NAME)
+
+    -- Requests for methods without a handler reach the interface handler
+    local fallbackCalls = 0
+    local intf = l2dbus.Interface.new(TEST_INTERFACE,
+        function(i, c, req)
+            fallbackCalls = fallbackCalls + 1
+            local reply = l2dbus.Message.newMethodReturn(req)
+            reply:addArgsBySignature("s", "fallback")
+            c:send(reply)
+            return l2dbus.Dbus.HANDLER_RESULT_HANDLED
+        end)
+
+    intf:registerMethods({
+        {
+            name = "Add",
+            args = {
+                {name = "a", sig = "i", dir = "in"},
+                {name = "b", sig = "i", dir = "in"},
+                {name = "sum", sig = "i", dir = "out"}
+            },
+            handler = function(ctx, a, b)
+                assert(ctx:needsReply())
+                assert(ctx:reply(a + b))
+                assert(ctx:isReplied())
+            end
+        },
+        {
+            name = "Fail",
+            handler = function(ctx) error("expected failure") end
+        },
+        {
+            name = "Other",
+            args = {{name = "s", sig = "s", dir = "out"}}
+        },
+        {
+            name = "Echo",
+            args = {
+                {name = "n", sig = "i", dir = "in"},
+                {name = "r", sig = "i", dir = "out"}
+            },
+            handler = function(ctx, n) ctx:reply(n) end
+        },
+        {
+            name = "Echo",
+            args = {
+                {name = "s", sig = "s", dir = "in"},
+                {name = "r", sig = "s", dir = "out"}
+            }
+        }
+    })
+
+    -- Overloads are told apart by their input signature
+    intf:setMethodHandler("Echo", function(ctx, str)
+        ctx:reply("echo " .. str)
+    end, "s")
+    assert(not pcall(intf.setMethodHandler, intf, "Echo", function() end, "d"))
+
+    local obj = l2dbus.ServiceObject.new(TEST_OBJECT,
+        function() return l2dbus.Dbus.HANDLER_RESULT_NOT_YET_HANDLED end)
+    assert(obj:addInterface(intf))
+    assert(conn:registerServiceObject(obj))
+
+    local client = testUtils.openSession(disp)
+    local pending = 0
+    local results = {}
+    local function request(key, m)
+        pending = pending + 1
+        local _, p = client:sendWithReply(m)
+        p:setNotify(function(pc)
+            results[key] = pc:stealReply()
+            pending = pending - 1
+            if pending == 0 then
+                disp:stop()
+            end
+        end)
+    end
+
+    request("add", newCall("Add", "ii", 2, 40))
+    request("badsig", newCall("Add", "s", "two"))
+    request("fail", newCall("Fail"))
+    request("other", newCall("Other"))
+    request("echoInt", newCall("Echo", "i", 7))
+    request("echoStr", newCall("Echo", "s", "seven"))
+    disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+
+    assert(results.add:getType() == l2dbus.Message.METHOD_RETURN)
+    assert(results.add:getArgs() == 42)
+    assert(results.badsig:getType() == l2dbus.Message.ERROR)
+    assert(results.badsig:getErrorName() == l2dbus.Dbus.ERROR_INVALID_ARGS)
+    assert(results.fail:getType() == l2dbus.Message.ERROR)
+    assert(results.fail:getErrorName() == "org.l2dbus.error.ProcessingRequest")
+    assert(results.other:getArgs() == "fallback")
+    assert(fallbackCalls == 1)
+    assert(results.echoInt:getArgs() == 7)
+    assert(results.echoStr:getArgs() == "echo seven")
+
+    -- Method calls over the dispatch budget are queued, not dropped
+    local N_QUEUED = 5
+    local deferred = disp:getStats().normal.deferred
+    disp:setBudget(1)
+    for i = 1, N_QUEUED do
+        request("queued" .. i, newCall("Add", "ii", i, i))
+    end
+    disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+    disp:setBudget(0)
+
+    for i = 1, N_QUEUED do
+        assert(results["queued" .. i]:getArgs() == 2 * i)
+    end
+    assert(disp:getStats().normal.deferred > deferred)
+    assert(fallbackCalls == 1)
+
+    print("All interface method tests passed")
+end
+
+main()
+collectgarbage("collect")
+l2dbus.shutdown()
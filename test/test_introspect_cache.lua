@@ -0,0 +1,69 @@
+#!/usr/bin/env lua
+
+local l2dbus = require("l2dbus")
+local testUtils = require("utils.l2dbusUtils")
+
+local TEST_BUS_NAME = "org.l2dbus.test.Introspect"
+local TEST_OBJECT = "/org/l2dbus/test/Introspect"
+local TEST_INTERFACE = "org.l2dbus.test.Introspect"
+
+local function main()
+    local disp, conn = testUtils.openService(TEST_BUS_NAME)
+
+    local obj = l2dbus.ServiceObject.new(TEST_OBJECT,
+        function() return l2dbus.Dbus.HANDLER_RESULT_NOT_YET_HANDLED end)
+    assert(obj:addInterface(l2dbus.Introspection.new()))
+    local intf = l2dbus.Interface.new(TEST_INTERFACE)
+    intf:registerMethods({{name = "First"}})
+    assert(obj:addInterface(intf))
+    assert(conn:registerServiceObject(obj))
+
+    -- Repeated requests are answered from the cache
+    local xml = obj:introspect(conn, TEST_OBJECT)
+    assert(xml:find("First", 1, true))
+    for i = 1, 10 do
+        assert(obj:introspect(conn, TEST_OBJECT) == xml)
+    end
+    local stats = obj:getIntrospectStats()
+    assert(stats.misses == 1)
+    assert(stats.hits == 10)
+
+    -- Changing an interface invalidates the cache
+    intf:registerMethods({{name = "Second"}})
+    xml = obj:introspect(conn, TEST_OBJECT)
+    assert(xml:find("Second", 1, true) and not xml:find("First", 1, true))
+    assert(obj:getIntrospectStats().misses == 2)
+
+    -- So does adding a child object
+    local child = l2dbus.ServiceObject.new(TEST_OBJECT .. "/Child")
+    assert(conn:registerServiceObject(child))
+    xml = obj:introspect(conn, TEST_OBJECT)
+    assert(xml:find("Child", 1, true))
+    assert(obj:getIntrospectStats().misses == 3)
+
+    -- Removing the interface
+    assert(obj:removeInterface(intf))
+    xml = obj:introspect(conn, TEST_OBJECT)
+    assert(not xml:find(TEST_INTERFACE, 1, true))
+
+    -- Introspect requests from a client get the cached XML
+    local client = testUtils.openSession(disp)
+    local req = testUtils.newCall(TEST_BUS_NAME, TEST_OBJECT,
+                                l2dbus.Dbus.INTERFACE_INTROSPECTABLE,
+                                "Introspect")
+    local _, pending = client:sendWithReply(req)
+    pending:setNotify(function(p)
+        local reply = p:stealReply()
+        assert(reply:getType() == l2dbus.Message.METHOD_RETURN)
+        assert(reply:getArgs() == xml)
+        disp:stop()
+    end)
+    disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+    assert(obj:getIntrospectStats().misses == 4)
+
+    print("All introspection cache tests passed")
+end
+
+main()
+collectgarbage("collect")
+l2dbus.shutdown()
@@ -0,0 +1,136 @@
+#!/usr/bin/env lua
+
+local l2dbus = require("l2dbus")
+local testUtils = require("utils.l2dbusUtils")
+
+local TEST_BUS_NAME = "org.l2dbus.test.ObjectManager"
+local TEST_MANAGER = "/org/l2dbus/test/Manager"
+local TEST_INTERFACE = "org.l2dbus.test.Device"
+local TEST_EXTRA_INTERFACE = "org.l2dbus.test.Extra"
+local OBJECT_MANAGER = "org.freedesktop.DBus.ObjectManager"
+
+local function main()
+    local disp, conn = testUtils.openService(TEST_BUS_NAME)
+    local client = testUtils.openSession(disp)
+
+    local manager = l2dbus.ServiceObject.new(TEST_MANAGER,
+        function() return l2dbus.Dbus.HANDLER_RESULT_NOT_YET_HANDLED end)
+    assert(manager:addInterface(l2dbus.ObjectManager.new()))
+    assert(conn:registerServiceObject(manager))
+
+    -- Every device shares one interface (and so its stored values)
+    local device = l2dbus.Interface.new(TEST_INTERFACE)
+    device:registerProperties({{name = "Level", sig = "i", access = "r"}})
+    device:setProperty("Level", 1)
+    local extra = l2dbus.Interface.new(TEST_EXTRA_INTERFACE)
+
+    local objects = {}
+    local function newDevice(path)
+        local obj = l2dbus.ServiceObject.new(path,
+            function() return l2dbus.Dbus.HANDLER_RESULT_NOT_YET_HANDLED end)
+        assert(obj:addInterface(device))
+        objects[path] = obj
+        return obj
+    end
+
+    local added = {}
+    local removed = {}
+    client:registerMatch({msgType = l2dbus.Message.SIGNAL,
+                        objInterface = OBJECT_MANAGER,
+                        path = TEST_MANAGER},
+        function(match, sig)
+            local args = sig:getArgsAsArray()
+            if sig:getMember() == "InterfacesAdded" then
+                added[#added + 1] = args
+            else
+                removed[#removed + 1] = args
+            end
+        end)
+
+    local managed
+    local function getManagedObjects()
+        local _, pending = client:sendWithReply(testUtils.newCall(TEST_BUS_NAME,
+                                    TEST_MANAGER, OBJECT_MANAGER,
+                                    "GetManagedObjects"))
+        pending:setNotify(function(p)
+            local reply = p:stealReply()
+            assert(reply:getType() == l2dbus.Message.METHOD_RETURN)
+            managed = reply:getArgs()
+        end)
+    end
+
+    local first = TEST_MANAGER .. "/dev0"
+    local ticks = 0
+    local ticker = l2dbus.Timeout.new(disp, 20, true,
+        function()
+            ticks = ticks + 1
+            if ticks == 1 then
+                -- Announced as soon as it's registered
+                assert(conn:registerServiceObject(newDevice(first)))
+                -- Not below the manager
+                assert(conn:registerServiceObject(newDevice("/org/l2dbus/test/Other")))
+                assert(objects[first]:addInterface(extra))
+                assert(objects[first]:removeInterface(extra))
+                getManagedObjects()
+            elseif ticks == 2 then
+                -- Bulk creation is announced once the objects are populated
+                l2dbus.ObjectManager.setBatching(conn, 0)
+                for i = 1, 100 do
+                    assert(conn:registerServiceObject(newDevice(TEST_MANAGER .. "/bulk/dev" .. i)))
+                end
+                -- Registered and gone again before it was announced
+                local transient = newDevice(TEST_MANAGER .. "/transient")
+                assert(conn:registerServiceObject(transient))
+                assert(conn:unregisterServiceObject(transient))
+                device:setProperty("Level", 2)
+                assert(l2dbus.ObjectManager.getStats(conn).pending == 101)
+            elseif ticks == 3 then
+                assert(conn:unregisterServiceObject(objects[first]))
+                getManagedObjects()
+            else
+                disp:stop()
+            end
+        end)
+    ticker:setEnable(true)
+    disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+    ticker:setEnable(false)
+
+    -- dev0 (twice) and the bulk objects
+    assert(#added == 102)
+    assert(added[1][1] == first)
+    assert(added[1][2][TEST_INTERFACE].Level == 1)
+    assert(added[2][1] == first and added[2][2][TEST_EXTRA_INTERFACE] ~= nil)
+    for i = 3, #added do
+        assert(added[i][1] == TEST_MANAGER .. "/bulk/dev" .. (i - 2))
+        assert(added[i][2][TEST_INTERFACE].Level == 2)
+    end
+
+    assert(#removed == 2)
+    assert(removed[1][1] == first and removed[1][2][1] == TEST_EXTRA_INTERFACE)
+    assert(removed[2][1] == first and removed[2][2][1] == TEST_INTERFACE)
+
+    -- The last answer lists only the bulk objects below the manager
+    local count = 0
+    for path, intfs in pairs(managed) do
+        assert(path:find(TEST_MANAGER .. "/bulk/", 1, true) == 1)
+        assert(intfs[TEST_INTERFACE].Level == 2)
+        count = count + 1
+    end
+    assert(count == 100)
+
+    local stats = l2dbus.ObjectManager.getStats(conn)
+    print(string.format("objects=%d added=%d removed=%d signals=%d queries=%d",
+        stats.objects, stats.added, stats.removed, stats.signals, stats.queries))
+    assert(stats.objects == 102)
+    assert(stats.signals == #added + #removed)
+    assert(stats.queries == 2)
+    assert(stats.pending == 0)
+
+    l2dbus.ObjectManager.setBatching(conn, nil)
+
+    print("All object manager tests passed")
+end
+
+main()
+collectgarbage("collect")
+l2dbus.shutdown()
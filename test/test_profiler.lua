@@ -0,0 +1,75 @@
+#!/usr/bin/env lua
+
+local l2dbus = require("l2dbus")
+local posix = require("posix")
+
+local function now()
+    local sec, nsec = posix.clock_gettime("monotonic")
+    return sec * 1000.0 + nsec / 1000000.0
+end
+
+local function busyWait(msec)
+    local deadline = now() + msec
+    while now() < deadline do end
+end
+
+local function main()
+    local mainLoop
+    if (arg[1] == "--glib") or (arg[1] == "-g") then
+        mainLoop = require("l2dbus_glib").MainLoop.new()
+    else
+        mainLoop = require("l2dbus_ev").MainLoop.new()
+    end
+    local disp = l2dbus.Dispatcher.new(mainLoop)
+    local Profiler = l2dbus.Profiler
+
+    local slowCalls = 0
+    Profiler.setEnable(true)
+    Profiler.setSlowThreshold(20, function(kind, handler, member, msec)
+        print(string.format("Slow %s handler %s took %.1f msec", kind,
+                            handler, msec))
+        slowCalls = slowCalls + 1
+    end)
+
+    local fastTicks = 0
+    local fast = l2dbus.Timeout.new(disp, 5, true, function(t)
+        fastTicks = fastTicks + 1
+        busyWait(1)
+    end)
+
+    local slowTicks = 0
+    local slow = l2dbus.Timeout.new(disp, 50, true, function(t)
+        slowTicks = slowTicks + 1
+        busyWait(30)
+        if slowTicks == 3 then
+            disp:stop()
+        end
+    end)
+
+    fast:setEnable(true)
+    slow:setEnable(true)
+    disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+    fast:setEnable(false)
+    slow:setEnable(false)
+
+    local report = Profiler.getReport(5)
+    for i, e in ipairs(report) do
+        print(string.format("%d: %s %s calls=%d total=%.1f avg=%.2f max=%.2f slow=%d",
+            i, e.kind, e.handler, e.calls, e.totalMsec, e.avgMsec,
+            e.maxMsec, e.slow))
+    end
+
+    assert(#report == 2)
+    assert(report[1].calls == slowTicks and report[1].slow == slowTicks)
+    assert(report[2].calls == fastTicks and report[2].slow == 0)
+    assert(slowCalls == slowTicks)
+
+    Profiler.reset()
+    Profiler.setEnable(false)
+    assert(#Profiler.getReport() == 0)
+    print("All profiler tests passed")
+end
+
+main()
+collectgarbage("collect")
+l2dbus.shutdown()
@@ -0,0 +1,97 @@
+#!/usr/bin/env lua
+
+local l2dbus = require("l2dbus")
+local testUtils = require("utils.l2dbusUtils")
+
+local TEST_BUS_NAME = "org.l2dbus.test.Properties"
+local TEST_OBJECT = "/org/l2dbus/test/Properties"
+local TEST_INTERFACE = "org.l2dbus.test.Properties"
+
+local function newCall(method, sig, ...)
+    return testUtils.newCall(TEST_BUS_NAME, TEST_OBJECT,
+                            l2dbus.Dbus.INTERFACE_PROPERTIES, method, sig, ...)
+end
+
+local function main()
+    local disp, conn = testUtils.openService(TEST_BUS_NAME)
+
+    local intf = l2dbus.Interface.new(TEST_INTERFACE)
+    intf:registerProperties({
+        {name = "Speed", sig = "d", access = "rw"},
+        {name = "Name", sig = "s", access = "r"},
+        {name = "Limit", sig = "i", access = "rw"}
+    })
+    intf:setProperty("Speed", 1.5)
+    intf:setProperty("Name", "car")
+    intf:setProperty("Limit", 100)
+    assert(intf:getProperty("Name") == "car")
+    assert(not pcall(intf.setProperty, intf, "Unknown", 1))
+
+    -- Values above the limit are rejected by the setter hook
+    local setterCalls = 0
+    intf:setPropertySetter(function(i, name, value)
+        setterCalls = setterCalls + 1
+        assert(i == intf)
+        return not (name == "Speed" and value > intf:getProperty("Limit"))
+    end)
+
+    -- Requests that reach the object handler weren't answered natively
+    local objectCalls = 0
+    local obj = l2dbus.ServiceObject.new(TEST_OBJECT,
+        function()
+            objectCalls = objectCalls + 1
+            return l2dbus.Dbus.HANDLER_RESULT_NOT_YET_HANDLED
+        end)
+    assert(obj:addInterface(intf))
+    assert(obj:addInterface(l2dbus.Properties.new()))
+    assert(conn:registerServiceObject(obj))
+
+    local client = testUtils.openSession(disp)
+    local results = {}
+    local pending = 0
+    local function request(key, method, sig, ...)
+        pending = pending + 1
+        local _, p = client:sendWithReply(newCall(method, sig, ...))
+        p:setNotify(function(pc)
+            results[key] = pc:stealReply()
+            pending = pending - 1
+            if pending == 0 then
+                disp:stop()
+            end
+        end)
+    end
+
+    request("get", "Get", "ss", TEST_INTERFACE, "Speed")
+    request("getAll", "GetAll", "s", TEST_INTERFACE)
+    request("set", "Set", "ssv", TEST_INTERFACE, "Speed",
+            l2dbus.DbusTypes.Variant.new(42.0, "vd"))
+    request("reject", "Set", "ssv", TEST_INTERFACE, "Speed",
+            l2dbus.DbusTypes.Variant.new(500.0, "vd"))
+    request("readOnly", "Set", "ssv", TEST_INTERFACE, "Name",
+            l2dbus.DbusTypes.Variant.new("bus", "vs"))
+    request("badSig", "Set", "ssv", TEST_INTERFACE, "Limit",
+            l2dbus.DbusTypes.Variant.new("ten", "vs"))
+    request("unknown", "Get", "ss", TEST_INTERFACE, "Colour")
+    -- Only Get, Set and GetAll are answered natively
+    request("other", "Reset", "ss", TEST_INTERFACE, "Speed")
+    disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+
+    assert(results.get:getArgs() == 1.5)
+    local all = results.getAll:getArgs()
+    assert(all.Speed == 1.5 and all.Name == "car" and all.Limit == 100)
+    assert(results.set:getType() == l2dbus.Message.METHOD_RETURN)
+    assert(intf:getProperty("Speed") == 42.0)
+    assert(results.reject:getErrorName() == l2dbus.Dbus.ERROR_INVALID_ARGS)
+    assert(results.readOnly:getErrorName() == "org.freedesktop.DBus.Error.PropertyReadOnly")
+    assert(results.badSig:getErrorName() == l2dbus.Dbus.ERROR_INVALID_ARGS)
+    assert(results.unknown:getErrorName() == "org.freedesktop.DBus.Error.UnknownProperty")
+    assert(results.other:getType() == l2dbus.Message.ERROR)
+    assert(setterCalls == 2)
+    assert(objectCalls == 1)
+
+    print("All property store tests passed")
+end
+
+main()
+collectgarbage("collect")
+l2dbus.shutdown()
@@ -0,0 +1,103 @@
+#!/usr/bin/env lua
+
+local l2dbus = require("l2dbus")
+
+local TEST_OBJECT = "/org/l2dbus/test/Batching"
+local TEST_INTERFACE = "org.l2dbus.test.Batching"
+
+local function main()
+    local mainLoop
+    if (arg[1] == "--glib") or (arg[1] == "-g") then
+        mainLoop = require("l2dbus_glib").MainLoop.new()
+    else
+        mainLoop = require("l2dbus_ev").MainLoop.new()
+    end
+    local disp = l2dbus.Dispatcher.new(mainLoop)
+    assert(nil ~= disp)
+    local conn = l2dbus.Connection.openStandard(disp, l2dbus.Dbus.BUS_SESSION)
+    assert(nil ~= conn)
+    local client = l2dbus.Connection.openStandard(disp, l2dbus.Dbus.BUS_SESSION)
+    assert(nil ~= client)
+
+    local intf = l2dbus.Interface.new(TEST_INTERFACE)
+    intf:registerProperties({
+        {name = "X", sig = "i", access = "r"},
+        {name = "Y", sig = "i", access = "r"},
+        {name = "Label", sig = "s", access = "r"}
+    })
+    intf:setProperty("Label", "start")
+    intf:setPropertyBatching(conn, TEST_OBJECT)
+
+    local signals = {}
+    client:registerMatch({msgType = l2dbus.Message.SIGNAL,
+                        objInterface = l2dbus.Dbus.INTERFACE_PROPERTIES,
+                        member = "PropertiesChanged",
+                        path = TEST_OBJECT},
+        function(match, msg)
+            signals[#signals + 1] = msg:getArgsAsArray()
+        end)
+
+    -- Many changes in one loop iteration become a single signal
+    local ticks = 0
+    local ticker = l2dbus.Timeout.new(disp, 20, true,
+        function()
+            ticks = ticks + 1
+            if ticks == 1 then
+                for i = 1, 50 do
+                    intf:setProperty("X", i)
+                    intf:setProperty("Y", -i)
+                end
+                intf:invalidateProperty("Label")
+            elseif ticks == 2 then
+                -- The latest change to a property wins
+                intf:invalidateProperty("Label")
+                intf:setProperty("Label", "end")
+            else
+                disp:stop()
+            end
+        end)
+    ticker:setEnable(true)
+    disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+    ticker:setEnable(false)
+
+    assert(#signals == 2)
+    local intfName, changed, invalidated = signals[1][1], signals[1][2], signals[1][3]
+    assert(intfName == TEST_INTERFACE)
+    assert(changed.X == 50 and changed.Y == -50)
+    assert(changed.Label == nil)
+    assert(#invalidated == 1 and invalidated[1] == "Label")
+
+    changed, invalidated = signals[2][2], signals[2][3]
+    assert(changed.Label == "end" and #invalidated == 0)
+
+    local stats = intf:getPropertyBatchStats()
+    print(string.format("changes=%d signals=%d", stats.changes, stats.signals))
+    assert(stats.changes == 103)
+    assert(stats.signals == 2)
+    assert(stats.pending == 0)
+
+    -- Pending changes are emitted when batching stops
+    intf:setProperty("X", 0)
+    assert(intf:getPropertyBatchStats().pending == 1)
+    intf:setPropertyBatching(nil)
+    assert(intf:getPropertyBatchStats().signals == 3)
+
+    -- Batches are emitted from a single path so the interface can't be shared
+    local objA = l2dbus.ServiceObject.new(TEST_OBJECT .. "/A")
+    local objB = l2dbus.ServiceObject.new(TEST_OBJECT .. "/B")
+    intf:setPropertyBatching(conn, TEST_OBJECT .. "/A")
+    assert(objA:addInterface(intf))
+    assert(not objB:addInterface(intf))
+    intf:setPropertyBatching(nil)
+    assert(objB:addInterface(intf))
+    assert(not pcall(intf.setPropertyBatching, intf, conn, TEST_OBJECT .. "/A"))
+    assert(objB:removeInterface(intf))
+    intf:setPropertyBatching(conn, TEST_OBJECT .. "/A")
+    intf:setPropertyBatching(nil)
+
+    print("All property batching tests passed")
+end
+
+main()
+collectgarbage("collect")
+l2dbus.shutdown()
@@ -0,0 +1,167 @@
+#!/usr/bin/env lua
+
+local l2dbus = require("l2dbus")
+local testUtils = require("utils.l2dbusUtils")
+local service = require("l2dbus.service")
+
+local TEST_BUS_NAME = "org.l2dbus.test.ReplyContext"
+local TEST_OBJECT = "/org/l2dbus/test/ReplyContext"
+local TEST_INTERFACE = "org.l2dbus.test.ReplyContext"
+
+local TEST_METADATA = {
+    methods = {
+        {
+            name = "Echo",
+            args = {
+                {sig = "i", name = "value", dir = "in"},
+                {sig = "i", name = "result", dir = "out"}
+            }
+        },
+        {
+            name = "Later",
+            args = {
+                {sig = "i", name = "value", dir = "in"},
+                {sig = "i", name = "result", dir = "out"}
+            }
+        },
+        {
+            name = "Hold",
+            args = {
+                {sig = "i", name = "value", dir = "in"},
+                {sig = "i", name = "result", dir = "out"}
+            }
+        },
+        {
+            name = "Fail",
+            args = {}
+        }
+    }
+}
+
+local function newCall(method, ...)
+    return testUtils.newCall(TEST_BUS_NAME, TEST_OBJECT, TEST_INTERFACE, method,
+                            select("#", ...) > 0 and "i" or nil, ...)
+end
+
+local function main()
+    local disp, conn = testUtils.openService(TEST_BUS_NAME)
+
+    local svc = service.new(TEST_OBJECT, false)
+    assert(svc:addInterface(TEST_INTERFACE, TEST_METADATA))
+    -- A context kept from an earlier request must not act on a later one
+    local kept = nil
+    svc:registerMethodHandler(TEST_INTERFACE, "Echo", function(ctx, value)
+        if kept == nil then
+            kept = ctx
+        else
+            assert(kept ~= ctx)
+            assert(not pcall(kept.reply, kept, -1))
+            assert(not pcall(kept.error, kept, "org.l2dbus.test.Error.Stale"))
+            assert(not pcall(kept.defer, kept))
+            assert(kept:isReplied() and not kept:needsReply())
+            assert(kept:getMessage() == nil)
+            assert(not kept:release())
+            assert(not ctx:isReplied())
+        end
+        ctx:reply(value)
+        -- A context can't be replied to twice
+        assert(not pcall(ctx.reply, ctx, value))
+    end)
+    local deferred = nil
+    svc:registerMethodHandler(TEST_INTERFACE, "Later", function(ctx, value)
+        deferred = {ctx = ctx, value = value}
+    end)
+    -- Every Hold request is answered once they are all in-flight
+    local N_HELD = 100
+    local held = {}
+    svc:registerMethodHandler(TEST_INTERFACE, "Hold", function(ctx, value)
+        held[#held + 1] = ctx
+        if #held == N_HELD then
+            for _, c in ipairs(held) do
+                c:reply(c:getMessage():getArgs())
+            end
+            held = {}
+        end
+    end)
+    svc:registerMethodHandler(TEST_INTERFACE, "Fail", function(ctx)
+        error("expected failure")
+    end)
+    assert(svc:attach(conn))
+
+    local client = testUtils.openSession(disp)
+    local nCalls = 200
+    local nReplies = 0
+    local function onReply(pending)
+        local reply = pending:stealReply()
+        assert(reply:getType() == l2dbus.Message.METHOD_RETURN)
+        assert(reply:getArgs() == nReplies)
+        nReplies = nReplies + 1
+        if nReplies < nCalls then
+            local _, p = client:sendWithReply(newCall("Echo", nReplies))
+            p:setNotify(onReply)
+        else
+            local _, p = client:sendWithReply(newCall("Later", 7))
+            p:setNotify(function(p)
+                assert(p:stealReply():getArgs() == 7)
+                local _, p = client:sendWithReply(newCall("Fail"))
+                p:setNotify(function(p)
+                    local reply = p:stealReply()
+                    assert(reply:getType() == l2dbus.Message.ERROR)
+                    disp:stop()
+                end)
+            end)
+        end
+    end
+    local _, pending = client:sendWithReply(newCall("Echo", 0))
+    pending:setNotify(onReply)
+
+    -- Deferred contexts stay valid after the handler returns
+    local ticker = l2dbus.Timeout.new(disp, 10, true, function()
+        if deferred then
+            assert(deferred.ctx:getMessage():getMember() == "Later")
+            deferred.ctx:reply(deferred.value)
+            assert(deferred.ctx:isReplied())
+            deferred = nil
+        end
+    end)
+    ticker:setEnable(true)
+    disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+    ticker:setEnable(false)
+
+    assert(nReplies == nCalls)
+    local stats = l2dbus.ReplyContext.getPoolStats()
+    print(string.format("created=%d reused=%d pooled=%d",
+        stats.created, stats.reused, stats.pooled))
+    -- Requests handled one at a time share a context
+    assert(stats.created <= 3)
+    assert(stats.reused >= nCalls - 1)
+
+    -- Only a bounded number of states outlive a burst of open requests
+    local nHeld = 0
+    for i = 1, N_HELD do
+        local _, p = client:sendWithReply(newCall("Hold", i))
+        p:setNotify(function(p)
+            assert(p:stealReply():getType() == l2dbus.Message.METHOD_RETURN)
+            nHeld = nHeld + 1
+            if nHeld == N_HELD then
+                disp:stop()
+            end
+        end)
+    end
+    disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+    collectgarbage("collect")
+    collectgarbage("collect")
+
+    local burst = l2dbus.ReplyContext.getPoolStats()
+    print(string.format("created=%d pooled=%d maxPooled=%d",
+        burst.created, burst.pooled, burst.maxPooled))
+    assert(burst.created >= N_HELD)
+    assert(burst.pooled == burst.maxPooled)
+    assert(burst.maxPooled < N_HELD)
+
+    print("All reply context tests passed")
+end
+
+main()
+collectgarbage("collect")
+l2dbus.shutdown()
@@ -0,0 +1,98 @@
+#!/usr/bin/env lua
+
+local l2dbus = require("l2dbus")
+
+local function newCall(method)
+    return l2dbus.Message.newMethodCall({destination = l2dbus.Dbus.SERVICE_DBUS,
+                                        path        = l2dbus.Dbus.PATH_DBUS,
+                                        interface   = l2dbus.Dbus.INTERFACE_DBUS,
+                                        method      = method})
+end
+
+local function main()
+    local mainLoop
+    if (arg[1] == "--glib") or (arg[1] == "-g") then
+        mainLoop = require("l2dbus_glib").MainLoop.new()
+    else
+        mainLoop = require("l2dbus_ev").MainLoop.new()
+    end
+    local disp = l2dbus.Dispatcher.new(mainLoop)
+    assert(nil ~= disp)
+    local conn = l2dbus.Connection.openStandard(disp, l2dbus.Dbus.BUS_SESSION)
+    assert(nil ~= conn)
+
+    local order = {}
+    local function record(v)
+        order[#order + 1] = v
+    end
+
+    -- Sleeping tasks are resumed by order of their deadline
+    l2dbus.spawn(disp, function()
+        l2dbus.sleep(30)
+        record("slow")
+    end)
+    l2dbus.spawn(disp, function(name)
+        l2dbus.sleep(10)
+        record(name)
+    end, "fast")
+    assert(not l2dbus.inTask())
+
+    -- Awaiting a single reply and several at once
+    local nTasks = 100
+    local done = 0
+    local function onDone()
+        done = done + 1
+        if done == nTasks then
+            l2dbus.spawn(function()
+                l2dbus.sleep(50)
+                disp:stop()
+            end)
+        end
+    end
+
+    for i = 1, nTasks do
+        l2dbus.spawn(disp, function()
+            assert(l2dbus.inTask())
+            local _, pending = conn:sendWithReply(newCall("GetId"))
+            local reply = pending:await()
+            assert(reply:getType() == l2dbus.Message.METHOD_RETURN)
+            assert(type(reply:getArgs()) == "string")
+
+            local _, p1 = conn:sendWithReply(newCall("GetId"))
+            local _, p2 = conn:sendWithReply(newCall("ListNames"))
+            local r1, r2 = l2dbus.awaitAll({p1, p2})
+            assert(r1:getArgs() == reply:getArgs())
+            assert(type(r2:getArgs()) == "table")
+            onDone()
+        end)
+    end
+
+    -- An error ends the task without stopping the others
+    l2dbus.spawn(disp, function() error("expected failure") end)
+
+    disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+
+    assert(done == nTasks)
+    assert(table.concat(order, " ") == "fast slow")
+
+    local stats = disp:getTaskStats()
+    print(string.format("spawned=%d created=%d completed=%d failed=%d resumed=%d",
+        stats.spawned, stats.created, stats.completed, stats.failed, stats.resumed))
+    assert(stats.live == 0)
+    assert(stats.failed == 1)
+    assert(stats.completed == stats.spawned - 1)
+
+    -- Finished tasks are re-used
+    local before = stats.created
+    for i = 1, 10 do
+        l2dbus.spawn(disp, function() if i == 10 then disp:stop() end end)
+    end
+    disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+    assert(disp:getTaskStats().created == before)
+
+    print("All scheduler tests passed")
+end
+
+main()
+collectgarbage("collect")
+l2dbus.shutdown()
@@ -0,0 +1,121 @@
+#!/usr/bin/env lua
+
+local l2dbus = require("l2dbus")
+local testUtils = require("utils.l2dbusUtils")
+local service = require("l2dbus.service")
+
+local TEST_BUS_NAME = "org.l2dbus.test.ServiceIndex"
+local TEST_OBJECT = "/org/l2dbus/test/ServiceIndex"
+local TEST_INTERFACE = "org.l2dbus.test.Index"
+
+local function pingMetadata(inSig)
+    return {
+        methods = {
+            {
+                name = "Ping",
+                args = {
+                    {sig = inSig, name = "value", dir = "in"},
+                    {sig = "s", name = "result", dir = "out"}
+                }
+            }
+        }
+    }
+end
+
+local function main()
+    local disp, conn = testUtils.openService(TEST_BUS_NAME)
+    local client = testUtils.openSession(disp)
+
+    -- Sends the requests and returns their replies once all have arrived
+    local function roundTrip(requests)
+        local replies = {}
+        local pending = #requests
+        for key, req in pairs(requests) do
+            local _, p = client:sendWithReply(testUtils.newCall(TEST_BUS_NAME,
+                            TEST_OBJECT, req[1], req[2], req[3], req[4]))
+            p:setNotify(function(pc)
+                local reply = pc:stealReply()
+                if reply:getType() == l2dbus.Message.ERROR then
+                    replies[key] = reply:getErrorName()
+                else
+                    replies[key] = reply:getArgs()
+                end
+                pending = pending - 1
+                if pending == 0 then
+                    disp:stop()
+                end
+            end)
+        end
+        disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+        return replies
+    end
+
+    local function pingHandler(tag)
+        return function(ctx, value)
+            ctx:reply(tag .. ":" .. tostring(value))
+        end
+    end
+
+    local svc = service.new(TEST_OBJECT, false)
+    local intfA = TEST_INTERFACE .. "A"
+    local intfB = TEST_INTERFACE .. "B"
+    local intfC = TEST_INTERFACE .. "C"
+    local intfD = TEST_INTERFACE .. "D"
+    assert(svc:addInterface(intfA, pingMetadata("s")))
+    assert(svc:addInterface(intfB, pingMetadata("i")))
+    svc:registerMethodHandler(intfA, "Ping", pingHandler("A"))
+    svc:registerMethodHandler(intfB, "Ping", pingHandler("B"))
+    assert(svc:attach(conn))
+
+    local UNKNOWN = l2dbus.Dbus.ERROR_UNKNOWN_METHOD
+    local INVALID = l2dbus.Dbus.ERROR_INVALID_ARGS
+
+    -- Requests without an interface are found by member and signature
+    local replies = roundTrip({
+        str = {nil, "Ping", "s", "x"},
+        int = {nil, "Ping", "i", 3},
+        badSig = {nil, "Ping", "d", 1.5},
+        noMember = {nil, "Nope"},
+        named = {intfB, "Ping", "i", 4},
+        namedBadSig = {intfA, "Ping", "i", 5},
+        namedNoMember = {intfA, "Nope"}
+    })
+    assert(replies.str == "A:x")
+    assert(replies.int == "B:3")
+    assert(replies.badSig == UNKNOWN)
+    assert(replies.noMember == UNKNOWN)
+    assert(replies.named == "B:4")
+    assert(replies.namedBadSig == INVALID)
+    assert(replies.namedNoMember == UNKNOWN)
+
+    -- The index follows interfaces as they're removed and added
+    assert(svc:removeInterface(intfB))
+    replies = roundTrip({int = {nil, "Ping", "i", 3}})
+    assert(replies.int == UNKNOWN)
+
+    assert(svc:addInterface(intfC, pingMetadata("i")))
+    replies = roundTrip({int = {nil, "Ping", "i", 3}})
+    assert(replies.int == UNKNOWN)
+    svc:registerMethodHandler(intfC, "Ping", pingHandler("C"))
+    replies = roundTrip({int = {nil, "Ping", "i", 3}})
+    assert(replies.int == "C:3")
+
+    -- The interface added first wins until its handler is unregistered
+    assert(svc:addInterface(intfD, pingMetadata("s")))
+    svc:registerMethodHandler(intfD, "Ping", pingHandler("D"))
+    replies = roundTrip({str = {nil, "Ping", "s", "x"}})
+    assert(replies.str == "A:x")
+    assert(svc:unregisterMethodHandler(intfA, "Ping"))
+    replies = roundTrip({str = {nil, "Ping", "s", "x"}})
+    assert(replies.str == "D:x")
+    assert(svc:unregisterMethodHandler(intfD, "Ping"))
+    replies = roundTrip({str = {nil, "Ping", "s", "x"}})
+    assert(replies.str == UNKNOWN)
+
+    svc:detach(conn)
+    print("All service member index tests passed")
+end
+
+main()
+collectgarbage("collect")
+l2dbus.shutdown()
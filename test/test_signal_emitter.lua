@@ -0,0 +1,101 @@
+#!/usr/bin/env lua
+
+local l2dbus = require("l2dbus")
+local service = require("l2dbus.service")
+
+local TEST_OBJECT = "/org/l2dbus/test/Emitter"
+local TEST_INTERFACE = "org.l2dbus.test.Emitter"
+
+local TEST_METADATA = {
+    signals = {
+        {
+            name = "Sample",
+            args = {
+                {sig = "u", name = "seq"},
+                {sig = "d", name = "value"},
+                {sig = "s", name = "unit"}
+            }
+        },
+        {
+            name = "Reset",
+            args = {}
+        }
+    }
+}
+
+local function main()
+    local mainLoop
+    if (arg[1] == "--glib") or (arg[1] == "-g") then
+        mainLoop = require("l2dbus_glib").MainLoop.new()
+    else
+        mainLoop = require("l2dbus_ev").MainLoop.new()
+    end
+    local disp = l2dbus.Dispatcher.new(mainLoop)
+    assert(nil ~= disp)
+    local conn = l2dbus.Connection.openStandard(disp, l2dbus.Dbus.BUS_SESSION)
+    assert(nil ~= conn)
+    local client = l2dbus.Connection.openStandard(disp, l2dbus.Dbus.BUS_SESSION)
+    assert(nil ~= client)
+
+    local svc = service.new(TEST_OBJECT, false)
+    assert(svc:addInterface(TEST_INTERFACE, TEST_METADATA))
+
+    -- Emitters are cached and validated against the interface
+    local sample = svc:signalEmitter(TEST_INTERFACE, "Sample")
+    assert(sample == svc:signalEmitter(TEST_INTERFACE, "Sample"))
+    assert(not pcall(svc.signalEmitter, svc, TEST_INTERFACE, "Unknown"))
+    assert(not pcall(svc.signalEmitter, svc, "org.l2dbus.test.Unknown", "Sample"))
+
+    -- Nothing is sent until the service is attached
+    assert(not sample(1, 1.0, "V"))
+    assert(svc:attach(conn))
+    assert(sample:getStats().connections == 1)
+
+    -- The argument count must match the signature
+    assert(not pcall(sample, 1, 1.0))
+
+    local nSamples = 1000
+    local received = 0
+    local lastSeq = 0
+    local resets = 0
+    client:registerMatch({msgType = l2dbus.Message.SIGNAL,
+                        objInterface = TEST_INTERFACE,
+                        path = TEST_OBJECT},
+        function(match, msg)
+            if msg:getMember() == "Sample" then
+                local seq, value, unit = msg:getArgs()
+                assert(seq == lastSeq + 1)
+                assert(value == seq / 2 and unit == "V")
+                lastSeq = seq
+                received = received + 1
+            else
+                resets = resets + 1
+                disp:stop()
+            end
+        end)
+
+    for seq = 1, nSamples do
+        assert(sample(seq, seq / 2, "V"))
+    end
+    -- An emitter created after attaching also uses the connection
+    assert(svc:signalEmitter(TEST_INTERFACE, "Reset"):emit())
+    disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+
+    assert(received == nSamples)
+    assert(resets == 1)
+    assert(sample:getStats().emitted == nSamples)
+
+    -- Detaching and removing the interface stops the emitters
+    assert(svc:detach(conn))
+    assert(sample:getStats().connections == 0)
+    assert(svc:attach(conn))
+    assert(sample:getStats().connections == 1)
+    assert(svc:removeInterface(TEST_INTERFACE))
+    assert(sample:getStats().connections == 0)
+
+    print("All signal emitter tests passed")
+end
+
+main()
+collectgarbage("collect")
+l2dbus.shutdown()
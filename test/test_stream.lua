@@ -0,0 +1,131 @@
+#!/usr/bin/env lua
+
+local l2dbus = require("l2dbus")
+local posix = require("posix")
+
+local Stream = l2dbus.Stream
+local gDisp
+local gLines = {}
+local gFrames = {}
+
+local function lengthFrame(payload)
+    local n = #payload
+    return string.char(math.floor(n / 16777216) % 256,
+                        math.floor(n / 65536) % 256,
+                        math.floor(n / 256) % 256, n % 256) .. payload
+end
+
+
+local function onLine(stream, event, data, user)
+    if event == Stream.EVENT_DATA then
+        print(user .. " line: " .. data)
+        gLines[#gLines + 1] = data
+    elseif event == Stream.EVENT_EOF then
+        print(user .. " EOF")
+        stream:close()
+        gDisp:stop()
+    elseif event == Stream.EVENT_ERROR then
+        print(user .. " error: " .. tostring(data))
+        gDisp:stop()
+    end
+end
+
+
+local function onFrame(stream, event, data, user)
+    if event == Stream.EVENT_DATA then
+        print(user .. " frame: " .. #data .. " bytes")
+        gFrames[#gFrames + 1] = data
+    elseif event == Stream.EVENT_EOF then
+        print(user .. " EOF")
+        stream:close()
+        gDisp:stop()
+    end
+end
+
+
+local function onWriter(stream, event, data, user)
+    if event == Stream.EVENT_DRAIN then
+        print(user .. " drained, queued=" .. stream:getWriteQueueSize())
+    elseif event == Stream.EVENT_ERROR then
+        print(user .. " error: " .. tostring(data))
+    end
+end
+
+
+local function testLines()
+    local rd, wr = posix.pipe()
+    local reader = Stream.new(gDisp, rd, onLine, "reader")
+    local writer = Stream.new(gDisp, wr, onWriter, "writer")
+    reader:setFraming(Stream.FRAME_LINE)
+
+    -- These writes are coalesced into a single writev()
+    writer:write("first line\nsecond ")
+    writer:write("line\n")
+    writer:write("unterminated")
+
+    -- Close the writer once the queue has been flushed
+    local flush
+    flush = l2dbus.Timeout.new(gDisp, 10, true, function(t)
+        if writer:getWriteQueueSize() == 0 then
+            t:setEnable(false)
+            writer:close()
+        end
+    end)
+    flush:setEnable(true)
+    gDisp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+
+    assert(#gLines == 3)
+    assert(gLines[1] == "first line")
+    assert(gLines[2] == "second line")
+    assert(gLines[3] == "unterminated")
+    assert(not reader:isOpen())
+end
+
+
+local function testLengthPrefix()
+    local rd, wr = posix.pipe()
+    local reader = Stream.new(gDisp, rd, onFrame, "reader")
+    local writer = Stream.new(gDisp, wr, onWriter, "writer")
+    local big = string.rep("x", 100000)
+    reader:setFraming(Stream.FRAME_LENGTH, 4)
+    reader:setReadBufferSize(128 * 1024)
+    writer:setWatermarks(32 * 1024, 8 * 1024)
+
+    assert(writer:write(lengthFrame("hello")))
+    -- Exceeds the high watermark so we're asked to wait for a drain
+    assert(not writer:write(lengthFrame(big)))
+
+    local flush
+    flush = l2dbus.Timeout.new(gDisp, 10, true, function(t)
+        if writer:getWriteQueueSize() == 0 then
+            t:setEnable(false)
+            writer:close()
+        end
+    end)
+    flush:setEnable(true)
+    gDisp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+
+    assert(#gFrames == 2)
+    assert(gFrames[1] == "hello")
+    assert(gFrames[2] == big)
+end
+
+
+local function main()
+    local mainLoop
+    if (arg[1] == "--glib") or (arg[1] == "-g") then
+        mainLoop = require("l2dbus_glib").MainLoop.new()
+    else
+        mainLoop = require("l2dbus_ev").MainLoop.new()
+    end
+    gDisp = l2dbus.Dispatcher.new(mainLoop)
+    assert(nil ~= gDisp)
+
+    testLines()
+    testLengthPrefix()
+    print("All stream tests passed")
+end
+
+main()
+collectgarbage("collect")
+l2dbus.shutdown()
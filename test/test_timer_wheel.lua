@@ -0,0 +1,127 @@
+#!/usr/bin/env lua
+
+local l2dbus = require("l2dbus")
+local posix = require("posix")
+local testUtils = require("utils.l2dbusUtils")
+
+local function now()
+    local sec, nsec = posix.clock_gettime("monotonic")
+    return sec * 1000.0 + nsec / 1000000.0
+end
+
+local function busyWait(msec)
+    local deadline = now() + msec
+    while now() < deadline do end
+end
+
+local function main()
+    local disp = testUtils.newDispatcher()
+
+    -- One-shot timeouts fire in the order of their deadlines and only once
+    local order = {}
+    local fired = {}
+    local intervals = {50, 10, 40, 20, 30}
+    local timeouts = {}
+    local start = now()
+    for _, interval in ipairs(intervals) do
+        local t = l2dbus.Timeout.new(disp, interval, false, function(t, msec)
+            assert(not t:isEnabled())
+            assert(now() - start >= msec)
+            fired[msec] = (fired[msec] or 0) + 1
+            order[#order + 1] = msec
+        end, interval)
+        t:setEnable(true)
+        timeouts[#timeouts + 1] = t
+    end
+    -- Runs past the last deadline so a repeated expiration would be seen
+    local stopper = l2dbus.Timeout.new(disp, 100, false, function()
+        disp:stop()
+    end)
+    stopper:setEnable(true)
+    disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+
+    assert(#order == #intervals)
+    for idx = 2, #order do
+        assert(order[idx - 1] < order[idx])
+    end
+    for _, interval in ipairs(intervals) do
+        assert(fired[interval] == 1)
+    end
+
+    -- A coarse resolution never fires a timeout early
+    disp:setTimerResolution(20)
+    local resolution, slack = disp:getTimerResolution()
+    assert(resolution == 20 and slack == 0)
+    local elapsed
+    start = now()
+    local coarse = l2dbus.Timeout.new(disp, 5, false, function()
+        elapsed = now() - start
+        disp:stop()
+    end)
+    coarse:setEnable(true)
+    disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+    print(string.format("5 msec timeout at 20 msec resolution: %.1f msec",
+        elapsed))
+    assert(elapsed >= 5)
+
+    -- Slack coalesces neighbouring expirations into fewer batches
+    disp:setTimerResolution(1, 50)
+    resolution, slack = disp:getTimerResolution()
+    assert(resolution == 1 and slack == 50)
+    local fireTimes = {}
+    local spread = {5, 15, 25, 35}
+    start = now()
+    for _, interval in ipairs(spread) do
+        local t = l2dbus.Timeout.new(disp, interval, false, function(t, msec)
+            local at = now() - start
+            assert(at >= msec)
+            fireTimes[#fireTimes + 1] = at
+            if #fireTimes == #spread then
+                disp:stop()
+            end
+        end, interval)
+        t:setEnable(true)
+        timeouts[#timeouts + 1] = t
+    end
+    disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+    -- Without slack every timeout would fire 10 msec after the previous
+    local batches = 1
+    for idx = 2, #fireTimes do
+        if fireTimes[idx] - fireTimes[idx - 1] > 5 then
+            batches = batches + 1
+        end
+    end
+    print(string.format("%d timeouts fired in %d batches", #spread, batches))
+    assert(batches <= 2)
+    disp:setTimerResolution(1)
+
+    -- A repeating timeout keeps its period even when its handler is slow
+    local N_TICKS = 10
+    local PERIOD = 20
+    local ticks = 0
+    start = now()
+    local periodic = l2dbus.Timeout.new(disp, PERIOD, true, function(t)
+        ticks = ticks + 1
+        if ticks == N_TICKS then
+            elapsed = now() - start
+            t:setEnable(false)
+            disp:stop()
+        else
+            busyWait(5)
+        end
+    end)
+    periodic:setEnable(true)
+    disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+    print(string.format("%d ticks of %d msec took %.1f msec", N_TICKS,
+        PERIOD, elapsed))
+    assert(elapsed >= N_TICKS * PERIOD)
+    -- Re-arming from the end of each handler would take 5 msec more a tick
+    assert(elapsed < N_TICKS * (PERIOD + 5) - 15)
+    assert(not periodic:isEnabled())
+
+    print("All timer wheel tests passed")
+end
+
+main()
+collectgarbage("collect")
+l2dbus.shutdown()
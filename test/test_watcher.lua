@@ -41,6 +41,99 @@ local function onTimeout(tm, disp)
 end
 
 
+-- Returns a pipe with data waiting to be read
+local function readyPipe()
+    local rd, wr = posix.pipe()
+    assert(rd ~= nil, "Failed creating pipe")
+    posix.write(wr, "x")
+    return rd, wr
+end
+
+
+local function testDeliveryModes(disp)
+    local READ = l2dbus.Watch.READ
+    local pipes = {}
+    local function newWatch(mode, handler)
+        local rd, wr = readyPipe()
+        pipes[#pipes + 1] = rd
+        pipes[#pipes + 1] = wr
+        local w = l2dbus.Watch.new(disp, rd, READ, handler or function()
+            error("Batched watch delivered to its own handler")
+        end)
+        w:setMode(mode)
+        assert(w:mode() == mode)
+        return w, rd
+    end
+
+    -- MODE_MASK delivers the raw event bitmask
+    local rcvEvents
+    local masked, maskedRd = newWatch(l2dbus.Watch.MODE_MASK,
+        function(w, events)
+            rcvEvents = events
+            posix.read(maskedRd, 16)
+            w:setEnable(false)
+            disp:stop()
+        end)
+    masked:setEnable(true)
+    disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+    assert(type(rcvEvents) == "number")
+    assert(0 ~= bit.band(rcvEvents, READ))
+
+    -- Watches signaled in the same iteration reach the batch handler together
+    local batches = {}
+    local removed
+    l2dbus.Watch.setBatchHandler(disp, function(watches, evMasks, count, token)
+        assert(token == "batch")
+        assert(#watches == count)
+        local batch = {}
+        for idx = 1, count do
+            assert(watches[idx] ~= removed)
+            assert(0 ~= bit.band(evMasks[idx], READ))
+            posix.read(watches[idx]:getDescriptor(), 16)
+            watches[idx]:setEnable(false)
+            batch[watches[idx]] = true
+        end
+        batches[#batches + 1] = batch
+        disp:stop()
+    end, "batch")
+
+    local N_BATCHED = 3
+    local batched = {}
+    for idx = 1, N_BATCHED do
+        batched[idx] = newWatch(l2dbus.Watch.MODE_BATCH)
+        batched[idx]:setEnable(true)
+    end
+    disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+    assert(#batches == 1)
+    for idx = 1, N_BATCHED do
+        assert(batches[1][batched[idx]])
+    end
+
+    -- A watch disabled while its batch is pending isn't delivered
+    batches = {}
+    local kept = newWatch(l2dbus.Watch.MODE_BATCH)
+    local dropped, droppedRd = newWatch(l2dbus.Watch.MODE_BATCH)
+    removed = dropped
+    local remover = newWatch(l2dbus.Watch.MODE_MASK, function(w)
+        w:setEnable(false)
+        dropped:setEnable(false)
+        posix.read(droppedRd, 16)
+    end)
+    kept:setEnable(true)
+    dropped:setEnable(true)
+    remover:setEnable(true)
+    disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+    assert(#batches == 1)
+    assert(batches[1][kept] and not batches[1][dropped])
+
+    l2dbus.Watch.setBatchHandler(disp, nil)
+    for _, fd in ipairs(pipes) do
+        posix.close(fd)
+    end
+    print("Watch delivery mode tests passed")
+end
+
+
 local function main()
     local errMsg = nil
 
@@ -62,6 +155,7 @@ local function main()
 	end
 	
     gDisp = l2dbus.Dispatcher.new(mainLoop)
+    testDeliveryModes(gDisp)
 
     -- Make sure the FIFO is available for reading/writing
     if 0 ~= posix.access(FIFO_PATH, "rw") then
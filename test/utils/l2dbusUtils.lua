@@ -0,0 +1,112 @@
+----------------------------------------------------------------
+--- Common set up of the l2dbus tests.
+---
+--- The tests run on the libev main loop unless *--glib* (or *-g*)
+--- is the first command line argument.
+----------------------------------------------------------------
+local l2dbus = require("l2dbus")
+
+local M = {}
+
+
+----------------------------------------------------------------
+--- newDispatcher
+---
+--- Creates a Dispatcher on the main loop selected by the command line.
+---
+--- @tparam   (table)   args ....command line arguments (defaults to arg)
+---
+--- @treturn  (userdata) the Dispatcher
+----------------------------------------------------------------
+function M.newDispatcher(args)
+    args = args or arg or {}
+    local mainLoop
+    if (args[1] == "--glib") or (args[1] == "-g") then
+        mainLoop = require("l2dbus_glib").MainLoop.new()
+    else
+        mainLoop = require("l2dbus_ev").MainLoop.new()
+    end
+    local disp = l2dbus.Dispatcher.new(mainLoop)
+    assert(nil ~= disp)
+    return disp
+end -- newDispatcher
+
+
+----------------------------------------------------------------
+--- openSession
+---
+--- Opens a connection to the session bus.
+---
+--- @tparam   (userdata) disp ....the Dispatcher of the connection
+---
+--- @treturn  (userdata) the Connection
+----------------------------------------------------------------
+function M.openSession(disp)
+    local conn = l2dbus.Connection.openStandard(disp, l2dbus.Dbus.BUS_SESSION)
+    assert(nil ~= conn)
+    return conn
+end -- openSession
+
+
+----------------------------------------------------------------
+--- requestName
+---
+--- Takes ownership of a bus name (replacing any existing owner).
+---
+--- @tparam   (userdata) conn ....the Connection to own the name
+--- @tparam   (string)   busName ....the well-known bus name
+----------------------------------------------------------------
+function M.requestName(conn, busName)
+    local msg = l2dbus.Message.newMethodCall({destination = l2dbus.Dbus.SERVICE_DBUS,
+                                            path        = l2dbus.Dbus.PATH_DBUS,
+                                            interface   = l2dbus.Dbus.INTERFACE_DBUS,
+                                            method      = "RequestName"})
+    msg:addArgsBySignature("su", busName, 4)
+    assert(conn:sendWithReplyAndBlock(msg))
+end -- requestName
+
+
+----------------------------------------------------------------
+--- openService
+---
+--- Creates a Dispatcher and a session bus connection owning a name.
+---
+--- @tparam   (string)  busName ....the well-known bus name of the test
+---
+--- @treturn  (userdata, userdata) the Dispatcher and the Connection
+----------------------------------------------------------------
+function M.openService(busName)
+    local disp = M.newDispatcher()
+    local conn = M.openSession(disp)
+    M.requestName(conn, busName)
+    return disp, conn
+end -- openService
+
+
+----------------------------------------------------------------
+--- newCall
+---
+--- Creates a method call. Arguments are only added if a signature
+--- is given.
+---
+--- @tparam   (string)  dest ....the destination bus name
+--- @tparam   (string)  path ....the object path
+--- @tparam   (string)  interface ....the interface (may be nil)
+--- @tparam   (string)  method ....the method name
+--- @tparam   (string)  sig ....optional signature of the arguments
+---
+--- @treturn  (userdata) the method call message
+----------------------------------------------------------------
+function M.newCall(dest, path, interface, method, sig, ...)
+    local msg = l2dbus.Message.newMethodCall({destination = dest,
+                                            path        = path,
+                                            interface   = interface,
+                                            method      = method})
+    if sig ~= nil then
+        msg:addArgsBySignature(sig, ...)
+    end
+    return msg
+end -- newCall
+
+
+return M